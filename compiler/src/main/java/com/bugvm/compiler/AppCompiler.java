@@ -440,6 +440,7 @@ public class AppCompiler {
 
         long duration = System.currentTimeMillis() - start;
         config.getLogger().info("Compiled %d classes in %.2f seconds", compiledCount, duration / 1000.0);
+        classCompiler.logTimings();
 
         return linkClasses;
     }
@@ -538,6 +539,8 @@ public class AppCompiler {
                     builder.useDebugLibs(true);
                 } else if ("-dump-intermediates".equals(args[i])) {
                     builder.dumpIntermediates(true);
+                } else if ("-lto".equals(args[i])) {
+                    builder.lto(true);
                 } else if ("-dynamic-jni".equals(args[i])) {
                     // TODO: Old option not used any longer. We still accept it
                     // for now. Delete it in a future release.
@@ -939,6 +942,11 @@ public class AppCompiler {
                          + "                        install dir specified using -d.");
         System.err.println("  -debug                Generates debug information");
         System.err.println("  -use-debug-libs       Links against debug versions of the BugVM VM libraries");
+        System.err.println("  -lto                  Enables link-time optimization. Classes are merged into one\n"
+                         + "                        module per -threads partition (classes in the same package\n"
+                         + "                        are kept together) which is optimized as a whole, allowing\n"
+                         + "                        methods to be inlined across classes. Slows down builds\n"
+                         + "                        considerably. Ignored if -debug is specified.");
         System.err.println("  -libs <list>          : separated list of static library files (.a), object\n"
                          + "                        files (.o) and system libraries that should be included\n" 
                          + "                        when linking the final executable.");
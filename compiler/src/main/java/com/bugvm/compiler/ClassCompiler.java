@@ -35,12 +35,14 @@ import java.util.Collections;
 import java.util.Comparator;
 import java.util.HashMap;
 import java.util.HashSet;
+import java.util.LinkedHashMap;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
 import java.util.concurrent.Executor;
 import java.util.concurrent.ExecutorService;
 import java.util.concurrent.RejectedExecutionException;
+import java.util.concurrent.atomic.AtomicLongArray;
 import java.util.regex.Matcher;
 import java.util.regex.Pattern;
 
@@ -219,6 +221,17 @@ public class ClassCompiler {
     private final TrampolineCompiler trampolineResolver;
     
     private final ByteArrayOutputStream output = new ByteArrayOutputStream(256 * 1024);
+
+    /*
+     * Time in nanoseconds spent in each phase of compilation summed over all
+     * classes and threads. See logTimings().
+     */
+    private static final int TIMING_GENERATE_IR = 0;
+    private static final int TIMING_PARSE_IR = 1;
+    private static final int TIMING_OPTIMIZE = 2;
+    private static final int TIMING_CODEGEN = 3;
+    private static final int TIMING_LINES = 4;
+    private final AtomicLongArray timings = new AtomicLongArray(5);
     
     public ClassCompiler(Config config) {
         this.config = config;
@@ -233,7 +246,7 @@ public class ClassCompiler {
     }
     
     public boolean mustCompile(Clazz clazz) {
-        File oFile = config.getOFile(clazz);
+        File oFile = config.isLto() ? config.getLtoBcFile(clazz) : config.getOFile(clazz);
         if (!oFile.exists() || oFile.lastModified() < clazz.lastModified() || oFile.length() == 0) {
             return true;
         }
@@ -287,7 +300,9 @@ public class ClassCompiler {
         try {
             config.getLogger().info("Compiling %s (%s %s %s)", clazz, os, arch, config.isDebug() ? "debug" : "release");
             output.reset();
+            long start = System.nanoTime();
             compile(clazz, output);
+            timings.addAndGet(TIMING_GENERATE_IR, System.nanoTime() - start);
         } catch (Throwable t) {
             if (t instanceof IOException) {
                 throw (IOException) t;
@@ -302,17 +317,34 @@ public class ClassCompiler {
         cCode.addAll(bridgeMethodCompiler.getCWrapperFunctions());
         cCode.addAll(callbackMethodCompiler.getCWrapperFunctions());
         
-        scheduleMachineCodeGeneration(executor, listener, config, clazz, output.toByteArray(), cCode);
+        scheduleMachineCodeGeneration(executor, listener, config, clazz, output.toByteArray(), cCode, timings);
+    }
+
+    /**
+     * Logs the time spent in each phase of compilation since the last call
+     * to this method. These are totals for a single build, not a comparison.
+     * To compare two compiler versions, build the runtime class library
+     * with <code>-clean -verbose</code> using each version and compare the
+     * logged phase totals.
+     */
+    public void logTimings() {
+        config.getLogger().debug("Time spent compiling classes (summed over all threads): "
+                + "IR generation %.2fs, IR parsing %.2fs, optimization %.2fs, "
+                + "machine code generation %.2fs, line numbers %.2fs",
+                timings.getAndSet(TIMING_GENERATE_IR, 0) / 1e9, timings.getAndSet(TIMING_PARSE_IR, 0) / 1e9,
+                timings.getAndSet(TIMING_OPTIMIZE, 0) / 1e9, timings.getAndSet(TIMING_CODEGEN, 0) / 1e9,
+                timings.getAndSet(TIMING_LINES, 0) / 1e9);
     }
 
     private static void scheduleMachineCodeGeneration(Executor executor, final ClassCompilerListener listener,
-            final Config config, final Clazz clazz, final byte[] llData, final List<String> cCode) {
+            final Config config, final Clazz clazz, final byte[] llData, final List<String> cCode,
+            final AtomicLongArray timings) {
         
         Runnable task = new Runnable() {
             @Override
             public void run() {
                 try {
-                    generateMachineCode(config, clazz, llData, cCode);
+                    generateMachineCode(config, clazz, llData, cCode, timings);
                     listener.success(clazz);
                 } catch (Throwable t) {
                     listener.failure(clazz, t);
@@ -330,7 +362,8 @@ public class ClassCompiler {
         }
     }
     
-    private static void generateMachineCode(Config config, Clazz clazz, byte[] llData, List<String> cCode) throws IOException {
+    private static void generateMachineCode(Config config, Clazz clazz, byte[] llData, List<String> cCode,
+            AtomicLongArray timings) throws IOException {
 
         if (config.isDumpIntermediates()) {
             File llFile = config.getLlFile(clazz);
@@ -345,8 +378,11 @@ public class ClassCompiler {
         }
 
         File oFile = config.getOFile(clazz);
+        File ltoBcFile = config.getLtoBcFile(clazz);
+        long start = System.nanoTime();
         try (Context context = new Context()) {
             try (Module module = Module.parseIR(context, llData, clazz.getClassName())) {
+                timings.addAndGet(TIMING_PARSE_IR, System.nanoTime() - start);
                 
                 if (!cCode.isEmpty()) {
                     int size = 0;
@@ -375,9 +411,11 @@ public class ClassCompiler {
                     }
                 }
                 
+                start = System.nanoTime();
                 try (PassManager passManager = createPassManager(config)) {
                     passManager.run(module);
                 }
+                timings.addAndGet(TIMING_OPTIMIZE, System.nanoTime() - start);
 
                 if (config.isDumpIntermediates()) {
                     File bcFile = config.getBcFile(clazz);
@@ -385,13 +423,25 @@ public class ClassCompiler {
                     module.writeBitcode(bcFile);
                 }
 
+                if (config.isLto()) {
+                    // Machine code will be generated by the Linker once the
+                    // bitcode of all classes in the same partition has been
+                    // merged.
+                    ltoBcFile.getParentFile().mkdirs();
+                    module.writeBitcode(ltoBcFile);
+                    return;
+                }
+
+                start = System.nanoTime();
                 String triple = config.getTriple();
                 Target target = Target.lookupTarget(triple);
                 try (TargetMachine targetMachine = target.createTargetMachine(triple,
                         config.getArch().getLlvmCpu(), null, 
                         config.isDebug()? CodeGenOptLevel.CodeGenLevelNone: null,
                         RelocMode.RelocPIC, null)) {
-                    targetMachine.setAsmVerbosityDefault(true);
+                    // Comments in the asm are only useful when dumped. Without
+                    // them there's less asm to print and parse again below.
+                    targetMachine.setAsmVerbosityDefault(config.isDumpIntermediates());
                     targetMachine.setFunctionSections(true);
                     targetMachine.setDataSections(true);
                     targetMachine.getOptions().setNoFramePointerElim(true);
@@ -421,128 +471,21 @@ public class ClassCompiler {
                         plugin.afterObjectFile(config, clazz, oFile);
                     }
 
-                    /*
-                     * Read out line number info from the .o file if any and
-                     * assemble into a separate .o file.
-                     */
-                    String symbolPrefix = config.getOs().getFamily() == OS.Family.darwin ? "_" : "";
-                    symbolPrefix += Symbols.EXTERNAL_SYMBOL_PREFIX;
-                    ModuleBuilder linesMb = null;
-                    try (ObjectFile objectFile = ObjectFile.load(oFile)) {
-                        for (Symbol symbol : objectFile.getSymbols()) {
-                            if (symbol.getSize() > 0 && symbol.getName().startsWith(symbolPrefix)) {
-                                List<LineInfo> lineInfos = objectFile.getLineInfos(symbol);
-                                if (!lineInfos.isEmpty()) {
-                                    Collections.sort(lineInfos, new Comparator<LineInfo>() {
-                                        public int compare(LineInfo o1, LineInfo o2) {
-                                            return Long.compare(o1.getAddress(), o2.getAddress());
-                                        }
-                                    });
-                                    
-                                    // The base address of the method which will be used to calculate offsets into the method
-                                    long baseAddress = symbol.getAddress();
-                                    // The first line number in the method. All other line numbers in the table will be deltas against this.
-                                    int firstLineNumber = lineInfos.get(0).getLineNumber();
-                                    // Calculate the max address and line number offsets
-                                    long maxAddressOffset = 0;
-                                    long maxLineOffset = 0;
-                                    for (LineInfo lineInfo : lineInfos) {
-                                        maxAddressOffset = Math.max(maxAddressOffset, lineInfo.getAddress() - baseAddress);
-                                        maxLineOffset = Math.max(maxLineOffset, lineInfo.getLineNumber() - firstLineNumber);
-                                    }
+                    timings.addAndGet(TIMING_CODEGEN, System.nanoTime() - start);
 
-                                    // Calculate the number of bytes needed to represent the highest offsets.
-                                    // Either 1, 2 or 4 bytes will be used.
-                                    int addressOffsetSize = (maxAddressOffset & ~0xff) == 0 ? 1 : ((maxAddressOffset & ~0xffff) == 0 ? 2 : 4);
-                                    int lineOffsetSize = (maxLineOffset & ~0xff) == 0 ? 1 : ((maxLineOffset & ~0xffff) == 0 ? 2 : 4);
-                                    
-                                    // The size of the address offsets table. We skip the first LineInfo as its offset is always 0.
-                                    int addressOffsetTableSize = addressOffsetSize * (lineInfos.size() - 1);
-                                    // Pad size of address offset table to make sure line offsets are aligned properly 
-                                    int addressOffsetPadding = (lineOffsetSize - (addressOffsetTableSize & (lineOffsetSize - 1))) & (lineOffsetSize - 1);
-                                    addressOffsetTableSize += addressOffsetPadding;
-                                    
-                                    // The first 32 bits of the line number info contains the number of line numbers
-                                    // minus the first. The 4 most significant bits are used to store the number of
-                                    // bytes needed by each entry in each table.
-                                    int flags = 0;
-                                    flags = addressOffsetSize - 1;
-                                    flags <<= 2;
-                                    flags |= lineOffsetSize - 1;
-                                    flags <<= 28;
-                                    flags |= (lineInfos.size() - 1) & 0x0fffffff;
-
-                                    StructureConstantBuilder builder = new StructureConstantBuilder();
-                                    builder
-                                        .add(new IntegerConstant(flags))
-                                        .add(new IntegerConstant(firstLineNumber));
-                                    
-                                    for (LineInfo lineInfo : lineInfos.subList(1, lineInfos.size())) {
-                                        if (addressOffsetSize == 1) {
-                                            builder.add(new IntegerConstant((byte) (lineInfo.getAddress() - baseAddress)));
-                                        } else if (addressOffsetSize == 2) {
-                                            builder.add(new IntegerConstant((short) (lineInfo.getAddress() - baseAddress)));
-                                        } else {
-                                            builder.add(new IntegerConstant((int) (lineInfo.getAddress() - baseAddress)));
-                                        }
-                                    }
-
-                                    // Padding
-                                    for (int i = 0; i < addressOffsetPadding; i++) {
-                                        builder.add(new IntegerConstant((byte) 0));
-                                    }
-
-                                    for (LineInfo lineInfo : lineInfos.subList(1, lineInfos.size())) {
-                                        if (lineOffsetSize == 1) {
-                                            builder.add(new IntegerConstant((byte) (lineInfo.getLineNumber() - firstLineNumber)));
-                                        } else if (lineOffsetSize == 2) {
-                                            builder.add(new IntegerConstant((short) (lineInfo.getLineNumber() - firstLineNumber)));
-                                        } else {
-                                            builder.add(new IntegerConstant((int) (lineInfo.getLineNumber() - firstLineNumber)));
-                                        }
-                                    }
-
-                                    // Extract the method's name and descriptor from the symbol and
-                                    // build the linetable symbol name.
-                                    String methodName = symbol.getName().substring(symbol.getName().lastIndexOf('.') + 1);
-                                    methodName = methodName.substring(0, methodName.indexOf('('));
-                                    String methodDesc = symbol.getName().substring(symbol.getName().lastIndexOf('('));
-                                    String linetableSymbol = Symbols.linetableSymbol(clazz.getInternalName(), methodName, methodDesc);
-                                    if (linesMb == null) {
-                                        linesMb = new ModuleBuilder();
-                                    }
-                                    linesMb.addGlobal(new Global(linetableSymbol, builder.build(), true));
-                                }
-                            }
-                        }
-                    }
-                    if (linesMb != null) {
-                        byte[] linesData = linesMb.build().toString().getBytes("UTF-8");
-                        if (config.isDumpIntermediates()) {
-                            File linesLlFile = config.getLinesLlFile(clazz);
-                            linesLlFile.getParentFile().mkdirs();
-                            FileUtils.writeByteArrayToFile(linesLlFile, linesData);
-                        }
-                        try (Module linesModule = Module.parseIR(context, linesData, clazz.getClassName() + ".lines")) {
-                            File linesOFile = config.getLinesOFile(clazz);
-                            ByteArrayOutputStream linesOBytes = new ByteArrayOutputStream();
-                            targetMachine.emit(linesModule, linesOBytes, CodeGenFileType.ObjectFile);
-                            //new HfsCompressor().compress(linesOFile, linesOBytes.toByteArray(), config);
-                            FileUtils.writeByteArrayToFile(linesOFile, linesOBytes.toByteArray());
-                        }
-                    } else {
-                        // Make sure there's no stale lines.o file lingering
-                        File linesOFile = config.getLinesOFile(clazz);
-                        if (linesOFile.exists()) {
-                            linesOFile.delete();
-                        }
-                    }
+                    start = System.nanoTime();
+                    assembleLinesObjectFile(config, context, targetMachine, oFile, 
+                            config.getLinesLlFile(clazz), config.getLinesOFile(clazz), clazz.getClassName());
+                    timings.addAndGet(TIMING_LINES, System.nanoTime() - start);
                 }
             }
         } catch (Throwable t) {
             if (oFile.exists()) {
                 oFile.delete();
             }
+            if (ltoBcFile.exists()) {
+                ltoBcFile.delete();
+            }
             if (t instanceof IOException) {
                 throw (IOException) t;
             }
@@ -556,6 +499,120 @@ public class ClassCompiler {
         }
     }
 
+    /**
+     * Reads out line number info from the specified .o file if any and
+     * assembles it into a separate .o file.
+     */
+    static void assembleLinesObjectFile(Config config, Context context, TargetMachine targetMachine, 
+            File oFile, File linesLlFile, File linesOFile, String name) throws IOException {
+
+        String symbolPrefix = config.getOs().getFamily() == OS.Family.darwin ? "_" : "";
+        symbolPrefix += Symbols.EXTERNAL_SYMBOL_PREFIX;
+        // The line number tables are added directly to an LLVM module. This
+        // is a lot faster than generating and parsing textual IR.
+        com.bugvm.llvm.Type i8 = context.getIntType(8);
+        com.bugvm.llvm.Type i16 = context.getIntType(16);
+        com.bugvm.llvm.Type i32 = context.getIntType(32);
+        Map<String, com.bugvm.llvm.Constant> linetables = new LinkedHashMap<>();
+        try (ObjectFile objectFile = ObjectFile.load(oFile)) {
+            for (Symbol symbol : objectFile.getSymbols()) {
+                if (symbol.getSize() > 0 && symbol.getName().startsWith(symbolPrefix)) {
+                    List<LineInfo> lineInfos = objectFile.getLineInfos(symbol);
+                    if (!lineInfos.isEmpty()) {
+                        Collections.sort(lineInfos, new Comparator<LineInfo>() {
+                            public int compare(LineInfo o1, LineInfo o2) {
+                                return Long.compare(o1.getAddress(), o2.getAddress());
+                            }
+                        });
+                        
+                        // The base address of the method which will be used to calculate offsets into the method
+                        long baseAddress = symbol.getAddress();
+                        // The first line number in the method. All other line numbers in the table will be deltas against this.
+                        int firstLineNumber = lineInfos.get(0).getLineNumber();
+                        // Calculate the max address and line number offsets
+                        long maxAddressOffset = 0;
+                        long maxLineOffset = 0;
+                        for (LineInfo lineInfo : lineInfos) {
+                            maxAddressOffset = Math.max(maxAddressOffset, lineInfo.getAddress() - baseAddress);
+                            maxLineOffset = Math.max(maxLineOffset, lineInfo.getLineNumber() - firstLineNumber);
+                        }
+
+                        // Calculate the number of bytes needed to represent the highest offsets.
+                        // Either 1, 2 or 4 bytes will be used.
+                        int addressOffsetSize = (maxAddressOffset & ~0xff) == 0 ? 1 : ((maxAddressOffset & ~0xffff) == 0 ? 2 : 4);
+                        int lineOffsetSize = (maxLineOffset & ~0xff) == 0 ? 1 : ((maxLineOffset & ~0xffff) == 0 ? 2 : 4);
+                        
+                        // The size of the address offsets table. We skip the first LineInfo as its offset is always 0.
+                        int addressOffsetTableSize = addressOffsetSize * (lineInfos.size() - 1);
+                        // Pad size of address offset table to make sure line offsets are aligned properly 
+                        int addressOffsetPadding = (lineOffsetSize - (addressOffsetTableSize & (lineOffsetSize - 1))) & (lineOffsetSize - 1);
+                        addressOffsetTableSize += addressOffsetPadding;
+                        
+                        // The first 32 bits of the line number info contains the number of line numbers
+                        // minus the first. The 4 most significant bits are used to store the number of
+                        // bytes needed by each entry in each table.
+                        int flags = 0;
+                        flags = addressOffsetSize - 1;
+                        flags <<= 2;
+                        flags |= lineOffsetSize - 1;
+                        flags <<= 28;
+                        flags |= (lineInfos.size() - 1) & 0x0fffffff;
+
+                        List<com.bugvm.llvm.Constant> values = new ArrayList<>(lineInfos.size() * 2 + 4);
+                        values.add(i32.constInt(flags));
+                        values.add(i32.constInt(firstLineNumber));
+                        
+                        com.bugvm.llvm.Type addressOffsetType = addressOffsetSize == 1 ? i8 : (addressOffsetSize == 2 ? i16 : i32);
+                        for (LineInfo lineInfo : lineInfos.subList(1, lineInfos.size())) {
+                            values.add(addressOffsetType.constInt(lineInfo.getAddress() - baseAddress));
+                        }
+
+                        // Padding
+                        for (int i = 0; i < addressOffsetPadding; i++) {
+                            values.add(i8.constInt(0));
+                        }
+
+                        com.bugvm.llvm.Type lineOffsetType = lineOffsetSize == 1 ? i8 : (lineOffsetSize == 2 ? i16 : i32);
+                        for (LineInfo lineInfo : lineInfos.subList(1, lineInfos.size())) {
+                            values.add(lineOffsetType.constInt(lineInfo.getLineNumber() - firstLineNumber));
+                        }
+
+                        // Extract the method's owner, name and descriptor from the symbol
+                        // and build the linetable symbol name.
+                        String owner = symbol.getName().substring(symbolPrefix.length(), symbol.getName().lastIndexOf('.'));
+                        owner = owner.replace('.', '/');
+                        String methodName = symbol.getName().substring(symbol.getName().lastIndexOf('.') + 1);
+                        methodName = methodName.substring(0, methodName.indexOf('('));
+                        String methodDesc = symbol.getName().substring(symbol.getName().lastIndexOf('('));
+                        String linetableSymbol = Symbols.linetableSymbol(owner, methodName, methodDesc);
+                        linetables.put(linetableSymbol, context.getConstStruct(
+                                values.toArray(new com.bugvm.llvm.Constant[values.size()])));
+                    }
+                }
+            }
+        }
+        if (!linetables.isEmpty()) {
+            try (Module linesModule = Module.create(context, name + ".lines")) {
+                for (Map.Entry<String, com.bugvm.llvm.Constant> entry : linetables.entrySet()) {
+                    linesModule.addGlobal(entry.getKey(), entry.getValue(), true);
+                }
+                if (config.isDumpIntermediates()) {
+                    linesLlFile.getParentFile().mkdirs();
+                    linesModule.writeIR(linesLlFile);
+                }
+                ByteArrayOutputStream linesOBytes = new ByteArrayOutputStream();
+                targetMachine.emit(linesModule, linesOBytes, CodeGenFileType.ObjectFile);
+                //new HfsCompressor().compress(linesOFile, linesOBytes.toByteArray(), config);
+                FileUtils.writeByteArrayToFile(linesOFile, linesOBytes.toByteArray());
+            }
+        } else {
+            // Make sure there's no stale lines.o file lingering
+            if (linesOFile.exists()) {
+                linesOFile.delete();
+            }
+        }
+    }
+
     private static PassManager createPassManager(Config config) {
         PassManager passManager = new PassManager();
         
@@ -575,20 +632,37 @@ public class ClassCompiler {
     }
     
     private static void patchAsmWithFunctionSizes(Config config, Clazz clazz, InputStream inStream, OutputStream outStream) throws IOException {
+        Set<String> methodSymbols = new HashSet<String>();
+        for (SootMethod method : clazz.getSootClass().getMethods()) {
+            if (!method.isAbstract()) {
+                methodSymbols.add(Symbols.methodSymbol(method));
+            }
+        }
+        patchAsmWithFunctionSizes(config, methodSymbols, Collections.singleton(clazz.getInternalName()), inStream, outStream);
+    }
+
+    /**
+     * Patches the method sizes in the info structs of the specified classes.
+     * All method functions must precede the info structs in the asm which is
+     * the case for modules containing one or more complete classes.
+     */
+    static void patchAsmWithFunctionSizes(Config config, Set<String> methodSymbols, Set<String> internalNames, 
+            InputStream inStream, OutputStream outStream) throws IOException {
+
         String labelPrefix = config.getOs().getFamily() == OS.Family.darwin ? "_" : "";
         String localLabelPrefix = config.getOs().getFamily() == OS.Family.darwin ? "L" : ".L";
         
         Set<String> functionNames = new HashSet<String>();
-        for (SootMethod method : clazz.getSootClass().getMethods()) {
-            if (!method.isAbstract()) {
-                String name = labelPrefix + Symbols.methodSymbol(method);
-                functionNames.add(name);
-            }
+        for (String symbol : methodSymbols) {
+            functionNames.add(labelPrefix + symbol);
+        }
+        Set<String> infoStructLabels = new HashSet<String>();
+        for (String internalName : internalNames) {
+            infoStructLabels.add(labelPrefix + Symbols.infoStructSymbol(internalName));
         }
         
-        String infoStructLabel = labelPrefix + Symbols.infoStructSymbol(clazz.getInternalName());
         Pattern methodImplPattern = Pattern.compile("\\s*\\.(?:quad|long)\\s+\"?(" 
-                + Pattern.quote(labelPrefix + Symbols.methodSymbolPrefix(clazz.getInternalName())) 
+                + Pattern.quote(labelPrefix + Symbols.EXTERNAL_SYMBOL_PREFIX) 
                 + "[^\\s\"]+)\"?.*");
         
         BufferedReader in = null;
@@ -610,7 +684,7 @@ public class ClassCompiler {
                         }
                         if (functionNames.contains(label)) {
                             currentFunction = label;
-                        } else if (label.equals(infoStructLabel)) {
+                        } else if (infoStructLabels.contains(label)) {
                             break;
                         }
                     }
@@ -1030,18 +1104,68 @@ public class ClassCompiler {
         } else {
             ITable itable = config.getITableCache().get(sootClass);
             ITable.Entry entry = itable.getEntry(m);
-            List<Value> args = new ArrayList<Value>();
-            args.add(function.getParameterRef(0));
-            args.add(getInfoStruct(function, sootClass));
-            args.add(function.getParameterRef(1));
-            args.add(new IntegerConstant(entry.getIndex()));
-            Value fptr = call(function, BC_LOOKUP_INTERFACE_METHOD_IMPL, args);
-            Variable f = function.newVariable(function.getType());
-            function.add(new Bitcast(f, fptr, f.getType()));
-            Value result = tailcall(function, f.ref(), function.getParameterRefs());
-            function.add(new Ret(result));
+            createInterfaceMethodDispatch(function, getInfoStruct(function, sootClass), entry.getIndex(), null);
         }
     }
+
+    /**
+     * Emits the code which finds and tail calls the implementation of an
+     * interface method in the receiver's itables. If {@code cache} isn't
+     * {@code null} it's the inline cache of a single invokeinterface call
+     * site (see {@link TrampolineCompiler}). It points to an immutable
+     * InterfaceCallCache maintained by _bcLookupInterfaceMethodImpl() (see
+     * bc.c) whose first {Class*, impl} pair is checked here before calling
+     * into the runtime.
+     */
+    static void createInterfaceMethodDispatch(Function function, Value info, int itableIndex, Global cache) {
+        Value cacheRef = new NullConstant(I8_PTR_PTR);
+        if (cache != null) {
+            Label checkLabel = new Label();
+            Label hitLabel = new Label();
+            Label missLabel = new Label();
+            Variable cached = function.newVariable(I8_PTR);
+            function.add(new Load(cached, cache.ref(), true));
+            Variable isEmpty = function.newVariable(I1);
+            function.add(new Icmp(isEmpty, Icmp.Condition.eq, cached.ref(), new NullConstant(I8_PTR)));
+            function.add(new Br(isEmpty.ref(), function.newBasicBlockRef(missLabel), function.newBasicBlockRef(checkLabel)));
+
+            function.newBasicBlock(checkLabel);
+            Variable cacheEntry = function.newVariable(I8_PTR_PTR);
+            function.add(new Bitcast(cacheEntry, cached.ref(), I8_PTR_PTR));
+            Variable cachedClass = function.newVariable(I8_PTR);
+            function.add(new Load(cachedClass, cacheEntry.ref()));
+            Value classPtr = call(function, OBJECT_CLASS, function.getParameterRef(1));
+            Variable clazz = function.newVariable(I8_PTR);
+            function.add(new Bitcast(clazz, classPtr, I8_PTR));
+            Variable isHit = function.newVariable(I1);
+            function.add(new Icmp(isHit, Icmp.Condition.eq, cachedClass.ref(), clazz.ref()));
+            function.add(new Br(isHit.ref(), function.newBasicBlockRef(hitLabel), function.newBasicBlockRef(missLabel)));
+
+            function.newBasicBlock(hitLabel);
+            Variable cachedImplPtr = function.newVariable(I8_PTR_PTR);
+            function.add(new Getelementptr(cachedImplPtr, cacheEntry.ref(), 1));
+            Variable cachedImpl = function.newVariable(I8_PTR);
+            function.add(new Load(cachedImpl, cachedImplPtr.ref()));
+            Variable cachedF = function.newVariable(function.getType());
+            function.add(new Bitcast(cachedF, cachedImpl.ref(), cachedF.getType()));
+            Value cachedResult = tailcall(function, cachedF.ref(), function.getParameterRefs());
+            function.add(new Ret(cachedResult));
+
+            function.newBasicBlock(missLabel);
+            cacheRef = cache.ref();
+        }
+        List<Value> args = new ArrayList<Value>();
+        args.add(function.getParameterRef(0));
+        args.add(info);
+        args.add(function.getParameterRef(1));
+        args.add(new IntegerConstant(itableIndex));
+        args.add(cacheRef);
+        Value fptr = call(function, BC_LOOKUP_INTERFACE_METHOD_IMPL, args);
+        Variable f = function.newVariable(function.getType());
+        function.add(new Bitcast(f, fptr, f.getType()));
+        Value result = tailcall(function, f.ref(), function.getParameterRefs());
+        function.add(new Ret(result));
+    }
     
     private Constant createVTableStruct() {
         VTable vtable = config.getVTableCache().get(sootClass);
@@ -74,10 +74,9 @@ public class Functions {
     public static final FunctionRef BC_NEW_DOUBLE_ARRAY = new FunctionRef("_bcNewDoubleArray", new FunctionType(Types.OBJECT_PTR, Types.ENV_PTR, Type.I32));
     public static final FunctionRef BC_MONITOR_ENTER = new FunctionRef("_bcMonitorEnter", new FunctionType(Type.VOID, Types.ENV_PTR, Types.OBJECT_PTR));
     public static final FunctionRef BC_MONITOR_EXIT = new FunctionRef("_bcMonitorExit", new FunctionType(Type.VOID, Types.ENV_PTR, Types.OBJECT_PTR));
-    public static final FunctionRef BC_LDC_STRING = new FunctionRef("_bcLdcString", new FunctionType(Types.OBJECT_PTR, Types.ENV_PTR, Type.I8_PTR_PTR, Type.I8_PTR));
     public static final FunctionRef BC_LOOKUP_VIRTUAL_METHOD = new FunctionRef("_bcLookupVirtualMethod", new FunctionType(Type.I8_PTR, Types.ENV_PTR, Types.OBJECT_PTR, Type.I8_PTR, Type.I8_PTR));
     public static final FunctionRef BC_LOOKUP_INTERFACE_METHOD = new FunctionRef("_bcLookupInterfaceMethod", new FunctionType(Type.I8_PTR, Types.ENV_PTR, Type.I8_PTR_PTR, Types.OBJECT_PTR, Type.I8_PTR, Type.I8_PTR));
-    public static final FunctionRef BC_LOOKUP_INTERFACE_METHOD_IMPL = new FunctionRef("_bcLookupInterfaceMethodImpl", new FunctionType(Type.I8_PTR, Types.ENV_PTR, Type.I8_PTR_PTR, Types.OBJECT_PTR, Type.I32));
+    public static final FunctionRef BC_LOOKUP_INTERFACE_METHOD_IMPL = new FunctionRef("_bcLookupInterfaceMethodImpl", new FunctionType(Type.I8_PTR, Types.ENV_PTR, Type.I8_PTR_PTR, Types.OBJECT_PTR, Type.I32, Type.I8_PTR_PTR));
     public static final FunctionRef BC_CHECKCAST = new FunctionRef("_bcCheckcast", new FunctionType(Types.OBJECT_PTR, Types.ENV_PTR, Type.I8_PTR_PTR, Types.OBJECT_PTR));
     public static final FunctionRef BC_CHECKCAST_ARRAY = new FunctionRef("_bcCheckcastArray", new FunctionType(Types.OBJECT_PTR, Types.ENV_PTR, Types.OBJECT_PTR, Types.OBJECT_PTR));
     public static final FunctionRef BC_INSTANCEOF = new FunctionRef("_bcInstanceof", new FunctionType(Type.I32, Types.ENV_PTR, Type.I8_PTR_PTR, Types.OBJECT_PTR));
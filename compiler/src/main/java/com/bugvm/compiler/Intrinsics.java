@@ -25,7 +25,10 @@ import java.util.Map;
 
 import com.bugvm.compiler.llvm.FunctionRef;
 import com.bugvm.compiler.llvm.FunctionType;
+import com.bugvm.compiler.llvm.Type;
 
+import soot.ArrayType;
+import soot.PrimType;
 import soot.SootFieldRef;
 import soot.SootMethod;
 import soot.SootMethodRef;
@@ -41,6 +44,7 @@ import soot.jimple.Stmt;
 public class Intrinsics {
 
     private static final Map<String, FunctionRef> SIMPLE_INTRINSICS;
+    private static final Map<String, FunctionRef> ARRAYCOPY_INTRINSICS;
     
     static {
         SIMPLE_INTRINSICS = new HashMap<String, FunctionRef>();
@@ -74,6 +78,114 @@ public class Intrinsics {
         SIMPLE_INTRINSICS.put("java/lang/Math/sin(D)D", 
                 new FunctionRef("intrinsics.java_lang_Math_sin", 
                         new FunctionType(DOUBLE, ENV_PTR, DOUBLE)));
+        SIMPLE_INTRINSICS.put("java/lang/Math/floor(D)D", 
+                new FunctionRef("intrinsics.java_lang_Math_floor", 
+                        new FunctionType(DOUBLE, ENV_PTR, DOUBLE)));
+        SIMPLE_INTRINSICS.put("java/lang/Math/ceil(D)D", 
+                new FunctionRef("intrinsics.java_lang_Math_ceil", 
+                        new FunctionType(DOUBLE, ENV_PTR, DOUBLE)));
+        SIMPLE_INTRINSICS.put("java/lang/Math/abs(I)I", 
+                new FunctionRef("intrinsics.java_lang_Math_abs_I", 
+                        new FunctionType(I32, ENV_PTR, I32)));
+        SIMPLE_INTRINSICS.put("java/lang/Math/abs(J)J", 
+                new FunctionRef("intrinsics.java_lang_Math_abs_J", 
+                        new FunctionType(I64, ENV_PTR, I64)));
+        SIMPLE_INTRINSICS.put("java/lang/Math/min(II)I", 
+                new FunctionRef("intrinsics.java_lang_Math_min_I", 
+                        new FunctionType(I32, ENV_PTR, I32, I32)));
+        SIMPLE_INTRINSICS.put("java/lang/Math/max(II)I", 
+                new FunctionRef("intrinsics.java_lang_Math_max_I", 
+                        new FunctionType(I32, ENV_PTR, I32, I32)));
+        SIMPLE_INTRINSICS.put("java/lang/Math/min(JJ)J", 
+                new FunctionRef("intrinsics.java_lang_Math_min_J", 
+                        new FunctionType(I64, ENV_PTR, I64, I64)));
+        SIMPLE_INTRINSICS.put("java/lang/Math/max(JJ)J", 
+                new FunctionRef("intrinsics.java_lang_Math_max_J", 
+                        new FunctionType(I64, ENV_PTR, I64, I64)));
+
+        for (String c : new String[] {"Integer", "Long"}) {
+            Type t = "Integer".equals(c) ? I32 : I64;
+            String d = "Integer".equals(c) ? "I" : "J";
+            String prefix = "java/lang/" + c + "/";
+            String fnPrefix = "intrinsics.java_lang_" + c + "_";
+            SIMPLE_INTRINSICS.put(prefix + "bitCount(" + d + ")I", 
+                    new FunctionRef(fnPrefix + "bitCount", new FunctionType(I32, ENV_PTR, t)));
+            SIMPLE_INTRINSICS.put(prefix + "numberOfLeadingZeros(" + d + ")I", 
+                    new FunctionRef(fnPrefix + "numberOfLeadingZeros", new FunctionType(I32, ENV_PTR, t)));
+            SIMPLE_INTRINSICS.put(prefix + "numberOfTrailingZeros(" + d + ")I", 
+                    new FunctionRef(fnPrefix + "numberOfTrailingZeros", new FunctionType(I32, ENV_PTR, t)));
+            SIMPLE_INTRINSICS.put(prefix + "reverseBytes(" + d + ")" + d, 
+                    new FunctionRef(fnPrefix + "reverseBytes", new FunctionType(t, ENV_PTR, t)));
+            SIMPLE_INTRINSICS.put(prefix + "rotateLeft(" + d + "I)" + d, 
+                    new FunctionRef(fnPrefix + "rotateLeft", new FunctionType(t, ENV_PTR, t, I32)));
+            SIMPLE_INTRINSICS.put(prefix + "rotateRight(" + d + "I)" + d, 
+                    new FunctionRef(fnPrefix + "rotateRight", new FunctionType(t, ENV_PTR, t, I32)));
+        }
+        SIMPLE_INTRINSICS.put("java/lang/Short/reverseBytes(S)S", 
+                new FunctionRef("intrinsics.java_lang_Short_reverseBytes", 
+                        new FunctionType(I16, ENV_PTR, I16)));
+        SIMPLE_INTRINSICS.put("java/lang/Character/reverseBytes(C)C", 
+                new FunctionRef("intrinsics.java_lang_Character_reverseBytes", 
+                        new FunctionType(I16, ENV_PTR, I16)));
+
+        SIMPLE_INTRINSICS.put("java/lang/Float/floatToRawIntBits(F)I", 
+                new FunctionRef("intrinsics.java_lang_Float_floatToRawIntBits", 
+                        new FunctionType(I32, ENV_PTR, FLOAT)));
+        SIMPLE_INTRINSICS.put("java/lang/Float/floatToIntBits(F)I", 
+                new FunctionRef("intrinsics.java_lang_Float_floatToIntBits", 
+                        new FunctionType(I32, ENV_PTR, FLOAT)));
+        SIMPLE_INTRINSICS.put("java/lang/Float/intBitsToFloat(I)F", 
+                new FunctionRef("intrinsics.java_lang_Float_intBitsToFloat", 
+                        new FunctionType(FLOAT, ENV_PTR, I32)));
+        SIMPLE_INTRINSICS.put("java/lang/Double/doubleToRawLongBits(D)J", 
+                new FunctionRef("intrinsics.java_lang_Double_doubleToRawLongBits", 
+                        new FunctionType(I64, ENV_PTR, DOUBLE)));
+        SIMPLE_INTRINSICS.put("java/lang/Double/doubleToLongBits(D)J", 
+                new FunctionRef("intrinsics.java_lang_Double_doubleToLongBits", 
+                        new FunctionType(I64, ENV_PTR, DOUBLE)));
+        SIMPLE_INTRINSICS.put("java/lang/Double/longBitsToDouble(J)D", 
+                new FunctionRef("intrinsics.java_lang_Double_longBitsToDouble", 
+                        new FunctionType(DOUBLE, ENV_PTR, I64)));
+
+        // String is final so these are safe to use for invokevirtual too.
+        // The receiver has already been null checked by the caller.
+        SIMPLE_INTRINSICS.put("java/lang/String/equals(Ljava/lang/Object;)Z", 
+                new FunctionRef("intrinsics.java_lang_String_equals", 
+                        new FunctionType(I8, ENV_PTR, OBJECT_PTR, OBJECT_PTR)));
+        SIMPLE_INTRINSICS.put("java/lang/String/compareTo(Ljava/lang/String;)I", 
+                new FunctionRef("intrinsics.java_lang_String_compareTo", 
+                        new FunctionType(I32, ENV_PTR, OBJECT_PTR, OBJECT_PTR)));
+        SIMPLE_INTRINSICS.put("java/lang/String/indexOf(I)I", 
+                new FunctionRef("intrinsics.java_lang_String_indexOf_I", 
+                        new FunctionType(I32, ENV_PTR, OBJECT_PTR, I32)));
+        SIMPLE_INTRINSICS.put("java/lang/String/indexOf(II)I", 
+                new FunctionRef("intrinsics.java_lang_String_indexOf_II", 
+                        new FunctionType(I32, ENV_PTR, OBJECT_PTR, I32, I32)));
+        SIMPLE_INTRINSICS.put("java/lang/String/indexOf(Ljava/lang/String;)I", 
+                new FunctionRef("intrinsics.java_lang_String_indexOf_String", 
+                        new FunctionType(I32, ENV_PTR, OBJECT_PTR, OBJECT_PTR)));
+        SIMPLE_INTRINSICS.put("java/lang/String/indexOf(Ljava/lang/String;I)I", 
+                new FunctionRef("intrinsics.java_lang_String_indexOf_StringI", 
+                        new FunctionType(I32, ENV_PTR, OBJECT_PTR, OBJECT_PTR, I32)));
+
+        ARRAYCOPY_INTRINSICS = new HashMap<String, FunctionRef>();
+        String[] primDescs = {"Z", "B", "S", "C", "I", "J", "F", "D"};
+        Type[] primTypes = {I8, I8, I16, I16, I32, I64, FLOAT, DOUBLE};
+        // Suffixes of the _bcArrayEquals functions in bc.c
+        String[] equalsSuffixes = {"8", "8", "16", "16", "32", "64", "F", "D"};
+        for (int i = 0; i < primDescs.length; i++) {
+            String d = primDescs[i];
+            SIMPLE_INTRINSICS.put("java/util/Arrays/fill([" + d + d + ")V", 
+                    new FunctionRef("intrinsics.java_util_Arrays_fill_" + d, 
+                            new FunctionType(VOID, ENV_PTR, OBJECT_PTR, primTypes[i])));
+            // Arrays.equals() is implemented entirely in bc.c. The arrays may be null.
+            SIMPLE_INTRINSICS.put("java/util/Arrays/equals([" + d + "[" + d + ")Z", 
+                    new FunctionRef("_bcArrayEquals" + equalsSuffixes[i], 
+                            new FunctionType(I8, ENV_PTR, OBJECT_PTR, OBJECT_PTR)));
+            ARRAYCOPY_INTRINSICS.put("[" + d, 
+                    new FunctionRef("intrinsics.java_lang_System_arraycopy_checked_" + d, 
+                            new FunctionType(VOID, ENV_PTR, OBJECT_PTR, I32, OBJECT_PTR, I32, I32)));
+        }
     }
     
     private static final FunctionRef LDC_PRIM_Z = new FunctionRef("intrinsics.ldc_prim_Z", new FunctionType(OBJECT_PTR, ENV_PTR));
@@ -101,12 +213,26 @@ public class Intrinsics {
         }
 
         if ("arraycopy".equals(methodRef.name()) 
-                && "java.lang.System".equals(methodRef.declaringClass().getName())
-                && "_getChars".equals(currMethod.getName())
-                && "java.lang.String".equals(currMethod.getDeclaringClass().getName())) {
-            
-            return new FunctionRef("intrinsics.java_lang_System_arraycopy_C", 
-                    new FunctionType(VOID, ENV_PTR, OBJECT_PTR, I32, OBJECT_PTR, I32, I32));
+                && "java.lang.System".equals(methodRef.declaringClass().getName())) {
+
+            if ("_getChars".equals(currMethod.getName())
+                    && "java.lang.String".equals(currMethod.getDeclaringClass().getName())) {
+                
+                return new FunctionRef("intrinsics.java_lang_System_arraycopy_C", 
+                        new FunctionType(VOID, ENV_PTR, OBJECT_PTR, I32, OBJECT_PTR, I32, I32));
+            }
+
+            // If src and dst are known to be arrays of the same primitive
+            // type we can skip the type checks in System.arraycopy() and
+            // copy the memory directly after checking the bounds.
+            soot.Type srcType = expr.getArg(0).getType();
+            soot.Type dstType = expr.getArg(2).getType();
+            if (srcType instanceof ArrayType && srcType.equals(dstType)
+                    && ((ArrayType) srcType).numDimensions == 1
+                    && ((ArrayType) srcType).baseType instanceof PrimType) {
+                
+                return ARRAYCOPY_INTRINSICS.get(getDescriptor(srcType));
+            }
         }
 
         return null;
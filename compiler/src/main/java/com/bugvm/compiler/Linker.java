@@ -24,6 +24,8 @@ import static com.bugvm.compiler.llvm.Linkage.*;
 import static com.bugvm.compiler.llvm.Type.*;
 
 import java.io.BufferedOutputStream;
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
 import java.io.File;
 import java.io.FileOutputStream;
 import java.io.IOException;
@@ -33,6 +35,7 @@ import java.nio.ByteBuffer;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.Collections;
+import java.util.Comparator;
 import java.util.HashMap;
 import java.util.HashSet;
 import java.util.LinkedList;
@@ -42,6 +45,7 @@ import java.util.Map.Entry;
 import java.util.Objects;
 import java.util.Random;
 import java.util.Set;
+import java.util.TreeMap;
 import java.util.TreeSet;
 import java.util.concurrent.Executor;
 import java.util.concurrent.ExecutorService;
@@ -52,6 +56,8 @@ import org.apache.commons.io.FileUtils;
 import org.apache.commons.lang3.tuple.Triple;
 import com.bugvm.compiler.clazz.Clazz;
 import com.bugvm.compiler.clazz.ClazzInfo;
+import com.bugvm.compiler.clazz.Dependency;
+import com.bugvm.compiler.clazz.InvokeMethodDependency;
 import com.bugvm.compiler.clazz.MethodInfo;
 import com.bugvm.compiler.clazz.Path;
 import com.bugvm.compiler.config.Arch;
@@ -82,8 +88,10 @@ import com.bugvm.compiler.plugin.CompilerPlugin;
 import com.bugvm.llvm.Context;
 import com.bugvm.llvm.Module;
 import com.bugvm.llvm.PassManager;
+import com.bugvm.llvm.PassManagerBuilder;
 import com.bugvm.llvm.Target;
 import com.bugvm.llvm.TargetMachine;
+import com.bugvm.llvm.binding.Attribute;
 import com.bugvm.llvm.binding.CodeGenFileType;
 import com.bugvm.llvm.binding.RelocMode;
 
@@ -93,6 +101,7 @@ import com.bugvm.llvm.binding.RelocMode;
 public class Linker {
 
     private static final TypeInfo[] EMPTY_TYPE_INFOS = new TypeInfo[0];
+    private static final int LTO_INLINE_THRESHOLD = 225;
 
     private static class TypeInfo implements Comparable<TypeInfo> {
         boolean error;
@@ -138,6 +147,28 @@ public class Linker {
         }
     }
 
+    /**
+     * A set of classes which are merged into a single module and optimized
+     * as a whole when link-time optimization is enabled.
+     */
+    private static class LtoPartition {
+        final int index;
+        final List<Clazz> classes = new ArrayList<>();
+        /**
+         * Holds lookup functions which override the weak ones in the classes
+         * of this partition.
+         */
+        final ModuleBuilder mb = new ModuleBuilder();
+        /**
+         * Functions which may be inlined into callers in this partition.
+         */
+        final Set<String> inlinableFunctions = new HashSet<>();
+
+        LtoPartition(int index) {
+            this.index = index;
+        }
+    }
+
     private final Config config;
     private final Map<String, byte[]> runtimeData = new HashMap<>();
 
@@ -277,6 +308,34 @@ public class Linker {
             mb.addGlobal(new Global("_bcMainClass", mb.getString(config.getMainClass())));
         }
 
+        /*
+         * Table of the String literal objects emitted by MethodCompiler sorted
+         * by String.hashCode(). The runtime initializes the objects on startup
+         * and returns them when interning equal strings.
+         */
+        Set<String> stringLiteralsSet = new HashSet<>();
+        for (Clazz clazz : linkClasses) {
+            stringLiteralsSet.addAll(clazz.getClazzInfo().getStringLiterals());
+        }
+        List<String> stringLiterals = new ArrayList<>(stringLiteralsSet);
+        Collections.sort(stringLiterals, new Comparator<String>() {
+            public int compare(String o1, String o2) {
+                int c = Integer.compare(o1.hashCode(), o2.hashCode());
+                return c != 0 ? c : o1.compareTo(o2);
+            }
+        });
+        ArrayConstantBuilder stringLiteralRefs = new ArrayConstantBuilder(I8_PTR);
+        ArrayConstantBuilder stringLiteralHashes = new ArrayConstantBuilder(I32);
+        for (String s : stringLiterals) {
+            Global g = new Global(stringLiteralSymbol(Strings.stringToModifiedUtf8Z(s)), external, I8, false);
+            mb.addGlobal(g);
+            stringLiteralRefs.add(g.ref());
+            stringLiteralHashes.add(new IntegerConstant(s.hashCode()));
+        }
+        stringLiteralRefs.add(new NullConstant(I8_PTR));
+        mb.addGlobal(new Global("_bcStringLiterals", stringLiteralRefs.build()));
+        mb.addGlobal(new Global("_bcStringLiteralHashes", stringLiteralHashes.build()));
+
         ModuleBuilder[] mbs = new ModuleBuilder[config.getThreads() + 1];
         FunctionRef[] stubRefs = new FunctionRef[mbs.length];
         ArrayConstantBuilder stubRefsArray = new ArrayConstantBuilder(I8_PTR);
@@ -319,12 +378,28 @@ public class Linker {
         for (Triple<String, String, String> node : config.getDependencyGraph().findReachableMethods()) {
             reachableMethods.add(node.getLeft() + "." + node.getMiddle() + node.getRight());
         }
+
+        List<LtoPartition> ltoPartitions = Collections.emptyList();
+        Map<Clazz, LtoPartition> ltoPartitionsByClass = new HashMap<>();
+        if (config.isLto()) {
+            ltoPartitions = partitionClasses(linkClasses, config.getThreads());
+            for (LtoPartition partition : ltoPartitions) {
+                partition.mb.addInclude(getClass().getClassLoader().getResource(
+                        String.format("header-%s-%s.ll", os.getFamily(), arch)));
+                partition.mb.addInclude(getClass().getClassLoader().getResource("header.ll"));
+                for (Clazz clazz : partition.classes) {
+                    ltoPartitionsByClass.put(clazz, partition);
+                }
+            }
+            config.getLogger().info("Optimizing %d classes in %d partitions", linkClasses.size(), ltoPartitions.size());
+        }
         
         int totalMethodCount = 0;
         int reachableMethodCount = 0;
         for (Clazz clazz : linkClasses) {
             int mbIdx = rnd.nextInt(mbs.length - 1) + 1;
             ClazzInfo ci = clazz.getClazzInfo();
+            LtoPartition ltoPartition = ltoPartitionsByClass.get(clazz);
 
             // Create strong stubs for unused methods which override the weak
             // ones generated by ClassCompiler. This must be done before we
@@ -337,6 +412,17 @@ public class Linker {
                         createStrippedMethodStub(stubRefs[mbIdx], mbs[mbIdx], clazz, mi);
                     } else {
                         reachableMethodCount++;
+                        if (ltoPartition != null) {
+                            // Unreachable methods must stay weak since they
+                            // are overridden by the stubs created above.
+                            String symbol = methodSymbol(clazz.getInternalName(), mi.getName(), mi.getDesc());
+                            if (isLeafMethod(mi)) {
+                                ltoPartition.inlinableFunctions.add(symbol);
+                            }
+                            if (mi.isStatic()) {
+                                ltoPartition.inlinableFunctions.add(clinitWrapperSymbol(symbol));
+                            }
+                        }
                     }
                 }
             }
@@ -383,7 +469,16 @@ public class Linker {
 
                             if (invokes.contains(clazz.getInternalName() + "." + name + mi.getDesc())) {
                                 if (reachableMethods.contains(clazz.getInternalName() + "." + name + mi.getDesc())) {
-                                    mbs[mbIdx].addFunction(createLookup(mbs[mbIdx], ci, mi));
+                                    if (ltoPartition != null) {
+                                        // Override the lookup function in the
+                                        // same module as the method to allow
+                                        // the call to be devirtualized.
+                                        ltoPartition.mb.addFunction(createLookup(ltoPartition.mb, ci, mi));
+                                        ltoPartition.inlinableFunctions.add(lookupWrapperSymbol(
+                                                clazz.getInternalName(), name, mi.getDesc()));
+                                    } else {
+                                        mbs[mbIdx].addFunction(createLookup(mbs[mbIdx], ci, mi));
+                                    }
                                 }
                             }
                         }
@@ -402,19 +497,21 @@ public class Linker {
 
         List<File> objectFiles = new ArrayList<File>();
 
-        generateMachineCode(config, mbs, objectFiles);
-
-        for (Clazz clazz : linkClasses) {
-            objectFiles.add(config.getOFile(clazz));
-        }
+        generateMachineCode(config, mbs, ltoPartitions, objectFiles);
 
-        /*
-         * Assemble the lines files for all linked classes into the module.
-         */
-        for (Clazz clazz : linkClasses) {
-            File f = config.getLinesOFile(clazz);
-            if (f.exists() && f.length() > 0) {
-                objectFiles.add(f);
+        if (!config.isLto()) {
+            for (Clazz clazz : linkClasses) {
+                objectFiles.add(config.getOFile(clazz));
+            }
+    
+            /*
+             * Assemble the lines files for all linked classes into the module.
+             */
+            for (Clazz clazz : linkClasses) {
+                File f = config.getLinesOFile(clazz);
+                if (f.exists() && f.length() > 0) {
+                    objectFiles.add(f);
+                }
             }
         }
 
@@ -422,7 +519,7 @@ public class Linker {
     }
 
     private void generateMachineCode(final Config config, ModuleBuilder[] mbs,
-            final List<File> objectFiles) throws IOException {
+            List<LtoPartition> ltoPartitions, final List<File> objectFiles) throws IOException {
 
         /*
          * Make sure the tmpDir exists before we launch the worker threads. This
@@ -434,6 +531,22 @@ public class Linker {
                 : Executors.newFixedThreadPool(config.getThreads());
 
         final List<Throwable> errors = Collections.synchronizedList(new ArrayList<Throwable>());
+        // Start with the LTO partitions since they take much longer to
+        // compile than the linker modules.
+        for (final LtoPartition partition : ltoPartitions) {
+            executor.execute(new Runnable() {
+                public void run() {
+                    try {
+                        List<File> files = generateMachineCode(config, partition);
+                        synchronized (objectFiles) {
+                            objectFiles.addAll(files);
+                        }
+                    } catch (Throwable t) {
+                        errors.add(t);
+                    }
+                }
+            });
+        }
         for (int i = 0; i < mbs.length; i++) {
             final ModuleBuilder mb = mbs[i];
             final int num = i;
@@ -522,6 +635,169 @@ public class Linker {
         return linkerO;
     }
 
+    /**
+     * Merges the classes in the specified {@link LtoPartition} into a single
+     * module, optimizes it as a whole and generates a .o file for it and
+     * another one for the line number info of the methods in it. Methods
+     * which are reachable are changed from weak to external linkage and have
+     * their <code>noinline</code> attribute removed so that they can be
+     * inlined into callers in the same partition.
+     */
+    private List<File> generateMachineCode(Config config, LtoPartition partition) throws IOException {
+        String name = "lto" + partition.index;
+        File ltoO = new File(config.getTmpDir(), name + ".o");
+        File ltoLinesO = new File(config.getTmpDir(), name + ".lines.o");
+        ltoO.getParentFile().mkdirs();
+
+        try (Context context = new Context()) {
+            try (Module module = Module.parseIR(context, partition.mb.build().toString(), name + ".ll")) {
+                Set<String> internalNames = new HashSet<>();
+                for (Clazz clazz : partition.classes) {
+                    internalNames.add(clazz.getInternalName());
+                    byte[] bc = FileUtils.readFileToByteArray(config.getLtoBcFile(clazz));
+                    try (Module m = Module.parseIR(context, bc, clazz.getClassName())) {
+                        module.link(m);
+                    }
+                }
+
+                Set<String> methodSymbols = new HashSet<>();
+                for (com.bugvm.llvm.Function f : module.getFunctions()) {
+                    String fnName = f.getName();
+                    if (f.isDeclaration() || !fnName.startsWith(EXTERNAL_SYMBOL_PREFIX)) {
+                        continue;
+                    }
+                    methodSymbols.add(fnName);
+                    if (partition.inlinableFunctions.contains(fnName)) {
+                        if (f.getLinkage() == com.bugvm.llvm.binding.Linkage.WeakAnyLinkage) {
+                            f.setLinkage(com.bugvm.llvm.binding.Linkage.ExternalLinkage);
+                        }
+                        f.removeAttribute(Attribute.NoInlineAttribute);
+                        f.removeAttribute(Attribute.OptimizeForSizeAttribute);
+                    }
+                }
+
+                try (PassManager passManager = new PassManager()) {
+                    try (PassManagerBuilder builder = new PassManagerBuilder()) {
+                        builder.setSetOptLevel(2);
+                        builder.setDisableTailCalls(true);
+                        builder.useInlinerWithThreshold(LTO_INLINE_THRESHOLD);
+                        builder.populateModulePassManager(passManager);
+                    }
+                    // Drop private functions and values which are no longer
+                    // used after inlining.
+                    passManager.addGlobalDCEPass();
+                    passManager.run(module);
+                }
+
+                if (config.isDumpIntermediates()) {
+                    module.writeBitcode(new File(config.getTmpDir(), name + ".bc"));
+                }
+
+                String triple = config.getTriple();
+                Target target = Target.lookupTarget(triple);
+                try (TargetMachine targetMachine = target.createTargetMachine(triple,
+                        config.getArch().getLlvmCpu(), null, null, RelocMode.RelocPIC, null)) {
+                    targetMachine.setAsmVerbosityDefault(config.isDumpIntermediates());
+                    targetMachine.setFunctionSections(true);
+                    targetMachine.setDataSections(true);
+                    targetMachine.getOptions().setNoFramePointerElim(true);
+                    // NOTE: Doesn't have any effect on x86. See #503.
+                    targetMachine.getOptions().setPositionIndependentExecutable(true);
+
+                    ByteArrayOutputStream output = new ByteArrayOutputStream(1024 * 1024);
+                    targetMachine.emit(module, output, CodeGenFileType.AssemblyFile);
+                    byte[] asm = output.toByteArray();
+                    output.reset();
+                    ClassCompiler.patchAsmWithFunctionSizes(config, methodSymbols, internalNames,
+                            new ByteArrayInputStream(asm), output);
+                    asm = output.toByteArray();
+
+                    if (config.isDumpIntermediates()) {
+                        FileUtils.writeByteArrayToFile(new File(config.getTmpDir(), name + ".s"), asm);
+                    }
+
+                    ByteArrayOutputStream oFileBytes = new ByteArrayOutputStream();
+                    targetMachine.assemble(asm, name, oFileBytes);
+                    FileUtils.writeByteArrayToFile(ltoO, oFileBytes.toByteArray());
+
+                    ClassCompiler.assembleLinesObjectFile(config, context, targetMachine, ltoO,
+                            new File(config.getTmpDir(), name + ".lines.ll"), ltoLinesO, name);
+                }
+            }
+        }
+
+        List<File> files = new ArrayList<>();
+        files.add(ltoO);
+        if (ltoLinesO.exists() && ltoLinesO.length() > 0) {
+            files.add(ltoLinesO);
+        }
+        return files;
+    }
+
+    /**
+     * Returns whether the specified method is a non-native method which
+     * doesn't call any other Java method. Only such methods are inlined
+     * during link-time optimization. Code which looks at the call stack, e.g.
+     * to find the calling class, assumes a frame for each method between
+     * itself and the caller it is looking for. This holds as long as only
+     * leaf methods are inlined since they never call such code.
+     */
+    private static boolean isLeafMethod(MethodInfo mi) {
+        if (mi.isNative() || mi.isSynchronized()) {
+            return false;
+        }
+        for (Dependency dep : mi.getDependencies()) {
+            if (dep instanceof InvokeMethodDependency) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Splits the specified classes into at most <code>count</code>
+     * {@link LtoPartition}s of roughly equal size. All classes in a package
+     * end up in the same partition since calls between classes are most
+     * common within packages. Use a single partition to optimize the whole
+     * program at once.
+     */
+    private List<LtoPartition> partitionClasses(Set<Clazz> classes, int count) {
+        Map<String, List<Clazz>> packages = new TreeMap<>();
+        for (Clazz clazz : classes) {
+            String internalName = clazz.getInternalName();
+            String packageName = internalName.substring(0, Math.max(0, internalName.lastIndexOf('/')));
+            List<Clazz> l = packages.get(packageName);
+            if (l == null) {
+                l = new ArrayList<>();
+                packages.put(packageName, l);
+            }
+            l.add(clazz);
+        }
+
+        // Assign the largest packages first, each to the currently smallest
+        // partition.
+        List<List<Clazz>> sorted = new ArrayList<>(packages.values());
+        Collections.sort(sorted, new Comparator<List<Clazz>>() {
+            public int compare(List<Clazz> o1, List<Clazz> o2) {
+                return Integer.compare(o2.size(), o1.size());
+            }
+        });
+        List<LtoPartition> partitions = new ArrayList<>();
+        for (int i = 0; i < Math.min(count, sorted.size()); i++) {
+            partitions.add(new LtoPartition(i));
+        }
+        for (List<Clazz> l : sorted) {
+            LtoPartition smallest = partitions.get(0);
+            for (LtoPartition partition : partitions) {
+                if (partition.classes.size() < smallest.classes.size()) {
+                    smallest = partition;
+                }
+            }
+            smallest.classes.addAll(l);
+        }
+        return partitions;
+    }
+
     private TypeInfo buildTypeInfo(TypeInfo typeInfo, Map<ClazzInfo, TypeInfo> typeInfos) {
         if (typeInfo.error || typeInfo.classTypes != null) {
             return typeInfo;
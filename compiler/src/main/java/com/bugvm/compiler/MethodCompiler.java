@@ -31,6 +31,7 @@ import java.util.Map.Entry;
 import java.util.Set;
 import java.util.TreeMap;
 
+import com.bugvm.compiler.clazz.Clazz;
 import com.bugvm.compiler.config.Config;
 import com.bugvm.compiler.llvm.*;
 import com.bugvm.compiler.llvm.Invoke;
@@ -203,11 +204,21 @@ public class MethodCompiler extends AbstractMethodCompiler {
     private ModuleBuilder moduleBuilder;
     
     private Variable dims;
+    // The type of all String literal objects. Set when the first one is created.
+    private Type stringLiteralType;
+    // Number of invokeinterface call sites compiled so far in the current class.
+    private int interfaceCallSites;
     
     public MethodCompiler(Config config) {
         super(config);
     }
     
+    @Override
+    public void reset(Clazz clazz) {
+        super.reset(clazz);
+        interfaceCallSites = 0;
+    }
+    
     protected Function doCompile(ModuleBuilder moduleBuilder, SootMethod method) {
         function = createMethodFunction(method);
         moduleBuilder.addFunction(function);
@@ -526,7 +537,7 @@ public class MethodCompiler extends AbstractMethodCompiler {
                     value = new IntegerConstant(ltag.getLongValue());
                 } else if (tag instanceof StringConstantValueTag) {
                     String s = ((StringConstantValueTag) tag).getStringValue();
-                    value = call(ldcString(s), env);
+                    value = ldcString(s);
                 }
                 
                 if (value != null) {
@@ -565,7 +576,7 @@ public class MethodCompiler extends AbstractMethodCompiler {
             return new NullConstant(Types.OBJECT_PTR);
         } else if (v instanceof soot.jimple.StringConstant) {
             String s = ((soot.jimple.StringConstant) v).value;
-            return call(unit, ldcString(s), env);
+            return ldcString(s);
         } else if (v instanceof soot.jimple.ClassConstant) {
             // ClassConstant is either the internal name of a class or the descriptor of an array
             String targetClassName = ((soot.jimple.ClassConstant) v).getValue();
@@ -590,20 +601,45 @@ public class MethodCompiler extends AbstractMethodCompiler {
         throw new IllegalArgumentException("Unknown Immediate type: " + v.getClass());
     }
 
-    private FunctionRef ldcString(String s) {
+    /**
+     * Returns a reference to the String object for a string literal. String
+     * literals are emitted as fully formed String and char[] objects with weak
+     * linkage so that each literal ends up as a single object in the
+     * executable. The runtime sets their class pointers on startup and makes
+     * them the interned instances using the table emitted by the Linker.
+     */
+    private Constant ldcString(String s) {
         byte[] modUtf8 = stringToModifiedUtf8Z(s);
-        FunctionRef fref = new FunctionRef(Symbols.ldcStringSymbol(modUtf8), new FunctionType(Types.OBJECT_PTR, Types.ENV_PTR));
-        if (moduleBuilder.hasSymbol(fref.getName())) {
-            return fref;
+        String symbol = Symbols.stringLiteralSymbol(modUtf8);
+        if (!moduleBuilder.hasSymbol(symbol)) {
+            ArrayConstantBuilder chars = new ArrayConstantBuilder(I16);
+            for (int i = 0; i < s.length(); i++) {
+                chars.add(new IntegerConstant(s.charAt(i)));
+            }
+            // Same layout as the CharArray struct in the runtime
+            StructureConstant value = new StructureConstantBuilder()
+                    .add(new StructureConstantBuilder()
+                            .add(new NullConstant(I8_PTR))
+                            .add(new NullConstant(I8_PTR))
+                            .build())
+                    .add(new IntegerConstant(s.length()))
+                    .add(chars.build())
+                    .build();
+            Global valueGlobal = new Global(Symbols.stringLiteralValueSymbol(modUtf8), Linkage.weak, value);
+            moduleBuilder.addGlobal(valueGlobal);
+
+            SootClass stringClass = config.getClazzes().load("java/lang/String").getSootClass();
+            Map<SootField, Constant> fields = new HashMap<>();
+            fields.put(stringClass.getFieldByName("value"), new ConstantBitcast(valueGlobal.ref(), OBJECT_PTR));
+            fields.put(stringClass.getFieldByName("count"), new IntegerConstant(s.length()));
+            fields.put(stringClass.getFieldByName("hashCode"), new IntegerConstant(s.hashCode()));
+            Global g = new Global(symbol, Linkage.weak, Types.getInstanceConstant(config.getOs(), config.getArch(), 
+                    stringClass, fields));
+            moduleBuilder.addGlobal(g);
+            stringLiteralType = g.getType().getBase();
         }
-        Global g = new Global(Symbols.ldcStringPtrSymbol(modUtf8), Linkage.weak, new NullConstant(Types.OBJECT_PTR));
-        moduleBuilder.addGlobal(g);
-        Function f = new FunctionBuilder(fref).linkage(Linkage.weak).build();
-        moduleBuilder.addFunction(f);
-        Value result = Functions.call(f, BC_LDC_STRING, f.getParameterRef(0), g.ref(),
-                moduleBuilder.getString(s), new IntegerConstant(s.length()));
-        f.add(new Ret(result));
-        return fref;
+        clazz.getClazzInfo().addStringLiteral(s);
+        return new ConstantBitcast(new GlobalRef(symbol, stringLiteralType), OBJECT_PTR);
     }
 
     private Value widenToI32Value(Unit unit, Value value, boolean unsigned) {
@@ -767,7 +803,7 @@ public class MethodCompiler extends AbstractMethodCompiler {
                 String runtimeClassName = runtimeType == NullType.v() ? targetClassName : Types.getInternalName(runtimeType);
                 trampoline = new Invokevirtual(this.className, targetClassName, methodName, methodDesc, runtimeClassName);
             } else if (expr instanceof InterfaceInvokeExpr) {
-                trampoline = new Invokeinterface(this.className, targetClassName, methodName, methodDesc);
+                trampoline = new Invokeinterface(this.className, targetClassName, methodName, methodDesc, interfaceCallSites++);
             }
             trampolines.add(trampoline);
 
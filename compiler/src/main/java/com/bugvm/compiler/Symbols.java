@@ -240,6 +240,10 @@ public class Symbols {
         return functionWrapper(methodSymbol(owner, name, desc), "lookup");
     }
 
+    public static String callSiteCacheSymbol(Trampoline t) {
+        return functionWrapper(t.getFunctionName(), "cache");
+    }
+
     public static String clinitWrapperSymbol(String targetFnName) {
         return functionWrapper(targetFnName, "clinit");
     }
@@ -351,6 +355,10 @@ public class Symbols {
         return methodSymbol(owner, name, desc, t.getClass().getSimpleName() + "(" + caller + "," + runtimeClass + ")");
     }
 
+    public static String trampolineCallSiteSymbol(Trampoline t, String caller, String owner, String name, String desc, int callSite) {
+        return methodSymbol(owner, name, desc, t.getClass().getSimpleName() + "(" + caller + ")#" + callSite);
+    }
+
     public static String trampolineFieldSymbol(Trampoline t, String caller, String owner, String name, String desc) {
         return fieldSymbol(owner, name, desc, t.getClass().getSimpleName() + "(" + caller + ")");
     }
@@ -363,12 +371,11 @@ public class Symbols {
         return classSymbol(targetClass, t.getClass().getSimpleName() + "(" + caller + ")");
     }
 
-    public static String ldcStringPtrSymbol(byte[] modUtf8) {
-        // NOTE: The symbols generated here are also used from C code in classinfo.c. Do not change.
-        return Strings.getStringVarName(modUtf8) + "_ptr";
+    public static String stringLiteralSymbol(byte[] modUtf8) {
+        return INTERNAL_SYMBOL_PREFIX + Strings.getStringVarName(modUtf8) + "[string]";
     }
 
-    public static String ldcStringSymbol(byte[] modUtf8) {
-        return INTERNAL_SYMBOL_PREFIX + Strings.getStringVarName(modUtf8) + "[ldcstring]";
+    public static String stringLiteralValueSymbol(byte[] modUtf8) {
+        return INTERNAL_SYMBOL_PREFIX + Strings.getStringVarName(modUtf8) + "[stringvalue]";
     }
 }
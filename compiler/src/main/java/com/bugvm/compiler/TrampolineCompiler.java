@@ -17,6 +17,7 @@
 package com.bugvm.compiler;
 
 import static com.bugvm.compiler.Access.*;
+import static com.bugvm.compiler.llvm.Type.*;
 import static com.bugvm.compiler.Functions.*;
 
 import java.util.Collections;
@@ -33,13 +34,16 @@ import com.bugvm.compiler.llvm.FunctionAttribute;
 import com.bugvm.compiler.llvm.FunctionDeclaration;
 import com.bugvm.compiler.llvm.FunctionRef;
 import com.bugvm.compiler.llvm.FunctionType;
+import com.bugvm.compiler.llvm.Getelementptr;
 import com.bugvm.compiler.llvm.Global;
 import com.bugvm.compiler.llvm.Linkage;
 import com.bugvm.compiler.llvm.NullConstant;
 import com.bugvm.compiler.llvm.Ret;
+import com.bugvm.compiler.llvm.Store;
 import com.bugvm.compiler.llvm.StructureType;
 import com.bugvm.compiler.llvm.Unreachable;
 import com.bugvm.compiler.llvm.Value;
+import com.bugvm.compiler.llvm.Variable;
 import com.bugvm.compiler.trampoline.Anewarray;
 import com.bugvm.compiler.trampoline.Checkcast;
 import com.bugvm.compiler.trampoline.FieldAccessor;
@@ -197,7 +201,12 @@ public class TrampolineCompiler {
                 mb.addFunction(errorFn);
                 return;
             }
-            createTrampolineAliasForMethod((Invoke) t, rm);
+            if (rm.getDeclaringClass().isInterface()) {
+                createInterfaceCallSite((Invokeinterface) t, rm, currentClass);
+            } else {
+                // Methods in java.lang.Object are called through the vtable
+                createTrampolineAliasForMethod((Invoke) t, rm);
+            }
         } else if (t instanceof Invoke) {
             SootMethod method = resolveMethod(errorFn, (Invoke) t);
             if (method != null) {
@@ -254,6 +263,35 @@ public class TrampolineCompiler {
         mb.addFunction(fn);
     }
     
+    /**
+     * Creates the trampoline of a single invokeinterface call site. It has
+     * an inline cache of its own instead of calling the interface method's
+     * lookup function.
+     */
+    private void createInterfaceCallSite(Invokeinterface t, SootMethod rm, Clazz currentClass) {
+        Function fn = new FunctionBuilder(t).linkage(aliasLinkage()).attribs(shouldInline(), FunctionAttribute.optsize).build();
+
+        // Used by _bcAbstractMethodCalled()
+        Variable reserved0 = fn.newVariable(I8_PTR_PTR);
+        fn.add(new Getelementptr(reserved0, fn.getParameterRef(0), 0, 4));
+        Variable reserved1 = fn.newVariable(I8_PTR_PTR);
+        fn.add(new Getelementptr(reserved1, fn.getParameterRef(0), 0, 5));
+        fn.add(new Store(mb.getString(rm.getName()), reserved0.ref()));
+        fn.add(new Store(mb.getString(Types.getDescriptor(rm)), reserved1.ref()));
+
+        SootClass iface = rm.getDeclaringClass();
+        FunctionRef infoFn = FunctionBuilder.infoStruct(iface).ref();
+        if (!Types.getInternalName(iface).equals(currentClass.getInternalName()) && !mb.hasSymbol(infoFn.getName())) {
+            mb.addFunctionDeclaration(new FunctionDeclaration(infoFn));
+        }
+        Global cache = new Global(Symbols.callSiteCacheSymbol(t), Linkage._private, new NullConstant(I8_PTR));
+        mb.addGlobal(cache);
+
+        ITable.Entry entry = config.getITableCache().get(iface).getEntry(rm);
+        ClassCompiler.createInterfaceMethodDispatch(fn, call(fn, infoFn), entry.getIndex(), cache);
+        mb.addFunction(fn);
+    }
+
     private void createTrampolineAliasForField(FieldAccessor t, SootField field) {
         String fnName = t.isGetter() ? Symbols.getterSymbol(field) : Symbols.setterSymbol(field);
         if (t.isStatic()) {
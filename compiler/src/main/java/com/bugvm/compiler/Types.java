@@ -22,9 +22,15 @@ import java.util.ArrayList;
 import java.util.Collections;
 import java.util.Comparator;
 import java.util.List;
+import java.util.Map;
 
 import com.bugvm.compiler.config.OS;
+import com.bugvm.compiler.llvm.FloatingPointConstant;
+import com.bugvm.compiler.llvm.FloatingPointType;
+import com.bugvm.compiler.llvm.IntegerConstant;
 import com.bugvm.compiler.llvm.IntegerType;
+import com.bugvm.compiler.llvm.PackedStructureConstant;
+import com.bugvm.compiler.llvm.PackedStructureConstantBuilder;
 import com.bugvm.compiler.llvm.PackedStructureType;
 import com.bugvm.compiler.llvm.Variable;
 import com.bugvm.compiler.config.Arch;
@@ -39,6 +45,8 @@ import com.bugvm.compiler.llvm.Getelementptr;
 import com.bugvm.compiler.llvm.NullConstant;
 import com.bugvm.compiler.llvm.OpaqueType;
 import com.bugvm.compiler.llvm.PointerType;
+import com.bugvm.compiler.llvm.StructureConstant;
+import com.bugvm.compiler.llvm.StructureConstantBuilder;
 import com.bugvm.compiler.llvm.StructureType;
 import com.bugvm.compiler.llvm.Type;
 import com.bugvm.compiler.llvm.Value;
@@ -75,7 +83,7 @@ public class Types {
     public static final StructureType BC_TRYCATCH_CONTEXT = new StructureType("BcTrycatchContext", TRYCATCH_CONTEXT, I8_PTR);
     public static final Type BC_TRYCATCH_CONTEXT_PTR = new PointerType(BC_TRYCATCH_CONTEXT);
     public static final Type ENV_PTR = new PointerType(new StructureType("Env", I8_PTR, I8_PTR, I8_PTR, 
-            I8_PTR, I8_PTR, I8_PTR, I8_PTR, I8_PTR, I32));
+            I8_PTR, I8_PTR, I8_PTR, I8_PTR, I8_PTR, I32, I8_PTR, I8_PTR, I8_PTR));
     // Dummy Class type definition. The real one is in header.ll
     public static final StructureType CLASS = new StructureType("Class", I8_PTR);
     public static final Type CLASS_PTR = new PointerType(CLASS);
@@ -516,6 +524,81 @@ public class Types {
     public static StructureType getInstanceType(OS os, Arch arch, SootClass clazz) {
         return new StructureType(DATA_OBJECT, getInstanceType0(os, arch, clazz, 1, new int[] {0}));
     }
+
+    private static PackedStructureConstant padConstant(Constant c, int padding) {
+        PackedStructureConstantBuilder paddingConstant = new PackedStructureConstantBuilder();
+        for (int i = 0; i < padding; i++) {
+            paddingConstant.add(new IntegerConstant((byte) 0));
+        }
+        return new PackedStructureConstantBuilder().add(paddingConstant.build()).add(c).build();
+    }
+
+    private static Constant zeroConstant(Type t) {
+        if (t instanceof IntegerType) {
+            return new IntegerConstant(0, (IntegerType) t);
+        }
+        if (t instanceof FloatingPointType) {
+            return new FloatingPointConstant(0.0, (FloatingPointType) t);
+        }
+        return new NullConstant(t);
+    }
+
+    private static PackedStructureConstant getInstanceConstant0(OS os, Arch arch, SootClass clazz, 
+            int subClassAlignment, int[] superSize, Map<SootField, Constant> fieldValues) {
+        
+        // Must produce the same layout as getInstanceType0()
+        PackedStructureConstantBuilder builder = new PackedStructureConstantBuilder();
+        List<SootField> fields = getInstanceFields(os, arch, clazz);
+        int superAlignment = 1;
+        if (!fields.isEmpty()) {
+            SootField field = fields.get(0);
+            superAlignment = getFieldAlignment(os, arch, field);
+        }
+        if (clazz.hasSuperclass()) {
+            builder.add(getInstanceConstant0(os, arch, clazz.getSuperclass(), superAlignment, superSize, fieldValues));
+        }
+        int offset = superSize[0];
+        for (SootField field : fields) {
+            int falign = getFieldAlignment(os, arch, field);
+            int padding = (offset & (falign - 1)) != 0 ? (falign - (offset & (falign - 1))) : 0;
+            Constant value = fieldValues.get(field);
+            if (value == null) {
+                value = zeroConstant(getType(field.getType()));
+            }
+            builder.add(padConstant(value, padding));
+            offset += padding + getFieldSize(arch, field);
+        }
+        
+        int padding = (offset & (subClassAlignment - 1)) != 0 
+                ? (subClassAlignment - (offset & (subClassAlignment - 1))) : 0;
+        for (int i = 0; i < padding; i++) {
+            builder.add(new IntegerConstant((byte) 0));
+            offset++;
+        }
+        
+        superSize[0] = offset;
+        
+        return builder.build();
+    }
+
+    /**
+     * Returns a constant instance of the specified class with the same layout
+     * as {@link #getInstanceType(OS, Arch, SootClass)}. The object header
+     * (class pointer and lock word) is zero and has to be initialized at
+     * runtime. Fields not in <code>fieldValues</code> are zero.
+     */
+    public static StructureConstant getInstanceConstant(OS os, Arch arch, SootClass clazz, 
+            Map<SootField, Constant> fieldValues) {
+        
+        StructureConstant header = new StructureConstantBuilder()
+                .add(new NullConstant(I8_PTR))
+                .add(new NullConstant(I8_PTR))
+                .build();
+        return new StructureConstantBuilder()
+                .add(header)
+                .add(getInstanceConstant0(os, arch, clazz, 1, new int[] {0}, fieldValues))
+                .build();
+    }
     
     public static int getFieldAlignment(OS os, Arch arch, SootField f) {
         soot.Type t = f.getType();
@@ -37,7 +37,7 @@ import soot.SootMethod;
  *
  */
 public class ClazzInfo implements Serializable {
-    private static final long serialVersionUID = 99L;
+    private static final long serialVersionUID = 100L;
     
     private int modifiers;
     private String name;
@@ -50,6 +50,7 @@ public class ClazzInfo implements Serializable {
     private final Set<String> checkcasts = new HashSet<String>();
     private final Set<String> instanceofs = new HashSet<String>();
     private final Set<String> invokes = new HashSet<String>();
+    private final Set<String> stringLiterals = new HashSet<String>();
     private boolean isStruct;
     private boolean isEnum;
     
@@ -307,6 +308,14 @@ public class ClazzInfo implements Serializable {
         invokes.add(className);
     }
 
+    public Set<String> getStringLiterals() {
+        return stringLiterals;
+    }
+
+    public void addStringLiteral(String s) {
+        stringLiterals.add(s);
+    }
+
     public boolean isPublic() {
         return (modifiers & Modifier.PUBLIC) > 0;
     }
@@ -193,6 +193,7 @@ public class Config {
     private boolean skipLinking = false;
     private boolean skipInstall = false;
     private boolean dumpIntermediates = false;
+    private boolean lto = false;
     private int threads = Runtime.getRuntime().availableProcessors();
     private Logger logger = Logger.NULL_LOGGER;
 
@@ -314,6 +315,16 @@ public class Config {
         return dumpIntermediates;
     }
 
+    /**
+     * Returns whether link-time optimization is enabled. When enabled classes
+     * are compiled to bitcode which is merged and optimized across classes in
+     * the {@link com.bugvm.compiler.Linker}. Always <code>false</code> for
+     * debug builds.
+     */
+    public boolean isLto() {
+        return lto && !debug;
+    }
+
     public boolean isSkipRuntimeLib() {
         return skipRuntimeLib != null && skipRuntimeLib.booleanValue();
     }
@@ -582,6 +593,10 @@ public class Config {
         return new File(getCacheDir(clazz.getPath()), getFileName(clazz, "class.lines.o"));
     }
 
+    public File getLtoBcFile(Clazz clazz) {
+        return new File(getCacheDir(clazz.getPath()), getFileName(clazz, "class.lto.bc"));
+    }
+
     public File getLinesLlFile(Clazz clazz) {
         return new File(getCacheDir(clazz.getPath()), getFileName(clazz, "class.lines.ll"));
     }
@@ -1133,6 +1148,11 @@ public class Config {
             return this;
         }
 
+        public Builder lto(boolean b) {
+            config.lto = b;
+            return this;
+        }
+
         public Builder skipRuntimeLib(boolean b) {
             config.skipRuntimeLib = b;
             return this;
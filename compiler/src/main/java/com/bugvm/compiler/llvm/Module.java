@@ -22,6 +22,7 @@ import java.io.StringWriter;
 import java.io.Writer;
 import java.net.URL;
 import java.util.Collection;
+import java.util.concurrent.ConcurrentHashMap;
 
 import org.apache.commons.io.IOUtils;
 
@@ -30,6 +31,12 @@ import org.apache.commons.io.IOUtils;
  * @version $Id$
  */
 public class Module {
+    /**
+     * The contents of included files. The same headers are included in every
+     * module so we only read them once.
+     */
+    private static final ConcurrentHashMap<String, String> INCLUDES = new ConcurrentHashMap<>();
+
     private final Collection<URL> includes;
     private final Collection<Global> globals;
     private final Collection<Alias> aliases;    
@@ -59,15 +66,7 @@ public class Module {
 
     public void write(Writer writer) throws IOException {
         for (URL g : includes) {
-            InputStream in = null;
-            try {
-                in = g.openStream();
-                IOUtils.copy(in, writer, "UTF-8");
-            } catch (IOException e) {
-                throw new RuntimeException(e);
-            } finally {
-                IOUtils.closeQuietly(in);
-            }
+            writer.write(getInclude(g));
             writer.write("\n");
         }
         writer.write("\n");
@@ -115,6 +114,24 @@ public class Module {
         }
     }
 
+    private static String getInclude(URL url) {
+        String key = url.toString();
+        String s = INCLUDES.get(key);
+        if (s == null) {
+            InputStream in = null;
+            try {
+                in = url.openStream();
+                s = IOUtils.toString(in, "UTF-8");
+            } catch (IOException e) {
+                throw new RuntimeException(e);
+            } finally {
+                IOUtils.closeQuietly(in);
+            }
+            INCLUDES.putIfAbsent(key, s);
+        }
+        return s;
+    }
+
     @Override
     public String toString() {
         StringWriter sw = new StringWriter();
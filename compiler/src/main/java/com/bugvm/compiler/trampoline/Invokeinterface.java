@@ -16,20 +16,64 @@
  */
 package com.bugvm.compiler.trampoline;
 
+import com.bugvm.compiler.Symbols;
+
 
 /**
  *
  * @version $Id$
  */
 public class Invokeinterface extends Invoke {
-    private static final long serialVersionUID = 1L;
+    private static final long serialVersionUID = 3L;
     
-    public Invokeinterface(String callingClass, String targetClass, String methodName, String methodDesc) {
+    /**
+     * Index of the invokeinterface instruction in the calling class. Each
+     * call site gets a trampoline with an inline cache of its own.
+     */
+    private final int callSite;
+
+    public Invokeinterface(String callingClass, String targetClass, String methodName, String methodDesc, int callSite) {
         super(callingClass, targetClass, methodName, methodDesc);
+        this.callSite = callSite;
+    }
+
+    public int getCallSite() {
+        return callSite;
     }
 
     @Override
     public boolean isStatic() {
         return false;
     }
+
+    @Override
+    public int hashCode() {
+        return 31 * super.hashCode() + callSite;
+    }
+
+    @Override
+    public boolean equals(Object obj) {
+        if (this == obj) {
+            return true;
+        }
+        if (!super.equals(obj)) {
+            return false;
+        }
+        return callSite == ((Invokeinterface) obj).callSite;
+    }
+
+    @Override
+    public int compareTo(Trampoline o) {
+        int c = super.compareTo(o);
+        if (c == 0) {
+            c = Integer.compare(callSite, ((Invokeinterface) o).callSite);
+        }
+        return c;
+    }
+
+    @Override
+    public String toString() {
+        return Symbols.trampolineCallSiteSymbol(this, getCallingClass(), getTarget(), getMethodName(), getMethodDesc(), 
+                callSite);
+    }
 }
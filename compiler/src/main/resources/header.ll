@@ -1,14 +1,14 @@
 %GatewayFrame = type {i8*, i8*, i8*}
 %StackFrame = type {i8*, i8*}
 %Thread = type {i32} ; Incomplete. Just enough to get threadId
-%Env = type {i8*, i8*, i8*, %Thread*, i8*, i8*, %GatewayFrame*, i8*, i32}
+%Env = type {i8*, i8*, i8*, %Thread*, i8*, i8*, %GatewayFrame*, i8*, i32, i8*, i8*, i8*}
 %DebugEnv = type {%Env, i8*, i8*, i8*, i8*, i8, i8}
 %TypeInfo = type {i32, i32, i32, i32, i32, [0 x i32]}
 %VITable = type {i16, [0 x i8*]}
 %ITable = type {%TypeInfo*, %VITable}
 %ITables = type {i16, %ITable*, [0 x %ITable*]}
-; NOTE: The compiler assumes that %Class is a multiple of 8 in size (currently 88 bytes + 0 bytes padding)
-%Class = type {i8*, i8*, i8*, i8*, %TypeInfo*, %VITable*, %ITables*, i8*, i8*, i8*, i8*, i8*, i32, i8*, i8*, i8*, i8*, i8*, i32, i32, i32, i16, i16}
+; NOTE: The compiler assumes that %Class is a multiple of 8 in size (currently 96 bytes + 0 bytes padding)
+%Class = type {i8*, i8*, i8*, i8*, %TypeInfo*, %VITable*, %ITables*, i8*, i8*, i8*, i8*, i8*, i32, i8*, i8*, i8*, i8*, i8*, i32, i32, i32, i16, i16, i8*, i8*}
 %Method = type opaque
 %Field = type opaque
 %Object = type {%Class*, i8*}
@@ -57,11 +57,25 @@ declare void @_bcRegisterFinalizer(%Env* %env, %Object* %o)
 
 declare i8* @_bcLookupVirtualMethod(%Env*, %Object*, i8*, i8*)
 declare i8* @_bcLookupInterfaceMethod(%Env*, i8**, %Object*, i8*, i8*)
-declare i8* @_bcLookupInterfaceMethodImpl(%Env*, i8**, %Object*, i32)
+declare i8* @_bcLookupInterfaceMethodImpl(%Env*, i8**, %Object*, i32, i8**)
 declare void @_bcAbstractMethodCalled(%Env*, %Object*)
 declare void @_bcNonPublicMethodCalled(%Env*, %Object*)
 declare void @_bcMoveMemory16(i8*, i8*, i64)
 declare void @_bcMoveMemory32(i8*, i8*, i64)
+declare i8 @_bcStringEquals(%Env*, %Object*, %Object*)
+declare i32 @_bcStringCompareTo(%Env*, %Object*, %Object*)
+declare i32 @_bcStringIndexOfChar(%Env*, %Object*, i32, i32)
+declare i32 @_bcStringIndexOfString(%Env*, %Object*, %Object*, i32)
+declare void @_bcArrayFill8(%Env*, %Object*, i8)
+declare void @_bcArrayFill16(%Env*, %Object*, i16)
+declare void @_bcArrayFill32(%Env*, %Object*, i32)
+declare void @_bcArrayFill64(%Env*, %Object*, i64)
+declare i8 @_bcArrayEquals8(%Env*, %Object*, %Object*)
+declare i8 @_bcArrayEquals16(%Env*, %Object*, %Object*)
+declare i8 @_bcArrayEquals32(%Env*, %Object*, %Object*)
+declare i8 @_bcArrayEquals64(%Env*, %Object*, %Object*)
+declare i8 @_bcArrayEqualsF(%Env*, %Object*, %Object*)
+declare i8 @_bcArrayEqualsD(%Env*, %Object*, %Object*)
 declare void @_bcThrow(%Env*, %Object*) noreturn
 declare void @_bcThrowIfExceptionOccurred(%Env*)
 declare %Object* @_bcExceptionClear(%Env*)
@@ -69,6 +83,7 @@ declare i32 @rvmTrycatchEnter(%Env*, %TrycatchContext*) returns_twice
 declare void @_bcTrycatchLeave(%Env*)
 declare void @_bcThrowNullPointerException(%Env*) noreturn
 declare void @_bcThrowArrayIndexOutOfBoundsException(%Env*, i32, i32) noreturn
+declare void @_bcThrowArrayCopyIndexOutOfBoundsException(%Env*, i32, i32, i32, i32, i32) noreturn
 declare void @_bcThrowArithmeticException(%Env*) noreturn
 declare void @_bcThrowUnsatisfiedLinkError(%Env*, i8*) noreturn
 declare void @_bcThrowUnsatisfiedLinkErrorBridgeNotBound(%Env*, i8*, i8*, i8*) noreturn
@@ -95,7 +110,6 @@ declare %Object* @_bcNewDoubleArray(%Env*, i32)
 declare %Object* @_bcNewMultiArray(%Env*, i32, i32*, %Object*)
 declare void @_bcSetObjectArrayElement(%Env*, %Object*, i32, %Object*)
 
-declare %Object* @_bcLdcString(%Env*, %Object**, i8*, i32)
         
 declare void @_bcMonitorEnter(%Env*, %Object*)
 declare void @_bcMonitorExit(%Env*, %Object*)
@@ -104,6 +118,7 @@ declare i8* @_bcResolveNative(%Env*, %Object*, i8*, i8*, i8*, i8*, i8**)
 
 declare void @_bcPushNativeFrame(%Env*, %GatewayFrame*, i8*)
 declare void @_bcPopNativeFrame(%Env*)
+declare void @_bcPopLocalRefFrames(%Env*)
 
 declare void @_bcPushCallbackFrame(%Env*, %GatewayFrame*, i8*)
 declare void @_bcPopCallbackFrame(%Env*)
@@ -121,6 +136,17 @@ declare void @llvm.memmove.p0i8.p0i8.i64(i8*, i8*, i64, i32, i1)
 declare double @llvm.sqrt.f64(double)
 declare double @llvm.cos.f64(double)
 declare double @llvm.sin.f64(double)
+declare double @llvm.floor.f64(double)
+declare double @llvm.ceil.f64(double)
+declare i32 @llvm.ctpop.i32(i32)
+declare i64 @llvm.ctpop.i64(i64)
+declare i32 @llvm.ctlz.i32(i32, i1)
+declare i64 @llvm.ctlz.i64(i64, i1)
+declare i32 @llvm.cttz.i32(i32, i1)
+declare i64 @llvm.cttz.i64(i64, i1)
+declare i16 @llvm.bswap.i16(i16)
+declare i32 @llvm.bswap.i32(i32)
+declare i64 @llvm.bswap.i64(i64)
 
 define private i32 @Thread_threadId(%Thread* %t) alwaysinline {
     %1 = getelementptr %Thread* %t, i32 0, i32 0 ; Thread->threadId
@@ -146,6 +172,12 @@ define private void @Env_gatewayFrames_store(%Env* %env, %GatewayFrame* %value)
     ret void
 }
 
+define private i8* @Env_localRefs(%Env* %env) alwaysinline {
+    %1 = getelementptr %Env* %env, i32 0, i32 11 ; Env->localRefs
+    %2 = load volatile i8** %1
+    ret i8* %2
+}
+
 define private %Class* @Object_class(%Object* %o) alwaysinline {
     %1 = getelementptr %Object* %o, i32 0, i32 0
     %2 = load volatile %Class** %1
@@ -388,6 +420,418 @@ define private void @intrinsics.com_bugvm_rt_VM_memmove64(%Env* %env, i64 %s1, i
     ret void
 }
 
+define private i32 @intrinsics.java_lang_Math_abs_I(%Env* %env, i32 %i) alwaysinline {
+    %1 = icmp slt i32 %i, 0
+    %2 = sub i32 0, %i
+    %3 = select i1 %1, i32 %2, i32 %i
+    ret i32 %3
+}
+
+define private i64 @intrinsics.java_lang_Math_abs_J(%Env* %env, i64 %l) alwaysinline {
+    %1 = icmp slt i64 %l, 0
+    %2 = sub i64 0, %l
+    %3 = select i1 %1, i64 %2, i64 %l
+    ret i64 %3
+}
+
+define private i32 @intrinsics.java_lang_Math_min_I(%Env* %env, i32 %a, i32 %b) alwaysinline {
+    %1 = icmp slt i32 %a, %b
+    %2 = select i1 %1, i32 %a, i32 %b
+    ret i32 %2
+}
+
+define private i32 @intrinsics.java_lang_Math_max_I(%Env* %env, i32 %a, i32 %b) alwaysinline {
+    %1 = icmp sgt i32 %a, %b
+    %2 = select i1 %1, i32 %a, i32 %b
+    ret i32 %2
+}
+
+define private i64 @intrinsics.java_lang_Math_min_J(%Env* %env, i64 %a, i64 %b) alwaysinline {
+    %1 = icmp slt i64 %a, %b
+    %2 = select i1 %1, i64 %a, i64 %b
+    ret i64 %2
+}
+
+define private i64 @intrinsics.java_lang_Math_max_J(%Env* %env, i64 %a, i64 %b) alwaysinline {
+    %1 = icmp sgt i64 %a, %b
+    %2 = select i1 %1, i64 %a, i64 %b
+    ret i64 %2
+}
+
+define private double @intrinsics.java_lang_Math_floor(%Env* %env, double %d) alwaysinline {
+    %1 = call double @llvm.floor.f64(double %d)
+    ret double %1
+}
+
+define private double @intrinsics.java_lang_Math_ceil(%Env* %env, double %d) alwaysinline {
+    %1 = call double @llvm.ceil.f64(double %d)
+    ret double %1
+}
+
+define private i32 @intrinsics.java_lang_Integer_bitCount(%Env* %env, i32 %i) alwaysinline {
+    %1 = call i32 @llvm.ctpop.i32(i32 %i)
+    ret i32 %1
+}
+
+define private i32 @intrinsics.java_lang_Integer_numberOfLeadingZeros(%Env* %env, i32 %i) alwaysinline {
+    %1 = call i32 @llvm.ctlz.i32(i32 %i, i1 false)
+    ret i32 %1
+}
+
+define private i32 @intrinsics.java_lang_Integer_numberOfTrailingZeros(%Env* %env, i32 %i) alwaysinline {
+    %1 = call i32 @llvm.cttz.i32(i32 %i, i1 false)
+    ret i32 %1
+}
+
+define private i32 @intrinsics.java_lang_Integer_reverseBytes(%Env* %env, i32 %i) alwaysinline {
+    %1 = call i32 @llvm.bswap.i32(i32 %i)
+    ret i32 %1
+}
+
+define private i32 @intrinsics.java_lang_Integer_rotateLeft(%Env* %env, i32 %i, i32 %d) alwaysinline {
+    %1 = and i32 %d, 31
+    %2 = sub i32 0, %d
+    %3 = and i32 %2, 31
+    %4 = shl i32 %i, %1
+    %5 = lshr i32 %i, %3
+    %6 = or i32 %4, %5
+    ret i32 %6
+}
+
+define private i32 @intrinsics.java_lang_Integer_rotateRight(%Env* %env, i32 %i, i32 %d) alwaysinline {
+    %1 = and i32 %d, 31
+    %2 = sub i32 0, %d
+    %3 = and i32 %2, 31
+    %4 = lshr i32 %i, %1
+    %5 = shl i32 %i, %3
+    %6 = or i32 %4, %5
+    ret i32 %6
+}
+
+define private i32 @intrinsics.java_lang_Long_bitCount(%Env* %env, i64 %i) alwaysinline {
+    %1 = call i64 @llvm.ctpop.i64(i64 %i)
+    %2 = trunc i64 %1 to i32
+    ret i32 %2
+}
+
+define private i32 @intrinsics.java_lang_Long_numberOfLeadingZeros(%Env* %env, i64 %i) alwaysinline {
+    %1 = call i64 @llvm.ctlz.i64(i64 %i, i1 false)
+    %2 = trunc i64 %1 to i32
+    ret i32 %2
+}
+
+define private i32 @intrinsics.java_lang_Long_numberOfTrailingZeros(%Env* %env, i64 %i) alwaysinline {
+    %1 = call i64 @llvm.cttz.i64(i64 %i, i1 false)
+    %2 = trunc i64 %1 to i32
+    ret i32 %2
+}
+
+define private i64 @intrinsics.java_lang_Long_reverseBytes(%Env* %env, i64 %i) alwaysinline {
+    %1 = call i64 @llvm.bswap.i64(i64 %i)
+    ret i64 %1
+}
+
+define private i64 @intrinsics.java_lang_Long_rotateLeft(%Env* %env, i64 %i, i32 %d) alwaysinline {
+    %d64 = zext i32 %d to i64
+    %1 = and i64 %d64, 63
+    %2 = sub i64 0, %d64
+    %3 = and i64 %2, 63
+    %4 = shl i64 %i, %1
+    %5 = lshr i64 %i, %3
+    %6 = or i64 %4, %5
+    ret i64 %6
+}
+
+define private i64 @intrinsics.java_lang_Long_rotateRight(%Env* %env, i64 %i, i32 %d) alwaysinline {
+    %d64 = zext i32 %d to i64
+    %1 = and i64 %d64, 63
+    %2 = sub i64 0, %d64
+    %3 = and i64 %2, 63
+    %4 = lshr i64 %i, %1
+    %5 = shl i64 %i, %3
+    %6 = or i64 %4, %5
+    ret i64 %6
+}
+
+define private i16 @intrinsics.java_lang_Short_reverseBytes(%Env* %env, i16 %i) alwaysinline {
+    %1 = call i16 @llvm.bswap.i16(i16 %i)
+    ret i16 %1
+}
+
+define private i16 @intrinsics.java_lang_Character_reverseBytes(%Env* %env, i16 %i) alwaysinline {
+    %1 = call i16 @llvm.bswap.i16(i16 %i)
+    ret i16 %1
+}
+
+define private i32 @intrinsics.java_lang_Float_floatToRawIntBits(%Env* %env, float %f) alwaysinline {
+    %1 = bitcast float %f to i32
+    ret i32 %1
+}
+
+define private i32 @intrinsics.java_lang_Float_floatToIntBits(%Env* %env, float %f) alwaysinline {
+    ; All NaNs are collapsed to the canonical NaN 0x7fc00000
+    %1 = fcmp uno float %f, %f
+    %2 = bitcast float %f to i32
+    %3 = select i1 %1, i32 2143289344, i32 %2
+    ret i32 %3
+}
+
+define private float @intrinsics.java_lang_Float_intBitsToFloat(%Env* %env, i32 %i) alwaysinline {
+    %1 = bitcast i32 %i to float
+    ret float %1
+}
+
+define private i64 @intrinsics.java_lang_Double_doubleToRawLongBits(%Env* %env, double %d) alwaysinline {
+    %1 = bitcast double %d to i64
+    ret i64 %1
+}
+
+define private i64 @intrinsics.java_lang_Double_doubleToLongBits(%Env* %env, double %d) alwaysinline {
+    ; All NaNs are collapsed to the canonical NaN 0x7ff8000000000000
+    %1 = fcmp uno double %d, %d
+    %2 = bitcast double %d to i64
+    %3 = select i1 %1, i64 9221120237041090560, i64 %2
+    ret i64 %3
+}
+
+define private double @intrinsics.java_lang_Double_longBitsToDouble(%Env* %env, i64 %l) alwaysinline {
+    %1 = bitcast i64 %l to double
+    ret double %1
+}
+
+define private i8 @intrinsics.java_lang_String_equals(%Env* %env, %Object* %s, %Object* %o) alwaysinline {
+    %1 = icmp eq %Object* %s, %o
+    br i1 %1, label %equal, label %call
+equal:
+    ret i8 1
+call:
+    %2 = call i8 @_bcStringEquals(%Env* %env, %Object* %s, %Object* %o)
+    ret i8 %2
+}
+
+define private i32 @intrinsics.java_lang_String_compareTo(%Env* %env, %Object* %s1, %Object* %s2) alwaysinline {
+    %s2Check = call i8 @checknull(%Env* %env, %Object* %s2)
+    %1 = call i32 @_bcStringCompareTo(%Env* %env, %Object* %s1, %Object* %s2)
+    ret i32 %1
+}
+
+define private i32 @intrinsics.java_lang_String_indexOf_I(%Env* %env, %Object* %s, i32 %c) alwaysinline {
+    %1 = call i32 @_bcStringIndexOfChar(%Env* %env, %Object* %s, i32 %c, i32 0)
+    ret i32 %1
+}
+
+define private i32 @intrinsics.java_lang_String_indexOf_II(%Env* %env, %Object* %s, i32 %c, i32 %start) alwaysinline {
+    %1 = call i32 @_bcStringIndexOfChar(%Env* %env, %Object* %s, i32 %c, i32 %start)
+    ret i32 %1
+}
+
+define private i32 @intrinsics.java_lang_String_indexOf_String(%Env* %env, %Object* %s, %Object* %sub) alwaysinline {
+    %subCheck = call i8 @checknull(%Env* %env, %Object* %sub)
+    %1 = call i32 @_bcStringIndexOfString(%Env* %env, %Object* %s, %Object* %sub, i32 0)
+    ret i32 %1
+}
+
+define private i32 @intrinsics.java_lang_String_indexOf_StringI(%Env* %env, %Object* %s, %Object* %sub, i32 %start) alwaysinline {
+    %subCheck = call i8 @checknull(%Env* %env, %Object* %sub)
+    %1 = call i32 @_bcStringIndexOfString(%Env* %env, %Object* %s, %Object* %sub, i32 %start)
+    ret i32 %1
+}
+
+define private void @intrinsics.java_util_Arrays_fill_Z(%Env* %env, %Object* %array, i8 %value) alwaysinline {
+    %arrayCheck = call i8 @checknull(%Env* %env, %Object* %array)
+    call void @_bcArrayFill8(%Env* %env, %Object* %array, i8 %value)
+    ret void
+}
+
+define private void @intrinsics.java_util_Arrays_fill_B(%Env* %env, %Object* %array, i8 %value) alwaysinline {
+    %arrayCheck = call i8 @checknull(%Env* %env, %Object* %array)
+    call void @_bcArrayFill8(%Env* %env, %Object* %array, i8 %value)
+    ret void
+}
+
+define private void @intrinsics.java_util_Arrays_fill_S(%Env* %env, %Object* %array, i16 %value) alwaysinline {
+    %arrayCheck = call i8 @checknull(%Env* %env, %Object* %array)
+    call void @_bcArrayFill16(%Env* %env, %Object* %array, i16 %value)
+    ret void
+}
+
+define private void @intrinsics.java_util_Arrays_fill_C(%Env* %env, %Object* %array, i16 %value) alwaysinline {
+    %arrayCheck = call i8 @checknull(%Env* %env, %Object* %array)
+    call void @_bcArrayFill16(%Env* %env, %Object* %array, i16 %value)
+    ret void
+}
+
+define private void @intrinsics.java_util_Arrays_fill_I(%Env* %env, %Object* %array, i32 %value) alwaysinline {
+    %arrayCheck = call i8 @checknull(%Env* %env, %Object* %array)
+    call void @_bcArrayFill32(%Env* %env, %Object* %array, i32 %value)
+    ret void
+}
+
+define private void @intrinsics.java_util_Arrays_fill_J(%Env* %env, %Object* %array, i64 %value) alwaysinline {
+    %arrayCheck = call i8 @checknull(%Env* %env, %Object* %array)
+    call void @_bcArrayFill64(%Env* %env, %Object* %array, i64 %value)
+    ret void
+}
+
+define private void @intrinsics.java_util_Arrays_fill_F(%Env* %env, %Object* %array, float %value) alwaysinline {
+    %arrayCheck = call i8 @checknull(%Env* %env, %Object* %array)
+    %1 = bitcast float %value to i32
+    call void @_bcArrayFill32(%Env* %env, %Object* %array, i32 %1)
+    ret void
+}
+
+define private void @intrinsics.java_util_Arrays_fill_D(%Env* %env, %Object* %array, double %value) alwaysinline {
+    %arrayCheck = call i8 @checknull(%Env* %env, %Object* %array)
+    %1 = bitcast double %value to i64
+    call void @_bcArrayFill64(%Env* %env, %Object* %array, i64 %1)
+    ret void
+}
+
+define private void @arraycopy_check(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length) alwaysinline {
+    %srcCheck = call i8 @checknull(%Env* %env, %Object* %src)
+    %dstCheck = call i8 @checknull(%Env* %env, %Object* %dst)
+    %srcLength = call i32 @arraylength(%Object* %src)
+    %dstLength = call i32 @arraylength(%Object* %dst)
+    ; Fails if srcPos < 0 || dstPos < 0 || length < 0 || srcPos > srcLength - length || dstPos > dstLength - length
+    %1 = or i32 %srcPos, %dstPos
+    %2 = or i32 %1, %length
+    %3 = icmp slt i32 %2, 0
+    %4 = sub i32 %srcLength, %length
+    %5 = icmp sgt i32 %srcPos, %4
+    %6 = sub i32 %dstLength, %length
+    %7 = icmp sgt i32 %dstPos, %6
+    %8 = or i1 %3, %5
+    %9 = or i1 %8, %7
+    br i1 %9, label %failure, label %success
+success:
+    ret void
+failure:
+    call void @_bcThrowArrayCopyIndexOutOfBoundsException(%Env* %env, i32 %srcLength, i32 %srcPos, i32 %dstLength, i32 %dstPos, i32 %length)
+    unreachable
+}
+
+define private void @intrinsics.java_lang_System_arraycopy_checked_Z(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length) alwaysinline {
+    call void @arraycopy_check(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length)
+    %srcArray = bitcast %Object* %src to %BooleanArray*
+    %srcBase = getelementptr %BooleanArray* %srcArray, i32 0, i32 2
+    %srcPtr = getelementptr i8* %srcBase, i32 %srcPos
+    %dstArray = bitcast %Object* %dst to %BooleanArray*
+    %dstBase = getelementptr %BooleanArray* %dstArray, i32 0, i32 2
+    %dstPtr = getelementptr i8* %dstBase, i32 %dstPos
+    %s1 = bitcast i8* %dstPtr to i8*
+    %s2 = bitcast i8* %srcPtr to i8*
+    %n = sext i32 %length to i64
+    call void @llvm.memmove.p0i8.p0i8.i64(i8* %s1, i8* %s2, i64 %n, i32 1, i1 false)
+    ret void
+}
+
+define private void @intrinsics.java_lang_System_arraycopy_checked_B(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length) alwaysinline {
+    call void @arraycopy_check(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length)
+    %srcArray = bitcast %Object* %src to %ByteArray*
+    %srcBase = getelementptr %ByteArray* %srcArray, i32 0, i32 2
+    %srcPtr = getelementptr i8* %srcBase, i32 %srcPos
+    %dstArray = bitcast %Object* %dst to %ByteArray*
+    %dstBase = getelementptr %ByteArray* %dstArray, i32 0, i32 2
+    %dstPtr = getelementptr i8* %dstBase, i32 %dstPos
+    %s1 = bitcast i8* %dstPtr to i8*
+    %s2 = bitcast i8* %srcPtr to i8*
+    %n = sext i32 %length to i64
+    call void @llvm.memmove.p0i8.p0i8.i64(i8* %s1, i8* %s2, i64 %n, i32 1, i1 false)
+    ret void
+}
+
+define private void @intrinsics.java_lang_System_arraycopy_checked_S(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length) alwaysinline {
+    call void @arraycopy_check(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length)
+    %srcArray = bitcast %Object* %src to %ShortArray*
+    %srcBase = getelementptr %ShortArray* %srcArray, i32 0, i32 2
+    %srcPtr = getelementptr i16* %srcBase, i32 %srcPos
+    %dstArray = bitcast %Object* %dst to %ShortArray*
+    %dstBase = getelementptr %ShortArray* %dstArray, i32 0, i32 2
+    %dstPtr = getelementptr i16* %dstBase, i32 %dstPos
+    %s1 = bitcast i16* %dstPtr to i8*
+    %s2 = bitcast i16* %srcPtr to i8*
+    %n = sext i32 %length to i64
+    call void @_bcMoveMemory16(i8* %s1, i8* %s2, i64 %n)
+    ret void
+}
+
+define private void @intrinsics.java_lang_System_arraycopy_checked_C(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length) alwaysinline {
+    call void @arraycopy_check(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length)
+    %srcArray = bitcast %Object* %src to %CharArray*
+    %srcBase = getelementptr %CharArray* %srcArray, i32 0, i32 2
+    %srcPtr = getelementptr i16* %srcBase, i32 %srcPos
+    %dstArray = bitcast %Object* %dst to %CharArray*
+    %dstBase = getelementptr %CharArray* %dstArray, i32 0, i32 2
+    %dstPtr = getelementptr i16* %dstBase, i32 %dstPos
+    %s1 = bitcast i16* %dstPtr to i8*
+    %s2 = bitcast i16* %srcPtr to i8*
+    %n = sext i32 %length to i64
+    call void @_bcMoveMemory16(i8* %s1, i8* %s2, i64 %n)
+    ret void
+}
+
+define private void @intrinsics.java_lang_System_arraycopy_checked_I(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length) alwaysinline {
+    call void @arraycopy_check(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length)
+    %srcArray = bitcast %Object* %src to %IntArray*
+    %srcBase = getelementptr %IntArray* %srcArray, i32 0, i32 2
+    %srcPtr = getelementptr i32* %srcBase, i32 %srcPos
+    %dstArray = bitcast %Object* %dst to %IntArray*
+    %dstBase = getelementptr %IntArray* %dstArray, i32 0, i32 2
+    %dstPtr = getelementptr i32* %dstBase, i32 %dstPos
+    %s1 = bitcast i32* %dstPtr to i8*
+    %s2 = bitcast i32* %srcPtr to i8*
+    %n = sext i32 %length to i64
+    call void @_bcMoveMemory32(i8* %s1, i8* %s2, i64 %n)
+    ret void
+}
+
+define private void @intrinsics.java_lang_System_arraycopy_checked_J(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length) alwaysinline {
+    call void @arraycopy_check(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length)
+    %srcArray = bitcast %Object* %src to %LongArray*
+    %srcBase = getelementptr %LongArray* %srcArray, i32 0, i32 2
+    %srcPtr = getelementptr i64* %srcBase, i32 %srcPos
+    %dstArray = bitcast %Object* %dst to %LongArray*
+    %dstBase = getelementptr %LongArray* %dstArray, i32 0, i32 2
+    %dstPtr = getelementptr i64* %dstBase, i32 %dstPos
+    %s1 = bitcast i64* %dstPtr to i8*
+    %s2 = bitcast i64* %srcPtr to i8*
+    %1 = sext i32 %length to i64
+    %n = shl i64 %1, 1
+    call void @_bcMoveMemory32(i8* %s1, i8* %s2, i64 %n)
+    ret void
+}
+
+define private void @intrinsics.java_lang_System_arraycopy_checked_F(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length) alwaysinline {
+    call void @arraycopy_check(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length)
+    %srcArray = bitcast %Object* %src to %FloatArray*
+    %srcBase = getelementptr %FloatArray* %srcArray, i32 0, i32 2
+    %srcPtr = getelementptr float* %srcBase, i32 %srcPos
+    %dstArray = bitcast %Object* %dst to %FloatArray*
+    %dstBase = getelementptr %FloatArray* %dstArray, i32 0, i32 2
+    %dstPtr = getelementptr float* %dstBase, i32 %dstPos
+    %s1 = bitcast float* %dstPtr to i8*
+    %s2 = bitcast float* %srcPtr to i8*
+    %n = sext i32 %length to i64
+    call void @_bcMoveMemory32(i8* %s1, i8* %s2, i64 %n)
+    ret void
+}
+
+define private void @intrinsics.java_lang_System_arraycopy_checked_D(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length) alwaysinline {
+    call void @arraycopy_check(%Env* %env, %Object* %src, i32 %srcPos, %Object* %dst, i32 %dstPos, i32 %length)
+    %srcArray = bitcast %Object* %src to %DoubleArray*
+    %srcBase = getelementptr %DoubleArray* %srcArray, i32 0, i32 2
+    %srcPtr = getelementptr double* %srcBase, i32 %srcPos
+    %dstArray = bitcast %Object* %dst to %DoubleArray*
+    %dstBase = getelementptr %DoubleArray* %dstArray, i32 0, i32 2
+    %dstPtr = getelementptr double* %dstBase, i32 %dstPos
+    %s1 = bitcast double* %dstPtr to i8*
+    %s2 = bitcast double* %srcPtr to i8*
+    %1 = sext i32 %length to i64
+    %n = shl i64 %1, 1
+    call void @_bcMoveMemory32(i8* %s1, i8* %s2, i64 %n)
+    ret void
+}
+
 define linkonce_odr i32 @arraylength(%Object* %o) alwaysinline {
     %array = bitcast %Object* %o to %Array*
     %length = getelementptr %Array* %array, i32 0, i32 1
@@ -896,6 +1340,12 @@ define private void @monitorenter(%Env* %env, %Object* %o) alwaysinline {
     %isThin = icmp eq i32 %thinBit, 0
     br i1 %isThin, label %yesThin, label %callBc
 yesThin:
+    ; Reserved locks and locks which have never been locked (and are about
+    ; to be reserved) are handled by _bcMonitorEnter
+    %reservation = and i32 %thin, 1572864 ; LW_SHARED | LW_RESERVED = 0x180000
+    %isShared = icmp eq i32 %reservation, 1048576 ; LW_SHARED = 0x100000
+    br i1 %isShared, label %checkOwner, label %callBc
+checkOwner:
     %1 = lshr i32 %thin, 3 ; LW_LOCK_OWNER_SHIFT = 3
     %owner = and i32 %1, 65535 ; LW_LOCK_OWNER_MASK = 0xffff
     %isUnowned = icmp eq i32 %owner, 0
@@ -922,6 +1372,11 @@ define private void @monitorexit(%Env* %env, %Object* %o) alwaysinline {
     %isThin = icmp eq i32 %thinBit, 0
     br i1 %isThin, label %yesThin, label %callBc
 yesThin:
+    ; Reserved locks are released by _bcMonitorExit
+    %reserved = and i32 %thin, 524288 ; LW_RESERVED = 0x80000
+    %isReserved = icmp ne i32 %reserved, 0
+    br i1 %isReserved, label %callBc, label %checkOwner
+checkOwner:
     %1 = lshr i32 %thin, 3 ; LW_LOCK_OWNER_SHIFT = 3
     %owner = and i32 %1, 65535 ; LW_LOCK_OWNER_MASK = 0xffff
     %currentThread = call %Thread* @Env_currentThread(%Env* %env)
@@ -929,13 +1384,13 @@ yesThin:
     %isOwner = icmp eq i32 %owner, %threadId
     br i1 %isOwner, label %maybeUnlock, label %callBc
 maybeUnlock:
-    %2 = lshr i32 %thin, 19 ; LW_LOCK_COUNT_SHIFT = 19
-    %count = and i32 %2, 8191 ; LW_LOCK_COUNT_MASK = 0x1fff
+    %2 = lshr i32 %thin, 21 ; LW_LOCK_COUNT_SHIFT = 21
+    %count = and i32 %2, 2047 ; LW_LOCK_COUNT_MASK = 0x7ff
     %lockPtr = call i32* @Object_lockPtr(%Object* %o)
     %isZero = icmp eq i32 %count, 0
     br i1 %isZero, label %unlock, label %callBc
 unlock:
-    %newThin = and i32 %thin, 6 ; LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT (0x3 << 1)
+    %newThin = and i32 %thin, 1048582 ; LW_UNLOCKED_MASK = (0x3 << 1) | LW_SHARED
     fence seq_cst
     store volatile i32 %newThin, i32* %lockPtr
     ret void
@@ -973,6 +1428,14 @@ define private void @pushNativeFrame(%Env* %env) alwaysinline {
 }
 
 define private void @popNativeFrame(%Env* %env) alwaysinline {
+    ; Pop any JNI local ref frames left by the native method
+    %localRefs = call i8* @Env_localRefs(%Env* %env)
+    %hasLocalRefs = icmp ne i8* %localRefs, null
+    br i1 %hasLocalRefs, label %popLocalRefs, label %popFrame
+popLocalRefs:
+    call void @_bcPopLocalRefFrames(%Env* %env)
+    br label %popFrame
+popFrame:
     %curr_gw = call %GatewayFrame* @Env_gatewayFrames(%Env* %env)
     %curr_gw_prev = getelementptr %GatewayFrame* %curr_gw, i32 0, i32 0
     %prev_gw_i8p = load volatile i8** %curr_gw_prev
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2013 RoboVM AB
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>.
+ */
+package com.bugvm.llvm;
+
+import com.bugvm.llvm.binding.LLVM;
+import com.bugvm.llvm.binding.ValueRef;
+
+/**
+ * A constant value created directly in a {@link Context} without going
+ * through textual IR.
+ */
+public class Constant {
+    protected ValueRef ref;
+
+    Constant(ValueRef ref) {
+        this.ref = ref;
+    }
+
+    protected ValueRef getRef() {
+        return ref;
+    }
+
+    public Type getType() {
+        return new Type(LLVM.TypeOf(ref));
+    }
+}
@@ -18,6 +18,7 @@ package com.bugvm.llvm;
 
 import com.bugvm.llvm.binding.ContextRef;
 import com.bugvm.llvm.binding.LLVM;
+import com.bugvm.llvm.binding.ValueRefArray;
 
 /**
  * 
@@ -57,6 +58,25 @@ public class Context implements AutoCloseable {
         dispose();
     }
     
+    public Type getIntType(int numBits) {
+        return new Type(LLVM.IntTypeInContext(getRef(), numBits));
+    }
+
+    /**
+     * Returns a non-packed struct constant with the specified members.
+     */
+    public Constant getConstStruct(Constant ... values) {
+        ValueRefArray array = new ValueRefArray(values.length);
+        try {
+            for (int i = 0; i < values.length; i++) {
+                array.set(i, values[i].getRef());
+            }
+            return new Constant(LLVM.ConstStructInContext(getRef(), array, values.length, false));
+        } finally {
+            array.delete();
+        }
+    }
+
     public static Context getGlobalContext() {
         return new Context(LLVM.GetGlobalContext());
     }
@@ -49,6 +49,10 @@ public class Function {
     public void setLinkage(Linkage linkage) {
         LLVM.SetLinkage(getRef(), linkage);
     }
+
+    public boolean isDeclaration() {
+        return LLVM.IsDeclaration(getRef());
+    }
     
     public Attribute[] getAttributes() {
         int mask = LLVM.GetFunctionAttr(getRef());
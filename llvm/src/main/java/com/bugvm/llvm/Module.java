@@ -59,6 +59,24 @@ public class Module implements AutoCloseable {
         dispose();
     }
 
+    /**
+     * Creates a new empty {@link Module}. Use this to build simple modules
+     * directly instead of generating and parsing textual IR.
+     */
+    public static Module create(Context context, String name) {
+        return new Module(LLVM.ModuleCreateWithNameInContext(name, context.getRef()));
+    }
+
+    /**
+     * Adds a global with external linkage initialized to the specified
+     * {@link Constant}.
+     */
+    public void addGlobal(String name, Constant initializer, boolean constant) {
+        ValueRef gref = LLVM.AddGlobal(getRef(), LLVM.TypeOf(initializer.getRef()), name);
+        LLVM.SetInitializer(gref, initializer.getRef());
+        LLVM.SetGlobalConstant(gref, constant);
+    }
+
     public Type getTypeByName(String name) {
         return new Type(LLVM.GetTypeByName(getRef(), name));
     }
@@ -82,6 +100,13 @@ public class Module implements AutoCloseable {
         }
     }
     
+    public void writeIR(File file) {
+        StringOut errorMessage = new StringOut();
+        if (LLVM.PrintModuleToFile(getRef(), file.getAbsolutePath(), errorMessage)) {
+            throw new LlvmException(errorMessage.getValue().trim());
+        }
+    }
+    
     public void link(Module other) {
         StringOut errorMessage = new StringOut();
         if (LLVM.LinkModules(getRef(), other.getRef(), 0, errorMessage)) {
@@ -15,6 +15,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>.
  */package com.bugvm.llvm;
 
+import java.math.BigInteger;
+
+import com.bugvm.llvm.binding.LLVM;
 import com.bugvm.llvm.binding.TypeRef;
 
 /**
@@ -27,4 +30,17 @@ public class Type {
         this.ref = ref;
     }
 
+    /**
+     * Returns an integer constant of this type. The value is truncated to the
+     * width of this type.
+     */
+    public Constant constInt(long value) {
+        BigInteger n = BigInteger.valueOf(value);
+        if (value < 0) {
+            // The binding takes an unsigned 64-bit value
+            n = n.add(BigInteger.ONE.shiftLeft(64));
+        }
+        return new Constant(LLVM.ConstInt(ref, n, false));
+    }
+
 }
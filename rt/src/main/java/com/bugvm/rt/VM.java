@@ -147,6 +147,28 @@ public final class VM {
 
     public native static final void generateHeapDump();
 
+    /**
+     * Writes the monitor contention profile collected so far to the
+     * specified file. Contention profiling must have been enabled using
+     * <code>-rvm:ContentionProfile=&lt;file&gt;</code>.
+     * 
+     * @param path the file to write to or <code>null</code> to overwrite
+     *        the file specified on the command line.
+     * @return <code>true</code> if the profile was written.
+     */
+    public native static final boolean dumpContentionProfile(String path);
+
+    /**
+     * Writes the allocation profile collected so far to the specified file.
+     * Allocation profiling must have been enabled using
+     * <code>-rvm:AllocationProfile=&lt;file&gt;</code>.
+     * 
+     * @param path the file to write to or <code>null</code> to overwrite
+     *        the file specified on the command line.
+     * @return <code>true</code> if the profile was written.
+     */
+    public native static final boolean dumpAllocationProfile(String path);
+
     public native static final long allocateMemory(int size);
 
     public native static final long allocateMemoryUncollectable(int size);
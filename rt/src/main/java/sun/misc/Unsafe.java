@@ -318,13 +318,7 @@ public final class Unsafe {
      * nanoseconds-from-now (<code>false</code>)
      * @param time the (absolute millis or relative nanos) time value
      */
-    public void park(boolean absolute, long time) {
-        if (absolute) {
-            Thread.currentThread().parkUntil(time);
-        } else {
-            Thread.currentThread().parkFor(time);
-        }
-    }
+    public native void park(boolean absolute, long time);
 
     /**
      * Unparks the given object, which must be a {@link Thread}.
@@ -336,12 +330,20 @@ public final class Unsafe {
      */
     public void unpark(Object obj) {
         if (obj instanceof Thread) {
-            ((Thread) obj).unpark();
+            unpark0((Thread) obj);
         } else {
             throw new IllegalArgumentException("valid for Threads only");
         }
     }
 
+    /**
+     * Helper for {@link #unpark}. Does nothing if the thread hasn't been
+     * started yet or has already terminated.
+     *
+     * @param thread non-null; the thread to unpark
+     */
+    private static native void unpark0(Thread thread);
+
     /**
      * Allocates an instance of the given class without running the constructor.
      * The class' <clinit> will be run, if necessary.
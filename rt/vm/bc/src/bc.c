@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include <bugvm.h>
+#include <math.h>
 #include "uthash.h"
 #include "utlist.h"
 #include "MurmurHash3.h"
@@ -22,12 +23,14 @@
 #define LOG_TAG "bc"
 
 #define ALLOC_NATIVE_FRAMES_SIZE 8
+#define INTERFACE_CALL_CACHE_MAX_ENTRIES 4
 
 typedef struct {
-    ClassInfoHeader* classInfoHeader;
     void* start;
     void* end;
-} AddressClassLookup;
+    ClassInfoHeader* classInfoHeader;
+    Method* method; // Set once the Method has been resolved
+} AddressMethodLookup;
 
 typedef struct {
     ClassInfoHeader* exHeader;
@@ -39,6 +42,29 @@ typedef struct {
     LandingPad** landingPads;
 } BcTrycatchContext;
 
+/*
+ * Inline cache of an invokeinterface call site. Each call site has a
+ * trampoline function of its own (see TrampolineCompiler) which checks
+ * entries[0] and calls _bcLookupInterfaceMethodImpl() on a mismatch. Caches are
+ * immutable once published. A site first becomes monomorphic, then
+ * polymorphic with up to INTERFACE_CALL_CACHE_MAX_ENTRIES receiver
+ * classes. The first miss after that makes the site megamorphic. That is
+ * sticky: megamorphic sites stop updating any shared state (neither the
+ * cache nor ITables.cache of the receiver classes) so that threads calling
+ * through them don't keep invalidating each others' cache lines.
+ * The layout of the first entry must match what ClassCompiler emits.
+ */
+typedef struct {
+    Class* clazz;
+    void* impl;
+} InterfaceCallCacheEntry;
+
+typedef struct {
+    InterfaceCallCacheEntry entries[INTERFACE_CALL_CACHE_MAX_ENTRIES];
+    uint32_t count;
+    jboolean megamorphic;
+} InterfaceCallCache;
+
 const char* __attribute__ ((weak)) _bcMainClass = NULL;
 extern char** _bcStaticLibs;
 extern char** _bcBootclasspath;
@@ -47,6 +73,8 @@ extern void* _bcBootClassesHash;
 extern void* _bcClassesHash;
 extern void* _bcStrippedMethodStubs;
 extern void* _bcRuntimeData;
+extern void* _bcStringLiterals;
+extern jint _bcStringLiteralHashes;
 static Class* loadBootClass(Env*, const char*, Object*);
 static Class* loadUserClass(Env*, const char*, Object*);
 static void classInitialized(Env*, Class*);
@@ -54,14 +82,15 @@ static Interface* loadInterfaces(Env*, Class*);
 static Field* loadFields(Env*, Class*);
 static Method* loadMethods(Env*, Class*);
 static Class* findClassAt(Env*, void*);
+static Method* findMethodAt(Env*, void*, jboolean);
 static Class* createClass(Env*, ClassInfoHeader*, Object*);
 static jboolean exceptionMatch(Env* env, TrycatchContext*);
 static ObjectArray* listBootClasses(Env*, Class*);
 static ObjectArray* listUserClasses(Env*, Class*);
 static Options options = {0};
 static VM* vm = NULL;
-static jint addressClassLookupsCount = 0;
-static AddressClassLookup* addressClassLookups = NULL;
+static jint addressMethodLookupsCount = 0;
+static AddressMethodLookup* addressMethodLookups = NULL;
 
 static void initOptions() {
     options.mainClass = (char*) _bcMainClass;
@@ -74,9 +103,12 @@ static void initOptions() {
     options.loadFields = loadFields;
     options.loadMethods = loadMethods;
     options.findClassAt = findClassAt;
+    options.findMethodAt = findMethodAt;
     options.exceptionMatch = exceptionMatch;
     options.staticLibs = _bcStaticLibs;
     options.runtimeData = &_bcRuntimeData;
+    options.stringLiterals = (Object**) &_bcStringLiterals;
+    options.stringLiteralHashes = &_bcStringLiteralHashes;
     options.listBootClasses = listBootClasses;
     options.listUserClasses = listUserClasses;
 }
@@ -429,73 +461,84 @@ static inline jboolean hasImpl(MethodInfo* mi) {
     return !isStrippedMethod(mi);
 }
 
-static jboolean countClassesWithConcreteMethodsCallback(Env* env, ClassInfoHeader* header, MethodInfo* mi, void* d) {
+static jboolean countConcreteMethodsCallback(Env* env, ClassInfoHeader* header, MethodInfo* mi, void* d) {
     if (hasImpl(mi)) {
         jint* count = (jint*) d;
         *count = *count + 1;
-        return FALSE;
     }
     return TRUE;
 }
 
-static jboolean initAddressClassLookupsCallback(Env* env, ClassInfoHeader* header, MethodInfo* mi, void* d) {
+static jboolean initAddressMethodLookupsCallback(Env* env, ClassInfoHeader* header, MethodInfo* mi, void* d) {
     if (hasImpl(mi)) {
-        AddressClassLookup** lookupPtr = (AddressClassLookup**) d;
-        AddressClassLookup* lookup = *lookupPtr;
-        if (lookup->classInfoHeader != header) {
-            if (lookup->classInfoHeader) {
-                *lookupPtr += 1;
-                lookup = *lookupPtr;
-            }
-            lookup->classInfoHeader = header;
-            lookup->start = mi->impl;
-            lookup->end = mi->impl + mi->size;
-        } else if (lookup->start > mi->impl) {
-            lookup->start = mi->impl;
-        } else if (lookup->end <= mi->impl) {
-            lookup->end = mi->impl + mi->size;
-        }
+        AddressMethodLookup** lookupPtr = (AddressMethodLookup**) d;
+        AddressMethodLookup* lookup = *lookupPtr;
+        lookup->start = mi->impl;
+        lookup->end = mi->impl + mi->size;
+        lookup->classInfoHeader = header;
+        lookup->method = NULL;
+        *lookupPtr += 1;
     }
     return TRUE;
 }
 
-static int addressClassLookupCompareBSearch(const void* _a, const void* _b) {
-    AddressClassLookup* needle = (AddressClassLookup*) _a;
-    AddressClassLookup* el = (AddressClassLookup*) _b;
-    void* pc = needle->start;
-    return (pc >= el->start && pc < el->end) ? 0 : ((pc < el->start) ? -1 : 1);
+static int addressMethodLookupCompareQSort(const void* _a, const void* _b) {
+    AddressMethodLookup* a = (AddressMethodLookup*) _a;
+    AddressMethodLookup* b = (AddressMethodLookup*) _b;
+    return (a->start < b->start) ? -1 : ((a->start > b->start) ? 1 : 0);
 }
 
-static int addressClassLookupCompareQSort(const void* _a, const void* _b) {
-    AddressClassLookup* a = (AddressClassLookup*) _a;
-    AddressClassLookup* b = (AddressClassLookup*) _b;
-    return (a->end <= b->start) ? -1 : 1;
-}
-
-static AddressClassLookup* getAddressClassLookups(Env* env) {
-    if (!addressClassLookups) {
+/*
+ * Returns a table of the address ranges of all compiled methods sorted
+ * on start address. The table is built on first use and never changes
+ * after that apart from the lazily resolved Method pointers.
+ */
+static AddressMethodLookup* getAddressMethodLookups(Env* env) {
+    AddressMethodLookup* lookups = addressMethodLookups;
+    if (!lookups) {
         jint count = 0;
-        iterateClassInfos(env, countClassesWithConcreteMethodsCallback, _bcBootClassesHash, &count);
-        iterateClassInfos(env, countClassesWithConcreteMethodsCallback, _bcClassesHash, &count);
-        AddressClassLookup* lookups = rvmAllocateMemoryAtomicUncollectable(env, sizeof(AddressClassLookup) * count);
+        iterateClassInfos(env, countConcreteMethodsCallback, _bcBootClassesHash, &count);
+        iterateClassInfos(env, countConcreteMethodsCallback, _bcClassesHash, &count);
+        lookups = rvmAllocateMemoryAtomicUncollectable(env, sizeof(AddressMethodLookup) * count);
         if (!lookups) return NULL;
-        AddressClassLookup* _lookups = lookups;
-        iterateClassInfos(env, initAddressClassLookupsCallback, _bcBootClassesHash, &_lookups);
-        iterateClassInfos(env, initAddressClassLookupsCallback, _bcClassesHash, &_lookups);
-        qsort(lookups, count, sizeof(AddressClassLookup), addressClassLookupCompareQSort);
-        addressClassLookupsCount = count;
-        addressClassLookups = lookups;
+        AddressMethodLookup* _lookups = lookups;
+        iterateClassInfos(env, initAddressMethodLookupsCallback, _bcBootClassesHash, &_lookups);
+        iterateClassInfos(env, initAddressMethodLookupsCallback, _bcClassesHash, &_lookups);
+        qsort(lookups, count, sizeof(AddressMethodLookup), addressMethodLookupCompareQSort);
+        addressMethodLookupsCount = count;
+        if (!rvmAtomicCompareAndSwapPtr((void**) &addressMethodLookups, NULL, lookups)) {
+            // Another thread beat us to it
+            rvmFreeMemoryUncollectable(env, lookups);
+            lookups = addressMethodLookups;
+        }
     }
-    return addressClassLookups;
+    return lookups;
 }
 
-Class* findClassAt(Env* env, void* pc) {
-    AddressClassLookup* lookups = getAddressClassLookups(env);
-    if (!lookups) return NULL;
-    AddressClassLookup needle = {NULL, pc, pc};
-    AddressClassLookup* result = bsearch(&needle, lookups, addressClassLookupsCount, sizeof(AddressClassLookup), addressClassLookupCompareBSearch);
-    if (!result) return NULL;
-    ClassInfoHeader* header = result->classInfoHeader;
+/*
+ * Binary search for the method containing pc. Doesn't allocate or take
+ * any locks so it can be used from signal handlers once the table has
+ * been built.
+ */
+static AddressMethodLookup* findAddressMethodLookup(AddressMethodLookup* lookups, jint count, void* pc) {
+    jint low = 0;
+    jint high = count - 1;
+    while (low <= high) {
+        jint mid = (low + high) >> 1;
+        AddressMethodLookup* lookup = &lookups[mid];
+        if (pc < lookup->start) {
+            high = mid - 1;
+        } else if (pc >= lookup->end) {
+            low = mid + 1;
+        } else {
+            return lookup;
+        }
+    }
+    return NULL;
+}
+
+static Class* getClassForLookup(Env* env, AddressMethodLookup* lookup) {
+    ClassInfoHeader* header = lookup->classInfoHeader;
     Class* clazz = header->clazz;
     if (!clazz) {
         Object* loader = NULL;
@@ -507,6 +550,42 @@ Class* findClassAt(Env* env, void* pc) {
     return clazz;
 }
 
+Class* findClassAt(Env* env, void* pc) {
+    AddressMethodLookup* lookups = getAddressMethodLookups(env);
+    if (!lookups) return NULL;
+    AddressMethodLookup* lookup = findAddressMethodLookup(lookups, addressMethodLookupsCount, pc);
+    if (!lookup) return NULL;
+    return getClassForLookup(env, lookup);
+}
+
+/*
+ * Returns the Method containing pc. If resolve is FALSE only Methods
+ * which have already been resolved are returned. In that mode this
+ * function is async-signal-safe as long as the table has been built
+ * (by an earlier call with resolve == TRUE).
+ */
+Method* findMethodAt(Env* env, void* pc, jboolean resolve) {
+    AddressMethodLookup* lookups = resolve ? getAddressMethodLookups(env) : addressMethodLookups;
+    if (!lookups) return NULL;
+    AddressMethodLookup* lookup = findAddressMethodLookup(lookups, addressMethodLookupsCount, pc);
+    if (!lookup) return NULL;
+    Method* method = lookup->method;
+    if (method || !resolve) return method;
+
+    Class* clazz = getClassForLookup(env, lookup);
+    if (!clazz) return NULL;
+    method = rvmGetMethods(env, clazz);
+    if (rvmExceptionCheck(env)) return NULL;
+    for (; method != NULL; method = method->next) {
+        if (method->impl == lookup->start) {
+            // Publishes the Method. Racing threads will store the same value.
+            rvmAtomicStorePtr((void**) &lookup->method, method);
+            return method;
+        }
+    }
+    return NULL;
+}
+
 jboolean exceptionMatch(Env* env, TrycatchContext* _tc) {
     BcTrycatchContext* tc = (BcTrycatchContext*) _tc;
     LandingPad* lps = tc->landingPads[tc->tc.sel - 1];
@@ -523,12 +602,7 @@ jboolean exceptionMatch(Env* env, TrycatchContext* _tc) {
             // Exception class not yet loaded so it cannot match.
             continue;
         }
-        Class* clazz = header->clazz;
-        Class* c = throwable->clazz;
-        while (c && c != clazz) {
-            c = c->superclass;
-        }
-        if (c == clazz) {
+        if (rvmIsAssignableFrom(env, throwable->clazz, header->clazz)) {
             tc->tc.sel = lps[i].landingPadId;
             return TRUE;
         }
@@ -615,20 +689,74 @@ void* _bcLookupInterfaceMethod(Env* env, ClassInfoHeader* header, Object* thiz,
     LEAVE(result);
 }
 
-void* _bcLookupInterfaceMethodImpl(Env* env, ClassInfoHeader* header, Object* thiz, uint32_t index) {
+static void addInterfaceCallCacheEntry(Env* env, InterfaceCallCache** cachePtr, InterfaceCallCache* cache, Class* clazz, void* impl) {
+    // Caches only point to Class structs (which are never collected) and
+    // code so they don't have to be scanned by the GC. Plain calloc() is
+    // used since there may be no gateway frame to throw an OOM from.
+    InterfaceCallCache* newCache = calloc(1, sizeof(InterfaceCallCache));
+    if (!newCache) return; // The cache is only an optimization
+    if (cache && cache->count == INTERFACE_CALL_CACHE_MAX_ENTRIES) {
+        // Keep the entries but don't add any more
+        memcpy(newCache, cache, sizeof(InterfaceCallCache));
+        newCache->megamorphic = TRUE;
+        if (!rvmAtomicCompareAndSwapPtr((void**) cachePtr, cache, newCache)) {
+            free(newCache);
+        }
+        return;
+    }
+    // The most recently seen class goes first since that's the one checked inline
+    newCache->entries[0].clazz = clazz;
+    newCache->entries[0].impl = impl;
+    newCache->count = 1;
+    if (cache) {
+        memcpy(&newCache->entries[1], &cache->entries[0], sizeof(InterfaceCallCacheEntry) * cache->count);
+        newCache->count += cache->count;
+    }
+    // Superseded caches are leaked on purpose. Other threads may still be
+    // reading them and a site is only ever updated a few times.
+    if (!rvmAtomicCompareAndSwapPtr((void**) cachePtr, cache, newCache)) {
+        free(newCache);
+    }
+}
+
+/*
+ * cachePtr is NULL when called from the lookup function of an interface
+ * method rather than from a call site.
+ */
+void* _bcLookupInterfaceMethodImpl(Env* env, ClassInfoHeader* header, Object* thiz, uint32_t index, InterfaceCallCache** cachePtr) {
+    Class* clazz = thiz->clazz;
+    InterfaceCallCache* cache = cachePtr ? *(InterfaceCallCache* volatile*) cachePtr : NULL;
+    jboolean megamorphic = cache && cache->megamorphic;
+    uint32_t i;
+    if (cache) {
+        for (i = 1; i < cache->count; i++) {
+            if (cache->entries[i].clazz == clazz) {
+                return cache->entries[i].impl;
+            }
+        }
+    }
+
     TypeInfo* typeInfo = header->typeInfo;
-    ITables* itables = thiz->clazz->itables;
+    ITables* itables = clazz->itables;
     ITable* itable = itables->cache;
-    if (itable->typeInfo == typeInfo) {
-        return itable->table.table[index];
+    if (itable->typeInfo != typeInfo) {
+        itable = NULL;
+        for (i = 0; i < itables->count; i++) {
+            if (itables->table[i]->typeInfo == typeInfo) {
+                itable = itables->table[i];
+                if (!megamorphic) {
+                    itables->cache = itable;
+                }
+                break;
+            }
+        }
     }
-    uint32_t i;
-    for (i = 0; i < itables->count; i++) {
-        itable = itables->table[i];
-        if (itable->typeInfo == typeInfo) {
-            itables->cache = itable;
-            return itable->table.table[index];
+    if (itable) {
+        void* impl = itable->table.table[index];
+        if (cachePtr && !megamorphic) {
+            addInterfaceCallCacheEntry(env, cachePtr, cache, clazz, impl);
         }
+        return impl;
     }
 
     ENTER;
@@ -636,7 +764,7 @@ void* _bcLookupInterfaceMethodImpl(Env* env, ClassInfoHeader* header, Object* th
     Class* ownerInterface = header->clazz;
     char message[256];
     snprintf(message, 256, "Class %s does not implement the requested interface %s", 
-        rvmToBinaryClassName(env, thiz->clazz->name), rvmToBinaryClassName(env, ownerInterface->name));
+        rvmToBinaryClassName(env, clazz->name), rvmToBinaryClassName(env, ownerInterface->name));
     rvmThrowIncompatibleClassChangeError(env, message);
     LEAVE(NULL);
 }
@@ -679,6 +807,118 @@ void _bcMoveMemory32(void* dest, const void* src, jlong n) {
     rvmMoveMemory32(dest, src, n);
 }
 
+/*
+ * Runtime helpers for the intrinsics in Intrinsics.java which are too large
+ * to be inlined into the calling method. Null checks on the receiver (and
+ * the argument where the Java code would throw) are done by the caller.
+ */
+
+jboolean _bcStringEquals(Env* env, Object* s, Object* o) {
+    if (s == o) return TRUE;
+    // String is final so there's no need to check for subclasses
+    if (!o || o->clazz != java_lang_String) return FALSE;
+    return rvmStringEquals(env, s, o);
+}
+
+jint _bcStringCompareTo(Env* env, Object* s1, Object* s2) {
+    return rvmStringCompareTo(env, s1, s2);
+}
+
+jint _bcStringIndexOfChar(Env* env, Object* s, jint c, jint start) {
+    return rvmStringIndexOfChar(env, s, c, start);
+}
+
+jint _bcStringIndexOfString(Env* env, Object* s, Object* sub, jint start) {
+    return rvmStringIndexOf(env, s, sub, start);
+}
+
+void _bcArrayFill8(Env* env, Object* array, jbyte value) {
+    ByteArray* a = (ByteArray*) array;
+    memset(a->values, value, a->length);
+}
+
+void _bcArrayFill16(Env* env, Object* array, jshort value) {
+    ShortArray* a = (ShortArray*) array;
+    jint i;
+    for (i = 0; i < a->length; i++) {
+        a->values[i] = value;
+    }
+}
+
+void _bcArrayFill32(Env* env, Object* array, jint value) {
+    IntArray* a = (IntArray*) array;
+    jint i;
+    for (i = 0; i < a->length; i++) {
+        a->values[i] = value;
+    }
+}
+
+void _bcArrayFill64(Env* env, Object* array, jlong value) {
+    LongArray* a = (LongArray*) array;
+    jint i;
+    for (i = 0; i < a->length; i++) {
+        a->values[i] = value;
+    }
+}
+
+#define ARRAY_EQUALS_PROLOGUE(T) \
+    if (array1 == array2) return TRUE; \
+    if (!array1 || !array2) return FALSE; \
+    T* a1 = (T*) array1; \
+    T* a2 = (T*) array2; \
+    if (a1->length != a2->length) return FALSE
+
+jboolean _bcArrayEquals8(Env* env, Object* array1, Object* array2) {
+    ARRAY_EQUALS_PROLOGUE(ByteArray);
+    return memcmp(a1->values, a2->values, a1->length) == 0;
+}
+
+jboolean _bcArrayEquals16(Env* env, Object* array1, Object* array2) {
+    ARRAY_EQUALS_PROLOGUE(ShortArray);
+    return memcmp(a1->values, a2->values, sizeof(jshort) * a1->length) == 0;
+}
+
+jboolean _bcArrayEquals32(Env* env, Object* array1, Object* array2) {
+    ARRAY_EQUALS_PROLOGUE(IntArray);
+    return memcmp(a1->values, a2->values, sizeof(jint) * a1->length) == 0;
+}
+
+jboolean _bcArrayEquals64(Env* env, Object* array1, Object* array2) {
+    ARRAY_EQUALS_PROLOGUE(LongArray);
+    return memcmp(a1->values, a2->values, sizeof(jlong) * a1->length) == 0;
+}
+
+// Float and double arrays are compared like Float.floatToIntBits() and
+// Double.doubleToLongBits() do: all NaNs are equal, 0.0 and -0.0 are not.
+
+jboolean _bcArrayEqualsF(Env* env, Object* array1, Object* array2) {
+    ARRAY_EQUALS_PROLOGUE(FloatArray);
+    jint* bits1 = (jint*) a1->values;
+    jint* bits2 = (jint*) a2->values;
+    jint i;
+    for (i = 0; i < a1->length; i++) {
+        if (bits1[i] != bits2[i] && !(isnan(a1->values[i]) && isnan(a2->values[i]))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+jboolean _bcArrayEqualsD(Env* env, Object* array1, Object* array2) {
+    ARRAY_EQUALS_PROLOGUE(DoubleArray);
+    jlong* bits1 = (jlong*) a1->values;
+    jlong* bits2 = (jlong*) a2->values;
+    jint i;
+    for (i = 0; i < a1->length; i++) {
+        if (bits1[i] != bits2[i] && !(isnan(a1->values[i]) && isnan(a2->values[i]))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+#undef ARRAY_EQUALS_PROLOGUE
+
 void _bcTrycatchLeave(Env* env) {
     rvmTrycatchLeave(env);
 }
@@ -708,6 +948,15 @@ void _bcThrowArrayIndexOutOfBoundsException(Env* env, jint length, jint index) {
     LEAVEV;
 }
 
+void _bcThrowArrayCopyIndexOutOfBoundsException(Env* env, jint srcLength, jint srcPos, jint dstLength, jint dstPos, jint length) {
+    ENTER;
+    char msg[128];
+    snprintf(msg, sizeof(msg), "src.length=%d srcPos=%d dst.length=%d dstPos=%d length=%d",
+             srcLength, srcPos, dstLength, dstPos, length);
+    rvmThrowNew(env, java_lang_ArrayIndexOutOfBoundsException, msg);
+    LEAVEV;
+}
+
 void _bcThrowArithmeticException(Env* env) {
     ENTER;
     rvmThrowArithmeticException(env);
@@ -881,18 +1130,6 @@ void _bcSetObjectArrayElement(Env* env, ObjectArray* array, jint index, Object*
 }
 
 
-Object* _bcLdcString(Env* env, Object** ptr, char* s, jint length) {
-    Object* o = *ptr;
-    if (o) return o;
-    ENTER;
-    o = rvmNewInternedStringUTF(env, s, length);
-    if (!rvmExceptionCheck(env)) {
-        *ptr = o;
-        rvmRegisterDisappearingLink(env, (void**) ptr, o);
-    }
-    LEAVE(o);
-}
-
 Object* _bcLdcArrayBootClass(Env* env, Class** arrayClassPtr, char* name) {
     Class* arrayClass = *arrayClassPtr;
     if (arrayClass) return (Object*) arrayClass;
@@ -984,9 +1221,16 @@ void _bcPushNativeFrame(Env* env, GatewayFrame* gwFrame, void* frameAddress) {
 }
 
 void _bcPopNativeFrame(Env* env) {
+    if (env->localRefs) {
+        rvmPopNativeLocalRefFrames(env);
+    }
     rvmPopGatewayFrame(env);
 }
 
+void _bcPopLocalRefFrames(Env* env) {
+    rvmPopNativeLocalRefFrames(env);
+}
+
 void _bcPushCallbackFrame(Env* env, GatewayFrame* gwFrame, void* frameAddress) {
     rvmPushGatewayFrame0(env, gwFrame, frameAddress, NULL);
 }
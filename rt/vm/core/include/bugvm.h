@@ -45,6 +45,7 @@ extern "C" {
 #include "bugvm/bitvector.h"
 #include "bugvm/access.h"
 #include "bugvm/atomic.h"
+#include "bugvm/move.h"
 #include "bugvm/init.h"
 #include "bugvm/memory.h"
 #include "bugvm/method.h"
@@ -53,6 +54,7 @@ extern "C" {
 #include "bugvm/array.h"
 #include "bugvm/exception.h"
 #include "bugvm/string.h"
+#include "bugvm/utf.h"
 #include "bugvm/thread.h"
 #include "bugvm/attribute.h"
 #include "bugvm/native.h"
@@ -62,6 +64,7 @@ extern "C" {
 #include "bugvm/mutex.h"
 #include "bugvm/monitor.h"
 #include "bugvm/signal.h"
+#include "bugvm/profiler.h"
 #include "bugvm/hooks.h"
 #include "bugvm/rt.h"
 #include "bugvm/lazy_helpers.h"
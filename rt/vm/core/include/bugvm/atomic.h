@@ -83,6 +83,14 @@ static inline void* rvmAtomicStorePtr(void** ptr, void* newval) {
     }
 }
 
+static inline jint rvmAtomicAddInt(jint* ptr, jint delta) {
+    return __sync_add_and_fetch(ptr, delta);
+}
+
+static inline jlong rvmAtomicAddLong(jlong* ptr, jlong delta) {
+    return __sync_add_and_fetch(ptr, delta);
+}
+
 static inline void rvmAtomicSynchronize() {
     __sync_synchronize();
 }
@@ -32,6 +32,12 @@
 #define CLASS_TYPE_ARRAY         0x20000000
 #define CLASS_TYPE_PROXY         0x30000000
 
+typedef struct {
+    jlong slotHits; // Checks answered by the single entry cache in TypeInfo
+    jlong hits;     // Checks answered by the global (source, target) cache
+    jlong misses;   // Checks which had to scan the TypeInfo of the source type
+} SubtypeCacheStats;
+
 #define CLASS_IS_INTERFACE(c) (IS_INTERFACE((c)->flags))
 #define CLASS_IS_PUBLIC(c) (IS_PUBLIC((c)->flags))
 #define CLASS_IS_STATIC(c) (IS_STATIC((c)->flags))
@@ -222,6 +228,7 @@ extern jboolean rvmIsSamePackage(Class* c1, Class* c2);
 
 extern jboolean rvmIsAssignableFrom(Env* env, Class* sub, Class* sup);
 extern jboolean rvmIsInstanceOf(Env* env, Object* obj, Class* clazz);
+extern void rvmGetSubtypeCacheStats(SubtypeCacheStats* stats);
 
 extern ObjectArray* rvmListClasses(Env* env, Class* instanceofClass, Object* classLoader);
 
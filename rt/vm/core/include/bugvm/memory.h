@@ -16,6 +16,40 @@
 #ifndef BUGVM_MEMORY_H
 #define BUGVM_MEMORY_H
 
+typedef struct {
+    jlong refills;     // Number of times a TLAB free list has been refilled from the GC
+    jlong refillBytes; // Total number of bytes handed to TLABs by the GC
+    jlong wasteBytes;  // Bytes left unused in TLABs of threads which have been detached
+} TlabStats;
+
+typedef struct {
+    jint capacity;   // Number of slots in the global refs table
+    jint objects;    // Number of distinct objects in the table
+    jint tombstones; // Number of slots left by deleted objects which haven't been reused yet
+    jlong refs;      // Number of global refs, objects referenced more than once counted once for each ref
+} GlobalRefStats;
+
+typedef struct {
+    jlong referents;         // Unreachable objects with registered references or cleanup handlers which have been processed
+    jlong softCleared;       // SoftReferences cleared
+    jlong weakCleared;       // WeakReferences cleared
+    jlong phantomCleared;    // PhantomReferences cleared
+    jlong finalizerEnqueued; // FinalizerReferences enqueued for finalization
+    jlong enqueueBatches;    // Number of batches of cleared references handed to ReferenceQueue
+} ReferenceStats;
+
+typedef struct {
+    jint threads;            // Number of finalizer threads
+    jlong queueDepth;        // Objects currently waiting to be processed by the finalizer threads
+    jlong maxQueueDepth;     // Highest queueDepth seen so far
+    jlong queued;            // Objects queued in total
+    jlong processed;         // Objects processed in total
+    jlong batches;           // Batches processed
+    jlong inlineBatches;     // Batches processed by other threads than the finalizer threads because the queue was full
+    jlong totalLatencyMicros; // Sum of the time each processed object spent waiting in the queue
+    jlong maxLatencyMicros;  // Longest time an object has spent waiting in the queue
+} FinalizerStats;
+
 extern jboolean rvmInitMemory(Env* env);
 extern Class* rvmAllocateMemoryForClass(Env* env, jint classDataSize);
 extern void rvmSetupGcDescriptor(Env* env, Class* clazz);
@@ -47,51 +81,22 @@ extern Object* rvmNewDirectByteBuffer(Env* env, void* address, jlong capacity);
 extern void* rvmGetDirectBufferAddress(Env* env, Object* buf);
 extern jlong rvmGetDirectBufferCapacity(Env* env, Object* buf);
 extern void rvmGenerateHeapDump(Env* env);
+extern void rvmGetTlabStats(Env* env, TlabStats* stats);
+extern void rvmGetGlobalRefStats(Env* env, GlobalRefStats* stats);
+extern void rvmGetReferenceStats(Env* env, ReferenceStats* total, ReferenceStats* lastGc);
+extern jboolean rvmStartFinalizerThreads(Env* env, jint count, jint limit);
+extern void rvmGetFinalizerStats(Env* env, FinalizerStats* stats);
 
 // Moves n 16-bit values from src to dest. src and dest must be 16-bit aligned.
 static inline void rvmMoveMemory16(void* dest, const void* src, size_t n) {
-    // This function is a modified version of the move16 function in Android's java_lang_System.cpp
     assert((((uintptr_t) dest | (uintptr_t) src) & 0x01) == 0);
-
-    uint16_t* d = (uint16_t*) dest;
-    const uint16_t* s = (uint16_t*) src;
-
-    if (d < s) {
-        /* copy forward */
-        while (n--) {
-            *d++ = *s++;
-        }
-    } else {
-        /* copy backward */
-        d += n;
-        s += n;
-        while (n--) {
-            *--d = *--s;
-        }
-    }
+    rvmMoveMemory(dest, src, n << 1);
 }
 
 // Moves n 32-bit values from src to dest. src and dest must be 32-bit aligned.
 static inline void rvmMoveMemory32(void* dest, const void* src, size_t n) {
-    // This function is a modified version of the move32 function in Android's java_lang_System.cpp
     assert((((uintptr_t) dest | (uintptr_t) src) & 0x03) == 0);
-
-    uint32_t* d = (uint32_t*) dest;
-    const uint32_t* s = (uint32_t*) src;
-
-    if (d < s) {
-        /* copy forward */
-        while (n--) {
-            *d++ = *s++;
-        }
-    } else {
-        /* copy backward */
-        d += n;
-        s += n;
-        while (n--) {
-            *--d = *--s;
-        }
-    }
+    rvmMoveMemory(dest, src, n << 2);
 }
 #endif
 
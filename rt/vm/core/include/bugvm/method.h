@@ -50,6 +50,7 @@ extern jboolean rvmUnregisterNative(Env* env, NativeMethod* method);
 extern void* rvmResolveNativeMethodImpl(Env* env, NativeMethod* method, const char* shortMangledName, const char* longMangledName, Object* classLoader, void** ptr);
 extern jboolean rvmLoadNativeLibrary(Env* env, const char* path, Object* classLoader);
 extern Method* rvmFindMethodAtAddress(Env* env, void* address);
+extern Method* rvmFindResolvedMethodAtAddress(Env* env, void* address);
 extern Method* rvmGetCallingMethod(Env* env);
 extern CallStack* rvmCaptureCallStack(Env* env);
 extern CallStack* rvmCaptureCallStackForThread(Env* env, Thread* thread);
@@ -28,5 +28,7 @@ void rvmObjectNotify(Env* env, Object* obj);
 void rvmObjectNotifyAll(Env* env, Object* obj);
 void rvmThreadSleep(Env* env, jlong msec, jint nsec);
 void rvmThreadInterrupt(Env* env, Thread* thread);
+void rvmThreadPark(Env* env, jboolean absolute, jlong time);
+void rvmThreadUnpark(Env* env, Object* threadObj);
 
 #endif
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2012 RoboVM AB
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BUGVM_MOVE_H
+#define BUGVM_MOVE_H
+
+/*
+ * Bulk copying and byte swapping. These functions don't depend on the rest
+ * of the VM and may be used by native code outside of the core which
+ * includes jni.h before this header.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Moves n bytes from src to dest. The areas may overlap. Unlike memmove()
+ * this never tears elements: if dest, src and n are all multiples of an
+ * element size of 2, 4 or 8 bytes every element is read and written by a
+ * single load and store. Use rvmMoveMemory16() and friends in memory.h
+ * when moving Java array elements.
+ */
+extern void rvmMoveMemory(void* dest, const void* src, size_t n);
+/*
+ * Copies count 16-bit, 32-bit or 64-bit values from src to dest reversing
+ * the byte order of each value. src and dest need not be aligned. They
+ * must either be equal or not overlap at all.
+ */
+extern void rvmSwapMemory16(void* dest, const void* src, size_t count);
+extern void rvmSwapMemory32(void* dest, const void* src, size_t count);
+extern void rvmSwapMemory64(void* dest, const void* src, size_t count);
+
+/*
+ * Returns the name of the kernels used by the functions above ("scalar",
+ * "sse2", "avx2" or "neon").
+ */
+extern const char* rvmMoveGetKernelsName(void);
+/*
+ * Forces the kernels with the specified name to be used. Returns FALSE if
+ * they aren't available on this CPU. Only meant to be used by benchmarks.
+ */
+extern jboolean rvmMoveUseKernels(const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -19,6 +19,13 @@
 extern void rvmInitJavaVM(VM* vm);
 extern void rvmInitJNIEnv(Env* env);
 extern jboolean rvmInitJNI(Env* env);
+extern jboolean rvmPushLocalRefFrame(Env* env, jint capacity);
+extern jboolean rvmPopLocalRefFrame(Env* env);
+extern void rvmPopNativeLocalRefFrames(Env* env);
+extern void rvmFreeLocalRefFrames(Env* env);
+extern jboolean rvmAddLocalRef(Env* env, Object* object);
+extern jboolean rvmRemoveLocalRef(Env* env, Object* object);
+extern jint rvmGetLocalRefsHighWaterMark(Env* env);
 
 #endif
 
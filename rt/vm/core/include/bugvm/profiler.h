@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2012 RoboVM AB
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BUGVM_PROFILER_H
+#define BUGVM_PROFILER_H
+
+extern jboolean rvmStartProfiler(Env* env, const char* path, jint interval);
+extern jboolean rvmStopProfiler(Env* env);
+extern jboolean rvmStartAllocationProfiler(Env* env, const char* path, jint interval);
+extern jboolean rvmStopAllocationProfiler(Env* env);
+extern jboolean rvmDumpAllocationProfile(Env* env, const char* path);
+extern jboolean rvmStartContentionProfiler(Env* env, const char* path);
+extern jboolean rvmStopContentionProfiler(Env* env);
+/*
+ * Writes the contention profile collected so far to the specified file or
+ * to the file passed to rvmStartContentionProfiler() if path is NULL.
+ */
+extern jboolean rvmDumpContentionProfile(Env* env, const char* path);
+
+#endif
@@ -55,6 +55,12 @@ extern jint rvmRTGetStringLength(Env* env, Object* str);
  */
 extern jchar* rvmRTGetStringChars(Env* env, Object* str);
 
+/**
+ * Returns the char array holding the characters of the specified
+ * java.lang.String instance.
+ */
+extern CharArray* rvmRTGetStringValue(Env* env, Object* str);
+
 /**
  * Initializes the java.lang.Thread object which will be associated with the
  * specified native Thread being attached to the VM. threadObj has been
@@ -22,6 +22,7 @@ extern Object* rvmNewString(Env* env, const jchar* chars, jint length);
 extern Object* rvmNewStringUTF(Env* env, const char* s, jint length);
 extern Object* rvmNewStringAscii(Env* env, const char* s, jint length);
 extern Object* rvmNewInternedStringUTF(Env* env, const char* s, jint length);
+extern Object* rvmNewInternedString(Env* env, const jchar* chars, jint length);
 extern Object* rvmInternString(Env* env, Object* str);
 extern jint rvmGetStringLength(Env* env, Object* str);
 extern jchar* rvmGetStringChars(Env* env, Object* str);
@@ -29,6 +30,10 @@ extern jint rvmGetStringUTFLength(Env* env, Object* str);
 extern char* rvmGetStringUTFChars(Env* env, Object* str);
 extern void rvmGetStringRegion(Env* env, Object* str, jint start, jint len, jchar* buf);
 extern void rvmGetStringUTFRegion(Env* env, Object* str, jint start, jint len, char* buf);
+extern jboolean rvmStringEquals(Env* env, Object* s1, Object* s2);
+extern jint rvmStringCompareTo(Env* env, Object* s1, Object* s2);
+extern jint rvmStringIndexOfChar(Env* env, Object* str, jint c, jint start);
+extern jint rvmStringIndexOf(Env* env, Object* str, Object* sub, jint start);
 
 #endif
 
@@ -54,6 +54,10 @@ typedef struct Array Array;
 typedef struct EnclosingMethod EnclosingMethod;
 typedef struct InnerClass InnerClass;
 typedef struct Env Env;
+typedef struct Tlab Tlab;
+typedef struct CallStackBuffer CallStackBuffer;
+typedef struct ProfileBuffer ProfileBuffer;
+typedef struct MemberIndex MemberIndex;
 typedef pthread_mutex_t Mutex;
 
 struct Field {
@@ -184,6 +188,8 @@ struct Class {
   jint instanceDataSize;   // The total number of bytes needed to store instances of this class.
   unsigned short classRefCount;
   unsigned short instanceRefCount;
+  MemberIndex* methodIndex; // Lazily created hash index of _methods. Managed by lookup.c.
+  MemberIndex* fieldIndex;  // Lazily created hash index of _fields. Managed by lookup.c.
   void* data[0] __attribute__ ((aligned (8)));  // This is where static fields are stored for the class. Must be 8-byte aligned.
 };
 
@@ -212,6 +218,9 @@ struct Monitor {
   Object*     obj;            /* what object are we part of [debug only] */
 
   Thread*     waitSet;  /* threads currently waiting on this monitor */
+  jint        waiters;  /* threads blocked on or waiting in this monitor */
+  jint        spinLimit; /* adaptive number of spins before blocking */
+  Monitor*    prev;
   Monitor*    next;
   Mutex lock;
 };
@@ -225,12 +234,16 @@ struct Thread {
   struct Thread* next;
   Monitor* waitMonitor;
   pthread_t pThread;
-  void* stackAddr;
+  void* stackAddr;  // The lowest usable address of the thread's stack (just above the guard page).
+  void* stackTop;   // The highest address of the thread's stack. Frames are always below this.
   jboolean interrupted;
   Mutex waitMutex;
   jint status;
   pthread_cond_t waitCond;
   sigset_t signalMask;
+  ProfileBuffer* profileBuffer; // Samples taken by the profiler. Owned by profiler.c.
+  jint parkState; // Permit used by rvmThreadPark(). A futex word on Linux.
+  jboolean lockReservationBusy; // Set while updating a reserved lock word. See monitor.c.
 };
 
 struct Array {
@@ -326,7 +339,19 @@ typedef struct Options {
     jint logLevel;
     jlong maxHeapSize;
     jlong initialHeapSize;
+    jint softReferenceThreshold;
+    jint finalizerThreads;
+    jint finalizerQueueLimit;
     jboolean enableGCHeapStats;
+    jboolean enableSubtypeCacheStats;
+    jboolean enableLocalRefStats;
+    jboolean disableLockReservation;
+    jint maxCallStackLength;
+    char* profileFile;
+    jint profileInterval;
+    char* allocationProfileFile;
+    jint allocationSampleInterval;
+    char* contentionProfileFile;
     jboolean enableHooks;
     jboolean waitForResume;
     jboolean printPID;
@@ -342,6 +367,8 @@ typedef struct Options {
     ClasspathEntry* classpath;
     char** staticLibs;
     void* runtimeData;
+    Object** stringLiterals; // NULL terminated. Sorted by String.hashCode().
+    jint* stringLiteralHashes; // String.hashCode() of each of the stringLiterals
     Class* (*loadBootClass)(Env*, const char*, Object*);
     Class* (*loadUserClass)(Env*, const char*, Object*);
     void (*classInitialized)(Env*, Class*);
@@ -349,6 +376,7 @@ typedef struct Options {
     Field* (*loadFields)(Env*, Class*);
     Method* (*loadMethods)(Env*, Class*);
     Class* (*findClassAt)(Env*, void*);
+    Method* (*findMethodAt)(Env*, void*, jboolean);
     jboolean (*exceptionMatch)(Env*, TrycatchContext*);
     ObjectArray* (*listBootClasses)(Env*, Class*);
     ObjectArray* (*listUserClasses)(Env*, Class*);
@@ -365,6 +393,8 @@ typedef struct RefTable {
     jint size; // Total size of this table
     jint count; // Number of references in this table
     void** entries;
+    struct GatewayFrame* gatewayFrame; // The GatewayFrame owning this table when used as a JNI local ref frame
+    jboolean implicit; // TRUE for a JNI local ref frame not pushed by PushLocalFrame()
 } RefTable;
 
 typedef struct GatewayFrame {
@@ -476,6 +506,9 @@ struct Env {
     GatewayFrame* gatewayFrames;
     TrycatchContext* trycatchContext;
     jint attachCount;
+    Tlab* tlab; // Thread local allocation buffer. Lazily created by memory.c.
+    CallStackBuffer* callStackBuffer; // Scratch buffer used when capturing call stacks. Lazily created by method.c.
+    RefTable* localRefs; // Top JNI local ref frame. Managed by native.c.
 };
 
 typedef struct DebugGcRoot {
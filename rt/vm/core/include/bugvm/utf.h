@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2012 RoboVM AB
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BUGVM_UTF_H
+#define BUGVM_UTF_H
+
+/*
+ * Transcoding between UTF-16 and modified UTF-8, standard UTF-8, US-ASCII
+ * and ISO-8859-1. These functions don't depend on the rest of the VM and
+ * may be used by native code outside of the core which includes jni.h
+ * before this header.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Returns the number of UTF-16 chars in the null terminated modified UTF-8
+ * string or -1 if the string isn't valid modified UTF-8.
+ */
+extern jint rvmUtf8CountChars(const char* utf8);
+/*
+ * Decodes the null terminated modified UTF-8 string into dst which must
+ * have room for rvmUtf8CountChars(utf8) chars.
+ */
+extern void rvmUtf8ToUtf16(jchar* dst, const char* utf8);
+/*
+ * Returns the number of bytes needed to encode the chars as modified UTF-8
+ * not including the terminating null.
+ */
+extern jint rvmUtf16CountModifiedUtf8Bytes(const jchar* src, jint length);
+/*
+ * Encodes the chars as null terminated modified UTF-8. dst must have room
+ * for rvmUtf16CountModifiedUtf8Bytes(src, length) + 1 bytes.
+ */
+extern void rvmUtf16ToModifiedUtf8(char* dst, const jchar* src, jint length);
+/*
+ * Returns the number of bytes needed to encode the chars as standard UTF-8.
+ * Surrogate pairs take 4 bytes, unpaired surrogates are replaced by '?'.
+ */
+extern jint rvmUtf16CountUtf8Bytes(const jchar* src, jint length);
+/*
+ * Encodes the chars as standard UTF-8 (not null terminated). dst must have
+ * room for rvmUtf16CountUtf8Bytes(src, length) bytes. Returns the number
+ * of bytes written.
+ */
+extern jint rvmUtf16ToUtf8(char* dst, const jchar* src, jint length);
+/*
+ * Widens US-ASCII bytes to chars. Bytes > 0x7f become U+FFFD.
+ */
+extern void rvmAsciiToUtf16(jchar* dst, const jbyte* src, jint length);
+/*
+ * Widens ISO-8859-1 bytes to chars.
+ */
+extern void rvmLatin1ToUtf16(jchar* dst, const jbyte* src, jint length);
+/*
+ * Narrows chars to bytes. Chars > maxValidChar become '?'. maxValidChar
+ * must be 0x7f (US-ASCII) or 0xff (ISO-8859-1).
+ */
+extern void rvmUtf16ToSingleByte(jbyte* dst, const jchar* src, jint length, jchar maxValidChar);
+
+/*
+ * Returns the name of the kernels used by the functions above ("scalar",
+ * "sse2", "avx2" or "neon").
+ */
+extern const char* rvmUtfGetKernelsName(void);
+/*
+ * Forces the kernels with the specified name to be used. Returns FALSE if
+ * they aren't available on this CPU. Only meant to be used by benchmarks.
+ */
+extern jboolean rvmUtfUseKernels(const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,10 +18,12 @@
 #include <string.h>
 #include "utlist.h"
 #include "private.h"
-#include "uthash.h"
 
 #define LOG_TAG "core.class"
 
+#define LOADED_CLASSES_INITIAL_CAPACITY 4096
+#define SUBTYPE_CACHE_SIZE 1024
+
 Class* java_lang_Object;
 Class* java_lang_Class;
 Class* java_lang_ClassLoader;
@@ -117,12 +119,20 @@ static Method* java_lang_Double_valueOf = NULL;
 
 static Mutex classLock;
 
-typedef struct LoadedClassEntry {
-    const char* key;      // The class name
-    Class* clazz;
-    UT_hash_handle hh;
-} LoadedClassEntry;
-static LoadedClassEntry* loadedClasses = NULL;
+/*
+ * Open addressing (linear probing) hash table of loaded classes keyed by
+ * class name. Lookups don't take any lock. Insertions are serialized by
+ * classLock. A slot is never changed once set. When the table has to grow
+ * a new table is built and published atomically. Readers still using the
+ * old table will find all classes that were loaded before it was replaced
+ * and the old table is reclaimed by the GC once no reader references it.
+ */
+typedef struct LoadedClassTable {
+    uint32_t capacity; // Always a power of 2
+    uint32_t count;
+    Class* classes[0];
+} LoadedClassTable;
+static LoadedClassTable* loadedClasses = NULL;
 
 // Class id counter used for dynamically created classes. We assume
 // that linked in classes never have class ids above about 250 million.
@@ -134,26 +144,77 @@ static ITables emptyITables = {0, &emptyITable};
 static Class* findClassByDescriptor(Env* env, const char* desc, Object* classLoader, Class* (*loaderFunc)(Env*, const char*, Object*));
 static Class* findClass(Env* env, const char* className, Object* classLoader, Class* (*loaderFunc)(Env*, const char*, Object*));
 static Class* findBootClass(Env* env, const char* className);
+static jboolean registerClass(Env* env, Class* clazz, jint state);
 
 inline uint32_t nextClassId(void) {
     return __sync_fetch_and_add(&classIdCounter, 1);
 }
 
+static inline uint32_t hashClassName(const char* className) {
+    // FNV-1a
+    uint32_t h = 2166136261U;
+    while (*className) {
+        h = (h ^ (uint8_t) *className++) * 16777619U;
+    }
+    return h;
+}
+
+/*
+ * Plain volatile loads are used when reading the table rather than
+ * rvmAtomicLoadPtr() which would write to the cache line. The loads that
+ * follow depend on the loaded pointers so they are ordered after the
+ * barrier in rvmAtomicStorePtr() on all supported CPUs.
+ */
+#define LOAD_PTR(p) (*(void* volatile*) (p))
+
 static Class* getLoadedClass(Env* env, const char* className) {
-    LoadedClassEntry* entry;
-    HASH_FIND_STR(loadedClasses, className, entry);
-    return entry ? entry->clazz : NULL;
-}
-
-static jboolean addLoadedClass(Env* env, Class* clazz) {
-    // LoadedClassEntrys are allocated atomically. Classes are always GC roots 
-    // which means that the class and it's name will be reachable regardless of 
-    // whether this is allocated atomically or not.
-    LoadedClassEntry* entry = rvmAllocateMemoryAtomicUncollectable(env, sizeof(LoadedClassEntry));
-    if (!entry) return FALSE;
-    entry->key = clazz->name;
-    entry->clazz = clazz;
-    HASH_ADD_KEYPTR(hh, loadedClasses, entry->key, strlen(entry->key), entry);
+    LoadedClassTable* table = LOAD_PTR(&loadedClasses);
+    if (!table) return NULL;
+    uint32_t mask = table->capacity - 1;
+    uint32_t i = hashClassName(className) & mask;
+    for (;;) {
+        Class* clazz = LOAD_PTR(&table->classes[i]);
+        if (!clazz) return NULL;
+        if (!strcmp(clazz->name, className)) return clazz;
+        i = (i + 1) & mask;
+    }
+}
+
+static void putLoadedClass(LoadedClassTable* table, Class* clazz) {
+    uint32_t mask = table->capacity - 1;
+    uint32_t i = hashClassName(clazz->name) & mask;
+    while (table->classes[i]) {
+        i = (i + 1) & mask;
+    }
+    // Publishes the class. rvmAtomicStorePtr() is a full barrier.
+    rvmAtomicStorePtr((void**) &table->classes[i], clazz);
+    table->count++;
+}
+
+/*
+ * Makes sure there's room for one more class in the loaded classes table.
+ * Must be called with the classLock held.
+ */
+static jboolean ensureLoadedClassesCapacity(Env* env) {
+    LoadedClassTable* table = loadedClasses;
+    if (table && (table->count + 1) * 4 <= table->capacity * 3) {
+        return TRUE;
+    }
+    uint32_t capacity = table ? table->capacity * 2 : LOADED_CLASSES_INITIAL_CAPACITY;
+    // Allocated atomically. Classes are always GC roots which means that the 
+    // classes will be reachable regardless of whether this is allocated 
+    // atomically or not.
+    LoadedClassTable* newTable = rvmAllocateMemoryAtomic(env, sizeof(LoadedClassTable) + capacity * sizeof(Class*));
+    if (!newTable) return FALSE;
+    newTable->capacity = capacity;
+    if (table) {
+        for (uint32_t i = 0; i < table->capacity; i++) {
+            if (table->classes[i]) {
+                putLoadedClass(newTable, table->classes[i]);
+            }
+        }
+    }
+    rvmAtomicStorePtr((void**) &loadedClasses, newTable);
     return TRUE;
 }
 
@@ -240,16 +301,25 @@ static Class* createArrayClass(Env* env, Class* componentType) {
     clazz->_methods = NULL;
     if (!rvmAddInterface(env, clazz, java_lang_Cloneable)) return NULL;
     if (!rvmAddInterface(env, clazz, java_io_Serializable)) return NULL;
-    if (!rvmRegisterClass(env, clazz)) return NULL;
-
-    clazz->flags = (clazz->flags & (~CLASS_STATE_MASK)) | CLASS_STATE_INITIALIZED;
+    // Array classes need no initialization. They must be published as
+    // initialized since other threads may find them as soon as they are
+    // registered.
+    if (!registerClass(env, clazz, CLASS_STATE_INITIALIZED)) return NULL;
 
     return clazz;
 }
 
 static Class* findClass(Env* env, const char* className, Object* classLoader, Class* (*loaderFunc)(Env*, const char*, Object*)) {
-    obtainClassLock();
+    // Fast path. Already loaded classes are found without locking.
     Class* clazz = getLoadedClass(env, className);
+    if (clazz != NULL) {
+        return clazz;
+    }
+
+    obtainClassLock();
+    // Check again now that we hold the lock. Another thread may have
+    // loaded the class.
+    clazz = getLoadedClass(env, className);
     if (clazz != NULL) {
         releaseClassLock();
         return clazz;
@@ -491,26 +561,38 @@ jboolean rvmIsSamePackage(Class* c1, Class* c2) {
     return strncmp(c1->name, c2->name, l1) == 0;
 }
 
-jboolean rvmIsAssignableFrom(Env* env, Class* s, Class* t) {
-    // TODO: What if s or t are NULL?
-    if (s == t || t == java_lang_Object) {
-        return TRUE;
-    }
+/*
+ * Global (source, target) subtype check cache. TypeInfo only has room for
+ * a single cached id (the layout is shared with compiled code) which
+ * thrashes when the same class is checked against several types in a
+ * row. This direct mapped cache remembers both positive and negative
+ * results. Each entry is a single 64-bit word holding ~source id in the
+ * upper half and target id << 1 | result in the lower half, so an all
+ * zero (empty) entry never matches and entries can't be torn. Class ids
+ * are allocated sequentially and never get near 2^31.
+ */
+static uint64_t subtypeCache[SUBTYPE_CACHE_SIZE] __attribute__ ((aligned (8)));
+static jboolean subtypeCacheStatsEnabled = FALSE;
+static SubtypeCacheStats subtypeCacheStats;
 
+static inline uint64_t subtypeCacheKey(uint32_t sid, uint32_t tid) {
+    return (((uint64_t) ~sid) << 32) | (((uint64_t) tid) << 1);
+}
+
+static inline uint32_t subtypeCacheIndex(uint32_t sid, uint32_t tid) {
+    return ((sid * 0x9e3779b1U) ^ tid) & (SUBTYPE_CACHE_SIZE - 1);
+}
+
+static jboolean isAssignableFrom(Env* env, Class* s, Class* t) {
     TypeInfo* sti = s->typeInfo;
     TypeInfo* tti = t->typeInfo;
-    uint32_t id = tti->id;
-    if (sti->cache == id) {
-        return TRUE;
-    }
 
     if (CLASS_IS_INTERFACE(t)) {
-        if (rvmIsInterfaceTypeInfoAssignable(env, sti, tti)) goto found;
-        return FALSE;
+        return rvmIsInterfaceTypeInfoAssignable(env, sti, tti);
     }
 
     // t must be a class or array class
-    if (rvmIsClassTypeInfoAssignable(env, sti, tti)) goto found;
+    if (rvmIsClassTypeInfoAssignable(env, sti, tti)) return TRUE;
 
     // The TypeInfo of array classes doesn't give the complete information.
     if (CLASS_IS_ARRAY(t) && CLASS_IS_ARRAY(s) 
@@ -519,10 +601,45 @@ jboolean rvmIsAssignableFrom(Env* env, Class* s, Class* t) {
     }
 
     return FALSE;
+}
 
-found:
-    sti->cache = id;
-    return TRUE;
+jboolean rvmIsAssignableFrom(Env* env, Class* s, Class* t) {
+    // TODO: What if s or t are NULL?
+    if (s == t || t == java_lang_Object) {
+        return TRUE;
+    }
+
+    TypeInfo* sti = s->typeInfo;
+    uint32_t sid = sti->id;
+    uint32_t tid = t->typeInfo->id;
+    if (sti->cache == tid) {
+        if (subtypeCacheStatsEnabled) rvmAtomicAddLong(&subtypeCacheStats.slotHits, 1);
+        return TRUE;
+    }
+
+    uint64_t key = subtypeCacheKey(sid, tid);
+    uint64_t* slot = &subtypeCache[subtypeCacheIndex(sid, tid)];
+    uint64_t entry = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    jboolean result;
+    if ((entry & ~((uint64_t) 1)) == key) {
+        if (subtypeCacheStatsEnabled) rvmAtomicAddLong(&subtypeCacheStats.hits, 1);
+        result = (jboolean) (entry & 1);
+    } else {
+        if (subtypeCacheStatsEnabled) rvmAtomicAddLong(&subtypeCacheStats.misses, 1);
+        result = isAssignableFrom(env, s, t);
+        __atomic_store_n(slot, key | result, __ATOMIC_RELAXED);
+    }
+
+    if (result) {
+        sti->cache = tid;
+    }
+    return result;
+}
+
+void rvmGetSubtypeCacheStats(SubtypeCacheStats* stats) {
+    stats->slotHits = subtypeCacheStats.slotHits;
+    stats->hits = subtypeCacheStats.hits;
+    stats->misses = subtypeCacheStats.misses;
 }
 
 jboolean rvmIsInstanceOf(Env* env, Object* obj, Class* clazz) {
@@ -544,6 +661,7 @@ jboolean rvmInitClasses(Env* env) {
     }
 
     gcAddRoot(&loadedClasses);
+    subtypeCacheStatsEnabled = env->vm->options->enableSubtypeCacheStats;
 
     // Cache important classes in java.lang.
     java_lang_Object = findBootClass(env, "java/lang/Object");
@@ -1101,7 +1219,7 @@ Method* rvmGetMethods(Env* env, Class* clazz) {
     return clazz->_methods;
 }
 
-jboolean rvmRegisterClass(Env* env, Class* clazz) {
+static jboolean registerClass(Env* env, Class* clazz, jint state) {
     assert(CLASS_IS_STATE_ALLOCATED(clazz));
 
     // We should now have enough of the class set up to build its GC descriptor
@@ -1111,7 +1229,7 @@ jboolean rvmRegisterClass(Env* env, Class* clazz) {
     // TODO: Verify the class hierarchy (class doesn't override final methods, changes public -> private, etc)
 
     obtainClassLock();
-    if (!addLoadedClass(env, clazz)) {
+    if (!ensureLoadedClassesCapacity(env)) {
         releaseClassLock();
         return FALSE;
     }
@@ -1121,12 +1239,20 @@ jboolean rvmRegisterClass(Env* env, Class* clazz) {
         return FALSE;
     }
 
-    clazz->flags = (clazz->flags & (~CLASS_STATE_MASK)) | CLASS_STATE_LOADED;
+    clazz->flags = (clazz->flags & (~CLASS_STATE_MASK)) | state;
+
+    // The class must be completely set up before it's published since
+    // getLoadedClass() doesn't take the classLock.
+    putLoadedClass(loadedClasses, clazz);
 
     releaseClassLock();
     return TRUE;
 }
 
+jboolean rvmRegisterClass(Env* env, Class* clazz) {
+    return registerClass(env, clazz, CLASS_STATE_LOADED);
+}
+
 void rvmInitialize(Env* env, Class* clazz) {
     assert(env->currentThread != NULL);
 
@@ -1566,10 +1692,17 @@ Object* rvmCloneObject(Env* env, Object* obj) {
     return copy;
 }
 
+uint32_t getLoadedClassCount() {
+    LoadedClassTable* table = LOAD_PTR(&loadedClasses);
+    return table ? table->count : 0;
+}
+
 void rvmIterateLoadedClasses(Env* env, jboolean (*f)(Env*, Class*, void*), void* data) {
-    LoadedClassEntry* entry;
-    for (entry = loadedClasses; entry != NULL; entry = entry->hh.next) {
-        if (!f(env, entry->clazz, data)) return;
+    LoadedClassTable* table = LOAD_PTR(&loadedClasses);
+    if (!table) return;
+    for (uint32_t i = 0; i < table->capacity; i++) {
+        Class* clazz = LOAD_PTR(&table->classes[i]);
+        if (clazz && !f(env, clazz, data)) return;
     }
 }
 
@@ -15,15 +15,12 @@
  */
 #include <bugvm.h>
 #include <string.h>
+#include "private.h"
 
 static Field* getField(Env* env, Class* clazz, char* name, char* desc) {
-    Field* field = rvmGetFields(env, clazz);
+    Field* field = indexedField(env, clazz, name, desc);
     if (rvmExceptionCheck(env)) return NULL;
-    for (; field != NULL; field = field->next) {
-        if (!strcmp(field->name, name) && !strcmp(field->desc, desc)) {
-            return field;
-        }
-    }
+    if (field) return field;
 
     Interface* interfaze = rvmGetInterfaces(env, clazz);
     if (rvmExceptionCheck(env)) return NULL;
@@ -40,9 +37,17 @@ static Field* getField(Env* env, Class* clazz, char* name, char* desc) {
     return NULL;
 }
 
-Field* rvmGetField(Env* env, Class* clazz, char* name, char* desc) {
+static Field* lookupField(Env* env, Class* clazz, char* name, char* desc) {
+    if (isFieldMiss(clazz, name, desc)) return NULL;
     Field* field = getField(env, clazz, name, desc);
     if (rvmExceptionCheck(env)) return NULL;
+    if (!field) addFieldMiss(clazz, name, desc);
+    return field;
+}
+
+Field* rvmGetField(Env* env, Class* clazz, char* name, char* desc) {
+    Field* field = lookupField(env, clazz, name, desc);
+    if (rvmExceptionCheck(env)) return NULL;
     if (!field) {
         rvmThrowNoSuchFieldError(env, name);
         return NULL;
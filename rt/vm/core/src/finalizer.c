@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2012 RoboVM AB
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Finalizer worker threads. Once the workers have been started the GC
+ * finalization callback (_finalizeObject() in memory.c) no longer processes
+ * objects itself but appends them to the finalizer queue. The workers take
+ * objects off the queue in batches, process them (clear and enqueue
+ * references, run cleanup handlers) and hand the references cleared by
+ * each batch to ReferenceQueue in one call.
+ *
+ * If the queue grows beyond the configured limit the thread which got
+ * notified by the GC helps draining the queue before it continues. This
+ * slows down threads allocating faster than finalization can keep up.
+ */
+#include <bugvm.h>
+#include <pthread.h>
+#include <string.h>
+#include "private.h"
+
+#define LOG_TAG "core.finalizer"
+
+#define FINALIZER_QUEUE_INITIAL_CAPACITY 1024 // Must be a power of 2
+#define FINALIZER_BATCH_SIZE 256
+#define DEFAULT_FINALIZER_THREADS 1
+#define DEFAULT_FINALIZER_QUEUE_LIMIT 65536
+
+typedef struct {
+    Object* object;
+    jlong enqueueTime; // Microseconds
+} FinalizerQueueEntry;
+
+/*
+ * Circular buffer of objects waiting to be finalized. The entries are
+ * allocated uncollectable so the objects stay reachable until they have
+ * been processed.
+ */
+static FinalizerQueueEntry* queue = NULL;
+static uint32_t queueCapacity = 0; // Always a power of 2
+static uint32_t queueHead = 0; // Next entry to take
+static uint32_t queueCount = 0;
+static uint32_t queueLimit = DEFAULT_FINALIZER_QUEUE_LIMIT;
+static Mutex queueLock;
+static pthread_cond_t queueCond;
+static volatile jboolean running = FALSE;
+// Set when the GC notified a thread which couldn't run the GC finalization
+// callbacks itself. See finalizerRequestInvoke().
+static volatile jboolean invokeRequested = FALSE;
+static jint threadCount = 0;
+static VM* vm = NULL;
+
+static FinalizerStats stats = {0}; // Protected by queueLock
+
+static jlong currentTimeMicros() {
+    // Monotonic so that wall-clock adjustments don't skew the latency stats
+    return monotonicNanos() / 1000;
+}
+
+/*
+ * Doubles the capacity of the queue. Called without the queueLock held
+ * since allocating may collect and end up in finalizerEnqueue() on the
+ * current thread.
+ */
+static jboolean growQueue(uint32_t minCapacity) {
+    uint32_t capacity = minCapacity * 2;
+    FinalizerQueueEntry* entries = gcAllocateUncollectable(capacity * sizeof(FinalizerQueueEntry));
+    if (!entries) return FALSE;
+    rvmLockMutex(&queueLock);
+    if (queueCapacity >= capacity) {
+        // Another thread grew the queue while we were allocating
+        rvmUnlockMutex(&queueLock);
+        gcFree(entries);
+        return TRUE;
+    }
+    uint32_t i;
+    for (i = 0; i < queueCount; i++) {
+        entries[i] = queue[(queueHead + i) & (queueCapacity - 1)];
+    }
+    FinalizerQueueEntry* old = queue;
+    queue = entries;
+    queueCapacity = capacity;
+    queueHead = 0;
+    rvmUnlockMutex(&queueLock);
+    gcFree(old);
+    return TRUE;
+}
+
+/*
+ * Appends an object handed to us by the GC to the finalizer queue. Returns
+ * FALSE if the workers aren't running or the queue couldn't be grown in
+ * which case the caller has to process the object itself.
+ */
+jboolean finalizerEnqueue(Env* env, Object* obj) {
+    if (!running) return FALSE;
+    jlong now = currentTimeMicros();
+    rvmLockMutex(&queueLock);
+    while (queueCount == queueCapacity) {
+        uint32_t capacity = queueCapacity;
+        rvmUnlockMutex(&queueLock);
+        if (!growQueue(capacity)) return FALSE;
+        rvmLockMutex(&queueLock);
+    }
+    FinalizerQueueEntry* entry = &queue[(queueHead + queueCount) & (queueCapacity - 1)];
+    entry->object = obj;
+    entry->enqueueTime = now;
+    queueCount++;
+    stats.queued++;
+    if (queueCount > stats.maxQueueDepth) {
+        stats.maxQueueDepth = queueCount;
+    }
+    rvmUnlockMutex(&queueLock);
+    return TRUE;
+}
+
+/*
+ * Takes at most max entries off the queue. Must be called with the
+ * queueLock held.
+ */
+static jint dequeueBatch(FinalizerQueueEntry* batch, jint max) {
+    jint n = 0;
+    while (n < max && queueCount > 0) {
+        FinalizerQueueEntry* entry = &queue[queueHead];
+        batch[n++] = *entry;
+        entry->object = NULL;
+        queueHead = (queueHead + 1) & (queueCapacity - 1);
+        queueCount--;
+    }
+    return n;
+}
+
+static void processBatch(Env* env, FinalizerQueueEntry* batch, jint n) {
+    jint i;
+    for (i = 0; i < n; i++) {
+        gcFinalizeObject(env, batch[i].object);
+    }
+    gcFlushClearedReferences(env);
+
+    jlong now = currentTimeMicros();
+    jlong totalLatency = 0;
+    jlong maxLatency = 0;
+    for (i = 0; i < n; i++) {
+        jlong latency = now - batch[i].enqueueTime;
+        totalLatency += latency;
+        if (latency > maxLatency) maxLatency = latency;
+        batch[i].object = NULL;
+    }
+    rvmLockMutex(&queueLock);
+    stats.processed += n;
+    stats.batches++;
+    stats.totalLatencyMicros += totalLatency;
+    if (maxLatency > stats.maxLatencyMicros) {
+        stats.maxLatencyMicros = maxLatency;
+    }
+    rvmUnlockMutex(&queueLock);
+}
+
+/*
+ * Called after the GC has handed all objects ready for finalization to
+ * finalizerEnqueue(). Wakes up the workers and applies back-pressure if
+ * the workers are falling behind. Must be called with no exception
+ * pending.
+ */
+void finalizerNotify(Env* env) {
+    if (!running) return;
+    rvmLockMutex(&queueLock);
+    if (queueCount > 0) {
+        pthread_cond_broadcast(&queueCond);
+    }
+    jboolean help = queueCount > queueLimit;
+    rvmUnlockMutex(&queueLock);
+    if (!help) return;
+
+    FinalizerQueueEntry batch[FINALIZER_BATCH_SIZE];
+    for (;;) {
+        rvmLockMutex(&queueLock);
+        if (queueCount <= queueLimit / 2) {
+            rvmUnlockMutex(&queueLock);
+            break;
+        }
+        jint n = dequeueBatch(batch, FINALIZER_BATCH_SIZE);
+        stats.inlineBatches++;
+        rvmUnlockMutex(&queueLock);
+        processBatch(env, batch, n);
+    }
+}
+
+/*
+ * Asks a finalizer thread to run the GC finalization callbacks. Called by
+ * the GC finalizer notifier on threads which aren't attached and thus can't
+ * run them. If the finalizer threads haven't been started yet the request
+ * is picked up once they have.
+ */
+void finalizerRequestInvoke(void) {
+    invokeRequested = TRUE;
+    if (!running) return;
+    rvmLockMutex(&queueLock);
+    pthread_cond_signal(&queueCond);
+    rvmUnlockMutex(&queueLock);
+}
+
+static void* finalizerThreadEntryPoint(void* arg) {
+    Env* env = NULL;
+    char name[32];
+    snprintf(name, sizeof(name), "Finalizer-%d", (jint) (intptr_t) arg);
+    if (rvmAttachCurrentThreadAsDaemon(vm, &env, name, NULL) != JNI_OK) {
+        WARNF("Failed to attach finalizer thread %s", name);
+        return NULL;
+    }
+    FinalizerQueueEntry batch[FINALIZER_BATCH_SIZE];
+    for (;;) {
+        rvmLockMutex(&queueLock);
+        while (queueCount == 0 && !invokeRequested) {
+            pthread_cond_wait(&queueCond, &queueLock);
+        }
+        if (invokeRequested) {
+            invokeRequested = FALSE;
+            rvmUnlockMutex(&queueLock);
+            // Queues the objects ready for finalization
+            gcInvokeFinalizers(env);
+            rvmExceptionClear(env);
+            continue;
+        }
+        jint n = dequeueBatch(batch, FINALIZER_BATCH_SIZE);
+        rvmUnlockMutex(&queueLock);
+        processBatch(env, batch, n);
+        rvmExceptionClear(env);
+    }
+    return NULL;
+}
+
+jboolean rvmStartFinalizerThreads(Env* env, jint count, jint limit) {
+    if (running) return TRUE;
+    if (count <= 0) count = DEFAULT_FINALIZER_THREADS;
+    if (limit > 0) queueLimit = limit;
+    if (rvmInitMutex(&queueLock) != 0) return FALSE;
+    if (pthread_cond_init(&queueCond, NULL) != 0) return FALSE;
+    queue = gcAllocateUncollectable(FINALIZER_QUEUE_INITIAL_CAPACITY * sizeof(FinalizerQueueEntry));
+    if (!queue) return FALSE;
+    queueCapacity = FINALIZER_QUEUE_INITIAL_CAPACITY;
+    vm = env->vm;
+    jint i;
+    for (i = 0; i < count; i++) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int err = pthread_create(&thread, &attr, finalizerThreadEntryPoint, (void*) (intptr_t) i);
+        pthread_attr_destroy(&attr);
+        if (err != 0) {
+            WARNF("Failed to start finalizer thread: %s", strerror(err));
+            break;
+        }
+    }
+    if (i == 0) return FALSE;
+    threadCount = i;
+    // From now on objects are queued rather than finalized by the thread
+    // which got notified by the GC.
+    running = TRUE;
+    TRACEF("Started %d finalizer threads", threadCount);
+    return TRUE;
+}
+
+/*
+ * The queueLock is never held while allocating so this is safe to call
+ * from the GC start callback.
+ */
+void rvmGetFinalizerStats(Env* env, FinalizerStats* result) {
+    if (!running) {
+        memset(result, 0, sizeof(FinalizerStats));
+        return;
+    }
+    rvmLockMutex(&queueLock);
+    *result = stats;
+    result->threads = threadCount;
+    result->queueDepth = queueCount;
+    rvmUnlockMutex(&queueLock);
+}
@@ -140,6 +140,12 @@ void rvmParseOption(char* arg, Options* options) {
         } else {
             options->initialHeapSize = n;
         }
+    } else if (startsWith(arg, "SoftReferenceThreshold=")) {
+        options->softReferenceThreshold = strtol(&arg[23], NULL, 10);
+    } else if (startsWith(arg, "FinalizerThreads=")) {
+        options->finalizerThreads = strtol(&arg[17], NULL, 10);
+    } else if (startsWith(arg, "FinalizerQueueLimit=")) {
+        options->finalizerQueueLimit = strtol(&arg[20], NULL, 10);
     } else if (startsWith(arg, "MainClass=")) {
         if (!options->mainClass) {
             char* s = strdup(&arg[10]);
@@ -151,6 +157,30 @@ void rvmParseOption(char* arg, Options* options) {
         }
     } else if (startsWith(arg, "EnableGCHeapStats")) {
         options->enableGCHeapStats = TRUE;
+    } else if (startsWith(arg, "EnableSubtypeCacheStats")) {
+        options->enableSubtypeCacheStats = TRUE;
+    } else if (startsWith(arg, "EnableLocalRefStats")) {
+        options->enableLocalRefStats = TRUE;
+    } else if (startsWith(arg, "DisableLockReservation")) {
+        options->disableLockReservation = TRUE;
+    } else if (startsWith(arg, "MaxStackTraceDepth=")) {
+        options->maxCallStackLength = strtol(&arg[19], NULL, 10);
+    } else if (startsWith(arg, "AllocationSampleInterval=")) {
+        options->allocationSampleInterval = strtol(&arg[25], NULL, 10);
+    } else if (startsWith(arg, "AllocationProfile=")) {
+        if (!options->allocationProfileFile) {
+            options->allocationProfileFile = strdup(&arg[18]);
+        }
+    } else if (startsWith(arg, "ContentionProfile=")) {
+        if (!options->contentionProfileFile) {
+            options->contentionProfileFile = strdup(&arg[18]);
+        }
+    } else if (startsWith(arg, "ProfileInterval=")) {
+        options->profileInterval = strtol(&arg[16], NULL, 10);
+    } else if (startsWith(arg, "Profile=")) {
+        if (!options->profileFile) {
+            options->profileFile = strdup(&arg[8]);
+        }
     } else if (startsWith(arg, "EnableHooks")) {
         options->enableHooks = TRUE;
     } else if (startsWith(arg, "WaitForResume")) {
@@ -395,6 +425,19 @@ Env* rvmStartup(Options* options) {
     registerJARURLProtocol();
 #endif
 
+    if (options->profileFile) {
+        TRACE("Starting profiler");
+        if (!rvmStartProfiler(env, options->profileFile, options->profileInterval)) return NULL;
+    }
+    if (options->allocationProfileFile) {
+        TRACE("Starting allocation profiler");
+        if (!rvmStartAllocationProfiler(env, options->allocationProfileFile, options->allocationSampleInterval)) return NULL;
+    }
+    if (options->contentionProfileFile) {
+        TRACE("Starting contention profiler");
+        if (!rvmStartContentionProfiler(env, options->contentionProfileFile)) return NULL;
+    }
+
     TRACE("Creating system ClassLoader");
     systemClassLoader = rvmGetSystemClassLoader(env);
     if (rvmExceptionOccurred(env)) goto error_system_ClassLoader;
@@ -407,6 +450,11 @@ Env* rvmStartup(Options* options) {
     TRACE("Initialization done");
     env->vm->initialized = TRUE;
     
+    TRACE("Starting finalizer threads");
+    if (!rvmStartFinalizerThreads(env, options->finalizerThreads, options->finalizerQueueLimit)) {
+        WARN("Failed to start finalizer threads. Finalizing on allocating threads.");
+    }
+
     // Start Daemons
     TRACE("Starting Daemons");
     java_lang_Daemons = rvmFindClassUsingLoader(env, "java/lang/Daemons", NULL);
@@ -504,6 +552,34 @@ jboolean rvmRun(Env* env) {
     return rvmDestroyVM(env->vm);
 }
 
+static void logSubtypeCacheStats(VM* vm) {
+    if (!vm->options->enableSubtypeCacheStats) return;
+    SubtypeCacheStats stats;
+    rvmGetSubtypeCacheStats(&stats);
+    jlong total = stats.slotHits + stats.hits + stats.misses;
+    INFOF("Subtype checks: %lld (TypeInfo cache hits: %lld, global cache hits: %lld, misses: %lld, hit rate: %lld%%)", 
+        total, stats.slotHits, stats.hits, stats.misses, total > 0 ? (total - stats.misses) * 100 / total : 0LL);
+}
+
+static void logLocalRefStats(Env* env) {
+    if (!env->vm->options->enableLocalRefStats) return;
+    INFOF("JNI local refs high-water mark: %d", rvmGetLocalRefsHighWaterMark(env));
+}
+
+/*
+ * Called when the VM is about to exit. May be called more than once.
+ */
+static void vmExiting(Env* env) {
+    static jboolean called = FALSE;
+    if (called) return;
+    called = TRUE;
+    rvmStopProfiler(env);
+    rvmStopAllocationProfiler(env);
+    rvmStopContentionProfiler(env);
+    logSubtypeCacheStats(env->vm);
+    logLocalRefStats(env);
+}
+
 jboolean rvmDestroyVM(VM* vm) {
     Env* env;
     if (JNI_OK != rvmAttachCurrentThread(vm, &env, NULL, NULL) ) {
@@ -515,10 +591,13 @@ jboolean rvmDestroyVM(VM* vm) {
 
     rvmJoinNonDaemonThreads(env);
 
+    vmExiting(env);
+
     return throwable == NULL ? TRUE : FALSE;
 }
 
 void rvmShutdown(Env* env, jint code) {
+    vmExiting(env);
     // TODO: Cleanup, stop threads.
     exit(code);
 }
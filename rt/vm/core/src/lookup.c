@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2012 RoboVM AB
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Per-class hash indexes of the methods and fields declared by a class. Used
+ * by method.c and field.c to avoid comparing the name and descriptor of
+ * every member in the linked lists of a class and all its superclasses and
+ * interfaces every time a member is looked up, e.g. by JNI
+ * GetMethodID()/GetFieldID(), _bcLookupVirtualMethod() or reflection.
+ *
+ * An index is built the first time a member of a class is looked up and is
+ * published in Class.methodIndex/Class.fieldIndex using a CAS. Once published
+ * an index is immutable and is read without taking any lock. If two threads
+ * race to build the same index the loser's copy is simply dropped and
+ * reclaimed by the GC.
+ *
+ * The members of a class never change once its method and field lists have
+ * been loaded, except while the class is still being created (e.g. proxy.c
+ * adds methods to classes in the CLASS_STATE_ALLOCATED state). Such classes
+ * aren't indexed, the member lists are searched linearly instead.
+ *
+ * Each index also has a small direct mapped cache of (name, desc) pairs for
+ * which a lookup through the whole class hierarchy (superclasses and
+ * interfaces) starting at the class failed. Repeated failing probes (e.g.
+ * optional JNI GetMethodID() lookups) then cost a single probe instead of
+ * one per class in the hierarchy. Miss entries are immutable and are
+ * published using rvmAtomicStorePtr(). A colliding miss simply replaces the
+ * previous entry.
+ *
+ * Member names and descriptors aren't interned (they point into the class
+ * data of compiled classes or are C strings passed in through JNI), so keys
+ * are hashed and confirmed with strcmp(). Equal pointers are accepted
+ * without comparing the strings.
+ */
+#include <bugvm.h>
+#include <string.h>
+#include "private.h"
+
+typedef struct MemberIndexEntry {
+    uint32_t hash;
+    const char* name;
+    const char* desc;
+    void* member;
+} MemberIndexEntry;
+
+#define MISS_CACHE_SIZE 8 // Must be a power of 2
+
+typedef struct MissEntry {
+    uint32_t hash;
+    uint32_t nameLength;
+    char key[0]; // name + '\0' + desc + '\0'
+} MissEntry;
+
+struct MemberIndex {
+    MissEntry* misses[MISS_CACHE_SIZE];
+    uint32_t mask;
+    MemberIndexEntry entries[0];
+};
+
+#define LOAD_PTR(p) (*(void* volatile*) (p))
+
+static inline uint32_t hashKey(const char* name, const char* desc) {
+    // FNV-1a over name, a separator and desc
+    uint32_t h = 2166136261U;
+    while (*name) {
+        h = (h ^ (uint8_t) *name++) * 16777619U;
+    }
+    h = (h ^ 0xff) * 16777619U;
+    while (*desc) {
+        h = (h ^ (uint8_t) *desc++) * 16777619U;
+    }
+    return h;
+}
+
+static inline jboolean keyEquals(MemberIndexEntry* entry, uint32_t hash, const char* name, const char* desc) {
+    return entry->hash == hash
+        && (entry->name == name || !strcmp(entry->name, name))
+        && (entry->desc == desc || !strcmp(entry->desc, desc));
+}
+
+static MemberIndex* allocateIndex(Env* env, jint count) {
+    // Keep the load factor at or below 0.5 so that there's always an empty slot
+    uint32_t size = 1;
+    while (size < (uint32_t) count * 2) {
+        size <<= 1;
+    }
+    MemberIndex* index = rvmAllocateMemory(env, sizeof(MemberIndex) + sizeof(MemberIndexEntry) * size);
+    if (!index) return NULL;
+    index->mask = size - 1;
+    return index;
+}
+
+static void insert(MemberIndex* index, const char* name, const char* desc, void* member) {
+    uint32_t hash = hashKey(name, desc);
+    uint32_t i = hash & index->mask;
+    while (index->entries[i].member) {
+        if (keyEquals(&index->entries[i], hash, name, desc)) {
+            // Keep the first one to match the linear search
+            return;
+        }
+        i = (i + 1) & index->mask;
+    }
+    index->entries[i].hash = hash;
+    index->entries[i].name = name;
+    index->entries[i].desc = desc;
+    index->entries[i].member = member;
+}
+
+static void* find(MemberIndex* index, const char* name, const char* desc) {
+    uint32_t hash = hashKey(name, desc);
+    uint32_t i = hash & index->mask;
+    while (index->entries[i].member) {
+        if (keyEquals(&index->entries[i], hash, name, desc)) {
+            return index->entries[i].member;
+        }
+        i = (i + 1) & index->mask;
+    }
+    return NULL;
+}
+
+static jboolean isMiss(MemberIndex* index, const char* name, const char* desc) {
+    if (!index) return FALSE;
+    uint32_t hash = hashKey(name, desc);
+    MissEntry* entry = LOAD_PTR(&index->misses[hash & (MISS_CACHE_SIZE - 1)]);
+    return entry && entry->hash == hash && !strcmp(entry->key, name)
+        && !strcmp(entry->key + entry->nameLength + 1, desc);
+}
+
+static void addMiss(MemberIndex* index, const char* name, const char* desc) {
+    if (!index) return; // Not indexed (yet)
+    size_t nameLength = strlen(name);
+    size_t descLength = strlen(desc);
+    MissEntry* entry = gcAllocate(sizeof(MissEntry) + nameLength + descLength + 2);
+    if (!entry) return; // Caching is best effort
+    entry->hash = hashKey(name, desc);
+    entry->nameLength = (uint32_t) nameLength;
+    memcpy(entry->key, name, nameLength + 1);
+    memcpy(entry->key + nameLength + 1, desc, descLength + 1);
+    rvmAtomicStorePtr((void**) &index->misses[entry->hash & (MISS_CACHE_SIZE - 1)], entry);
+}
+
+static MemberIndex* publish(MemberIndex** slot, MemberIndex* index) {
+    if (!rvmAtomicCompareAndSwapPtr((void**) slot, NULL, index)) {
+        // Another thread beat us to it
+        return LOAD_PTR(slot);
+    }
+    return index;
+}
+
+Method* indexedMethod(Env* env, Class* clazz, const char* name, const char* desc) {
+    Method* methods = rvmGetMethods(env, clazz);
+    if (rvmExceptionCheck(env)) return NULL;
+
+    MemberIndex* index = LOAD_PTR(&clazz->methodIndex);
+    if (!index) {
+        Method* method;
+        if (CLASS_IS_STATE_ALLOCATED(clazz)) {
+            for (method = methods; method != NULL; method = method->next) {
+                if (!strcmp(method->name, name) && !strcmp(method->desc, desc)) {
+                    return method;
+                }
+            }
+            return NULL;
+        }
+        jint count = 0;
+        for (method = methods; method != NULL; method = method->next) {
+            count++;
+        }
+        index = allocateIndex(env, count);
+        if (!index) return NULL;
+        for (method = methods; method != NULL; method = method->next) {
+            insert(index, method->name, method->desc, method);
+        }
+        index = publish(&clazz->methodIndex, index);
+    }
+    return find(index, name, desc);
+}
+
+Field* indexedField(Env* env, Class* clazz, const char* name, const char* desc) {
+    Field* fields = rvmGetFields(env, clazz);
+    if (rvmExceptionCheck(env)) return NULL;
+
+    MemberIndex* index = LOAD_PTR(&clazz->fieldIndex);
+    if (!index) {
+        Field* field;
+        if (CLASS_IS_STATE_ALLOCATED(clazz)) {
+            for (field = fields; field != NULL; field = field->next) {
+                if (!strcmp(field->name, name) && !strcmp(field->desc, desc)) {
+                    return field;
+                }
+            }
+            return NULL;
+        }
+        jint count = 0;
+        for (field = fields; field != NULL; field = field->next) {
+            count++;
+        }
+        index = allocateIndex(env, count);
+        if (!index) return NULL;
+        for (field = fields; field != NULL; field = field->next) {
+            insert(index, field->name, field->desc, field);
+        }
+        index = publish(&clazz->fieldIndex, index);
+    }
+    return find(index, name, desc);
+}
+
+jboolean isMethodMiss(Class* clazz, const char* name, const char* desc) {
+    return isMiss(LOAD_PTR(&clazz->methodIndex), name, desc);
+}
+
+void addMethodMiss(Class* clazz, const char* name, const char* desc) {
+    addMiss(LOAD_PTR(&clazz->methodIndex), name, desc);
+}
+
+jboolean isFieldMiss(Class* clazz, const char* name, const char* desc) {
+    return isMiss(LOAD_PTR(&clazz->fieldIndex), name, desc);
+}
+
+void addFieldMiss(Class* clazz, const char* name, const char* desc) {
+    addMiss(LOAD_PTR(&clazz->fieldIndex), name, desc);
+}
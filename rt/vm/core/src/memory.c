@@ -18,6 +18,7 @@
 #include <stdint.h>
 #include <gc/gc_mark.h>
 #include <gc/gc_gcj.h>
+#include <gc/gc_inline.h>
 #include "private.h"
 #include "uthash.h"
 #include "utlist.h"
@@ -26,7 +27,20 @@
 
 #define MIN_HEAP_SIZE (4*1024*1024) // 4MB
 #define DEFAULT_INITIAL_HEAP_SIZE (16*1024*1024) // 16MB
-#define GLOBAL_REFS_INITIAL_SIZE 2048
+#define GLOBAL_REFS_INITIAL_SIZE 2048 // Must be a power of 2
+// Number of global ref deletes buffered per thread before the global refs table is updated
+// Objects up to this many GC granules (128 bytes on 64-bit) are allocated from the TLAB
+#define TLAB_MAX_GRANULES 8
+// Approximate number of bytes handed to a TLAB free list by the GC on each refill
+#define TLAB_REFILL_BYTES 4096
+// TLAB free list kinds
+#define TLAB_KIND_GCJ 0
+#define TLAB_KIND_OBJECT_ARRAY 1
+#define TLAB_KIND_COUNT 2
+// Number of independently locked shards of the referents table
+#define REFERENT_SHARDS 64 // Must be a power of 2
+// Soft referents are kept alive as long as less than this percentage of the heap is in use
+#define DEFAULT_SOFT_REFERENCE_THRESHOLD 75
 
 static Class* java_nio_DirectByteBuffer = NULL;
 static Method* java_nio_DirectByteBuffer_init = NULL;
@@ -55,6 +69,7 @@ static VM* vm = NULL;
 // when memory is so low that there's not even enough left to allocate a new 
 // OutOfMemoryError.
 static Object* criticalOutOfMemoryError = NULL;
+static jboolean enableGCHeapStats = FALSE;
 
 // GC descriptor specifying which words in a ReferentEntry that should be scanned 
 // for heap pointers. The hh.hashv value in particular must not be scanned since
@@ -89,17 +104,97 @@ typedef struct HeapStat {
     jlong numberOfLiveBytes;
     UT_hash_handle hh;
 } HeapStat;
-static ReferentEntry* referents = NULL;
 static uint32_t referentEntryGCKind;
 
-static RefTable globalRefs = {0};
+/*
+ * The referents table keeps track of the references and cleanup handlers
+ * registered for objects. It's split into shards by referent address, each
+ * having its own lock and uthash, so that threads registering references
+ * for different objects rarely contend.
+ */
+typedef struct {
+    Mutex lock;
+    ReferentEntry* referents;
+} ReferentShard;
+static ReferentShard referentShards[REFERENT_SHARDS];
+
+/*
+ * References cleared by finalizeObject() which haven't been handed to
+ * ReferenceQueue.add() yet. A circular list linked through pendingNext.
+ * Flushed in one call once all ready finalizers have been run.
+ */
+static Object* clearedReferences = NULL;
+static Mutex clearedReferencesLock;
+static jint invokingFinalizers = 0;
+
+static ReferenceStats referenceStats = {0}; // Totals
+static ReferenceStats referenceStatsAtLastGc = {0};
+static ReferenceStats referenceStatsLastGc = {0}; // Processed after the previous GC
+
+// Soft reference policy. See updateSoftReferencePolicy().
+static jint softReferenceThreshold = DEFAULT_SOFT_REFERENCE_THRESHOLD;
+static jlong maxHeapSize = 0;
+static GC_word softReferencePolicyGcNo = 0;
+static volatile jboolean retainSoftReferents = FALSE;
+static volatile jboolean clearAllSoftReferents = FALSE;
+
+/*
+ * The global refs table. JNI global refs are plain Object pointers so the
+ * table is a set of objects rather than a table of handles. It's an open
+ * addressing hash table (linear probing) keyed on the object address. The
+ * same object may be added several times so each slot keeps a reference
+ * count. Removed slots are marked with GLOBAL_REF_TOMBSTONE to keep probe
+ * sequences intact and are reused by later adds. The table is allocated
+ * uncollectable so that the GC scans it for roots. Protected by
+ * globalRefsLock.
+ */
+typedef struct {
+    Object* object;
+    jint count;
+} GlobalRefSlot;
+#define GLOBAL_REF_TOMBSTONE ((Object*) 1)
+static GlobalRefSlot* globalRefSlots = NULL;
+static jint globalRefsCapacity = 0; // Always a power of 2
+static jint globalRefsUsed = 0; // Slots which are in use or tombstones
+static jint globalRefsObjects = 0; // Distinct objects in the table
+static jlong globalRefsCount = 0; // Sum of all slot counts
+
+static void finalizerNotifier(void);
 
-static Mutex referentsLock;
 static Mutex globalRefsLock;
 
 // The GC kind used when allocating Object arrays
 static uint32_t objectArrayGCKind;
 
+/*
+ * Thread local allocation buffer (TLAB). Boehm doesn't move objects so we
+ * can't bump allocate from a contiguous chunk without breaking the per object
+ * gcj descriptors. Instead each size class has a small stack of cleared
+ * objects which is refilled in one go using GC_generic_malloc_many().
+ */
+typedef struct {
+    void** objects;
+    uint32_t count;
+    uint32_t capacity;
+} TlabFreeList;
+
+struct Tlab {
+    TlabFreeList freeLists[TLAB_KIND_COUNT][TLAB_MAX_GRANULES];
+    // Allocation sampling state. See sampleAllocation().
+    jlong sampleBytes; // Bytes allocated since the last sample
+    jlong nextSampleBytes; // sampleBytes threshold for the next sample
+    uint32_t sampleSeed;
+};
+
+// 1 if the GC adds an extra byte to each object to support pointers just past the end
+static size_t tlabExtraBytes = 0;
+static jlong tlabRefills = 0;
+static jlong tlabRefillBytes = 0;
+static jlong tlabWasteBytes = 0;
+// Average number of bytes allocated by a thread between allocation samples.
+// 0 means allocation sampling is disabled.
+static jint allocationSampleInterval = 0;
+
 // The GC descriptor used for object instances which have no references to other objects.
 #define REF_FREE_GC_DESCRIPTOR ((void*) ((0 << GC_DS_TAGS) | GC_DS_LENGTH))
 // The GC descriptor used for objects which have to be marked using the markObject() mark procedure.
@@ -116,6 +211,15 @@ static inline struct GC_ms_entry* markRegion(void** start, void** end, struct GC
     return mark_stack_ptr;
 }
 
+/*
+ * Returns TRUE if obj is a SoftReference whose referent should be marked
+ * strongly reachable by the current collection.
+ */
+static inline jboolean isRetainedSoftReference(Object* obj) {
+    return retainSoftReferents && !clearAllSoftReferents && java_lang_ref_SoftReference
+        && rvmIsSubClass(java_lang_ref_SoftReference, obj->clazz);
+}
+
 static struct GC_ms_entry* markObject(GC_word* addr, struct GC_ms_entry* mark_stack_ptr, struct GC_ms_entry* mark_stack_limit, GC_word env) {
     Object* obj = (Object*) addr;
 
@@ -145,6 +249,8 @@ static struct GC_ms_entry* markObject(GC_word* addr, struct GC_ms_entry* mark_st
         mark_stack_ptr = GC_MARK_AND_PUSH(clazz->_interfaces, mark_stack_ptr, mark_stack_limit, NULL);
         mark_stack_ptr = GC_MARK_AND_PUSH(clazz->_fields, mark_stack_ptr, mark_stack_limit, NULL);
         mark_stack_ptr = GC_MARK_AND_PUSH(clazz->_methods, mark_stack_ptr, mark_stack_limit, NULL);
+        mark_stack_ptr = GC_MARK_AND_PUSH(clazz->methodIndex, mark_stack_ptr, mark_stack_limit, NULL);
+        mark_stack_ptr = GC_MARK_AND_PUSH(clazz->fieldIndex, mark_stack_ptr, mark_stack_limit, NULL);
         void** start = (void**) (((char*) clazz) + offsetof(Class, data));
         void** end = (void**) (((char*) start) + clazz->classRefCount * sizeof(Object*));
         mark_stack_ptr = markRegion(start, end, mark_stack_ptr, mark_stack_limit);
@@ -154,7 +260,7 @@ static struct GC_ms_entry* markObject(GC_word* addr, struct GC_ms_entry* mark_st
         while (clazz != NULL) {
             void** start = (void**) (((char*) obj) + clazz->instanceDataOffset);
             void** end = (void**) (((char*) start) + clazz->instanceRefCount * sizeof(Object*));
-            if (clazz == java_lang_ref_Reference) {
+            if (clazz == java_lang_ref_Reference && !isRetainedSoftReference(obj)) {
                 // Don't mark the referent field
                 void** referent_start = (void**) (((char*) obj) + java_lang_ref_Reference_referent->offset);
                 void** referent_end = (void**) (((char*) referent_start) + sizeof(Object*));
@@ -410,13 +516,24 @@ static void freeHeapStatsHash(HeapStat* statsHash) {
 }
 
 static void logGcHeapStats() {
+    // Classes are never unloaded so the hash of loaded classes only has to
+    // be rebuilt when classes have been loaded since the previous GC. Only
+    // accessed from the GC start callback which runs with the GC lock held.
+    static LoadedClass* loadedClassesHash = NULL;
+    static uint32_t loadedClassesCount = 0;
+
     Env* env = rvmGetEnv();
     if (!env) {
         return;
     }
 
-    LoadedClass* loadedClassesHash = NULL;
-    rvmIterateLoadedClasses(env, buildLoadedClassesHash, &loadedClassesHash);
+    uint32_t count = getLoadedClassCount();
+    if (!loadedClassesHash || count != loadedClassesCount) {
+        freeLoadedClassesHash(loadedClassesHash);
+        loadedClassesHash = NULL;
+        rvmIterateLoadedClasses(env, buildLoadedClassesHash, &loadedClassesHash);
+        loadedClassesCount = count;
+    }
 
     HeapStat* statsHash = NULL;
     HeapStatsCallbackData data = {loadedClassesHash, &statsHash};
@@ -444,10 +561,55 @@ static void logGcHeapStats() {
     HASH_SORT(statsHash, sortHeapStatsByNumberOfDeadInstancesDesc);
     printHeapStatsHash(stderr, statsHash, "*** Heap objects sorted by number of dead instances ***", 20);
 
-    freeLoadedClassesHash(loadedClassesHash);
+    fprintf(stderr, "*** TLABs ***\n");
+    fprintf(stderr, "Refills: %lld, refilled bytes: %lld, wasted bytes: %lld\n\n",
+        rvmAtomicLoadLong(&tlabRefills), rvmAtomicLoadLong(&tlabRefillBytes), rvmAtomicLoadLong(&tlabWasteBytes));
+
+    // Read without taking the globalRefsLock. A thread holding it may be
+    // waiting for the GC lock which is held while this runs.
+    fprintf(stderr, "*** Global refs ***\n");
+    fprintf(stderr, "Refs: %lld, objects: %d, tombstones: %d, capacity: %d\n\n",
+        globalRefsCount, globalRefsObjects, globalRefsUsed - globalRefsObjects, globalRefsCapacity);
+
+    fprintf(stderr, "*** References processed after previous GC ***\n");
+    fprintf(stderr, "Referents: %lld, soft cleared: %lld, weak cleared: %lld, phantom cleared: %lld, "
+        "finalizer enqueued: %lld, enqueue batches: %lld, soft referents retained: %s\n\n",
+        referenceStatsLastGc.referents, referenceStatsLastGc.softCleared, referenceStatsLastGc.weakCleared,
+        referenceStatsLastGc.phantomCleared, referenceStatsLastGc.finalizerEnqueued,
+        referenceStatsLastGc.enqueueBatches, retainSoftReferents ? "yes" : "no");
+
+    FinalizerStats finalizerStats;
+    rvmGetFinalizerStats(env, &finalizerStats);
+    fprintf(stderr, "*** Finalizer threads ***\n");
+    fprintf(stderr, "Threads: %d, queue depth: %lld (max %lld), queued: %lld, processed: %lld, batches: %lld "
+        "(%lld inline), latency avg/max: %lld/%lld us\n\n",
+        finalizerStats.threads, finalizerStats.queueDepth, finalizerStats.maxQueueDepth, finalizerStats.queued,
+        finalizerStats.processed, finalizerStats.batches, finalizerStats.inlineBatches,
+        finalizerStats.processed > 0 ? finalizerStats.totalLatencyMicros / finalizerStats.processed : 0LL,
+        finalizerStats.maxLatencyMicros);
+
     freeHeapStatsHash(statsHash);
 }
 
+static void gcStartCallback() {
+    // Turn idle fat locks back into thin locks
+    deflateMonitors();
+    // The finalizers of the previous collection have run by now (unless
+    // they're still running) so the references processed since the
+    // previous GC start are attributed to the previous GC.
+    jlong* total = (jlong*) &referenceStats;
+    jlong* atLastGc = (jlong*) &referenceStatsAtLastGc;
+    jlong* lastGc = (jlong*) &referenceStatsLastGc;
+    for (jint i = 0; i < (jint) (sizeof(ReferenceStats) / sizeof(jlong)); i++) {
+        jlong value = rvmAtomicLoadLong(&total[i]);
+        lastGc[i] = value - atLastGc[i];
+        atLastGc[i] = value;
+    }
+    if (enableGCHeapStats) {
+        logGcHeapStats();
+    }
+}
+
 void gcHeapDump(Env* env) {
     fprintf(stderr, "digraph {\n");
     GC_rvm_apply_to_each_live_object(heapDumpCallback, NULL);
@@ -475,6 +637,7 @@ jboolean initGC(Options* options) {
     }
 
     objectArrayGCKind = GC_new_kind(GC_new_free_list(), GC_DS_LENGTH, 1, 1);
+    tlabExtraBytes = GC_get_all_interior_pointers() ? 1 : 0;
     referentEntryGCKind = gcNewDirectBitmapKind(REFERENT_ENTRY_GC_BITMAP);
     markObjectGcDescriptor = (void*) (size_t) GC_MAKE_PROC(GC_new_proc(markObject), 0);
 
@@ -482,7 +645,12 @@ jboolean initGC(Options* options) {
     memset(&fakeClass, 0, sizeof(Class));
     fakeClass.gcDescriptor = (void*) ((sizeof(Class) << GC_DS_TAG_BITS) | GC_DS_LENGTH);
 
-    if (rvmInitMutex(&referentsLock) != 0) {
+    for (jint i = 0; i < REFERENT_SHARDS; i++) {
+        if (rvmInitMutex(&referentShards[i].lock) != 0) {
+            return FALSE;
+        }
+    }
+    if (rvmInitMutex(&clearedReferencesLock) != 0) {
         return FALSE;
     }
     if (rvmInitMutex(&globalRefsLock) != 0) {
@@ -492,9 +660,17 @@ jboolean initGC(Options* options) {
     GC_set_warn_proc(gcWarnProc);
     GC_allow_register_threads();
 
-    if (options->enableGCHeapStats) {
-        GC_set_start_callback(logGcHeapStats);
+    enableGCHeapStats = options->enableGCHeapStats;
+    GC_set_start_callback(gcStartCallback);
+
+    maxHeapSize = options->maxHeapSize;
+    if (options->softReferenceThreshold > 0) {
+        softReferenceThreshold = options->softReferenceThreshold;
     }
+    // Run finalizers from finalizerNotifier() instead of from within the
+    // allocation functions so that cleared references can be batched.
+    GC_set_finalize_on_demand(1);
+    GC_set_finalizer_notifier(finalizerNotifier);
 
     return TRUE;
 }
@@ -526,11 +702,47 @@ uint32_t gcNewDirectBitmapKind(size_t bitmap) {
     return GC_new_kind(GC_new_free_list(), bitmap | GC_DS_BITMAP, 0, 1);
 }
 
+/*
+ * Decides whether soft referents should survive the next collection. Soft
+ * referents are kept while less than softReferenceThreshold percent of the
+ * max heap size (or of the current heap size if there is no max) was in use
+ * after the previous collection. Called from allocation slow paths outside
+ * of the GC lock and only does any work once per collection.
+ */
+static void updateSoftReferencePolicy() {
+    GC_word gcNo = GC_get_gc_no();
+    if (gcNo == softReferencePolicyGcNo) {
+        return;
+    }
+    softReferencePolicyGcNo = gcNo;
+    GC_word heapSize, freeBytes, unmappedBytes, bytesSinceGC, totalBytes;
+    GC_get_heap_usage_safe(&heapSize, &freeBytes, &unmappedBytes, &bytesSinceGC, &totalBytes);
+    jlong used = (jlong) (heapSize - unmappedBytes - freeBytes);
+    jlong limit = maxHeapSize > 0 ? maxHeapSize : (jlong) (heapSize - unmappedBytes);
+    retainSoftReferents = used * 100 < limit * softReferenceThreshold ? TRUE : FALSE;
+}
+
+/*
+ * Collects after an allocation has failed. All soft references are cleared
+ * before giving up. Soft referents are reclaimed one collection after they
+ * have been cleared by finalizeObject() so a second collection is needed
+ * if they were retained.
+ */
+static void gcCollectForAllocationFailure() {
+    jboolean retained = retainSoftReferents;
+    clearAllSoftReferents = TRUE;
+    GC_gcollect();
+    if (retained) {
+        GC_gcollect();
+    }
+    clearAllSoftReferents = FALSE;
+}
+
 static inline void* gcAllocateKind(size_t size, uint32_t kind) {
     void* m = GC_generic_malloc(size, kind);
     if (!m) {
         // Force GC and try again
-        GC_gcollect();
+        gcCollectForAllocationFailure();
         m = GC_generic_malloc(size, kind);
     }
     return m;
@@ -539,7 +751,7 @@ void* gcAllocate(size_t size) {
     void* m = GC_MALLOC(size);
     if (!m) {
         // Force GC and try again
-        GC_gcollect();
+        gcCollectForAllocationFailure();
         m = GC_MALLOC(size);
     }
     return m;
@@ -548,7 +760,7 @@ static inline void* gcAllocateObject(size_t size, void* clazz) {
     void* m = GC_gcj_malloc(size, clazz);
     if (!m) {
         // Force GC and try again
-        GC_gcollect();
+        gcCollectForAllocationFailure();
         m = GC_gcj_malloc(size, clazz);
     }
     return m;
@@ -557,7 +769,7 @@ void* gcAllocateUncollectable(size_t size) {
     void* m = GC_MALLOC_UNCOLLECTABLE(size);
     if (!m) {
         // Force GC and try again
-        GC_gcollect();
+        gcCollectForAllocationFailure();
         m = GC_MALLOC_UNCOLLECTABLE(size);
     }
     return m;
@@ -566,7 +778,7 @@ static inline void* gcAllocateAtomic(size_t size) {
     void* m = GC_MALLOC_ATOMIC(size);
     if (!m) {
         // Force GC and try again
-        GC_gcollect();
+        gcCollectForAllocationFailure();
         m = GC_MALLOC_ATOMIC(size);
     }
     if (m) {
@@ -574,11 +786,11 @@ static inline void* gcAllocateAtomic(size_t size) {
     }
     return m;
 }
-static inline void* gcAllocateAtomicUncollectable(size_t size) {
+void* gcAllocateAtomicUncollectable(size_t size) {
     void* m = GC_MALLOC_ATOMIC_UNCOLLECTABLE(size);
     if (!m) {
         // Force GC and try again
-        GC_gcollect();
+        gcCollectForAllocationFailure();
         m = GC_MALLOC_ATOMIC_UNCOLLECTABLE(size);
     }
     if (m) {
@@ -591,6 +803,164 @@ void gcFree(void* ptr) {
     GC_free(ptr);
 }
 
+static jboolean tlabRefill(TlabFreeList* freeList, jint tlabKind, size_t granules) {
+    size_t bytes = granules * GC_GRANULE_BYTES;
+    updateSoftReferencePolicy();
+    if (!freeList->objects) {
+        // GC_generic_malloc_many() may overshoot TLAB_REFILL_BYTES by one object
+        uint32_t capacity = TLAB_REFILL_BYTES / bytes + 1;
+        freeList->objects = gcAllocateUncollectable(capacity * sizeof(void*));
+        if (!freeList->objects) {
+            return FALSE;
+        }
+        freeList->capacity = capacity;
+    }
+
+    // The objects returned by GC_generic_malloc_many() are linked through their
+    // first word. For gcj objects that's where the GC expects the Class* holding
+    // the mark descriptor so a collection must not happen until each object has
+    // been unlinked and stored in the (conservatively scanned) objects array.
+    GC_disable();
+    void* list = NULL;
+    GC_generic_malloc_many(bytes - tlabExtraBytes,
+        tlabKind == TLAB_KIND_GCJ ? GC_gcj_kind : objectArrayGCKind, &list);
+    uint32_t count = 0;
+    while (list) {
+        void* next = *((void**) list);
+        *((void**) list) = NULL;
+        if (freeList->count < freeList->capacity) {
+            freeList->objects[freeList->count++] = list;
+            count++;
+        } else {
+            GC_free(list);
+        }
+        list = next;
+    }
+    GC_enable();
+
+    if (count == 0) {
+        return FALSE;
+    }
+    rvmAtomicAddLong(&tlabRefills, 1);
+    rvmAtomicAddLong(&tlabRefillBytes, count * bytes);
+    return TRUE;
+}
+
+/*
+ * Picks the number of bytes the thread owning the specified TLAB has to
+ * allocate before its next allocation sample is taken. The distance is
+ * randomized (between 0.5 and 1.5 times the interval) so that periodic
+ * allocation patterns don't always sample the same site.
+ */
+static void scheduleNextSample(Tlab* tlab, jint interval) {
+    // xorshift32
+    uint32_t x = tlab->sampleSeed ? tlab->sampleSeed : (uint32_t) (uintptr_t) tlab | 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    tlab->sampleSeed = x;
+    tlab->nextSampleBytes = interval / 2 + x % ((uint32_t) interval + 1);
+}
+
+static inline Tlab* getTlab(Env* env) {
+    Tlab* tlab = env->tlab;
+    if (!tlab) {
+        tlab = gcAllocateUncollectable(sizeof(Tlab));
+        if (tlab) {
+            // Seed the sampling threshold so that the first allocation made
+            // by every thread isn't sampled.
+            jint interval = allocationSampleInterval;
+            if (interval > 0) {
+                scheduleNextSample(tlab, interval);
+            }
+            env->tlab = tlab;
+        }
+    }
+    return tlab;
+}
+
+/*
+ * Returns a cleared object of at least size bytes from the calling thread's
+ * TLAB or NULL if the object is too big or the TLAB couldn't be refilled. In
+ * the latter case the caller should fall back to allocating directly from the
+ * GC which will collect if needed.
+ */
+static inline void* tlabAllocate(Env* env, jint tlabKind, size_t size) {
+    size_t granules = (size + tlabExtraBytes + GC_GRANULE_BYTES - 1) / GC_GRANULE_BYTES;
+    if (granules > TLAB_MAX_GRANULES) {
+        return NULL;
+    }
+    Tlab* tlab = getTlab(env);
+    if (!tlab) {
+        return NULL;
+    }
+    TlabFreeList* freeList = &tlab->freeLists[tlabKind][granules - 1];
+    if (freeList->count == 0 && !tlabRefill(freeList, tlabKind, granules)) {
+        return NULL;
+    }
+    freeList->count--;
+    void* m = freeList->objects[freeList->count];
+    // Don't keep the object reachable through the TLAB once it's been handed out
+    freeList->objects[freeList->count] = NULL;
+    return m;
+}
+
+void gcFreeTlab(Env* env) {
+    Tlab* tlab = env->tlab;
+    if (!tlab) {
+        return;
+    }
+    env->tlab = NULL;
+    jlong wasteBytes = 0;
+    for (jint kind = 0; kind < TLAB_KIND_COUNT; kind++) {
+        for (jint i = 0; i < TLAB_MAX_GRANULES; i++) {
+            TlabFreeList* freeList = &tlab->freeLists[kind][i];
+            // The unused objects will be reclaimed by the next GC
+            wasteBytes += freeList->count * (i + 1) * GC_GRANULE_BYTES;
+            if (freeList->objects) {
+                gcFree(freeList->objects);
+            }
+        }
+    }
+    gcFree(tlab);
+    if (wasteBytes > 0) {
+        rvmAtomicAddLong(&tlabWasteBytes, wasteBytes);
+    }
+}
+
+void gcSetAllocationSampleInterval(jint interval) {
+    allocationSampleInterval = interval > 0 ? interval : 0;
+}
+
+/*
+ * Hands a sample to the allocation profiler once the calling thread has
+ * allocated roughly allocationSampleInterval bytes since the previous one
+ * (see scheduleNextSample()). Each sample is weighted by the number of bytes
+ * allocated since the previous sample.
+ */
+static inline void sampleAllocation(Env* env, Class* clazz, size_t size) {
+    jint interval = allocationSampleInterval;
+    if (interval == 0) {
+        return;
+    }
+    Tlab* tlab = getTlab(env);
+    if (!tlab) {
+        return;
+    }
+    if (tlab->nextSampleBytes == 0) {
+        // The TLAB was created before sampling was enabled
+        scheduleNextSample(tlab, interval);
+    }
+    tlab->sampleBytes += size;
+    if (tlab->sampleBytes < tlab->nextSampleBytes) {
+        return;
+    }
+    jlong bytes = tlab->sampleBytes;
+    tlab->sampleBytes = 0;
+    scheduleNextSample(tlab, interval);
+    allocationProfilerRecordSample(env, clazz, bytes);
+}
+
 /*
  * Adds a reference to the tail of a circular queue of references.
  */
@@ -670,21 +1040,24 @@ static void enqueueReference(Env* env, Object* ref, Object** cleared) {
  * referents.  Cleared references registered to a reference queue are
  * enqueued on the cleared list.
  */
-static void clearAndEnqueueReferences(Env* env, Object** list, Object** cleared) {
+static jint clearAndEnqueueReferences(Env* env, Object** list, Object** cleared) {
     // This code is a port of the clearWhiteReferences() function in Android's MarkSweep.cpp
     assert(list != NULL);
     assert(cleared != NULL);
+    jint count = 0;
     while (*list != NULL) {
         Object* ref = dequeuePendingReference(env, list);
         Object* referent = rvmGetObjectInstanceFieldValue(env, ref, java_lang_ref_Reference_referent);
         if (referent != NULL) {
             clearReference(env, ref);
+            count++;
             if (isEnqueuable(env, ref)) {
                 enqueueReference(env, ref, cleared);
             }
         }
     }
     assert(*list == NULL);
+    return count;
 }
 
 /*
@@ -692,9 +1065,10 @@ static void clearAndEnqueueReferences(Env* env, Object** list, Object** cleared)
  * referent is moved to the zombie field (which makes it reachable again), 
  * and the referent field is cleared.
  */
-static void enqueueFinalizerReferences(Env* env, Object** list, Object** cleared) {
+static jint enqueueFinalizerReferences(Env* env, Object** list, Object** cleared) {
     // This code is a port of the enqueueFinalizerReferences() function in Android's MarkSweep.cpp
     assert(list != NULL);
+    jint count = 0;
     while (*list != NULL) {
         Object* ref = dequeuePendingReference(env, list);
         Object* referent = rvmGetObjectInstanceFieldValue(env, ref, java_lang_ref_Reference_referent);
@@ -706,27 +1080,47 @@ static void enqueueFinalizerReferences(Env* env, Object** list, Object** cleared
             // Clear the referent
             clearReference(env, ref);
             enqueueReference(env, ref, cleared);
+            count++;
         }
     }
     assert(*list == NULL);
+    return count;
 }
 
 static void _finalizeObject(GC_PTR addr, GC_PTR client_data);
 
-static void finalizeObject(Env* env, Object* obj) {
+/*
+ * Returns TRUE if the object was allocated by the GC. Objects emitted
+ * statically by the compiler (String literals and their char[] values) live
+ * in the executable's data. They are never collected and the GC ignores
+ * finalizers registered for them.
+ */
+static inline jboolean isHeapObject(Object* o) {
+    return GC_base(o) != NULL;
+}
+
+static inline ReferentShard* getReferentShard(Object* o) {
+    uintptr_t p = (uintptr_t) o;
+    return &referentShards[((p >> 4) ^ (p >> 12)) & (REFERENT_SHARDS - 1)];
+}
+
+void gcFinalizeObject(Env* env, Object* obj) {
 //    TRACEF("finalizeObject: %p (%s)\n", obj, obj->clazz->name);
 
-    rvmLockMutex(&referentsLock);
+    ReferentShard* shard = getReferentShard(obj);
+    rvmLockMutex(&shard->lock);
     void* key = (void*) GC_HIDE_POINTER(obj);
     ReferentEntry* referentEntry;
-    HASH_FIND_PTR(referents, &key, referentEntry);
+    HASH_FIND_PTR(shard->referents, &key, referentEntry);
 
     assert(referentEntry != NULL);
 
+    rvmAtomicAddLong(&referenceStats.referents, 1);
+
     if (referentEntry->references == NULL) {
         // The object is not referenced by any type of reference and can never be resurrected.
-        HASH_DEL(referents, referentEntry);
-        rvmUnlockMutex(&referentsLock);
+        HASH_DEL(shard->referents, referentEntry);
+        rvmUnlockMutex(&shard->lock);
         // Run all cleanup handlers registered for the object
         CleanupHandlerList* l = referentEntry->cleanupHandlers;
         while (l) {
@@ -742,7 +1136,7 @@ static void finalizeObject(Env* env, Object* obj) {
     Object* weakReferences = NULL;
     Object* finalizerReferences = NULL;
     Object* phantomReferences = NULL;
-    Object* clearedReferences = NULL;
+    Object* cleared = NULL;
 
     ReferenceList* refNode;
     while (referentEntry->references != NULL) {
@@ -763,23 +1157,94 @@ static void finalizeObject(Env* env, Object* obj) {
     }
     assert(referentEntry->references == NULL);
 
-    clearAndEnqueueReferences(env, &softReferences, &clearedReferences);
-    clearAndEnqueueReferences(env, &weakReferences, &clearedReferences);
-    enqueueFinalizerReferences(env, &finalizerReferences, &clearedReferences);
-    clearAndEnqueueReferences(env, &phantomReferences, &clearedReferences);
+    jint softCleared = clearAndEnqueueReferences(env, &softReferences, &cleared);
+    jint weakCleared = clearAndEnqueueReferences(env, &weakReferences, &cleared);
+    jint finalizerEnqueued = enqueueFinalizerReferences(env, &finalizerReferences, &cleared);
+    jint phantomCleared = clearAndEnqueueReferences(env, &phantomReferences, &cleared);
 
     // Reregister for finalization. If no new references have been added to the list of references for the referent the
     // next time it gets finalized we know it will never be resurrected.
     GC_REGISTER_FINALIZER_NO_ORDER(obj, _finalizeObject, NULL, NULL, NULL);
 
-    rvmUnlockMutex(&referentsLock);
+    rvmUnlockMutex(&shard->lock);
+
+    if (softCleared) rvmAtomicAddLong(&referenceStats.softCleared, softCleared);
+    if (weakCleared) rvmAtomicAddLong(&referenceStats.weakCleared, weakCleared);
+    if (finalizerEnqueued) rvmAtomicAddLong(&referenceStats.finalizerEnqueued, finalizerEnqueued);
+    if (phantomCleared) rvmAtomicAddLong(&referenceStats.phantomCleared, phantomCleared);
+
+    if (cleared != NULL) {
+        // Append to the batch flushed by gcFlushClearedReferences()
+        rvmLockMutex(&clearedReferencesLock);
+        while (cleared != NULL) {
+            Object* ref = dequeuePendingReference(env, &cleared);
+            enqueuePendingReference(env, ref, &clearedReferences);
+        }
+        rvmUnlockMutex(&clearedReferencesLock);
+    }
+}
 
-    if (clearedReferences != NULL) {
-        rvmCallVoidClassMethod(env, java_lang_ref_ReferenceQueue, java_lang_ref_ReferenceQueue_add, clearedReferences);
+/*
+ * Hands all references cleared since the previous call to the Java
+ * ReferenceQueue code in a single call.
+ */
+void gcFlushClearedReferences(Env* env) {
+    rvmLockMutex(&clearedReferencesLock);
+    Object* list = clearedReferences;
+    clearedReferences = NULL;
+    rvmUnlockMutex(&clearedReferencesLock);
+    if (list != NULL) {
+        rvmAtomicAddLong(&referenceStats.enqueueBatches, 1);
+        rvmCallVoidClassMethod(env, java_lang_ref_ReferenceQueue, java_lang_ref_ReferenceQueue_add, list);
         assert(rvmExceptionOccurred(env) == NULL);
     }
 }
 
+/*
+ * Runs the GC finalization callbacks on the current thread until the GC has
+ * no more objects ready for finalization. Once the finalizer threads have
+ * been started (see finalizer.c) the callbacks only queue the objects for
+ * the finalizer threads. Otherwise the objects are processed right away and
+ * the references cleared by them are enqueued. Only one thread runs the
+ * callbacks at a time. Other threads return immediately and leave the work
+ * to that thread which checks for more work after it has cleared
+ * invokingFinalizers.
+ */
+void gcInvokeFinalizers(Env* env) {
+    while (GC_should_invoke_finalizers()) {
+        if (!rvmAtomicCompareAndSwapInt(&invokingFinalizers, 0, 1)) {
+            return;
+        }
+        updateSoftReferencePolicy();
+        Object* throwable = rvmExceptionClear(env);
+        jint count;
+        do {
+            count = GC_invoke_finalizers();
+            gcFlushClearedReferences(env);
+        } while (count > 0);
+        finalizerNotify(env);
+        if (throwable) {
+            rvmThrow(env, throwable);
+        }
+        rvmAtomicStoreInt(&invokingFinalizers, 0);
+    }
+}
+
+/*
+ * Called by the GC (without the GC lock held) when there are objects ready
+ * for finalization. The GC calls this at most once per collection so the
+ * notification must not be dropped. If the current thread can't run the
+ * callbacks (it isn't attached) a finalizer thread is asked to do it.
+ */
+static void finalizerNotifier(void) {
+    Env* env = rvmGetEnv();
+    if (!rvmHasCurrentThread(env)) {
+        finalizerRequestInvoke();
+        return;
+    }
+    gcInvokeFinalizers(env);
+}
+
 static void _finalizeObject(GC_PTR addr, GC_PTR client_data) {
     Object* obj = (Object*) addr;
     Env* env = rvmGetEnv();
@@ -787,7 +1252,9 @@ static void _finalizeObject(GC_PTR addr, GC_PTR client_data) {
     // first triggers a GC. If there are finalize objects this function will be called with no Env associated 
     // with the current thread. In such cases we reregister the object for finalization and it will be finalized later.
     if (rvmHasCurrentThread(env)) {
-        finalizeObject(env, obj);
+        if (!finalizerEnqueue(env, obj)) {
+            gcFinalizeObject(env, obj);
+        }
     } else {
         GC_REGISTER_FINALIZER_NO_ORDER(obj, _finalizeObject, NULL, NULL, NULL);
     }
@@ -801,47 +1268,65 @@ void rvmRegisterFinalizer(Env* env, Object* obj) {
 
 /**
  * Returns the ReferentEntry for the specified object or creates one and adds
- * it to the referents hash if none exists. referentsLock MUST be held.
+ * it to the shard's referents hash if none exists. The shard's lock MUST be
+ * held.
  */
-static ReferentEntry* getReferentEntryForObject(Env* env, Object* o) {
+static ReferentEntry* getReferentEntryForObject(Env* env, ReferentShard* shard, Object* o) {
     void* key = (void*) GC_HIDE_POINTER(o); // Hide the pointer from the GC so that the key doesn't prevent the object from being GCed.
     ReferentEntry* referentEntry;
-    HASH_FIND_PTR(referents, &key, referentEntry);
+    HASH_FIND_PTR(shard->referents, &key, referentEntry);
     if (!referentEntry) {
         // Object is not in the hashtable. Add it.
         referentEntry = allocateMemoryOfKind(env, sizeof(ReferentEntry), referentEntryGCKind);
         if (!referentEntry) return NULL; // OOM thrown
         referentEntry->key = key;
-        HASH_ADD_PTR(referents, key, referentEntry);
+        HASH_ADD_PTR(shard->referents, key, referentEntry);
     }
     return referentEntry;
 }
 
 void registerCleanupHandler(Env* env, Object* object, CleanupHandler handler) {
-    rvmLockMutex(&referentsLock);
-    CleanupHandlerList* l = rvmAllocateMemory(env, sizeof(CleanupHandlerList));
+    if (!isHeapObject(object)) {
+        // The object is never collected so the handler would never run.
+        // A ReferentEntry would never be removed.
+        return;
+    }
+    ReferentShard* shard = getReferentShard(object);
+    rvmLockMutex(&shard->lock);
+    ReferentEntry* referentEntry = getReferentEntryForObject(env, shard, object);
+    if (!referentEntry) goto done;
+    // Monitors may be inflated and deflated many times for the same object.
+    // Only register each handler once.
+    CleanupHandlerList* l = NULL;
+    LL_SEARCH_SCALAR(referentEntry->cleanupHandlers, l, handler, handler);
+    if (l) goto done;
+    l = rvmAllocateMemory(env, sizeof(CleanupHandlerList));
     if (!l) goto done; // OOM thrown
     l->handler = handler;
-    ReferentEntry* referentEntry = getReferentEntryForObject(env, object);
-    if (!referentEntry) goto done;
     // Add the handler to the object's list of cleanup handlers
     LL_PREPEND(referentEntry->cleanupHandlers, l);
     // Register the referent for finalization
     GC_REGISTER_FINALIZER_NO_ORDER(object, _finalizeObject, NULL, NULL, NULL);
 
 done:
-    rvmUnlockMutex(&referentsLock);
+    rvmUnlockMutex(&shard->lock);
 }
 
 void rvmRegisterReference(Env* env, Object* reference, Object* referent) {
-    if (referent) {
-        // Add 'reference' to the references list for 'referent' in the referents hashtable
-        rvmLockMutex(&referentsLock);
+    if (referent && isHeapObject(referent)) {
+        // Non-heap referents are never cleared. Tracking them would pin the
+        // references (and e.g. WeakHashMap values) forever since their
+        // ReferentEntry would never be finalized and removed.
 
+        // Allocate outside of the lock
         ReferenceList* l = rvmAllocateMemory(env, sizeof(ReferenceList));
-        if (!l) goto done; // OOM thrown
+        if (!l) return; // OOM thrown
         l->reference = reference;
-        ReferentEntry* referentEntry = getReferentEntryForObject(env, referent);
+
+        // Add 'reference' to the references list for 'referent' in the referents hashtable
+        ReferentShard* shard = getReferentShard(referent);
+        rvmLockMutex(&shard->lock);
+        ReferentEntry* referentEntry = getReferentEntryForObject(env, shard, referent);
         if (!referentEntry) goto done;
         // Add the reference to the referent's list of references
         LL_PREPEND(referentEntry->references, l);
@@ -849,7 +1334,18 @@ void rvmRegisterReference(Env* env, Object* reference, Object* referent) {
         GC_REGISTER_FINALIZER_NO_ORDER(referent, _finalizeObject, NULL, NULL, NULL);
 
 done:
-        rvmUnlockMutex(&referentsLock);
+        rvmUnlockMutex(&shard->lock);
+    }
+}
+
+void rvmGetReferenceStats(Env* env, ReferenceStats* total, ReferenceStats* lastGc) {
+    jlong* src = (jlong*) &referenceStats;
+    jlong* dst = (jlong*) total;
+    for (jint i = 0; i < (jint) (sizeof(ReferenceStats) / sizeof(jlong)); i++) {
+        dst[i] = rvmAtomicLoadLong(&src[i]);
+    }
+    if (lastGc) {
+        *lastGc = referenceStatsLastGc;
     }
 }
 
@@ -864,7 +1360,10 @@ void rvmUnregisterDisappearingLink(Env* env, void** address) {
 jboolean rvmInitMemory(Env* env) {
     vm = env->vm;
 
-    gcAddRoot(&referents);
+    for (jint i = 0; i < REFERENT_SHARDS; i++) {
+        gcAddRoot(&referentShards[i].referents);
+    }
+    gcAddRoot(&clearedReferences);
 
     java_lang_ref_Reference_referent = rvmGetInstanceField(env, java_lang_ref_Reference, "referent", "Ljava/lang/Object;");
     if (!java_lang_ref_Reference_referent) return FALSE;
@@ -987,17 +1486,24 @@ Class* rvmAllocateMemoryForClass(Env* env, jint classDataSize) {
 }
 
 Object* rvmAllocateMemoryForObject(Env* env, Class* clazz) {
-    Object* m = (Object*) gcAllocateObject(clazz->instanceDataSize, clazz);
-    if (!m) {
-        if (clazz == java_lang_OutOfMemoryError) {
-            // We can't even allocate an OutOfMemoryError object. Prevent
-            // infinite recursion by returning the shared criticalOutOfMemoryError
-            // object.
-            return criticalOutOfMemoryError;
+    Object* m = (Object*) tlabAllocate(env, TLAB_KIND_GCJ, clazz->instanceDataSize);
+    if (m) {
+        // Same as GC_gcj_malloc()
+        m->clazz = clazz;
+    } else {
+        m = (Object*) gcAllocateObject(clazz->instanceDataSize, clazz);
+        if (!m) {
+            if (clazz == java_lang_OutOfMemoryError) {
+                // We can't even allocate an OutOfMemoryError object. Prevent
+                // infinite recursion by returning the shared criticalOutOfMemoryError
+                // object.
+                return criticalOutOfMemoryError;
+            }
+            rvmThrowOutOfMemoryError(env);
+            return NULL;
         }
-        rvmThrowOutOfMemoryError(env);
-        return NULL;
     }
+    sampleAllocation(env, clazz, clazz->instanceDataSize);
     return m;
 }
 
@@ -1009,20 +1515,28 @@ Array* rvmAllocateMemoryForArray(Env* env, Class* arrayClass, jint length) {
     }
     Array* m = NULL;
     if (CLASS_IS_PRIMITIVE(arrayClass->componentType)) {
-        m = (Array*) gcAllocateObject((size_t) size, arrayClass);
+        m = (Array*) tlabAllocate(env, TLAB_KIND_GCJ, (size_t) size);
+        if (m) {
+            // Same as GC_gcj_malloc()
+            m->object.clazz = arrayClass;
+        } else {
+            m = (Array*) gcAllocateObject((size_t) size, arrayClass);
+        }
     } else {
         // Object array. Conservatively scanned. Only the lock (if thin) 
         // and the length fields could become a problem if they look like 
-        // pointers into the heap.
-        // TODO: This doesn't benefit from thread local allocation. We
-        // could have used gcAllocate() but that would have made object
-        // arrays invisible to the heapDumpCallback().
-        m = (Array*) gcAllocateKind((size_t) size, objectArrayGCKind);
+        // pointers into the heap. Small arrays are allocated from the TLAB
+        // since GC_generic_malloc() doesn't use thread local free lists.
+        m = (Array*) tlabAllocate(env, TLAB_KIND_OBJECT_ARRAY, (size_t) size);
+        if (!m) {
+            m = (Array*) gcAllocateKind((size_t) size, objectArrayGCKind);
+        }
     }
     if (!m) {
         rvmThrowOutOfMemoryError(env);
         return NULL;
     }
+    sampleAllocation(env, arrayClass, (size_t) size);
     return m;
 }
 
@@ -1080,20 +1594,106 @@ jboolean rvmInitRefTable(Env* env, RefTable* refTable, jint size) {
     return TRUE;
 }
 
+static inline uint32_t hashGlobalRef(Object* object) {
+    uint64_t h = (uint64_t) (uintptr_t) object * 0x9e3779b97f4a7c15ULL;
+    return (uint32_t) (h >> 32);
+}
+
+/*
+ * Returns the slot holding object or NULL if not found. Must be called with
+ * the globalRefsLock held.
+ */
+static GlobalRefSlot* findGlobalRefSlot(Object* object) {
+    if (!globalRefSlots) return NULL;
+    uint32_t mask = globalRefsCapacity - 1;
+    uint32_t i = hashGlobalRef(object) & mask;
+    for (;;) {
+        GlobalRefSlot* slot = &globalRefSlots[i];
+        if (slot->object == object) return slot;
+        if (!slot->object) return NULL;
+        i = (i + 1) & mask;
+    }
+}
+
+/*
+ * Rehashes all objects into a new table large enough to hold at least one
+ * more object. Tombstones are dropped. Must be called with the
+ * globalRefsLock held.
+ */
+static jboolean resizeGlobalRefs(Env* env) {
+    jint capacity = globalRefsCapacity ? globalRefsCapacity : GLOBAL_REFS_INITIAL_SIZE;
+    while ((globalRefsObjects + 1) * 2 > capacity) {
+        capacity <<= 1;
+    }
+    GlobalRefSlot* slots = rvmAllocateMemoryUncollectable(env, capacity * sizeof(GlobalRefSlot));
+    if (!slots) {
+        return FALSE;
+    }
+    uint32_t mask = capacity - 1;
+    for (jint j = 0; j < globalRefsCapacity; j++) {
+        GlobalRefSlot* slot = &globalRefSlots[j];
+        if (slot->object && slot->object != GLOBAL_REF_TOMBSTONE) {
+            uint32_t i = hashGlobalRef(slot->object) & mask;
+            while (slots[i].object) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = *slot;
+        }
+    }
+    if (globalRefSlots) {
+        rvmFreeMemoryUncollectable(env, globalRefSlots);
+    }
+    globalRefSlots = slots;
+    globalRefsCapacity = capacity;
+    globalRefsUsed = globalRefsObjects;
+    return TRUE;
+}
+
+/*
+ * Drops one reference to object from the global refs table. Must be called
+ * with the globalRefsLock held.
+ */
+static jboolean removeGlobalRef(Object* object) {
+    GlobalRefSlot* slot = findGlobalRefSlot(object);
+    if (!slot) {
+        return FALSE;
+    }
+    globalRefsCount--;
+    if (--slot->count == 0) {
+        slot->object = GLOBAL_REF_TOMBSTONE;
+        globalRefsObjects--;
+    }
+    return TRUE;
+}
+
 jboolean rvmAddGlobalRef(Env* env, Object* object) {
     if (!object) {
         return TRUE;
     }
     rvmLockMutex(&globalRefsLock);
-    if (!globalRefs.entries) {
-        if (!rvmInitRefTable(env, &globalRefs, GLOBAL_REFS_INITIAL_SIZE)) {
+    GlobalRefSlot* slot = findGlobalRefSlot(object);
+    if (!slot) {
+        if ((globalRefsUsed + 1) * 4 > globalRefsCapacity * 3 && !resizeGlobalRefs(env)) {
             rvmUnlockMutex(&globalRefsLock);
             return FALSE;
         }
+        uint32_t mask = globalRefsCapacity - 1;
+        uint32_t i = hashGlobalRef(object) & mask;
+        while (globalRefSlots[i].object && globalRefSlots[i].object != GLOBAL_REF_TOMBSTONE) {
+            i = (i + 1) & mask;
+        }
+        slot = &globalRefSlots[i];
+        if (!slot->object) {
+            globalRefsUsed++;
+        }
+        slot->object = object;
+        slot->count = 0;
+        globalRefsObjects++;
     }
-    jboolean result = rvmAddRef(env, &globalRefs, object);
+    slot->count++;
+    globalRefsCount++;
     rvmUnlockMutex(&globalRefsLock);
-    return result;
+    return TRUE;
 }
 
 jboolean rvmRemoveGlobalRef(Env* env, Object* object) {
@@ -1101,11 +1701,20 @@ jboolean rvmRemoveGlobalRef(Env* env, Object* object) {
         return TRUE;
     }
     rvmLockMutex(&globalRefsLock);
-    jboolean result = rvmRemoveRef(env, &globalRefs, object);
+    jboolean result = removeGlobalRef(object);
     rvmUnlockMutex(&globalRefsLock);
     return result;
 }
 
+void rvmGetGlobalRefStats(Env* env, GlobalRefStats* stats) {
+    rvmLockMutex(&globalRefsLock);
+    stats->capacity = globalRefsCapacity;
+    stats->objects = globalRefsObjects;
+    stats->tombstones = globalRefsUsed - globalRefsObjects;
+    stats->refs = globalRefsCount;
+    rvmUnlockMutex(&globalRefsLock);
+}
+
 jboolean rvmAddRef(Env* env, RefTable* refTable, Object* object) {
     jint index = refTable->count;
     if (index >= refTable->size) {
@@ -1216,3 +1825,9 @@ jlong rvmGetDirectBufferCapacity(Env* env, Object* buf) {
 void rvmGenerateHeapDump(Env* env) {
     gcHeapDump(env);
 }
+
+void rvmGetTlabStats(Env* env, TlabStats* stats) {
+    stats->refills = rvmAtomicLoadLong(&tlabRefills);
+    stats->refillBytes = rvmAtomicLoadLong(&tlabRefillBytes);
+    stats->wasteBytes = rvmAtomicLoadLong(&tlabWasteBytes);
+}
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include <bugvm.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unwind.h>
 #include "private.h"
@@ -25,6 +26,16 @@
 // for methods which have no line number info.
 #define FIRST_NO_LINE_NUMBERS_LINE 0x00100000
 
+#define CALL_STACK_BUFFER_INITIAL_CAPACITY 64
+
+// Per thread scratch buffer the frames are collected in before being
+// copied into an exactly sized CallStack.
+struct CallStackBuffer {
+    jint length;
+    jint capacity;
+    CallStackFrame* frames;
+};
+
 DynamicLib* bootNativeLibs = NULL;
 DynamicLib* mainNativeLibs = NULL;
 
@@ -40,6 +51,10 @@ static ObjectArray* empty_java_lang_StackTraceElement_array = NULL;
 // frames. dumpThreadStackTrace() assumes MAX_CALL_STACK_LENGTH.
 static CallStack* shared_callStack = NULL;
 
+// The maximum number of frames captured by rvmCaptureCallStack(). Set
+// using -rvm:MaxStackTraceDepth=<n>. Never larger than MAX_CALL_STACK_LENGTH.
+static jint maxCallStackLength = MAX_CALL_STACK_LENGTH;
+
 static inline void obtainNativeLibsLock() {
     rvmLockMutex(&nativeLibsLock);
 }
@@ -57,14 +72,7 @@ static inline void releaseThreadStackTraceLock() {
 }
 
 static Method* findMethod(Env* env, Class* clazz, const char* name, const char* desc) {
-    Method* method = rvmGetMethods(env, clazz);
-    if (rvmExceptionCheck(env)) return NULL;
-    for (; method != NULL; method = method->next) {
-        if (!strcmp(method->name, name) && !strcmp(method->desc, desc)) {
-            return method;
-        }
-    }
-    return NULL;
+    return indexedMethod(env, clazz, name, desc);
 }
 
 static Method* getMethod(Env* env, Class* clazz, const char* name, const char* desc) {
@@ -105,6 +113,14 @@ static Method* getMethod(Env* env, Class* clazz, const char* name, const char* d
     return NULL;
 }
 
+static Method* lookupMethod(Env* env, Class* clazz, const char* name, const char* desc) {
+    if (isMethodMiss(clazz, name, desc)) return NULL;
+    Method* method = getMethod(env, clazz, name, desc);
+    if (rvmExceptionCheck(env)) return NULL;
+    if (!method) addMethodMiss(clazz, name, desc);
+    return method;
+}
+
 jboolean rvmInitMethods(Env* env) {
     if (rvmInitMutex(&nativeLibsLock) != 0) {
         return FALSE;
@@ -112,6 +128,10 @@ jboolean rvmInitMethods(Env* env) {
     if (rvmInitMutex(&threadStackTraceLock) != 0) {
         return FALSE;
     }
+    jint maxLength = env->vm->options->maxCallStackLength;
+    if (maxLength > 0 && maxLength < MAX_CALL_STACK_LENGTH) {
+        maxCallStackLength = maxLength;
+    }
     java_lang_StackTraceElement = rvmFindClassUsingLoader(env, "java/lang/StackTraceElement", NULL);
     if (!java_lang_StackTraceElement) {
         return FALSE;
@@ -133,13 +153,13 @@ jboolean rvmInitMethods(Env* env) {
 }
 
 jboolean rvmHasMethod(Env* env, Class* clazz, const char* name, const char* desc) {
-    Method* method = getMethod(env, clazz, name, desc);
+    Method* method = lookupMethod(env, clazz, name, desc);
     if (rvmExceptionCheck(env)) return FALSE;
     return method ? TRUE : FALSE;
 }
 
 Method* rvmGetMethod(Env* env, Class* clazz, const char* name, const char* desc) {
-    Method* method = getMethod(env, clazz, name, desc);
+    Method* method = lookupMethod(env, clazz, name, desc);
     if (rvmExceptionCheck(env)) return NULL;
     if (!method) {
         rvmThrowNoSuchMethodError(env, name);
@@ -160,7 +180,7 @@ Method* rvmGetClassMethod(Env* env, Class* clazz, const char* name, const char*
 }
 
 Method* rvmGetClassInitializer(Env* env, Class* clazz) {
-    return getMethod(env, clazz, "<clinit>", "()V");
+    return lookupMethod(env, clazz, "<clinit>", "()V");
 }
 
 Method* rvmGetInstanceMethod(Env* env, Class* clazz, const char* name, const char* desc) {
@@ -175,19 +195,11 @@ Method* rvmGetInstanceMethod(Env* env, Class* clazz, const char* name, const cha
 }
 
 Method* rvmFindMethodAtAddress(Env* env, void* address) {
-    Class* clazz = env->vm->options->findClassAt(env, address);
-    if (!clazz) return NULL;
-    Method* method = rvmGetMethods(env, clazz);
-    if (rvmExceptionCheck(env)) return NULL;
-    for (; method != NULL; method = method->next) {
-        void* start = method->impl;
-        void* end = start + method->size;
-        if (start && address >= start && address < end) {
-            return method;
-        }
-    }
-    // TODO: We should never end up here
-    return NULL;
+    return env->vm->options->findMethodAt(env, address, TRUE);
+}
+
+Method* rvmFindResolvedMethodAtAddress(Env* env, void* address) {
+    return env->vm->options->findMethodAt(env, address, FALSE);
 }
 
 static jboolean getCallingMethodIterator(Env* env, void* pc, void* fp, ProxyMethod* proxyMethod, void* data) {
@@ -207,12 +219,6 @@ Method* rvmGetCallingMethod(Env* env) {
     return result;
 }
 
-static jboolean captureCallStackCountFramesIterator(Env* env, void* pc, void* fp, ProxyMethod* proxyMethod, void* data) {
-    jint* countPtr = (jint*) data;
-    *countPtr += 1;
-    return *countPtr < MAX_CALL_STACK_LENGTH ? TRUE : FALSE;
-}
-
 typedef struct {
     CallStack* data;
     jint maxLength;
@@ -228,10 +234,50 @@ static jboolean captureCallStackIterator(Env* env, void* pc, void* fp, ProxyMeth
     return data->length < args->maxLength ? TRUE : FALSE;
 }
 
-jint countCallStackFrames(Env* env, Frame* fp) {
-    jint count = 0;
-    unwindIterateCallStack(env, fp, captureCallStackCountFramesIterator, &count);
-    return count;
+static jboolean captureCallStackBufferIterator(Env* env, void* pc, void* fp, ProxyMethod* proxyMethod, void* data) {
+    CallStackBuffer* buffer = (CallStackBuffer*) data;
+    if (buffer->length == buffer->capacity) {
+        jint capacity = buffer->capacity << 1;
+        if (capacity > maxCallStackLength) capacity = maxCallStackLength;
+        CallStackFrame* frames = realloc(buffer->frames, sizeof(CallStackFrame) * capacity);
+        if (!frames) {
+            return FALSE; // Truncate the call stack rather than fail
+        }
+        buffer->frames = frames;
+        buffer->capacity = capacity;
+    }
+    CallStackFrame* frame = &buffer->frames[buffer->length++];
+    frame->pc = pc;
+    frame->fp = fp;
+    frame->method = (Method*) proxyMethod;
+    frame->lineNumber = 0;
+    return buffer->length < maxCallStackLength ? TRUE : FALSE;
+}
+
+static CallStackBuffer* getCallStackBuffer(Env* env) {
+    CallStackBuffer* buffer = env->callStackBuffer;
+    if (!buffer) {
+        buffer = calloc(1, sizeof(CallStackBuffer));
+        if (!buffer) return NULL;
+        buffer->capacity = CALL_STACK_BUFFER_INITIAL_CAPACITY < maxCallStackLength
+                ? CALL_STACK_BUFFER_INITIAL_CAPACITY : maxCallStackLength;
+        buffer->frames = malloc(sizeof(CallStackFrame) * buffer->capacity);
+        if (!buffer->frames) {
+            free(buffer);
+            return NULL;
+        }
+        env->callStackBuffer = buffer;
+    }
+    return buffer;
+}
+
+void freeCallStackBuffer(Env* env) {
+    CallStackBuffer* buffer = env->callStackBuffer;
+    if (buffer) {
+        env->callStackBuffer = NULL;
+        free(buffer->frames);
+        free(buffer);
+    }
 }
 
 CallStack* allocateCallStackFrames(Env* env, jint maxLength) {
@@ -243,13 +289,29 @@ void captureCallStack(Env* env, Frame* fp, CallStack* data, jint maxLength) {
     unwindIterateCallStack(env, fp, captureCallStackIterator, &args);
 }
 
+/*
+ * Walks the stack once collecting the frames in the thread's scratch
+ * buffer and then copies them into a CallStack of the exact size. Only
+ * PCs (and ProxyMethods) are recorded here. Methods and line numbers are
+ * resolved lazily by rvmResolveCallStackFrame() when the stack trace is
+ * actually requested.
+ */
 CallStack* captureCallStackFromFrame(Env* env, Frame* fp) {
-    jint count = countCallStackFrames(env, fp);
+    CallStackBuffer* buffer = getCallStackBuffer(env);
+    if (!buffer) {
+        rvmThrowOutOfMemoryError(env);
+        return NULL;
+    }
+    buffer->length = 0;
+    unwindIterateCallStack(env, fp, captureCallStackBufferIterator, buffer);
     if (rvmExceptionOccurred(env)) return NULL;
-    CallStack* data = allocateCallStackFrames(env, count);
+    jint length = buffer->length;
+    CallStack* data = allocateCallStackFrames(env, length);
     if (!data) return NULL;
-    captureCallStack(env, fp, data, count);
-    if (rvmExceptionOccurred(env)) return NULL;
+    // Allocating may have thrown an OutOfMemoryError which captures a
+    // call stack into the same buffer but then we never get here.
+    memcpy(data->frames, buffer->frames, sizeof(CallStackFrame) * length);
+    data->length = length;
     return data;
 }
 
@@ -34,6 +34,7 @@
  */
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
@@ -41,12 +42,28 @@
 #include <sys/time.h>
 #include <errno.h>
 #include <assert.h>
+#if defined(LINUX)
+#   include <linux/futex.h>
+#   include <sys/syscall.h>
+#endif
+#if defined(DARWIN)
+#   include <mach/mach_time.h>
+#endif
 
 #include <bugvm.h>
 #include "private.h"
+#include "utlist.h"
 
 #define LOG_TAG "core.monitor"
 
+/*
+ * Values of Thread.parkState. Only the thread itself moves its state from
+ * PARK_EMPTY to PARK_PARKED. Any thread may set PARK_PERMIT.
+ */
+#define PARK_EMPTY 0
+#define PARK_PERMIT 1
+#define PARK_PARKED -1
+
 typedef uint32_t u4;
 typedef int32_t s4;
 typedef uint64_t u8;
@@ -108,6 +125,19 @@ static inline int android_atomic_acquire_cas(LW_TYPE old_value, LW_TYPE new_valu
 }
 #endif
 
+/*
+ * Hints to the CPU that we're in a spin loop.
+ */
+static inline void cpuRelax(void) {
+#if defined(RVM_X86) || defined(RVM_X86_64)
+    __asm__ __volatile__ ("pause" : : : "memory");
+#elif defined(RVM_ARMV7) || defined(RVM_THUMBV7) || defined(RVM_ARM64)
+    __asm__ __volatile__ ("yield" : : : "memory");
+#else
+    __sync_synchronize();
+#endif
+}
+
 /*
  * Every Object has a monitor associated with it, but not every Object is
  * actually locked.  Even the ones that are locked do not need a
@@ -121,15 +151,28 @@ static inline int android_atomic_acquire_cas(LW_TYPE old_value, LW_TYPE new_valu
  *
  * The two states of an Object's lock are referred to as "thin" and
  * "fat".  A lock may transition from the "thin" state to the "fat"
- * state and this transition is referred to as inflation.  Once a lock
- * has been inflated it remains in the "fat" state indefinitely.
+ * state and this transition is referred to as inflation.  BugVM note:
+ * Unlike Dalvik an inflated lock which is found to be idle at the start
+ * of a GC is deflated back to the "thin" state (see deflateMonitors()).
  *
  * The lock value itself is stored in Object.lock.  The LSB of the
  * lock encodes its state.  When cleared, the lock is in the "thin"
  * state and its bits are formatted as follows:
  *
- *    [31 ---- 19] [18 ---- 3] [2 ---- 1] [0]
- *     lock count   thread id  hash state  0
+ *    [31 ---- 21] [20] [19] [18 ---- 3] [2 ---- 1] [0]
+ *     lock count    S    R   thread id  hash state  0
+ *
+ * BugVM note: The R and S bits implement lock reservation as described in
+ * Kawachiya et al.'s "Lock Reservation: Java Locks Can Mostly Do Without
+ * Atomic Operations" (OOPSLA 2002).  The first thread to lock an object
+ * reserves the lock by setting R and its thread id.  While R is set the
+ * lock count is the number of times the reserving thread holds the lock
+ * (0 means unlocked) and only the reserving thread updates the lock word,
+ * using plain loads and stores.  Another thread which wants the lock
+ * cancels the reservation while the reserving thread is stopped in a
+ * signal handler (see revokeReservation()).  This turns the lock word
+ * into an ordinary thin lock with S set.  S means the object is shared
+ * and is never reserved again.
  *
  * When set, the lock is in the "fat" state and its bits are formatted
  * as follows:
@@ -184,10 +227,25 @@ static inline int android_atomic_acquire_cas(LW_TYPE old_value, LW_TYPE new_valu
  * Lock recursion count field.  Contains a count of the numer of times
  * a lock has been recursively acquired.
  */
-#define LW_LOCK_COUNT_MASK 0x1fff
-#define LW_LOCK_COUNT_SHIFT 19
+#define LW_LOCK_COUNT_MASK 0x7ff
+#define LW_LOCK_COUNT_SHIFT 21
 #define LW_LOCK_COUNT(x) (((x) >> LW_LOCK_COUNT_SHIFT) & LW_LOCK_COUNT_MASK)
 
+/*
+ * Lock reservation bits.  LW_RESERVED is set while the lock is reserved for
+ * the thread in the owner field.  LW_SHARED is set once a reservation has
+ * been cancelled or the lock has been inflated and prevents the lock from
+ * being reserved again.
+ */
+#define LW_RESERVED (1 << 19)
+#define LW_SHARED (1 << 20)
+#define LW_IS_RESERVED(x) (((x) & LW_RESERVED) != 0)
+
+/*
+ * The bits which survive unlocking a thin lock.
+ */
+#define LW_UNLOCKED_MASK ((LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT) | LW_SHARED)
+
 /*
  * Returns TRUE if the lock has been fattened.
  */
@@ -207,37 +265,114 @@ static inline int android_atomic_acquire_cas(LW_TYPE old_value, LW_TYPE new_valu
  * TODO: the various members of monitor are not SMP-safe.
  */
 
-static Monitor* threadSleepMonitor;
+/*
+ * Spin limits used before a contending thread blocks or sleeps. Each fat
+ * monitor adapts its own limit: it's doubled when a spinning thread
+ * acquires the monitor (the owner tends to hold it briefly) and halved when
+ * spinning fails. Contended thin locks use a global limit adapted the same
+ * way. The limits are zero on uniprocessors where spinning is pointless.
+ */
+#define MIN_SPIN_LIMIT 16
+#define DEFAULT_SPIN_LIMIT 256
+#define MAX_SPIN_LIMIT 8192
+
 static void freeMonitorCleanupHandler(Env* env, Object* object);
 
+static jboolean lockReservationEnabled = TRUE;
+static jint maxSpinLimit = MAX_SPIN_LIMIT;
+static jint thinLockSpinLimit = DEFAULT_SPIN_LIMIT;
+
+/*
+ * All monitors currently associated with an object. Monitors are never
+ * freed once created. A thread may read a fat lock word and then be
+ * preempted before it locks the monitor while the monitor is deflated. By
+ * keeping deflated monitors in a pool for reuse the monitor memory stays
+ * valid and the thread will notice that mon->obj has changed once it has
+ * the monitor locked.
+ */
+static Mutex monitorsLock;
+static Monitor* inflatedMonitors = NULL;
+static Monitor* freeMonitors = NULL;
+static jboolean deflationEnabled = FALSE;
+
 jboolean rvmInitMonitors(Env* env) {
-    threadSleepMonitor = rvmCreateMonitor(env, NULL);
+    if (rvmInitMutex(&monitorsLock) != 0) {
+        return FALSE;
+    }
+    if (sysconf(_SC_NPROCESSORS_ONLN) <= 1) {
+        maxSpinLimit = 0;
+        thinLockSpinLimit = 0;
+    }
+    lockReservationEnabled = !env->vm->options->disableLockReservation;
+    deflationEnabled = TRUE;
     return TRUE;
 }
 
+static inline jint growSpinLimit(jint limit) {
+    limit = limit < MIN_SPIN_LIMIT ? MIN_SPIN_LIMIT : limit * 2;
+    return limit > maxSpinLimit ? maxSpinLimit : limit;
+}
+
+static inline jint shrinkSpinLimit(jint limit) {
+    // Never go below MIN_SPIN_LIMIT or we would never find out that
+    // spinning has become worthwhile again.
+    limit /= 2;
+    limit = limit < MIN_SPIN_LIMIT ? MIN_SPIN_LIMIT : limit;
+    return limit > maxSpinLimit ? maxSpinLimit : limit;
+}
+
 /*
  * Create and initialize a monitor.
  */
 Monitor* rvmCreateMonitor(Env* env, Object* obj) {
-    Monitor* mon;
+    Monitor* mon = NULL;
 
-    mon = (Monitor*) rvmAllocateMemoryAtomicUncollectable(env, sizeof(Monitor));
-    if (mon == NULL) {
-        rvmAbort("Unable to allocate monitor");
-    }
-    if (((LW_TYPE)mon & 7) != 0) {
-        rvmAbort("Misaligned monitor: %p", mon);
+    if (obj) {
+        rvmLockMutex(&monitorsLock);
+        mon = freeMonitors;
+        if (mon) {
+            LL_DELETE(freeMonitors, mon);
+        }
+        rvmUnlockMutex(&monitorsLock);
     }
-    mon->obj = obj;
-    rvmInitMutex(&mon->lock);
 
-    if (obj) {
-        registerCleanupHandler(env, obj, freeMonitorCleanupHandler);
+    if (mon) {
+        /*
+         * Reuse a deflated monitor. Don't reset waiters or the mutex.
+         * Threads which read the old lock word may still be using them.
+         */
+        rvmLockMutex(&mon->lock);
+        mon->obj = obj;
+        rvmUnlockMutex(&mon->lock);
+    } else {
+        mon = (Monitor*) rvmAllocateMemoryAtomicUncollectable(env, sizeof(Monitor));
+        if (mon == NULL) {
+            rvmAbort("Unable to allocate monitor");
+        }
+        if (((LW_TYPE)mon & 7) != 0) {
+            rvmAbort("Misaligned monitor: %p", mon);
+        }
+        mon->obj = obj;
+        rvmInitMutex(&mon->lock);
     }
+    mon->spinLimit = maxSpinLimit > 0 ? DEFAULT_SPIN_LIMIT : 0;
 
     return mon;
 }
 
+/*
+ * Makes a monitor whose fat lock word has been published visible to
+ * deflateMonitors() and arranges for it to be pooled when the object dies.
+ * Must not be called before the fat lock word is in place: registering the
+ * cleanup handler may allocate and trigger a GC.
+ */
+static void registerInflatedMonitor(Env* env, Monitor* mon) {
+    rvmLockMutex(&monitorsLock);
+    DL_APPEND(inflatedMonitors, mon);
+    rvmUnlockMutex(&monitorsLock);
+    registerCleanupHandler(env, mon->obj, freeMonitorCleanupHandler);
+}
+
 /*
  * Get the object that a monitor is part of.
  */
@@ -248,6 +383,186 @@ Object* rvmGetMonitorObject(Monitor* mon) {
         return mon->obj;
 }
 
+/*
+ * Returns the thread id of the thread holding the given thin lock or 0 if
+ * the lock isn't held.  A reserved lock is only held if its count is > 0.
+ */
+static inline u4 thinLockHolder(LW_TYPE thin) {
+    if (LW_IS_RESERVED(thin) && LW_LOCK_COUNT(thin) == 0) {
+        return 0;
+    }
+    return LW_LOCK_OWNER(thin);
+}
+
+/*
+ * Returns the ordinary thin lock word equivalent to the given reserved
+ * lock word.  The holds of the reserving thread are preserved.
+ */
+static inline LW_TYPE unreservedLockWord(LW_TYPE thin) {
+    LW_TYPE newThin = (thin & LW_UNLOCKED_MASK) | LW_SHARED;
+    u4 holds = LW_LOCK_COUNT(thin);
+    if (holds > 0) {
+        newThin |= (LW_TYPE) LW_LOCK_OWNER(thin) << LW_LOCK_OWNER_SHIFT;
+        newThin |= (LW_TYPE) (holds - 1) << LW_LOCK_COUNT_SHIFT;
+    }
+    return newThin;
+}
+
+/*
+ * Prevents the compiler from moving memory accesses across this point.
+ */
+static inline void compilerBarrier(void) {
+    __asm__ __volatile__ ("" : : : "memory");
+}
+
+/*
+ * The functions below are the only ones which update a reserved lock word
+ * without atomic operations.  They set self->lockReservationBusy while
+ * reading and writing the lock word.  revokeReservation() only cancels a
+ * reservation if the reserving thread was stopped while the flag was clear,
+ * so the thread is never interrupted between reading the lock word and
+ * writing the new value.  The lock word is read again after setting the
+ * flag since the reservation may have been cancelled just before.
+ */
+
+/*
+ * Acquires a lock reserved for the calling thread.  Returns FALSE if the
+ * reservation has been cancelled or the count is about to overflow.
+ */
+static jboolean lockReserved(Thread* self, Object* obj) {
+    volatile LW_TYPE* thinp = (volatile LW_TYPE*) &obj->lock;
+    jboolean locked = FALSE;
+    LW_TYPE thin;
+
+    self->lockReservationBusy = TRUE;
+    compilerBarrier();
+    thin = *thinp;
+    if (LW_SHAPE(thin) == LW_SHAPE_THIN && LW_IS_RESERVED(thin)
+            && LW_LOCK_OWNER(thin) == self->threadId
+            && LW_LOCK_COUNT(thin) < LW_LOCK_COUNT_MASK) {
+        *thinp = thin + (1 << LW_LOCK_COUNT_SHIFT);
+        locked = TRUE;
+    }
+    compilerBarrier();
+    self->lockReservationBusy = FALSE;
+    return locked;
+}
+
+/*
+ * Releases a lock reserved for and held by the calling thread.  Returns
+ * FALSE if the reservation has been cancelled.
+ */
+static jboolean unlockReserved(Thread* self, Object* obj) {
+    volatile LW_TYPE* thinp = (volatile LW_TYPE*) &obj->lock;
+    jboolean unlocked = FALSE;
+    LW_TYPE thin;
+
+    self->lockReservationBusy = TRUE;
+    compilerBarrier();
+    thin = *thinp;
+    if (LW_SHAPE(thin) == LW_SHAPE_THIN && LW_IS_RESERVED(thin)
+            && LW_LOCK_OWNER(thin) == self->threadId) {
+        assert(LW_LOCK_COUNT(thin) > 0);
+        *thinp = thin - (1 << LW_LOCK_COUNT_SHIFT);
+        unlocked = TRUE;
+    }
+    compilerBarrier();
+    self->lockReservationBusy = FALSE;
+    return unlocked;
+}
+
+/*
+ * Cancels the calling thread's own reservation of the lock, if any.  Done
+ * before the lock is inflated.
+ */
+static void unreserveOwnLock(Thread* self, Object* obj) {
+    volatile LW_TYPE* thinp = (volatile LW_TYPE*) &obj->lock;
+    LW_TYPE thin;
+
+    self->lockReservationBusy = TRUE;
+    compilerBarrier();
+    thin = *thinp;
+    if (LW_SHAPE(thin) == LW_SHAPE_THIN && LW_IS_RESERVED(thin)
+            && LW_LOCK_OWNER(thin) == self->threadId) {
+        *thinp = unreservedLockWord(thin);
+    }
+    compilerBarrier();
+    self->lockReservationBusy = FALSE;
+}
+
+typedef struct {
+    Object* obj;
+    jboolean done;
+} RevokeData;
+
+/*
+ * Called by runWithThreadStopped() while the reserving thread is stopped.
+ * Must not lock anything.
+ */
+static void revokeWhileStopped(Thread* owner, void* data) {
+    RevokeData* revokeData = (RevokeData*) data;
+    Object* obj = revokeData->obj;
+    LW_TYPE thin;
+
+    if (owner->lockReservationBusy) {
+        return;
+    }
+    thin = obj->lock;
+    if (LW_SHAPE(thin) == LW_SHAPE_THIN && LW_IS_RESERVED(thin)
+            && LW_LOCK_OWNER(thin) == owner->threadId) {
+        android_atomic_release_store(unreservedLockWord(thin), (LW_TYPE*) &obj->lock);
+    }
+    revokeData->done = TRUE;
+}
+
+/*
+ * Cancels another thread's reservation of the lock of obj.  Afterwards the
+ * lock word is an ordinary thin lock (or has been inflated).  Stopping the
+ * reserving thread is expensive but happens at most once per object.
+ */
+static void revokeReservation(Env* env, Thread* self, Object* obj) {
+    volatile LW_TYPE* thinp = (volatile LW_TYPE*) &obj->lock;
+    RevokeData data;
+    jint oldStatus;
+
+    /*
+     * Holding the threads list lock prevents the reserving thread from
+     * exiting and its thread id from being reused while we're at it.  It
+     * also serializes revocations.
+     */
+    oldStatus = rvmChangeThreadStatus(env, self, THREAD_MONITOR);
+    rvmLockThreadsList();
+    for (;;) {
+        LW_TYPE thin = *thinp;
+        if (LW_SHAPE(thin) != LW_SHAPE_THIN || !LW_IS_RESERVED(thin)) {
+            break;
+        }
+        assert(LW_LOCK_OWNER(thin) != self->threadId);
+        Thread* owner = rvmGetThreadByThreadId(env, LW_LOCK_OWNER(thin));
+        if (!owner) {
+            /* The reserving thread has exited */
+            if (android_atomic_cas(thin, unreservedLockWord(thin), (LW_TYPE*) thinp) == 0) {
+                break;
+            }
+            continue;
+        }
+        data.obj = obj;
+        data.done = FALSE;
+        if (runWithThreadStopped(env, owner, revokeWhileStopped, &data) && data.done) {
+            break;
+        }
+        /*
+         * The reserving thread was stopped in the middle of updating a
+         * reserved lock word or couldn't be stopped at all.  Try again.
+         */
+        rvmUnlockThreadsList();
+        sched_yield();
+        rvmLockThreadsList();
+    }
+    rvmUnlockThreadsList();
+    rvmChangeThreadStatus(env, self, oldStatus);
+}
+
 /*
  * Returns the thread id of the thread owning the given lock.
  */
@@ -262,7 +577,7 @@ static u4 lockOwner(Object* obj) {
      */
     lock = obj->lock;
     if (LW_SHAPE(lock) == LW_SHAPE_THIN) {
-        return LW_LOCK_OWNER(lock);
+        return thinLockHolder(lock);
     } else {
         owner = LW_MONITOR(lock)->owner;
         return owner ? owner->threadId : 0;
@@ -296,8 +611,10 @@ jboolean rvmHoldsLock(Env* env, Thread* thread, Object* obj) {
 }
 
 /*
- * Free the monitor associated with an object and make the object's lock
- * thin again.  This is called during garbage collection.
+ * Releases the monitor associated with an object and make the object's
+ * lock thin again.  This is called during garbage collection. The monitor
+ * is put in the pool of free monitors rather than freed (see
+ * inflatedMonitors).
  */
 static void freeMonitor(Monitor *mon) {
     assert(mon != NULL);
@@ -313,18 +630,93 @@ static void freeMonitor(Monitor *mon) {
      */
     assert(rvmTryLockMutex(&mon->lock) == 0);
     assert(rvmUnlockMutex(&mon->lock) == 0);
-    rvmDestroyMutex(&mon->lock);
+
+    rvmLockMutex(&monitorsLock);
+    DL_DELETE(inflatedMonitors, mon);
+    mon->obj = NULL;
+    LL_PREPEND(freeMonitors, mon);
+    rvmUnlockMutex(&monitorsLock);
 }
 
 static void freeMonitorCleanupHandler(Env* env, Object* object) {
+    // The lock may have been deflated since the handler was registered
     if (LW_SHAPE(object->lock) == LW_SHAPE_FAT) {
         Monitor* mon = LW_MONITOR(object->lock);
         freeMonitor(mon);
         object->lock = 0;
-        rvmFreeMemoryUncollectable(env, mon);
     }
 }
 
+/*
+ * Deflates all inflated monitors which aren't owned and have no waiting
+ * threads. Called at the start of each GC. Must not allocate memory or
+ * block so only tries to lock the mutexes and skips monitors in use.
+ */
+void deflateMonitors() {
+    Monitor* mon;
+    Monitor* tmp;
+
+    if (!deflationEnabled || rvmTryLockMutex(&monitorsLock) != 0) {
+        return;
+    }
+    DL_FOREACH_SAFE(inflatedMonitors, mon, tmp) {
+        if (rvmTryLockMutex(&mon->lock) != 0) {
+            continue;
+        }
+        /*
+         * mon->owner is checked since the mutex is recursive and the
+         * current thread may own the monitor.
+         */
+        if (mon->owner == NULL && mon->waitSet == NULL
+                && rvmAtomicLoadInt(&mon->waiters) == 0) {
+            Object* obj = mon->obj;
+            LW_TYPE fat = obj ? obj->lock : 0;
+            if (LW_SHAPE(fat) != LW_SHAPE_FAT || LW_MONITOR(fat) != mon) {
+                // Not (or no longer) the object's published monitor.
+                rvmUnlockMutex(&mon->lock);
+                continue;
+            }
+            /*
+             * Nobody owns the lock so the lock count is 0. Only the hash
+             * state has to be preserved. Threads which read the fat lock
+             * word before this will see mon->obj != obj after locking the
+             * monitor and retry.
+             */
+            mon->obj = NULL;
+            android_atomic_release_store((fat & (LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT)) | LW_SHARED,
+                (LW_TYPE*) &obj->lock);
+            DL_DELETE(inflatedMonitors, mon);
+            LL_PREPEND(freeMonitors, mon);
+        }
+        rvmUnlockMutex(&mon->lock);
+    }
+    rvmUnlockMutex(&monitorsLock);
+}
+
+/*
+ * Gets the current time of the monotonic clock which all timed waits on a
+ * thread's waitCond are measured against.
+ */
+static void monotonicTime(struct timespec* ts) {
+#if defined(DARWIN)
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    uint64_t nanos = mach_absolute_time() * timebase.numer / timebase.denom;
+    ts->tv_sec = nanos / 1000000000ULL;
+    ts->tv_nsec = nanos % 1000000000ULL;
+#else
+    clock_gettime(CLOCK_MONOTONIC, ts);
+#endif
+}
+
+jlong monotonicNanos(void) {
+    struct timespec ts;
+    monotonicTime(&ts);
+    return (jlong) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 /*
  * Lock a monitor.
  */
@@ -336,9 +728,40 @@ static void lockMonitor(Env* env, Thread* self, Monitor* mon) {
         return;
     }
     if (rvmTryLockMutex(&mon->lock) != 0) {
-        oldStatus = rvmChangeThreadStatus(env, self, THREAD_MONITOR);
-        rvmLockMutex(&mon->lock);
-        rvmChangeThreadStatus(env, self, oldStatus);
+        /*
+         * Spin for a while before blocking. The monitor's spin limit
+         * reflects how long its owners have recently held it.
+         */
+        jint spinLimit = mon->spinLimit;
+        jboolean acquired = FALSE;
+        jboolean profile = contentionProfilerEnabled();
+        jlong start = profile ? monotonicNanos() : 0;
+        jint i;
+        for (i = 0; i < spinLimit; i++) {
+            cpuRelax();
+            if (*(Thread* volatile *) &mon->owner == NULL && rvmTryLockMutex(&mon->lock) == 0) {
+                acquired = TRUE;
+                break;
+            }
+        }
+        if (acquired) {
+            mon->spinLimit = growSpinLimit(spinLimit);
+        } else {
+            mon->spinLimit = shrinkSpinLimit(spinLimit);
+            rvmAtomicAddInt(&mon->waiters, 1);
+            oldStatus = rvmChangeThreadStatus(env, self, THREAD_MONITOR);
+            rvmLockMutex(&mon->lock);
+            rvmChangeThreadStatus(env, self, oldStatus);
+            rvmAtomicAddInt(&mon->waiters, -1);
+        }
+        if (profile) {
+            // mon->obj is NULL if the monitor was deflated while we waited.
+            // The caller will retry with the object's new lock.
+            Object* obj = mon->obj;
+            if (obj) {
+                contentionProfilerRecord(env, obj, monotonicNanos() - start);
+            }
+        }
     }
     mon->owner = self;
     assert(mon->lockCount == 0);
@@ -427,21 +850,12 @@ static void waitSetRemove(Env* env, Monitor *mon, Thread *thread) {
 }
 
 /*
- * Converts the given relative waiting time into an absolute time.
+ * Converts the given relative waiting time into an absolute monotonic time.
  */
 static void absoluteTime(jlong msec, jint nsec, struct timespec *ts) {
     jlong endSec;
 
-#ifdef HAVE_TIMEDWAIT_MONOTONIC
-    clock_gettime(CLOCK_MONOTONIC, ts);
-#else
-    {
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        ts->tv_sec = tv.tv_sec;
-        ts->tv_nsec = tv.tv_usec * 1000;
-    }
-#endif
+    monotonicTime(ts);
     endSec = ts->tv_sec + msec / 1000;
     if (endSec >= 0x7fffffff) {
         TRACE("NOTE: end time exceeds epoch");
@@ -457,6 +871,35 @@ static void absoluteTime(jlong msec, jint nsec, struct timespec *ts) {
     }
 }
 
+/*
+ * Waits on self->waitCond until it is signalled or the absolute time ts
+ * returned by absoluteTime() has passed. The caller must hold
+ * self->waitMutex. Returns ETIMEDOUT if the time has passed.
+ */
+static int timedWait(Thread* self, const struct timespec* ts) {
+#if defined(DARWIN)
+    /*
+     * Condition variables on Darwin can't use the monotonic clock. Wait for
+     * the remaining time relative to now instead.
+     */
+    struct timespec rel;
+    monotonicTime(&rel);
+    rel.tv_sec = ts->tv_sec - rel.tv_sec;
+    rel.tv_nsec = ts->tv_nsec - rel.tv_nsec;
+    if (rel.tv_nsec < 0) {
+        rel.tv_sec--;
+        rel.tv_nsec += 1000000000L;
+    }
+    if (rel.tv_sec < 0) {
+        return ETIMEDOUT;
+    }
+    return pthread_cond_timedwait_relative_np(&self->waitCond, &self->waitMutex, &rel);
+#else
+    /* waitCond uses CLOCK_MONOTONIC. See initThread() in thread.c. */
+    return pthread_cond_timedwait(&self->waitCond, &self->waitMutex, ts);
+#endif
+}
+
 /*
  * Wait on a monitor until timeout, interrupt, or notification.  Used for
  * Object.wait() and (somewhat indirectly) Thread.sleep() and Thread.join().
@@ -529,6 +972,12 @@ static void waitMonitor(Env* env, Thread* self, Monitor* mon, jlong msec, jint n
     int prevLockCount = mon->lockCount;
     mon->lockCount = 0;
     mon->owner = NULL;
+    /*
+     * Prevent the monitor from being deflated until we own it again. Once
+     * notified we're no longer in the wait set but must still be able to
+     * reacquire this monitor.
+     */
+    rvmAtomicAddInt(&mon->waiters, 1);
 
     /*
      * Update thread status.  If the GC wakes up, it'll ignore us, knowing
@@ -582,11 +1031,7 @@ static void waitMonitor(Env* env, Thread* self, Monitor* mon, jlong msec, jint n
         assert(ret == 0);
     } else {
         do {
-#ifdef HAVE_TIMEDWAIT_MONOTONIC
-            ret = pthread_cond_timedwait_monotonic(&self->waitCond, &self->waitMutex, &ts);
-#else
-            ret = pthread_cond_timedwait(&self->waitCond, &self->waitMutex, &ts);
-#endif
+            ret = timedWait(self, &ts);
         } while (!self->interrupted && self->waitMonitor != NULL && ret != ETIMEDOUT && (ret == 0 || ret == EINTR));
         assert(ret == 0 || ret == ETIMEDOUT);
     }
@@ -612,6 +1057,7 @@ done:
     mon->owner = self;
     mon->lockCount = prevLockCount;
     waitSetRemove(env, mon, self);
+    rvmAtomicAddInt(&mon->waiters, -1);
 
     /* set self->status back to THREAD_RUNNING, and self-suspend if needed */
     rvmChangeThreadStatus(env, self, THREAD_RUNNING);
@@ -704,6 +1150,7 @@ static void inflateMonitor(Env* env, Thread *self, Object* obj) {
     assert(self != NULL);
     assert(obj != NULL);
     assert(LW_SHAPE(obj->lock) == LW_SHAPE_THIN);
+    assert(!LW_IS_RESERVED(obj->lock));
     assert(LW_LOCK_OWNER(obj->lock) == self->threadId);
     /* Allocate and acquire a new monitor. */
     mon = rvmCreateMonitor(env, obj);
@@ -715,6 +1162,10 @@ static void inflateMonitor(Env* env, Thread *self, Object* obj) {
     thin |= (LW_TYPE)mon | LW_SHAPE_FAT;
     /* Publish the updated lock word. */
     android_atomic_release_store(thin, (LW_TYPE *)&obj->lock);
+    registerInflatedMonitor(env, mon);
+    if (contentionProfilerEnabled()) {
+        contentionProfilerRecord(env, obj, -1);
+    }
 }
 
 /*
@@ -728,11 +1179,14 @@ void rvmLockObject(Env* env, Object* obj) {
     volatile LW_TYPE *thinp;
     jint oldStatus;
     struct timespec tm;
+    jint spinLimit, spins;
     long sleepDelayNs;
-    long minSleepDelayNs = 1000000;  /* 1 millisecond */
-    long maxSleepDelayNs = 1000000000;  /* 1 second */
+    long minSleepDelayNs = 10000;  /* 10 microseconds */
+    long maxSleepDelayNs = 1000000;  /* 1 millisecond */
     LW_TYPE thin, newThin;
+    Monitor* mon;
     u4 threadId;
+    jlong start;
 
     assert(self != NULL);
     assert(obj != NULL);
@@ -740,6 +1194,26 @@ void rvmLockObject(Env* env, Object* obj) {
     thinp = &obj->lock;
 retry:
     thin = *thinp;
+    if (LW_SHAPE(thin) == LW_SHAPE_THIN && LW_IS_RESERVED(thin)) {
+        /*
+         * The lock is reserved.  If it's reserved for the calling thread
+         * it's acquired without any atomic operations.  Otherwise the
+         * reservation has to be cancelled first.
+         */
+        if (LW_LOCK_OWNER(thin) == threadId) {
+            if (lockReserved(self, obj)) {
+                return;
+            }
+            /*
+             * The count is about to overflow (or the reservation was
+             * just cancelled).  Continue as an ordinary thin lock.
+             */
+            unreserveOwnLock(self, obj);
+        } else {
+            revokeReservation(env, self, obj);
+        }
+        goto retry;
+    }
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /*
          * The lock is a thin lock.  The owner field is used to
@@ -763,10 +1237,18 @@ retry:
             /*
              * The lock is unowned.  Install the thread id of the
              * calling thread into the owner field.  This is the
-             * common case.  In performance critical code the JIT
-             * will have tried this before calling out to the VM.
+             * common case.  Compiled code tries this inline for
+             * shared locks before calling out to the VM.  If the lock
+             * has never been shared it's also reserved for the calling
+             * thread.  With reservation disabled the lock is marked
+             * shared right away so that later acquires stay inline.
              */
             newThin = thin | (threadId << LW_LOCK_OWNER_SHIFT);
+            if (!(thin & LW_SHARED)) {
+                newThin |= lockReservationEnabled
+                        ? LW_RESERVED | (1 << LW_LOCK_COUNT_SHIFT)
+                        : LW_SHARED;
+            }
             if (android_atomic_acquire_cas(thin, newThin,
                     (LW_TYPE*)thinp) != 0) {
                 /*
@@ -783,16 +1265,21 @@ retry:
              */
             oldStatus = rvmChangeThreadStatus(env, self, THREAD_MONITOR);
             /*
-             * Spin until the thin lock is released or inflated.
+             * Spin until the thin lock is released or inflated. Busy
+             * spin first, then yield and finally sleep for increasing
+             * amounts of time.
              */
+            spinLimit = thinLockSpinLimit;
+            spins = 0;
             sleepDelayNs = 0;
+            start = contentionProfilerEnabled() ? monotonicNanos() : 0;
             for (;;) {
                 thin = *thinp;
                 /*
                  * Check the shape of the lock word.  Another thread
                  * may have inflated the lock while we were waiting.
                  */
-                if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
+                if (LW_SHAPE(thin) == LW_SHAPE_THIN && !LW_IS_RESERVED(thin)) {
                     if (LW_LOCK_OWNER(thin) == 0) {
                         /*
                          * The lock has been released.  Install the
@@ -808,6 +1295,13 @@ retry:
                              */
                             break;
                         }
+                    } else if (spins < spinLimit) {
+                        /*
+                         * The lock has not been released.  Spin in
+                         * case the owner is about to release it.
+                         */
+                        cpuRelax();
+                        spins++;
                     } else {
                         /*
                          * The lock has not been released.  Yield so
@@ -821,21 +1315,20 @@ retry:
                             tm.tv_nsec = sleepDelayNs;
                             nanosleep(&tm, NULL);
                             /*
-                             * Prepare the next delay value.  Wrap to
-                             * avoid once a second polls for eternity.
+                             * Prepare the next delay value.
                              */
                             if (sleepDelayNs < maxSleepDelayNs / 2) {
                                 sleepDelayNs *= 2;
                             } else {
-                                sleepDelayNs = minSleepDelayNs;
+                                sleepDelayNs = maxSleepDelayNs;
                             }
                         }
                     }
                 } else {
                     /*
-                     * The thin lock was inflated by another thread.
-                     * Let the VM know we are no longer waiting and
-                     * try again.
+                     * The thin lock was inflated (or reserved) by another
+                     * thread.  Let the VM know we are no longer waiting
+                     * and try again.
                      */
                     TRACEF("(%d) lock %p surprise-fattened",
                              threadId, &obj->lock);
@@ -845,11 +1338,23 @@ retry:
             }
             TRACEF("(%d) spin on lock done %p: %#x (%#x) %#x",
                  threadId, &obj->lock, 0, *thinp, thin);
+            /*
+             * Adapt the spin limit depending on whether spinning was
+             * enough to acquire the lock.
+             */
+            if (spins < spinLimit) {
+                thinLockSpinLimit = growSpinLimit(spinLimit);
+            } else {
+                thinLockSpinLimit = shrinkSpinLimit(spinLimit);
+            }
             /*
              * We have acquired the thin lock.  Let the VM know that
              * we are no longer waiting.
              */
             rvmChangeThreadStatus(env, self, oldStatus);
+            if (start) {
+                contentionProfilerRecord(env, obj, monotonicNanos() - start);
+            }
             /*
              * Fatten the lock.
              */
@@ -860,8 +1365,20 @@ retry:
         /*
          * The lock is a fat lock.
          */
-        assert(LW_MONITOR(obj->lock) != NULL);
-        lockMonitor(env, self, LW_MONITOR(obj->lock));
+        mon = LW_MONITOR(thin);
+        assert(mon != NULL);
+        lockMonitor(env, self, mon);
+        if (mon->obj != obj) {
+            /*
+             * The monitor was deflated (and possibly reused for another
+             * object) after we read the lock word.  Release it and try
+             * again.
+             */
+            assert(mon->lockCount == 0);
+            mon->owner = NULL;
+            rvmUnlockMutex(&mon->lock);
+            goto retry;
+        }
     }
 }
 
@@ -882,12 +1399,24 @@ jboolean rvmUnlockObject(Env* env, Object* obj) {
      * examining its state.
      */
     thin = *(volatile LW_TYPE *)&obj->lock;
+    if (LW_SHAPE(thin) == LW_SHAPE_THIN && LW_IS_RESERVED(thin)
+            && thinLockHolder(thin) == self->threadId) {
+        /*
+         * The lock is reserved for and held by the calling thread.  If the
+         * reservation is cancelled concurrently we fall through and
+         * release the resulting ordinary thin lock.
+         */
+        if (unlockReserved(self, obj)) {
+            return TRUE;
+        }
+        thin = *(volatile LW_TYPE *)&obj->lock;
+    }
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /*
          * The lock is thin.  We must ensure that the lock is owned
          * by the given thread before unlocking it.
          */
-        if (LW_LOCK_OWNER(thin) == self->threadId) {
+        if (!LW_IS_RESERVED(thin) && LW_LOCK_OWNER(thin) == self->threadId) {
             /*
              * We are the lock owner.  It is safe to update the lock
              * without CAS as lock ownership guards the lock itself.
@@ -896,9 +1425,9 @@ jboolean rvmUnlockObject(Env* env, Object* obj) {
                 /*
                  * The lock was not recursively acquired, the common
                  * case.  Unlock by clearing all bits except for the
-                 * hash state.
+                 * hash state and the shared bit.
                  */
-                thin &= (LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT);
+                thin &= LW_UNLOCKED_MASK;
                 android_atomic_release_store(thin, (LW_TYPE*)&obj->lock);
             } else {
                 /*
@@ -944,11 +1473,12 @@ void rvmObjectWait(Env* env, Object* obj, jlong msec, jint nsec, jboolean interr
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /* Make sure that 'self' holds the lock.
          */
-        if (LW_LOCK_OWNER(thin) != self->threadId) {
+        if (thinLockHolder(thin) != self->threadId) {
             rvmThrowIllegalMonitorStateException(env, 
                 "object not locked by thread before wait()");
             return;
         }
+        unreserveOwnLock(self, obj);
 
         /* This thread holds the lock.  We need to fatten the lock
          * so 'self' can block on it.  Don't update the object lock
@@ -975,7 +1505,7 @@ void rvmObjectNotify(Env* env, Object* obj) {
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /* Make sure that 'self' holds the lock.
          */
-        if (LW_LOCK_OWNER(thin) != self->threadId) {
+        if (thinLockHolder(thin) != self->threadId) {
             rvmThrowIllegalMonitorStateException(env, 
                 "object not locked by thread before notify()");
             return;
@@ -1003,7 +1533,7 @@ void rvmObjectNotifyAll(Env* env, Object* obj) {
     if (LW_SHAPE(thin) == LW_SHAPE_THIN) {
         /* Make sure that 'self' holds the lock.
          */
-        if (LW_LOCK_OWNER(thin) != self->threadId) {
+        if (thinLockHolder(thin) != self->threadId) {
             rvmThrowIllegalMonitorStateException(env, 
                 "object not locked by thread before notifyAll()");
             return;
@@ -1018,6 +1548,23 @@ void rvmObjectNotifyAll(Env* env, Object* obj) {
     }
 }
 
+#if defined(LINUX)
+static void unparkThread(Thread* thread) {
+    if (rvmAtomicStoreInt(&thread->parkState, PARK_PERMIT) == PARK_PARKED) {
+        syscall(SYS_futex, &thread->parkState, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+#else
+/*
+ * The caller must hold thread->waitMutex.
+ */
+static void unparkThread(Thread* thread) {
+    if (rvmAtomicStoreInt(&thread->parkState, PARK_PERMIT) == PARK_PARKED) {
+        pthread_cond_signal(&thread->waitCond);
+    }
+}
+#endif
+
 /*
  * This implements java.lang.Thread.sleep(long msec, int nsec).
  *
@@ -1026,23 +1573,45 @@ void rvmObjectNotifyAll(Env* env, Object* obj) {
  * signals around and rely on EINTR, but that's inefficient and relies
  * on native code respecting our signal mask.)
  *
- * We have to do all of this stuff for Object.wait() as well, so it's
- * easiest to just sleep on a private Monitor.
+ * Instead we do a timed wait on the thread's own waitCond, which
+ * rvmThreadInterrupt() signals. No lock is shared with other threads so
+ * many threads sleeping at once don't contend with each other.
  *
  * It appears that we want sleep(0,0) to go through the motions of sleeping
  * for a very short duration, rather than just returning.
  */
 void rvmThreadSleep(Env* env, jlong msec, jint nsec) {
     Thread* self = env->currentThread;
-    Monitor* mon = threadSleepMonitor;
+    struct timespec ts;
+    jboolean wasInterrupted;
+    int ret = 0;
+
+    if (msec < 0 || nsec < 0 || nsec > 999999) {
+        rvmThrowIllegalArgumentException(env, "timeout arguments out of range");
+        return;
+    }
 
     /* sleep(0,0) wakes up immediately, wait(0,0) means wait forever; adjust */
     if (msec == 0 && nsec == 0)
         nsec++;
 
-    lockMonitor(env, self, mon);
-    waitMonitor(env, self, mon, msec, nsec, TRUE);
-    unlockMonitor(env, self, mon);
+    absoluteTime(msec, nsec, &ts);
+
+    rvmLockMutex(&self->waitMutex);
+    if (!self->interrupted) {
+        rvmChangeThreadStatus(env, self, THREAD_TIMED_WAIT);
+        do {
+            ret = timedWait(self, &ts);
+        } while (!self->interrupted && ret != ETIMEDOUT && (ret == 0 || ret == EINTR));
+        rvmChangeThreadStatus(env, self, THREAD_RUNNING);
+    }
+    wasInterrupted = self->interrupted;
+    self->interrupted = FALSE;
+    rvmUnlockMutex(&self->waitMutex);
+
+    if (wasInterrupted) {
+        rvmThrowInterruptedException(env);
+    }
 }
 
 /*
@@ -1069,6 +1638,9 @@ void rvmThreadInterrupt(Env* env, Thread* thread) {
      */
     thread->interrupted = TRUE;
 
+    /* Wake the thread up if it is parked */
+    unparkThread(thread);
+
     /*
      * Is the thread waiting?
      *
@@ -1078,8 +1650,134 @@ void rvmThreadInterrupt(Env* env, Thread* thread) {
      */
     if (thread->waitMonitor != NULL) {
         thread->waitMonitor = NULL; /* Makes the thread exit its wait loop */
-        pthread_cond_signal(&thread->waitCond);
     }
 
+    /*
+     * Wake the thread if it's waiting on a monitor or sleeping. Both loops
+     * check the interrupted flag so signalling a thread which is doing
+     * neither is harmless.
+     */
+    pthread_cond_signal(&thread->waitCond);
+
     rvmUnlockMutex(&thread->waitMutex);
 }
+
+/*
+ * Implements sun.misc.Unsafe.park(). Blocks the current thread until it is
+ * unparked or interrupted or the specified time has passed, unless a permit
+ * is already available, in which case it is consumed and this returns
+ * immediately. If absolute is TRUE time is a deadline in milliseconds since
+ * the epoch, otherwise a number of nanoseconds (0 means forever). May return
+ * spuriously. Doesn't clear the interrupted flag.
+ *
+ * Parking doesn't involve any Monitor. On Linux the park state is a futex
+ * word so an unpark of a thread which isn't parked is a single atomic swap.
+ * Elsewhere the thread's waitMutex and waitCond are used.
+ */
+void rvmThreadPark(Env* env, jboolean absolute, jlong time) {
+    Thread* self = env->currentThread;
+
+    if (rvmAtomicCompareAndSwapInt(&self->parkState, PARK_PERMIT, PARK_EMPTY)) {
+        return;
+    }
+    if (self->interrupted || (!absolute && time < 0)) {
+        return;
+    }
+    if (absolute) {
+        /*
+         * The deadline is in wall clock time but we wait on monotonic time.
+         * If the wall clock is changed while parked we return too early
+         * (which is allowed) or too late.
+         */
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        jlong delayMillis = time - ((jlong) tv.tv_sec * 1000 + tv.tv_usec / 1000);
+        if (delayMillis <= 0) {
+            return;
+        }
+        time = delayMillis > LLONG_MAX / 1000000 ? LLONG_MAX : delayMillis * 1000000;
+    }
+
+#if defined(LINUX)
+    if (!rvmAtomicCompareAndSwapInt(&self->parkState, PARK_EMPTY, PARK_PARKED)) {
+        /* Unparked since we checked above. Consume the permit. */
+        rvmAtomicStoreInt(&self->parkState, PARK_EMPTY);
+        return;
+    }
+
+    rvmChangeThreadStatus(env, self, time > 0 ? THREAD_TIMED_WAIT : THREAD_WAIT);
+    jlong deadline = 0;
+    if (time > 0) {
+        jlong now = monotonicNanos();
+        deadline = time > LLONG_MAX - now ? LLONG_MAX : now + time;
+    }
+    /*
+     * FUTEX_WAIT returns immediately if the state is no longer PARK_PARKED.
+     * Signals (e.g. GC stop-the-world signals) make it return EINTR.
+     */
+    while (rvmAtomicLoadInt(&self->parkState) == PARK_PARKED && !self->interrupted) {
+        if (deadline > 0) {
+            jlong remaining = deadline - monotonicNanos();
+            if (remaining <= 0) {
+                break;
+            }
+            struct timespec ts;
+            ts.tv_sec = remaining / 1000000000LL > 0x7ffffffe ? 0x7ffffffe : remaining / 1000000000LL;
+            ts.tv_nsec = remaining % 1000000000LL;
+            syscall(SYS_futex, &self->parkState, FUTEX_WAIT_PRIVATE, PARK_PARKED, &ts, NULL, 0);
+        } else {
+            syscall(SYS_futex, &self->parkState, FUTEX_WAIT_PRIVATE, PARK_PARKED, NULL, NULL, 0);
+        }
+    }
+    /* Consumes the permit if we were unparked */
+    rvmAtomicStoreInt(&self->parkState, PARK_EMPTY);
+    rvmChangeThreadStatus(env, self, THREAD_RUNNING);
+#else
+    rvmLockMutex(&self->waitMutex);
+    if (self->parkState == PARK_PERMIT || self->interrupted) {
+        self->parkState = PARK_EMPTY;
+        rvmUnlockMutex(&self->waitMutex);
+        return;
+    }
+    self->parkState = PARK_PARKED;
+    rvmChangeThreadStatus(env, self, time > 0 ? THREAD_TIMED_WAIT : THREAD_WAIT);
+    if (time > 0) {
+        struct timespec ts;
+        absoluteTime(time / 1000000, (jint) (time % 1000000), &ts);
+        timedWait(self, &ts);
+    } else {
+        pthread_cond_wait(&self->waitCond, &self->waitMutex);
+    }
+    self->parkState = PARK_EMPTY;
+    rvmChangeThreadStatus(env, self, THREAD_RUNNING);
+    rvmUnlockMutex(&self->waitMutex);
+#endif
+}
+
+/*
+ * Implements sun.misc.Unsafe.unpark(). Makes a permit available to the
+ * specified thread and wakes it up if it is parked. Does nothing if the
+ * thread hasn't been started yet or has already exited.
+ */
+void rvmThreadUnpark(Env* env, Object* threadObj) {
+#if defined(LINUX)
+    /*
+     * No locking needed. Thread structs are GC allocated so the struct stays
+     * valid even if the thread exits while we're unparking it.
+     */
+    Thread* thread = rvmRTGetNativeThread(env, threadObj);
+    if (thread) {
+        unparkThread(thread);
+    }
+#else
+    /* The waitMutex is destroyed when the thread exits */
+    rvmLockThreadsList();
+    Thread* thread = rvmRTGetNativeThread(env, threadObj);
+    if (thread) {
+        rvmLockMutex(&thread->waitMutex);
+        unparkThread(thread);
+        rvmUnlockMutex(&thread->waitMutex);
+    }
+    rvmUnlockThreadsList();
+#endif
+}
@@ -0,0 +1,598 @@
+/*
+ * Copyright (C) 2012 RoboVM AB
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Bulk copying and byte swapping used by System.arraycopy(), the
+ * VM.memmove*() intrinsics and libcore.io.Memory.
+ *
+ * rvmMoveMemory() dispatches on size. Moves of up to 64 bytes load
+ * everything into registers before storing anything. This makes them
+ * safe for overlapping areas without checking the direction. Larger moves
+ * use a forward or backward loop depending on how the areas overlap. The
+ * first and last vector are loaded up front and the loop stores aligned
+ * vectors in between. Large forward moves of non-overlapping areas use
+ * non-temporal stores so they don't evict the whole cache.
+ *
+ * All offsets loaded and stored are multiples of the element size when
+ * the pointers and the size are. Elements of up to 8 bytes are therefore
+ * never torn, as Java requires for array copies.
+ *
+ * Like the kernels in utf.c the loops are selected on first use: AVX2 if
+ * the CPU supports it, SSE2 on x86 otherwise, NEON on ARM and portable C
+ * everywhere else. This file must not depend on the rest of the VM.
+ */
+#include <bugvm.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#   define MOVE_SSE2
+#endif
+#if defined(MOVE_SSE2) && defined(__x86_64__) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#   include <immintrin.h>
+#   define MOVE_AVX2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   include <arm_neon.h>
+#   define MOVE_NEON
+#endif
+
+// Forward moves larger than this which don't overlap use non-temporal stores
+#define NON_TEMPORAL_THRESHOLD (4 * 1024 * 1024)
+
+typedef struct {
+    const char* name;
+    // Moves of more than 64 bytes. dest <= src or the areas don't overlap.
+    void (*forward)(uint8_t* dest, const uint8_t* src, size_t n);
+    // Moves of more than 64 bytes. dest > src.
+    void (*backward)(uint8_t* dest, const uint8_t* src, size_t n);
+    // Moves of more than NON_TEMPORAL_THRESHOLD bytes. The areas don't overlap.
+    void (*forwardNonTemporal)(uint8_t* dest, const uint8_t* src, size_t n);
+    // Byte swap kernels. Return the number of values swapped. The caller
+    // swaps the rest.
+    size_t (*swap16)(uint8_t* dest, const uint8_t* src, size_t count);
+    size_t (*swap32)(uint8_t* dest, const uint8_t* src, size_t count);
+    size_t (*swap64)(uint8_t* dest, const uint8_t* src, size_t count);
+} MoveKernels;
+
+static inline uint16_t load16(const uint8_t* p) { uint16_t v; memcpy(&v, p, 2); return v; }
+static inline uint32_t load32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t load64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline void store16(uint8_t* p, uint16_t v) { memcpy(p, &v, 2); }
+static inline void store32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }
+static inline void store64(uint8_t* p, uint64_t v) { memcpy(p, &v, 8); }
+
+/* Portable kernels */
+
+static void forwardScalar(uint8_t* dest, const uint8_t* src, size_t n) {
+    uint64_t head = load64(src);
+    uint64_t tail = load64(src + n - 8);
+    size_t i;
+    for (i = 8; i < n - 8; i += 8) {
+        store64(dest + i, load64(src + i));
+    }
+    store64(dest, head);
+    store64(dest + n - 8, tail);
+}
+
+static void backwardScalar(uint8_t* dest, const uint8_t* src, size_t n) {
+    uint64_t head = load64(src);
+    uint64_t tail = load64(src + n - 8);
+    size_t i;
+    for (i = (n - 9) & ~(size_t) 7; i >= 8; i -= 8) {
+        store64(dest + i, load64(src + i));
+    }
+    store64(dest + n - 8, tail);
+    store64(dest, head);
+}
+
+static size_t swap16Scalar(uint8_t* dest, const uint8_t* src, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        store16(dest + i * 2, __builtin_bswap16(load16(src + i * 2)));
+    }
+    return count;
+}
+
+static size_t swap32Scalar(uint8_t* dest, const uint8_t* src, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        store32(dest + i * 4, __builtin_bswap32(load32(src + i * 4)));
+    }
+    return count;
+}
+
+static size_t swap64Scalar(uint8_t* dest, const uint8_t* src, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        store64(dest + i * 8, __builtin_bswap64(load64(src + i * 8)));
+    }
+    return count;
+}
+
+static const MoveKernels scalarKernels = {
+    "scalar", forwardScalar, backwardScalar, forwardScalar, swap16Scalar, swap32Scalar, swap64Scalar
+};
+
+#if defined(MOVE_SSE2)
+/* SSE2 kernels. 16 bytes per vector. */
+
+static inline void forwardSse2Impl(uint8_t* dest, const uint8_t* src, size_t n, int nonTemporal) {
+    __m128i head = _mm_loadu_si128((const __m128i*) src);
+    __m128i tail = _mm_loadu_si128((const __m128i*) (src + n - 16));
+    uint8_t* end = dest + n - 16;
+    size_t skip = 16 - ((uintptr_t) dest & 15);
+    uint8_t* d = dest + skip;
+    const uint8_t* s = src + skip;
+    // All loads of an iteration happen before its stores. With dest < src
+    // the stores only ever overwrite source bytes which have been loaded.
+    while (d + 64 <= end) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*) s);
+        __m128i v1 = _mm_loadu_si128((const __m128i*) (s + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i*) (s + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i*) (s + 48));
+        if (nonTemporal) {
+            _mm_stream_si128((__m128i*) d, v0);
+            _mm_stream_si128((__m128i*) (d + 16), v1);
+            _mm_stream_si128((__m128i*) (d + 32), v2);
+            _mm_stream_si128((__m128i*) (d + 48), v3);
+        } else {
+            _mm_store_si128((__m128i*) d, v0);
+            _mm_store_si128((__m128i*) (d + 16), v1);
+            _mm_store_si128((__m128i*) (d + 32), v2);
+            _mm_store_si128((__m128i*) (d + 48), v3);
+        }
+        d += 64;
+        s += 64;
+    }
+    while (d < end) {
+        _mm_store_si128((__m128i*) d, _mm_loadu_si128((const __m128i*) s));
+        d += 16;
+        s += 16;
+    }
+    if (nonTemporal) {
+        _mm_sfence();
+    }
+    _mm_storeu_si128((__m128i*) dest, head);
+    _mm_storeu_si128((__m128i*) end, tail);
+}
+
+static void forwardSse2(uint8_t* dest, const uint8_t* src, size_t n) {
+    forwardSse2Impl(dest, src, n, 0);
+}
+
+static void forwardNonTemporalSse2(uint8_t* dest, const uint8_t* src, size_t n) {
+    forwardSse2Impl(dest, src, n, 1);
+}
+
+static void backwardSse2(uint8_t* dest, const uint8_t* src, size_t n) {
+    __m128i head = _mm_loadu_si128((const __m128i*) src);
+    __m128i tail = _mm_loadu_si128((const __m128i*) (src + n - 16));
+    uint8_t* d = dest + n;
+    size_t skip = (uintptr_t) d & 15;
+    d -= skip;
+    const uint8_t* s = src + (d - dest);
+    // Mirror image of the forward loop. With dest > src the stores only
+    // ever overwrite source bytes which have been loaded.
+    while (d - 64 >= dest + 16) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*) (s - 16));
+        __m128i v1 = _mm_loadu_si128((const __m128i*) (s - 32));
+        __m128i v2 = _mm_loadu_si128((const __m128i*) (s - 48));
+        __m128i v3 = _mm_loadu_si128((const __m128i*) (s - 64));
+        _mm_store_si128((__m128i*) (d - 16), v0);
+        _mm_store_si128((__m128i*) (d - 32), v1);
+        _mm_store_si128((__m128i*) (d - 48), v2);
+        _mm_store_si128((__m128i*) (d - 64), v3);
+        d -= 64;
+        s -= 64;
+    }
+    while (d > dest + 16) {
+        d -= 16;
+        s -= 16;
+        _mm_store_si128((__m128i*) d, _mm_loadu_si128((const __m128i*) s));
+    }
+    _mm_storeu_si128((__m128i*) (dest + n - 16), tail);
+    _mm_storeu_si128((__m128i*) dest, head);
+}
+
+static inline __m128i swapBytesSse2(__m128i v) {
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static size_t swap16Sse2(uint8_t* dest, const uint8_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + i * 2));
+        _mm_storeu_si128((__m128i*) (dest + i * 2), swapBytesSse2(v));
+    }
+    return i;
+}
+
+static size_t swap32Sse2(uint8_t* dest, const uint8_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = swapBytesSse2(_mm_loadu_si128((const __m128i*) (src + i * 4)));
+        // Swap the 16-bit halves of each 32-bit value
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xb1), 0xb1);
+        _mm_storeu_si128((__m128i*) (dest + i * 4), v);
+    }
+    return i;
+}
+
+static size_t swap64Sse2(uint8_t* dest, const uint8_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i v = swapBytesSse2(_mm_loadu_si128((const __m128i*) (src + i * 8)));
+        // Reverse the 16-bit quarters of each 64-bit value
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1b), 0x1b);
+        _mm_storeu_si128((__m128i*) (dest + i * 8), v);
+    }
+    return i;
+}
+
+static const MoveKernels sse2Kernels = {
+    "sse2", forwardSse2, backwardSse2, forwardNonTemporalSse2, swap16Sse2, swap32Sse2, swap64Sse2
+};
+#endif
+
+#if defined(MOVE_AVX2)
+/*
+ * AVX2 kernels. 32 bytes per vector. Compiled for AVX2 regardless of the
+ * compiler flags and only used if the CPU supports it. The upper halves of
+ * the ymm registers are cleared before returning to avoid AVX-SSE
+ * transition penalties in the caller.
+ */
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline void forwardAvx2Impl(uint8_t* dest, const uint8_t* src, size_t n, int nonTemporal) {
+    __m256i head = _mm256_loadu_si256((const __m256i*) src);
+    __m256i tail = _mm256_loadu_si256((const __m256i*) (src + n - 32));
+    uint8_t* end = dest + n - 32;
+    size_t skip = 32 - ((uintptr_t) dest & 31);
+    uint8_t* d = dest + skip;
+    const uint8_t* s = src + skip;
+    while (d + 128 <= end) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*) s);
+        __m256i v1 = _mm256_loadu_si256((const __m256i*) (s + 32));
+        __m256i v2 = _mm256_loadu_si256((const __m256i*) (s + 64));
+        __m256i v3 = _mm256_loadu_si256((const __m256i*) (s + 96));
+        if (nonTemporal) {
+            _mm256_stream_si256((__m256i*) d, v0);
+            _mm256_stream_si256((__m256i*) (d + 32), v1);
+            _mm256_stream_si256((__m256i*) (d + 64), v2);
+            _mm256_stream_si256((__m256i*) (d + 96), v3);
+        } else {
+            _mm256_store_si256((__m256i*) d, v0);
+            _mm256_store_si256((__m256i*) (d + 32), v1);
+            _mm256_store_si256((__m256i*) (d + 64), v2);
+            _mm256_store_si256((__m256i*) (d + 96), v3);
+        }
+        d += 128;
+        s += 128;
+    }
+    while (d < end) {
+        _mm256_store_si256((__m256i*) d, _mm256_loadu_si256((const __m256i*) s));
+        d += 32;
+        s += 32;
+    }
+    if (nonTemporal) {
+        _mm_sfence();
+    }
+    _mm256_storeu_si256((__m256i*) dest, head);
+    _mm256_storeu_si256((__m256i*) end, tail);
+    _mm256_zeroupper();
+}
+
+AVX2 static void forwardAvx2(uint8_t* dest, const uint8_t* src, size_t n) {
+    forwardAvx2Impl(dest, src, n, 0);
+}
+
+AVX2 static void forwardNonTemporalAvx2(uint8_t* dest, const uint8_t* src, size_t n) {
+    forwardAvx2Impl(dest, src, n, 1);
+}
+
+AVX2 static void backwardAvx2(uint8_t* dest, const uint8_t* src, size_t n) {
+    __m256i head = _mm256_loadu_si256((const __m256i*) src);
+    __m256i tail = _mm256_loadu_si256((const __m256i*) (src + n - 32));
+    uint8_t* d = dest + n;
+    size_t skip = (uintptr_t) d & 31;
+    d -= skip;
+    const uint8_t* s = src + (d - dest);
+    while (d - 128 >= dest + 32) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*) (s - 32));
+        __m256i v1 = _mm256_loadu_si256((const __m256i*) (s - 64));
+        __m256i v2 = _mm256_loadu_si256((const __m256i*) (s - 96));
+        __m256i v3 = _mm256_loadu_si256((const __m256i*) (s - 128));
+        _mm256_store_si256((__m256i*) (d - 32), v0);
+        _mm256_store_si256((__m256i*) (d - 64), v1);
+        _mm256_store_si256((__m256i*) (d - 96), v2);
+        _mm256_store_si256((__m256i*) (d - 128), v3);
+        d -= 128;
+        s -= 128;
+    }
+    while (d > dest + 32) {
+        d -= 32;
+        s -= 32;
+        _mm256_store_si256((__m256i*) d, _mm256_loadu_si256((const __m256i*) s));
+    }
+    _mm256_storeu_si256((__m256i*) (dest + n - 32), tail);
+    _mm256_storeu_si256((__m256i*) dest, head);
+    _mm256_zeroupper();
+}
+
+AVX2 static inline size_t swapAvx2(uint8_t* dest, const uint8_t* src, size_t count, size_t size, __m256i mask) {
+    size_t perVector = 32 / size;
+    size_t i = 0;
+    for (; i + perVector <= count; i += perVector) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src + i * size));
+        _mm256_storeu_si256((__m256i*) (dest + i * size), _mm256_shuffle_epi8(v, mask));
+    }
+    _mm256_zeroupper();
+    return i;
+}
+
+AVX2 static size_t swap16Avx2(uint8_t* dest, const uint8_t* src, size_t count) {
+    __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    return swapAvx2(dest, src, count, 2, mask);
+}
+
+AVX2 static size_t swap32Avx2(uint8_t* dest, const uint8_t* src, size_t count) {
+    __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    return swapAvx2(dest, src, count, 4, mask);
+}
+
+AVX2 static size_t swap64Avx2(uint8_t* dest, const uint8_t* src, size_t count) {
+    __m256i mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    return swapAvx2(dest, src, count, 8, mask);
+}
+
+static const MoveKernels avx2Kernels = {
+    "avx2", forwardAvx2, backwardAvx2, forwardNonTemporalAvx2, swap16Avx2, swap32Avx2, swap64Avx2
+};
+#endif
+
+#if defined(MOVE_NEON)
+/* NEON kernels. 16 bytes per vector. There are no non-temporal stores. */
+
+static void forwardNeon(uint8_t* dest, const uint8_t* src, size_t n) {
+    uint8x16_t head = vld1q_u8(src);
+    uint8x16_t tail = vld1q_u8(src + n - 16);
+    uint8_t* end = dest + n - 16;
+    size_t skip = 16 - ((uintptr_t) dest & 15);
+    uint8_t* d = dest + skip;
+    const uint8_t* s = src + skip;
+    while (d + 64 <= end) {
+        uint8x16_t v0 = vld1q_u8(s);
+        uint8x16_t v1 = vld1q_u8(s + 16);
+        uint8x16_t v2 = vld1q_u8(s + 32);
+        uint8x16_t v3 = vld1q_u8(s + 48);
+        vst1q_u8(d, v0);
+        vst1q_u8(d + 16, v1);
+        vst1q_u8(d + 32, v2);
+        vst1q_u8(d + 48, v3);
+        d += 64;
+        s += 64;
+    }
+    while (d < end) {
+        vst1q_u8(d, vld1q_u8(s));
+        d += 16;
+        s += 16;
+    }
+    vst1q_u8(dest, head);
+    vst1q_u8(end, tail);
+}
+
+static void backwardNeon(uint8_t* dest, const uint8_t* src, size_t n) {
+    uint8x16_t head = vld1q_u8(src);
+    uint8x16_t tail = vld1q_u8(src + n - 16);
+    uint8_t* d = dest + n;
+    size_t skip = (uintptr_t) d & 15;
+    d -= skip;
+    const uint8_t* s = src + (d - dest);
+    while (d - 64 >= dest + 16) {
+        uint8x16_t v0 = vld1q_u8(s - 16);
+        uint8x16_t v1 = vld1q_u8(s - 32);
+        uint8x16_t v2 = vld1q_u8(s - 48);
+        uint8x16_t v3 = vld1q_u8(s - 64);
+        vst1q_u8(d - 16, v0);
+        vst1q_u8(d - 32, v1);
+        vst1q_u8(d - 48, v2);
+        vst1q_u8(d - 64, v3);
+        d -= 64;
+        s -= 64;
+    }
+    while (d > dest + 16) {
+        d -= 16;
+        s -= 16;
+        vst1q_u8(d, vld1q_u8(s));
+    }
+    vst1q_u8(dest + n - 16, tail);
+    vst1q_u8(dest, head);
+}
+
+static size_t swap16Neon(uint8_t* dest, const uint8_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vst1q_u8(dest + i * 2, vrev16q_u8(vld1q_u8(src + i * 2)));
+    }
+    return i;
+}
+
+static size_t swap32Neon(uint8_t* dest, const uint8_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u8(dest + i * 4, vrev32q_u8(vld1q_u8(src + i * 4)));
+    }
+    return i;
+}
+
+static size_t swap64Neon(uint8_t* dest, const uint8_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        vst1q_u8(dest + i * 8, vrev64q_u8(vld1q_u8(src + i * 8)));
+    }
+    return i;
+}
+
+static const MoveKernels neonKernels = {
+    "neon", forwardNeon, backwardNeon, forwardNeon, swap16Neon, swap32Neon, swap64Neon
+};
+#endif
+
+static const MoveKernels* kernels = NULL;
+
+static const MoveKernels* selectKernels(void) {
+#if defined(MOVE_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2Kernels;
+    }
+#endif
+#if defined(MOVE_SSE2)
+    return &sse2Kernels;
+#elif defined(MOVE_NEON)
+    return &neonKernels;
+#else
+    return &scalarKernels;
+#endif
+}
+
+static inline const MoveKernels* getKernels(void) {
+    // Racy but harmless. All threads select the same kernels.
+    const MoveKernels* k = kernels;
+    if (!k) {
+        k = selectKernels();
+        kernels = k;
+    }
+    return k;
+}
+
+const char* rvmMoveGetKernelsName(void) {
+    return getKernels()->name;
+}
+
+jboolean rvmMoveUseKernels(const char* name) {
+    const MoveKernels* k = NULL;
+    if (!strcmp(name, "scalar")) {
+        k = &scalarKernels;
+    }
+#if defined(MOVE_SSE2)
+    if (!strcmp(name, "sse2")) {
+        k = &sse2Kernels;
+    }
+#endif
+#if defined(MOVE_AVX2)
+    __builtin_cpu_init();
+    if (!strcmp(name, "avx2") && __builtin_cpu_supports("avx2")) {
+        k = &avx2Kernels;
+    }
+#endif
+#if defined(MOVE_NEON)
+    if (!strcmp(name, "neon")) {
+        k = &neonKernels;
+    }
+#endif
+    if (!k) {
+        return FALSE;
+    }
+    kernels = k;
+    return TRUE;
+}
+
+typedef struct {
+    uint64_t lo, hi;
+} Chunk16;
+
+static inline Chunk16 load128(const uint8_t* p) { Chunk16 v; memcpy(&v, p, 16); return v; }
+static inline void store128(uint8_t* p, Chunk16 v) { memcpy(p, &v, 16); }
+
+void rvmMoveMemory(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*) dest;
+    const uint8_t* s = (const uint8_t*) src;
+
+    // Small moves: load everything before storing anything
+    if (n <= 16) {
+        if (n >= 8) {
+            uint64_t a = load64(s);
+            uint64_t b = load64(s + n - 8);
+            store64(d, a);
+            store64(d + n - 8, b);
+        } else if (n >= 4) {
+            uint32_t a = load32(s);
+            uint32_t b = load32(s + n - 4);
+            store32(d, a);
+            store32(d + n - 4, b);
+        } else if (n >= 2) {
+            uint16_t a = load16(s);
+            uint16_t b = load16(s + n - 2);
+            store16(d, a);
+            store16(d + n - 2, b);
+        } else if (n == 1) {
+            *d = *s;
+        }
+        return;
+    }
+    if (n <= 32) {
+        Chunk16 a = load128(s);
+        Chunk16 b = load128(s + n - 16);
+        store128(d, a);
+        store128(d + n - 16, b);
+        return;
+    }
+    if (n <= 64) {
+        Chunk16 a = load128(s);
+        Chunk16 b = load128(s + 16);
+        Chunk16 c = load128(s + n - 32);
+        Chunk16 e = load128(s + n - 16);
+        store128(d, a);
+        store128(d + 16, b);
+        store128(d + n - 32, c);
+        store128(d + n - 16, e);
+        return;
+    }
+
+    if (d == s) {
+        return;
+    }
+    const MoveKernels* k = getKernels();
+    if (d < s || d >= s + n) {
+        if (n >= NON_TEMPORAL_THRESHOLD && (d + n <= s || d >= s + n)) {
+            k->forwardNonTemporal(d, s, n);
+        } else {
+            k->forward(d, s, n);
+        }
+    } else {
+        k->backward(d, s, n);
+    }
+}
+
+void rvmSwapMemory16(void* dest, const void* src, size_t count) {
+    size_t i = getKernels()->swap16((uint8_t*) dest, (const uint8_t*) src, count);
+    swap16Scalar((uint8_t*) dest + i * 2, (const uint8_t*) src + i * 2, count - i);
+}
+
+void rvmSwapMemory32(void* dest, const void* src, size_t count) {
+    size_t i = getKernels()->swap32((uint8_t*) dest, (const uint8_t*) src, count);
+    swap32Scalar((uint8_t*) dest + i * 4, (const uint8_t*) src + i * 4, count - i);
+}
+
+void rvmSwapMemory64(void* dest, const void* src, size_t count) {
+    size_t i = getKernels()->swap64((uint8_t*) dest, (const uint8_t*) src, count);
+    swap64Scalar((uint8_t*) dest + i * 8, (const uint8_t*) src + i * 8, count - i);
+}
@@ -16,6 +16,10 @@
 #include <bugvm.h>
 #include <string.h>
 
+#define LOG_TAG "core.native"
+// Initial capacity of implicitly created local ref frames
+#define LOCAL_REF_FRAME_DEFAULT_CAPACITY 16
+
 extern struct JNINativeInterface_ jni;
 extern struct JNIInvokeInterface_ javaVM;
 
@@ -59,6 +63,171 @@ jboolean rvmInitJNI(Env* env) {
     return TRUE;
 }
 
+/*
+ * JNI local refs are plain Object pointers just like global refs and are
+ * normally kept reachable by the GC scanning the native stack. Refs
+ * explicitly created using NewLocalRef(), the results of PopLocalFrame() and
+ * objects returned by JNI functions while the native method has a frame of
+ * its own are also recorded in the local ref frames of the Env. Each frame
+ * is a RefTable with uncollectable (and thus precisely scanned) entries.
+ * Frames are linked through RefTable->prev with Env->localRefs being the top
+ * frame. A frame belongs to the GatewayFrame which was current when it was
+ * pushed. Frames which haven't been popped explicitly when a native method
+ * returns are popped by _bcPopLocalRefFrames() in popNativeFrame() (see
+ * header.ll).
+ *
+ * Natively attached threads have no GatewayFrame outside of calls into Java.
+ * Nothing would ever pop an implicit frame for them so their refs are only
+ * recorded in frames pushed with PushLocalFrame().
+ */
+static jint localRefsHighWaterMark = 0;
+
+static void updateLocalRefsHighWaterMark(Env* env) {
+    jint refs = 0;
+    jint frames = 0;
+    RefTable* frame;
+    for (frame = env->localRefs; frame; frame = frame->prev) {
+        refs += frame->count;
+        frames++;
+    }
+    jint mark = localRefsHighWaterMark;
+    // Only report when the mark passes a power of 2 to keep the log sane
+    if (refs > mark && rvmAtomicCompareAndSwapInt(&localRefsHighWaterMark, mark, refs)
+            && (refs & (refs - 1)) == 0) {
+        Method* method = rvmGetCallingMethod(env);
+        rvmExceptionClear(env);
+        INFOF("New JNI local refs high-water mark: %d refs in %d frames (thread %d, method %s.%s%s)",
+            refs, frames, env->currentThread ? env->currentThread->threadId : 0,
+            method ? method->clazz->name : "?", method ? method->name : "?", method ? method->desc : "");
+    }
+}
+
+static jboolean pushLocalRefFrame(Env* env, jint capacity, jboolean implicit) {
+    RefTable* frame = calloc(1, sizeof(RefTable));
+    if (!frame) {
+        rvmThrowOutOfMemoryError(env);
+        return FALSE;
+    }
+    if (!rvmInitRefTable(env, frame, capacity > 0 ? capacity : LOCAL_REF_FRAME_DEFAULT_CAPACITY)) {
+        free(frame);
+        return FALSE;
+    }
+    frame->gatewayFrame = env->gatewayFrames;
+    frame->implicit = implicit;
+    frame->prev = env->localRefs;
+    env->localRefs = frame;
+    return TRUE;
+}
+
+static void popLocalRefFrame(Env* env) {
+    RefTable* frame = env->localRefs;
+    env->localRefs = frame->prev;
+    rvmFreeMemoryUncollectable(env, frame->entries);
+    free(frame);
+}
+
+/*
+ * Returns the top local ref frame if it belongs to the current native
+ * method or NULL if the native method hasn't got any frame.
+ */
+static inline RefTable* currentLocalRefFrame(Env* env) {
+    RefTable* frame = env->localRefs;
+    return frame && frame->gatewayFrame == env->gatewayFrames ? frame : NULL;
+}
+
+jboolean rvmPushLocalRefFrame(Env* env, jint capacity) {
+    return pushLocalRefFrame(env, capacity, FALSE);
+}
+
+/*
+ * Pops the top local ref frame if it was pushed by rvmPushLocalRefFrame()
+ * during the current native method. Returns FALSE and leaves the frames
+ * untouched otherwise.
+ */
+jboolean rvmPopLocalRefFrame(Env* env) {
+    RefTable* frame = currentLocalRefFrame(env);
+    if (!frame || frame->implicit) {
+        return FALSE;
+    }
+    popLocalRefFrame(env);
+    return TRUE;
+}
+
+/*
+ * Pops all local ref frames pushed while the current GatewayFrame was
+ * current. Called when a native method returns.
+ */
+void rvmPopNativeLocalRefFrames(Env* env) {
+    while (currentLocalRefFrame(env)) {
+        popLocalRefFrame(env);
+    }
+}
+
+void rvmFreeLocalRefFrames(Env* env) {
+    while (env->localRefs) {
+        popLocalRefFrame(env);
+    }
+}
+
+/*
+ * Returns the top local ref frame of the current native method. Creates
+ * an implicit frame if the native method hasn't pushed any frame yet.
+ * Returns NULL without an exception if refs aren't recorded at all (see
+ * above).
+ */
+static RefTable* getLocalRefFrame(Env* env) {
+    RefTable* frame = currentLocalRefFrame(env);
+    if (frame || !env->gatewayFrames) {
+        return frame;
+    }
+    if (!pushLocalRefFrame(env, LOCAL_REF_FRAME_DEFAULT_CAPACITY, TRUE)) {
+        return NULL;
+    }
+    return env->localRefs;
+}
+
+jboolean rvmAddLocalRef(Env* env, Object* object) {
+    if (!object) return TRUE;
+    RefTable* frame = getLocalRefFrame(env);
+    if (!frame) {
+        return env->gatewayFrames ? FALSE : TRUE;
+    }
+    if (!rvmAddRef(env, frame, object)) {
+        return FALSE;
+    }
+    if (env->vm->options->enableLocalRefStats) {
+        updateLocalRefsHighWaterMark(env);
+    }
+    return TRUE;
+}
+
+/*
+ * Removes a ref from the top frame of the current native method. Refs in
+ * older frames stay until their frames are popped.
+ */
+jboolean rvmRemoveLocalRef(Env* env, Object* object) {
+    RefTable* frame = currentLocalRefFrame(env);
+    return frame ? rvmRemoveRef(env, frame, object) : FALSE;
+}
+
+/*
+ * Records an object returned to native code by a JNI function in the top
+ * frame of the current native method if it has one. Otherwise the object
+ * is kept alive by the native stack like before.
+ */
+static inline void* localRef(Env* env, void* object) {
+    RefTable* frame = currentLocalRefFrame(env);
+    if (object && frame && rvmAddRef(env, frame, (Object*) object)
+            && env->vm->options->enableLocalRefStats) {
+        updateLocalRefsHighWaterMark(env);
+    }
+    return object;
+}
+
+jint rvmGetLocalRefsHighWaterMark(Env* env) {
+    return localRefsHighWaterMark;
+}
+
 static void throwUnsupportedOperationException(Env* env, char* msg) {
     Class* clazz = rvmFindClassUsingLoader(env, "java/lang/UnsupportedOperationException", NULL);
     if (!clazz) return;
@@ -148,9 +317,9 @@ static jobject ToReflectedMethod(JNIEnv* env, jclass cls, jmethodID methodID, jb
         return NULL;
     }
     if (!strcmp("<init>", method->name)) {
-        return (jobject) rvmNewObject((Env*) env, java_lang_reflect_Constructor, java_lang_reflect_Constructor_init, PTR_TO_LONG(method));
+        return (jobject) localRef((Env*) env, rvmNewObject((Env*) env, java_lang_reflect_Constructor, java_lang_reflect_Constructor_init, PTR_TO_LONG(method)));
     } else {
-        return (jobject) rvmNewObject((Env*) env, java_lang_reflect_Method, java_lang_reflect_Method_init, PTR_TO_LONG(method));
+        return (jobject) localRef((Env*) env, rvmNewObject((Env*) env, java_lang_reflect_Method, java_lang_reflect_Method_init, PTR_TO_LONG(method)));
     }
 }
 
@@ -205,7 +374,7 @@ static jobject ToReflectedField(JNIEnv* env, jclass cls, jfieldID fieldID, jbool
     if (((Class*) cls) != field->clazz || (FIELD_IS_STATIC(field) ? TRUE : FALSE) != isStatic) {
         return NULL;
     }
-    return (jobject) rvmNewObject((Env*) env, java_lang_reflect_Field, java_lang_reflect_Field_init, PTR_TO_LONG(field));
+    return (jobject) localRef((Env*) env, rvmNewObject((Env*) env, java_lang_reflect_Field, java_lang_reflect_Field_init, PTR_TO_LONG(field)));
 }
 
 static jint Throw(JNIEnv* env, jthrowable obj) {
@@ -218,7 +387,7 @@ static jint ThrowNew(JNIEnv* env, jclass clazz, const char* msg) {
 }
 
 static jthrowable ExceptionOccurred(JNIEnv* env) {
-    return (jthrowable) rvmExceptionOccurred((Env*) env);
+    return (jthrowable) localRef((Env*) env, rvmExceptionOccurred((Env*) env));
 }
 
 static void ExceptionDescribe(JNIEnv* env) {
@@ -237,11 +406,16 @@ static void FatalError(JNIEnv* env, const char* msg) {
 }
 
 static jint PushLocalFrame(JNIEnv* env, jint cap) {
-    return 0;
+    return rvmPushLocalRefFrame((Env*) env, cap) ? JNI_OK : JNI_ERR;
 }
 
 static jobject PopLocalFrame(JNIEnv* env, jobject res) {
-    return res;
+    if (!rvmPopLocalRefFrame((Env*) env)) {
+        WARN("PopLocalFrame() without a matching PushLocalFrame() ignored");
+        return res;
+    }
+    // Keep the result alive in the previous frame
+    return localRef((Env*) env, res);
 }
 
 static jobject NewGlobalRef(JNIEnv* env, jobject lobj) {
@@ -254,6 +428,9 @@ static void DeleteGlobalRef(JNIEnv* env, jobject gref) {
 }
 
 static void DeleteLocalRef(JNIEnv* env, jobject obj) {
+    if (obj) {
+        rvmRemoveLocalRef((Env*) env, (Object*) obj);
+    }
 }
 
 static jboolean IsSameObject(JNIEnv* env, jobject obj1, jobject obj2) {
@@ -261,23 +438,41 @@ static jboolean IsSameObject(JNIEnv* env, jobject obj1, jobject obj2) {
 }
 
 static jobject NewLocalRef(JNIEnv* env, jobject ref) {
+    if (!rvmAddLocalRef((Env*) env, (Object*) ref)) {
+        return NULL;
+    }
     return ref;
 }
 
 static jint EnsureLocalCapacity(JNIEnv* env, jint capacity) {
-    return 0;
+    RefTable* frame = getLocalRefFrame((Env*) env);
+    if (!frame) {
+        return ((Env*) env)->gatewayFrames ? JNI_ERR : JNI_OK;
+    }
+    jint needed = frame->count + capacity;
+    if (needed > frame->size) {
+        void** entries = rvmAllocateMemoryUncollectable((Env*) env, needed * sizeof(void*));
+        if (!entries) {
+            return JNI_ERR;
+        }
+        memcpy(entries, frame->entries, frame->count * sizeof(void*));
+        rvmFreeMemoryUncollectable((Env*) env, frame->entries);
+        frame->entries = entries;
+        frame->size = needed;
+    }
+    return JNI_OK;
 }
 
 static jobject AllocObject(JNIEnv* env, jclass clazz) {
-    return (jobject) rvmAllocateObject((Env*) env, (Class*) clazz);
+    return (jobject) localRef((Env*) env, rvmAllocateObject((Env*) env, (Class*) clazz));
 }
 
 static jobject NewObjectV(JNIEnv* env, jclass clazz, jmethodID methodID, va_list args) {
-    return (jobject) rvmNewObjectV((Env*) env, (Class*) clazz, (Method*) methodID, args);
+    return (jobject) localRef((Env*) env, rvmNewObjectV((Env*) env, (Class*) clazz, (Method*) methodID, args));
 }
 
 static jobject NewObjectA(JNIEnv* env, jclass clazz, jmethodID methodID, jvalue* args) {
-    return (jobject) rvmNewObjectA((Env*) env, (Class*) clazz, (Method*) methodID, args);
+    return (jobject) localRef((Env*) env, rvmNewObjectA((Env*) env, (Class*) clazz, (Method*) methodID, args));
 }
 
 static jobject NewObject(JNIEnv* env, jclass clazz, jmethodID methodID, ...) {
@@ -301,11 +496,11 @@ static jmethodID GetMethodID(JNIEnv* env, jclass clazz, const char* name, const
 }
 
 static jobject CallObjectMethodV(JNIEnv* env, jobject obj, jmethodID methodID, va_list args) {
-    return (jobject) rvmCallObjectInstanceMethodV((Env*) env, (Object*) obj, (Method*) methodID, args);
+    return (jobject) localRef((Env*) env, rvmCallObjectInstanceMethodV((Env*) env, (Object*) obj, (Method*) methodID, args));
 }
 
 static jobject CallObjectMethodA(JNIEnv* env, jobject obj, jmethodID methodID, jvalue* args) {
-    return (jobject) rvmCallObjectInstanceMethodA((Env*) env, (Object*) obj, (Method*) methodID, args);
+    return (jobject) localRef((Env*) env, rvmCallObjectInstanceMethodA((Env*) env, (Object*) obj, (Method*) methodID, args));
 }
 
 static jobject CallObjectMethod(JNIEnv* env, jobject obj, jmethodID methodID, ...) {
@@ -460,11 +655,11 @@ static void CallVoidMethod(JNIEnv* env, jobject obj, jmethodID methodID, ...) {
 }
 
 static jobject CallNonvirtualObjectMethodV(JNIEnv* env, jobject obj, jclass clazz, jmethodID methodID, va_list args) {
-    return (jobject) rvmCallNonvirtualObjectInstanceMethodV((Env*) env, (Object*) obj, (Method*) methodID, args);
+    return (jobject) localRef((Env*) env, rvmCallNonvirtualObjectInstanceMethodV((Env*) env, (Object*) obj, (Method*) methodID, args));
 }
 
 static jobject CallNonvirtualObjectMethodA(JNIEnv* env, jobject obj, jclass clazz, jmethodID methodID, jvalue*  args) {
-    return (jobject) rvmCallNonvirtualObjectInstanceMethodA((Env*) env, (Object*) obj, (Method*) methodID, args);
+    return (jobject) localRef((Env*) env, rvmCallNonvirtualObjectInstanceMethodA((Env*) env, (Object*) obj, (Method*) methodID, args));
 }
 
 static jobject CallNonvirtualObjectMethod(JNIEnv* env, jobject obj, jclass clazz, jmethodID methodID, ...) {
@@ -623,7 +818,7 @@ static jfieldID GetFieldID(JNIEnv* env, jclass clazz, const char* name, const ch
 }
 
 static jobject GetObjectField(JNIEnv* env, jobject obj, jfieldID fieldID) {
-    return (jobject) rvmGetObjectInstanceFieldValue((Env*) env, (Object*) obj, (InstanceField*) fieldID);
+    return (jobject) localRef((Env*) env, rvmGetObjectInstanceFieldValue((Env*) env, (Object*) obj, (InstanceField*) fieldID));
 }
 
 static jboolean GetBooleanField(JNIEnv* env, jobject obj, jfieldID fieldID) {
@@ -699,11 +894,11 @@ static jmethodID GetStaticMethodID(JNIEnv* env, jclass clazz, const char* name,
 }
 
 static jobject CallStaticObjectMethodV(JNIEnv* env, jclass clazz, jmethodID methodID, va_list args) {
-    return (jobject) rvmCallObjectClassMethodV((Env*) env, (Class*) clazz, (Method*) methodID, args);
+    return (jobject) localRef((Env*) env, rvmCallObjectClassMethodV((Env*) env, (Class*) clazz, (Method*) methodID, args));
 }
 
 static jobject CallStaticObjectMethodA(JNIEnv* env, jclass clazz, jmethodID methodID, jvalue* args) {
-    return (jobject) rvmCallObjectClassMethodA((Env*) env, (Class*) clazz, (Method*) methodID, args);
+    return (jobject) localRef((Env*) env, rvmCallObjectClassMethodA((Env*) env, (Class*) clazz, (Method*) methodID, args));
 }
 
 static jobject CallStaticObjectMethod(JNIEnv* env, jclass clazz, jmethodID methodID, ...) {
@@ -862,7 +1057,7 @@ static jfieldID GetStaticFieldID(JNIEnv* env, jclass clazz, const char* name, co
 }
 
 static jobject GetStaticObjectField(JNIEnv* env, jclass clazz, jfieldID fieldID) {
-    return (jobject) rvmGetObjectClassFieldValue((Env*) env, (Class*) clazz, (ClassField*) fieldID);
+    return (jobject) localRef((Env*) env, rvmGetObjectClassFieldValue((Env*) env, (Class*) clazz, (ClassField*) fieldID));
 }
 
 static jboolean GetStaticBooleanField(JNIEnv* env, jclass clazz, jfieldID fieldID) {
@@ -934,7 +1129,7 @@ static void SetStaticDoubleField(JNIEnv* env, jclass clazz, jfieldID fieldID, jd
 }
 
 static jstring NewString(JNIEnv* env, const jchar* unicode, jsize len) {
-    return (jstring) rvmNewString((Env*) env, (jchar*) unicode, len);
+    return (jstring) localRef((Env*) env, rvmNewString((Env*) env, (jchar*) unicode, len));
 }
 
 static jsize GetStringLength(JNIEnv* env, jstring str) {
@@ -950,7 +1145,7 @@ static void ReleaseStringChars(JNIEnv* env, jstring str, const jchar* chars) {
 }
   
 static jstring NewStringUTF(JNIEnv* env, const char* utf) {
-    return (jstring) rvmNewStringUTF((Env*) env, (char*) utf, -1);
+    return (jstring) localRef((Env*) env, rvmNewStringUTF((Env*) env, (char*) utf, -1));
 }
 
 static jsize GetStringUTFLength(JNIEnv* env, jstring str) {
@@ -970,11 +1165,11 @@ static jsize GetArrayLength(JNIEnv* env, jarray array) {
 }
 
 static jobjectArray NewObjectArray(JNIEnv* env, jsize len, jclass clazz, jobject init) {
-    return (jobjectArray) rvmNewObjectArray((Env*) env, len, (Class*) clazz, NULL, (Object*) init);
+    return (jobjectArray) localRef((Env*) env, rvmNewObjectArray((Env*) env, len, (Class*) clazz, NULL, (Object*) init));
 }
 
 static jobject GetObjectArrayElement(JNIEnv* env, jobjectArray array, jsize index) {
-    return (jobject) ((ObjectArray*) array)->values[index];
+    return (jobject) localRef((Env*) env, ((ObjectArray*) array)->values[index]);
 }
 
 static void SetObjectArrayElement(JNIEnv* env, jobjectArray array, jsize index, jobject val) {
@@ -982,35 +1177,35 @@ static void SetObjectArrayElement(JNIEnv* env, jobjectArray array, jsize index,
 }
 
 static jbooleanArray NewBooleanArray(JNIEnv* env, jsize len) {
-    return (jbooleanArray) rvmNewBooleanArray((Env*) env, len);
+    return (jbooleanArray) localRef((Env*) env, rvmNewBooleanArray((Env*) env, len));
 }
 
 static jbyteArray NewByteArray(JNIEnv* env, jsize len) {
-    return (jbyteArray) rvmNewByteArray((Env*) env, len);
+    return (jbyteArray) localRef((Env*) env, rvmNewByteArray((Env*) env, len));
 }
 
 static jcharArray NewCharArray(JNIEnv* env, jsize len) {
-    return (jcharArray) rvmNewCharArray((Env*) env, len);
+    return (jcharArray) localRef((Env*) env, rvmNewCharArray((Env*) env, len));
 }
 
 static jshortArray NewShortArray(JNIEnv* env, jsize len) {
-    return (jshortArray) rvmNewShortArray((Env*) env, len);
+    return (jshortArray) localRef((Env*) env, rvmNewShortArray((Env*) env, len));
 }
 
 static jintArray NewIntArray(JNIEnv* env, jsize len) {
-    return (jintArray) rvmNewIntArray((Env*) env, len);
+    return (jintArray) localRef((Env*) env, rvmNewIntArray((Env*) env, len));
 }
 
 static jlongArray NewLongArray(JNIEnv* env, jsize len) {
-    return (jlongArray) rvmNewLongArray((Env*) env, len);
+    return (jlongArray) localRef((Env*) env, rvmNewLongArray((Env*) env, len));
 }
 
 static jfloatArray NewFloatArray(JNIEnv* env, jsize len) {
-    return (jfloatArray) rvmNewFloatArray((Env*) env, len);
+    return (jfloatArray) localRef((Env*) env, rvmNewFloatArray((Env*) env, len));
 }
 
 static jdoubleArray NewDoubleArray(JNIEnv* env, jsize len) {
-    return (jdoubleArray) rvmNewDoubleArray((Env*) env, len);
+    return (jdoubleArray) localRef((Env*) env, rvmNewDoubleArray((Env*) env, len));
 }
 
 static jboolean* GetBooleanArrayElements(JNIEnv* env, jbooleanArray array, jboolean* isCopy) {
@@ -1228,7 +1423,7 @@ static jboolean ExceptionCheck(JNIEnv* env) {
 }
 
 static jobject NewDirectByteBuffer(JNIEnv* env, void* address, jlong capacity) {
-    return (jobject) rvmNewDirectByteBuffer((Env*) env, address, capacity);
+    return (jobject) localRef((Env*) env, rvmNewDirectByteBuffer((Env*) env, address, capacity));
 }
 
 static void* GetDirectBufferAddress(JNIEnv* env, jobject buf) {
@@ -39,7 +39,13 @@ extern void gcAddRoots(void* start, void* end);
 extern uint32_t gcNewDirectBitmapKind(size_t bitmap);
 extern void* gcAllocate(size_t size);
 extern void* gcAllocateUncollectable(size_t size);
+extern void* gcAllocateAtomicUncollectable(size_t size);
 extern void gcFree(void* ptr);
+extern void gcFreeTlab(Env* env);
+extern void gcSetAllocationSampleInterval(jint interval);
+extern void gcFinalizeObject(Env* env, Object* obj);
+extern void gcFlushClearedReferences(Env* env);
+extern void gcInvokeFinalizers(Env* env);
 extern void* allocateMemoryOfKind(Env* env, size_t size, uint32_t kind);
 extern void registerCleanupHandler(Env* env, Object* object, CleanupHandler handler);
 
@@ -64,14 +70,43 @@ extern void unwindIterateCallStack(Env* env, void* fp, jboolean (*iterator)(Env*
 /* method.c */
 extern void captureCallStack(Env* env, Frame* fp, CallStack* data, jint maxLength);
 extern CallStack* captureCallStackFromFrame(Env* env, Frame* fp);
+extern void freeCallStackBuffer(Env* env);
 
 /* signal.c */
 extern void dumpThreadStackTrace(Env* env, Thread* thread, CallStack* callStack);
+extern jboolean runWithThreadStopped(Env* env, Thread* thread, void (*f)(Thread*, void*), void* data);
+extern jboolean rvmInstallProfilingSignal(Env* env);
+
+/* finalizer.c */
+extern jboolean finalizerEnqueue(Env* env, Object* obj);
+extern void finalizerNotify(Env* env);
+extern void finalizerRequestInvoke(void);
+
+/* profiler.c */
+extern void profilerAttachThread(Env* env);
+extern void profilerDetachThread(Env* env);
+extern void profilerRecordSample(Env* env, void* pc, Frame* fp);
+extern void allocationProfilerRecordSample(Env* env, Class* clazz, jlong bytes);
+extern jboolean contentionProfilerEnabled(void);
+extern void contentionProfilerRecord(Env* env, Object* obj, jlong nanos);
+
+/* monitor.c */
+extern void deflateMonitors();
+extern jlong monotonicNanos(void);
 
 /* class.c */
 extern uint32_t nextClassId();
+extern uint32_t getLoadedClassCount();
 extern ProxyMethod* addProxyMethod(Env* env, Class* clazz, Method* proxiedMethod, jint access, void* impl);
 
+/* lookup.c */
+extern Method* indexedMethod(Env* env, Class* clazz, const char* name, const char* desc);
+extern Field* indexedField(Env* env, Class* clazz, const char* name, const char* desc);
+extern jboolean isMethodMiss(Class* clazz, const char* name, const char* desc);
+extern void addMethodMiss(Class* clazz, const char* name, const char* desc);
+extern jboolean isFieldMiss(Class* clazz, const char* name, const char* desc);
+extern void addFieldMiss(Class* clazz, const char* name, const char* desc);
+
 /* call0-<os>-<arch>.s and proxy0-<os>-<arch>.s */
 #define RETURN_TYPE_INT    0
 #define RETURN_TYPE_LONG   1
@@ -0,0 +1,747 @@
+/*
+ * Copyright (C) 2012 RoboVM AB
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sampling CPU profiler. A SIGPROF timer (see signal.c) interrupts the
+ * running threads at regular intervals. The signal handler walks the
+ * frame pointer chain of the interrupted thread and pushes the raw PCs
+ * into a lock-free ring buffer owned by the thread. A background thread
+ * periodically drains the ring buffers of all threads and aggregates
+ * identical stacks. When the profiler is stopped the PCs are symbolized
+ * using the method address index and the profile is written in the
+ * collapsed stack format understood by flamegraph.pl and most profile
+ * viewers:
+ *
+ *   java.lang.Thread.run;com.example.Foo.bar;com.example.Foo.baz 42
+ *
+ * This file also contains the allocation profiler. memory.c samples the
+ * allocations of each thread roughly every N bytes (see sampleAllocation())
+ * and hands the samples to allocationProfilerRecordSample() which captures
+ * a shallow call stack and aggregates the samples by allocated class and
+ * call stack. The allocation profile is written in the same format with
+ * the allocated class as leaf frame and the estimated number of allocated
+ * bytes as count:
+ *
+ *   com.example.Foo.bar;com.example.Foo.baz;java.lang.StringBuilder 1048576
+ *
+ * Finally this file contains the monitor contention profiler. monitor.c
+ * reports every contended monitor acquisition with the time the thread was
+ * blocked, and every lock inflation, to contentionProfilerRecord(). These
+ * are rare compared to uncontended acquisitions so a shallow call stack is
+ * captured for each of them. Events are aggregated by the class of the
+ * locked object and call stack. The report is plain text listing the
+ * classes and then the call sites by total blocked time with the number
+ * of contended acquisitions, total and max blocked time, inflations and a
+ * log2 histogram of the blocked times in microseconds.
+ */
+#include <bugvm.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "private.h"
+#include "uthash.h"
+
+#define LOG_TAG "core.profiler"
+
+#define PROFILE_BUFFER_WORDS 4096 // Must be a power of 2
+#define PROFILE_MAX_DEPTH 128
+#define PROFILE_DEFAULT_INTERVAL 10000 // 10 ms, 100 samples per second
+#define PROFILE_DRAIN_INTERVAL_MS 100
+#define ALLOCATION_PROFILE_MAX_DEPTH 8
+#define ALLOCATION_PROFILE_DEFAULT_INTERVAL (512 * 1024) // 512 KB
+#define CONTENTION_PROFILE_MAX_DEPTH 8
+// Bucket 0 counts blocked times < 1 us, bucket i times in [2^(i-1), 2^i) us
+// and the last bucket everything longer.
+#define CONTENTION_HISTOGRAM_BUCKETS 20
+
+/*
+ * Single producer (the signal handler of the owning thread), single
+ * consumer (the drainer thread) ring buffer. Each sample is stored as a
+ * depth word followed by depth PCs, leaf first.
+ */
+struct ProfileBuffer {
+    struct ProfileBuffer* next;
+    volatile uint32_t head; // Only written by the owning thread
+    volatile uint32_t tail; // Only written by the drainer thread
+    volatile jboolean orphaned; // Set when the owning thread has detached
+    jint dropped; // Samples dropped because the buffer was full
+    uintptr_t words[PROFILE_BUFFER_WORDS];
+};
+
+typedef struct ProfileStack {
+    UT_hash_handle hh;
+    jlong count;
+    jint depth;
+    void* pcs[0];
+} ProfileStack;
+
+typedef struct AllocationSite {
+    UT_hash_handle hh;
+    jlong samples;
+    jlong bytes; // Estimated number of bytes allocated at this site
+    jint depth;
+    void* key[0]; // The allocated Class followed by depth PCs, leaf first
+} AllocationSite;
+
+typedef struct ContentionSite {
+    UT_hash_handle hh;
+    jlong contended; // Number of contended acquisitions
+    jlong inflations;
+    jlong totalNanos; // Total time blocked
+    jlong maxNanos;
+    jlong histogram[CONTENTION_HISTOGRAM_BUCKETS];
+    jint depth;
+    void* key[0]; // The Class of the locked object followed by depth PCs, leaf first
+} ContentionSite;
+
+typedef struct ContentionClass {
+    UT_hash_handle hh;
+    Class* clazz;
+    jlong contended;
+    jlong inflations;
+    jlong totalNanos;
+    jlong maxNanos;
+} ContentionClass;
+
+static Mutex profilerLock;
+static jboolean profilerLockInitialized = FALSE;
+static volatile jboolean profiling = FALSE;
+static jboolean drainerRunning = FALSE;
+static pthread_t drainerThread;
+static char* profileFile = NULL;
+static ProfileBuffer* buffers = NULL; // Protected by profilerLock
+static ProfileStack* stacks = NULL; // Protected by profilerLock
+static jlong samples = 0; // Protected by profilerLock
+static jlong dropped = 0; // Protected by profilerLock
+
+static Mutex allocationProfilerLock;
+static jboolean allocationProfilerLockInitialized = FALSE;
+static volatile jboolean allocationProfiling = FALSE;
+static char* allocationProfileFile = NULL;
+static AllocationSite* allocationSites = NULL; // Protected by allocationProfilerLock
+static jlong allocationSamples = 0; // Protected by allocationProfilerLock
+
+static Mutex contentionProfilerLock;
+static jboolean contentionProfilerLockInitialized = FALSE;
+static volatile jboolean contentionProfiling = FALSE;
+static char* contentionProfileFile = NULL;
+static ContentionSite* contentionSites = NULL; // Protected by contentionProfilerLock
+
+static void addStack(void** pcs, jint depth) {
+    ProfileStack* stack = NULL;
+    HASH_FIND(hh, stacks, pcs, depth * sizeof(void*), stack);
+    if (!stack) {
+        stack = calloc(1, sizeof(ProfileStack) + depth * sizeof(void*));
+        if (!stack) return;
+        stack->depth = depth;
+        memcpy(stack->pcs, pcs, depth * sizeof(void*));
+        HASH_ADD_KEYPTR(hh, stacks, stack->pcs, depth * sizeof(void*), stack);
+    }
+    stack->count++;
+    samples++;
+}
+
+/*
+ * Moves all complete samples in the buffer to the stacks table. Must be
+ * called with the profilerLock held.
+ */
+static void drainBuffer(ProfileBuffer* buffer) {
+    void* pcs[PROFILE_MAX_DEPTH];
+    uint32_t head = buffer->head;
+    rvmAtomicSynchronize();
+    uint32_t tail = buffer->tail;
+    while (tail != head) {
+        jint depth = (jint) buffer->words[tail++ & (PROFILE_BUFFER_WORDS - 1)];
+        jint i;
+        for (i = 0; i < depth; i++) {
+            pcs[i] = (void*) buffer->words[tail++ & (PROFILE_BUFFER_WORDS - 1)];
+        }
+        addStack(pcs, depth);
+    }
+    rvmAtomicSynchronize();
+    buffer->tail = tail;
+    dropped += buffer->dropped;
+    buffer->dropped = 0;
+}
+
+/*
+ * Drains all buffers and frees the ones belonging to threads which have
+ * detached. Must be called with the profilerLock held.
+ */
+static void drainBuffers(void) {
+    ProfileBuffer* prev = NULL;
+    ProfileBuffer* buffer = buffers;
+    while (buffer) {
+        ProfileBuffer* next = buffer->next;
+        jboolean orphaned = buffer->orphaned;
+        drainBuffer(buffer);
+        if (orphaned) {
+            if (prev) {
+                prev->next = next;
+            } else {
+                buffers = next;
+            }
+            free(buffer);
+        } else {
+            prev = buffer;
+        }
+        buffer = next;
+    }
+}
+
+static void* drainerThreadEntryPoint(void* arg) {
+    struct timespec ts = {0, PROFILE_DRAIN_INTERVAL_MS * 1000000L};
+    while (profiling) {
+        nanosleep(&ts, NULL);
+        rvmLockMutex(&profilerLock);
+        drainBuffers();
+        rvmUnlockMutex(&profilerLock);
+    }
+    return NULL;
+}
+
+static jboolean setTimer(jint interval) {
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value = timer.it_interval;
+    return setitimer(ITIMER_PROF, &timer, NULL) == 0 ? TRUE : FALSE;
+}
+
+void profilerAttachThread(Env* env) {
+    if (!profiling) return;
+    ProfileBuffer* buffer = calloc(1, sizeof(ProfileBuffer));
+    if (!buffer) {
+        WARNF("Failed to allocate profile buffer for thread %d", env->currentThread->threadId);
+        return;
+    }
+    rvmLockMutex(&profilerLock);
+    buffer->next = buffers;
+    buffers = buffer;
+    rvmUnlockMutex(&profilerLock);
+    // Publishes the buffer to the signal handler
+    rvmAtomicStorePtr((void**) &env->currentThread->profileBuffer, buffer);
+}
+
+void profilerDetachThread(Env* env) {
+    Thread* thread = env->currentThread;
+    ProfileBuffer* buffer = thread ? thread->profileBuffer : NULL;
+    if (!buffer) return;
+    // Once profileBuffer is NULL the signal handler won't touch the
+    // buffer so it's safe to hand it over to the drainer thread.
+    rvmAtomicStorePtr((void**) &thread->profileBuffer, NULL);
+    buffer->orphaned = TRUE;
+}
+
+/*
+ * Records a sample of the current thread. Called from the SIGPROF signal
+ * handler so this function must be async-signal-safe. Frames are only
+ * followed as long as they are properly nested within the thread's stack
+ * so garbage frame pointers in native code end the walk instead of
+ * faulting.
+ */
+void profilerRecordSample(Env* env, void* pc, Frame* fp) {
+    Thread* thread = env->currentThread;
+    if (!thread) return;
+    ProfileBuffer* buffer = thread->profileBuffer;
+    if (!buffer) return;
+
+    void* pcs[PROFILE_MAX_DEPTH];
+    jint depth = 0;
+    pcs[depth++] = pc;
+    void* low = &pcs[0]; // The signal handler runs on the thread's stack
+    void* high = thread->stackTop;
+    while (depth < PROFILE_MAX_DEPTH && (void*) fp > low && (void*) fp < high
+            && ((uintptr_t) fp & (sizeof(void*) - 1)) == 0) {
+        pcs[depth++] = fp->returnAddress;
+        low = fp;
+        fp = fp->prev;
+    }
+
+    uint32_t head = buffer->head;
+    uint32_t tail = buffer->tail;
+    if (PROFILE_BUFFER_WORDS - (head - tail) < (uint32_t) depth + 1) {
+        buffer->dropped++;
+        return;
+    }
+    buffer->words[head++ & (PROFILE_BUFFER_WORDS - 1)] = (uintptr_t) depth;
+    jint i;
+    for (i = 0; i < depth; i++) {
+        buffer->words[head++ & (PROFILE_BUFFER_WORDS - 1)] = (uintptr_t) pcs[i];
+    }
+    rvmAtomicSynchronize();
+    buffer->head = head;
+}
+
+static void writeFrame(Env* env, FILE* f, void* pc, jboolean first) {
+    Method* method = env->currentThread ? rvmFindMethodAtAddress(env, pc) : NULL;
+    rvmExceptionClear(env);
+    if (!first) fputc(';', f);
+    if (method) {
+        const char* s = method->clazz->name;
+        for (; *s; s++) {
+            fputc(*s == '/' ? '.' : *s, f);
+        }
+        fprintf(f, ".%s", method->name);
+    } else {
+        fprintf(f, "%p", pc);
+    }
+}
+
+static void writeClassFrame(FILE* f, Class* clazz, jboolean first) {
+    if (!first) fputc(';', f);
+    const char* s = clazz->name;
+    for (; *s; s++) {
+        fputc(*s == '/' ? '.' : *s, f);
+    }
+}
+
+static jboolean writeProfile(Env* env, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        WARNF("Failed to open profile file %s", path);
+        return FALSE;
+    }
+    ProfileStack* stack;
+    for (stack = stacks; stack != NULL; stack = stack->hh.next) {
+        jint i;
+        for (i = stack->depth - 1; i >= 0; i--) {
+            // Return addresses point after the call instruction which may be
+            // the first instruction of the next method. Look up the call
+            // instead. The leaf PC is the actual interrupted instruction.
+            void* pc = i == 0 ? stack->pcs[i] : stack->pcs[i] - 1;
+            writeFrame(env, f, pc, i == stack->depth - 1);
+        }
+        fprintf(f, " %lld\n", stack->count);
+    }
+    fclose(f);
+    return TRUE;
+}
+
+jboolean rvmStartProfiler(Env* env, const char* path, jint interval) {
+    if (!profilerLockInitialized) {
+        if (rvmInitMutex(&profilerLock) != 0) return FALSE;
+        profilerLockInitialized = TRUE;
+    }
+    if (profiling) return TRUE;
+    if (interval <= 0) interval = PROFILE_DEFAULT_INTERVAL;
+    profileFile = strdup(path);
+    if (!profileFile) return FALSE;
+
+    profiling = TRUE;
+    if (!rvmInstallProfilingSignal(env)) {
+        profiling = FALSE;
+        return FALSE;
+    }
+    if (pthread_create(&drainerThread, NULL, drainerThreadEntryPoint, NULL) != 0) {
+        profiling = FALSE;
+        return FALSE;
+    }
+    drainerRunning = TRUE;
+    // Threads attached from now on get buffers in attachThread(). Other
+    // threads than the current one aren't sampled.
+    profilerAttachThread(env);
+    if (!setTimer(interval)) {
+        WARN("Failed to start profiling timer");
+        rvmStopProfiler(env);
+        return FALSE;
+    }
+    INFOF("Profiling started. Sampling every %d us. Profile will be written to %s", interval, path);
+    return TRUE;
+}
+
+jboolean rvmStopProfiler(Env* env) {
+    if (!profiling) return TRUE;
+    setTimer(0);
+    profiling = FALSE;
+    if (drainerRunning) {
+        pthread_join(drainerThread, NULL);
+        drainerRunning = FALSE;
+    }
+    profilerDetachThread(env);
+
+    rvmLockMutex(&profilerLock);
+    drainBuffers();
+    jboolean result = writeProfile(env, profileFile);
+    INFOF("Profiling stopped. %lld samples taken, %lld dropped", samples, dropped);
+    ProfileStack* stack;
+    ProfileStack* tmp;
+    HASH_ITER(hh, stacks, stack, tmp) {
+        HASH_DEL(stacks, stack);
+        free(stack);
+    }
+    samples = 0;
+    dropped = 0;
+    free(profileFile);
+    profileFile = NULL;
+    rvmUnlockMutex(&profilerLock);
+    return result;
+}
+
+/*
+ * Records an allocation sample. Called by memory.c right after an object
+ * of the specified class has been allocated. bytes is the number of bytes
+ * allocated by the current thread since the previous sample.
+ */
+void allocationProfilerRecordSample(Env* env, Class* clazz, jlong bytes) {
+    if (!allocationProfiling || !env->currentThread) return;
+
+    struct {
+        CallStack callStack;
+        CallStackFrame frames[ALLOCATION_PROFILE_MAX_DEPTH];
+    } buffer;
+    CallStack* callStack = &buffer.callStack;
+    callStack->length = 0;
+    captureCallStack(env, NULL, callStack, ALLOCATION_PROFILE_MAX_DEPTH);
+    void* key[ALLOCATION_PROFILE_MAX_DEPTH + 1];
+    key[0] = clazz;
+    jint depth = callStack->length;
+    jint i;
+    for (i = 0; i < depth; i++) {
+        key[i + 1] = callStack->frames[i].pc;
+    }
+    size_t keyLength = (depth + 1) * sizeof(void*);
+
+    rvmLockMutex(&allocationProfilerLock);
+    AllocationSite* site = NULL;
+    HASH_FIND(hh, allocationSites, key, keyLength, site);
+    if (!site) {
+        site = calloc(1, sizeof(AllocationSite) + keyLength);
+        if (!site) {
+            rvmUnlockMutex(&allocationProfilerLock);
+            return;
+        }
+        site->depth = depth;
+        memcpy(site->key, key, keyLength);
+        HASH_ADD_KEYPTR(hh, allocationSites, site->key, keyLength, site);
+    }
+    site->samples++;
+    site->bytes += bytes;
+    allocationSamples++;
+    rvmUnlockMutex(&allocationProfilerLock);
+}
+
+static int compareAllocationSitesByBytesDesc(const void* _a, const void* _b) {
+    AllocationSite* a = *((AllocationSite**) _a);
+    AllocationSite* b = *((AllocationSite**) _b);
+    return a->bytes < b->bytes ? 1 : (a->bytes > b->bytes ? -1 : 0);
+}
+
+jboolean rvmDumpAllocationProfile(Env* env, const char* path) {
+    if (!allocationProfilerLockInitialized) return FALSE;
+    if (!path) path = allocationProfileFile;
+    if (!path) return FALSE;
+
+    // Symbolizing may load classes and allocate which in turn may record
+    // samples so the sites are copied and written without holding the lock.
+    rvmLockMutex(&allocationProfilerLock);
+    jint count = HASH_COUNT(allocationSites);
+    AllocationSite** sites = calloc(count > 0 ? count : 1, sizeof(AllocationSite*));
+    jint n = 0;
+    jint i, j;
+    AllocationSite* site;
+    for (site = allocationSites; sites && site != NULL; site = site->hh.next) {
+        size_t size = sizeof(AllocationSite) + (site->depth + 1) * sizeof(void*);
+        AllocationSite* copy = malloc(size);
+        if (!copy) break;
+        memcpy(copy, site, size);
+        sites[n++] = copy;
+    }
+    jlong samples = allocationSamples;
+    rvmUnlockMutex(&allocationProfilerLock);
+    if (!sites) return FALSE;
+
+    qsort(sites, n, sizeof(AllocationSite*), compareAllocationSitesByBytesDesc);
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        WARNF("Failed to open allocation profile file %s", path);
+    } else {
+        for (i = 0; i < n; i++) {
+            site = sites[i];
+            // All PCs are return addresses of calls into the allocation
+            // functions or the callees of the allocating methods.
+            for (j = site->depth; j > 0; j--) {
+                writeFrame(env, f, site->key[j] - 1, j == site->depth);
+            }
+            writeClassFrame(f, (Class*) site->key[0], site->depth == 0);
+            fprintf(f, " %lld\n", site->bytes);
+        }
+        fclose(f);
+        INFOF("Allocation profile with %lld samples in %d sites written to %s", samples, n, path);
+    }
+    for (i = 0; i < n; i++) {
+        free(sites[i]);
+    }
+    free(sites);
+    return f ? TRUE : FALSE;
+}
+
+jboolean rvmStartAllocationProfiler(Env* env, const char* path, jint interval) {
+    if (!allocationProfilerLockInitialized) {
+        if (rvmInitMutex(&allocationProfilerLock) != 0) return FALSE;
+        allocationProfilerLockInitialized = TRUE;
+    }
+    if (allocationProfiling) return TRUE;
+    if (interval <= 0) interval = ALLOCATION_PROFILE_DEFAULT_INTERVAL;
+    allocationProfileFile = path ? strdup(path) : NULL;
+    if (path && !allocationProfileFile) return FALSE;
+
+    allocationProfiling = TRUE;
+    gcSetAllocationSampleInterval(interval);
+    INFOF("Allocation profiling started. Sampling every %d bytes", interval);
+    return TRUE;
+}
+
+jboolean rvmStopAllocationProfiler(Env* env) {
+    if (!allocationProfiling) return TRUE;
+    gcSetAllocationSampleInterval(0);
+    allocationProfiling = FALSE;
+
+    jboolean result = TRUE;
+    if (allocationProfileFile) {
+        result = rvmDumpAllocationProfile(env, allocationProfileFile);
+    }
+    rvmLockMutex(&allocationProfilerLock);
+    AllocationSite* site;
+    AllocationSite* tmp;
+    HASH_ITER(hh, allocationSites, site, tmp) {
+        HASH_DEL(allocationSites, site);
+        free(site);
+    }
+    allocationSamples = 0;
+    free(allocationProfileFile);
+    allocationProfileFile = NULL;
+    rvmUnlockMutex(&allocationProfilerLock);
+    return result;
+}
+
+jboolean contentionProfilerEnabled(void) {
+    return contentionProfiling;
+}
+
+static jint histogramBucket(jlong nanos) {
+    jlong micros = nanos / 1000;
+    jint bucket = 0;
+    while (micros > 0 && bucket < CONTENTION_HISTOGRAM_BUCKETS - 1) {
+        micros >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * Records a contended acquisition of the lock of obj which blocked the
+ * current thread for the specified number of nanoseconds, or if nanos is
+ * negative, an inflation of the lock. Called by monitor.c. Must not lock
+ * any Java monitors.
+ */
+void contentionProfilerRecord(Env* env, Object* obj, jlong nanos) {
+    if (!contentionProfiling || !env->currentThread || !obj) return;
+
+    struct {
+        CallStack callStack;
+        CallStackFrame frames[CONTENTION_PROFILE_MAX_DEPTH];
+    } buffer;
+    CallStack* callStack = &buffer.callStack;
+    callStack->length = 0;
+    captureCallStack(env, NULL, callStack, CONTENTION_PROFILE_MAX_DEPTH);
+    void* key[CONTENTION_PROFILE_MAX_DEPTH + 1];
+    key[0] = obj->clazz;
+    jint depth = callStack->length;
+    jint i;
+    for (i = 0; i < depth; i++) {
+        key[i + 1] = callStack->frames[i].pc;
+    }
+    size_t keyLength = (depth + 1) * sizeof(void*);
+
+    rvmLockMutex(&contentionProfilerLock);
+    ContentionSite* site = NULL;
+    HASH_FIND(hh, contentionSites, key, keyLength, site);
+    if (!site) {
+        site = calloc(1, sizeof(ContentionSite) + keyLength);
+        if (!site) {
+            rvmUnlockMutex(&contentionProfilerLock);
+            return;
+        }
+        site->depth = depth;
+        memcpy(site->key, key, keyLength);
+        HASH_ADD_KEYPTR(hh, contentionSites, site->key, keyLength, site);
+    }
+    if (nanos < 0) {
+        site->inflations++;
+    } else {
+        site->contended++;
+        site->totalNanos += nanos;
+        if (nanos > site->maxNanos) {
+            site->maxNanos = nanos;
+        }
+        site->histogram[histogramBucket(nanos)]++;
+    }
+    rvmUnlockMutex(&contentionProfilerLock);
+}
+
+static int compareContentionSitesByTotalDesc(const void* _a, const void* _b) {
+    ContentionSite* a = *((ContentionSite**) _a);
+    ContentionSite* b = *((ContentionSite**) _b);
+    return a->totalNanos < b->totalNanos ? 1 : (a->totalNanos > b->totalNanos ? -1 : 0);
+}
+
+static int compareContentionClassesByTotalDesc(ContentionClass* a, ContentionClass* b) {
+    return a->totalNanos < b->totalNanos ? 1 : (a->totalNanos > b->totalNanos ? -1 : 0);
+}
+
+static void writeContentionCounts(FILE* f, jlong contended, jlong totalNanos, jlong maxNanos, jlong inflations) {
+    fprintf(f, "%lld contended, %lld us total, %lld us max, %lld inflations\n",
+            contended, totalNanos / 1000, maxNanos / 1000, inflations);
+}
+
+jboolean rvmDumpContentionProfile(Env* env, const char* path) {
+    if (!contentionProfilerLockInitialized) return FALSE;
+    if (!path) path = contentionProfileFile;
+    if (!path) return FALSE;
+
+    // Symbolizing may load classes and lock monitors which in turn may
+    // record events so the sites are copied and written without holding
+    // the lock.
+    rvmLockMutex(&contentionProfilerLock);
+    jint count = HASH_COUNT(contentionSites);
+    ContentionSite** sites = calloc(count > 0 ? count : 1, sizeof(ContentionSite*));
+    jint n = 0;
+    jint i, j;
+    ContentionSite* site;
+    for (site = contentionSites; sites && site != NULL; site = site->hh.next) {
+        size_t size = sizeof(ContentionSite) + (site->depth + 1) * sizeof(void*);
+        ContentionSite* copy = malloc(size);
+        if (!copy) break;
+        memcpy(copy, site, size);
+        sites[n++] = copy;
+    }
+    rvmUnlockMutex(&contentionProfilerLock);
+    if (!sites) return FALSE;
+
+    qsort(sites, n, sizeof(ContentionSite*), compareContentionSitesByTotalDesc);
+    ContentionClass* classes = NULL;
+    ContentionClass* c;
+    ContentionClass* tmp;
+    for (i = 0; i < n; i++) {
+        site = sites[i];
+        Class* clazz = (Class*) site->key[0];
+        HASH_FIND_PTR(classes, &clazz, c);
+        if (!c) {
+            c = calloc(1, sizeof(ContentionClass));
+            if (!c) continue;
+            c->clazz = clazz;
+            HASH_ADD_PTR(classes, clazz, c);
+        }
+        c->contended += site->contended;
+        c->inflations += site->inflations;
+        c->totalNanos += site->totalNanos;
+        if (site->maxNanos > c->maxNanos) {
+            c->maxNanos = site->maxNanos;
+        }
+    }
+    HASH_SORT(classes, compareContentionClassesByTotalDesc);
+
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        WARNF("Failed to open contention profile file %s", path);
+    } else {
+        fprintf(f, "Contended monitors by class:\n");
+        for (c = classes; c != NULL; c = c->hh.next) {
+            fputs("  ", f);
+            writeClassFrame(f, c->clazz, TRUE);
+            fputs(": ", f);
+            writeContentionCounts(f, c->contended, c->totalNanos, c->maxNanos, c->inflations);
+        }
+        fprintf(f, "\nContended monitors by class and call site:\n");
+        for (i = 0; i < n; i++) {
+            site = sites[i];
+            fputs("\n", f);
+            writeClassFrame(f, (Class*) site->key[0], TRUE);
+            fputs(": ", f);
+            writeContentionCounts(f, site->contended, site->totalNanos, site->maxNanos, site->inflations);
+            if (site->contended > 0) {
+                fputs("  blocked us:", f);
+                for (j = 0; j < CONTENTION_HISTOGRAM_BUCKETS; j++) {
+                    if (site->histogram[j] == 0) continue;
+                    if (j == 0) {
+                        fprintf(f, " <1:%lld", site->histogram[j]);
+                    } else if (j == CONTENTION_HISTOGRAM_BUCKETS - 1) {
+                        fprintf(f, " >=%lld:%lld", 1LL << (j - 1), site->histogram[j]);
+                    } else {
+                        fprintf(f, " %lld-%lld:%lld", 1LL << (j - 1), 1LL << j, site->histogram[j]);
+                    }
+                }
+                fputs("\n", f);
+            }
+            // All PCs are return addresses of calls into the monitor
+            // functions or the callees of the locking methods.
+            for (j = 1; j <= site->depth; j++) {
+                fputs("    at ", f);
+                writeFrame(env, f, site->key[j] - 1, TRUE);
+                fputs("\n", f);
+            }
+        }
+        fclose(f);
+        INFOF("Contention profile with %d call sites written to %s", n, path);
+    }
+    HASH_ITER(hh, classes, c, tmp) {
+        HASH_DEL(classes, c);
+        free(c);
+    }
+    for (i = 0; i < n; i++) {
+        free(sites[i]);
+    }
+    free(sites);
+    return f ? TRUE : FALSE;
+}
+
+jboolean rvmStartContentionProfiler(Env* env, const char* path) {
+    if (!contentionProfilerLockInitialized) {
+        if (rvmInitMutex(&contentionProfilerLock) != 0) return FALSE;
+        contentionProfilerLockInitialized = TRUE;
+    }
+    if (contentionProfiling) return TRUE;
+    contentionProfileFile = path ? strdup(path) : NULL;
+    if (path && !contentionProfileFile) return FALSE;
+
+    contentionProfiling = TRUE;
+    INFO("Contention profiling started");
+    return TRUE;
+}
+
+jboolean rvmStopContentionProfiler(Env* env) {
+    if (!contentionProfiling) return TRUE;
+    contentionProfiling = FALSE;
+
+    jboolean result = TRUE;
+    if (contentionProfileFile) {
+        result = rvmDumpContentionProfile(env, contentionProfileFile);
+    }
+    rvmLockMutex(&contentionProfilerLock);
+    ContentionSite* site;
+    ContentionSite* tmp;
+    HASH_ITER(hh, contentionSites, site, tmp) {
+        HASH_DEL(contentionSites, site);
+        free(site);
+    }
+    free(contentionProfileFile);
+    contentionProfileFile = NULL;
+    rvmUnlockMutex(&contentionProfilerLock);
+    return result;
+}
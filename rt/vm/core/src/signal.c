@@ -42,7 +42,9 @@ static inline int sem_post(sem_t* sem) {
 
 #define LOG_TAG "core.signal"
 
+// Also used by runWithThreadStopped()
 #define DUMP_THREAD_STACK_TRACE_SIGNAL SIGUSR1
+#define PROFILING_SIGNAL SIGPROF
 // The signal used in libcore's AsynchronousSocketCloseMonitor.cpp
 #if defined(__APPLE__)
 #define BLOCKED_THREAD_SIGNAL SIGUSR2
@@ -69,6 +71,12 @@ typedef struct {
 static Method* throwableInitMethod = NULL;
 static CallStack* dumpThreadStackTraceCallStack = NULL;
 static sem_t dumpThreadStackTraceCallSemaphore;
+// Serializes dumpThreadStackTrace() and runWithThreadStopped()
+static Mutex threadSignalLock;
+static volatile jboolean stopThreadRequested = FALSE;
+static sem_t threadStoppedSemaphore;
+static sem_t resumeThreadSemaphore;
+static jboolean signalsInitialized = FALSE;
 #if defined(DARWIN)
 static struct sigaction sigbusFallback;
 #endif
@@ -77,6 +85,7 @@ static struct sigaction sigsegvFallback;
 static void signalHandler_npe_so_nochaining(int signum, siginfo_t* info, void* context);
 static void signalHandler_npe_so_chaining(int signum, siginfo_t* info, void* context);
 static void signalHandler_dump_thread(int signum, siginfo_t* info, void* context);
+static void signalHandler_profile(int signum, siginfo_t* info, void* context);
 static jboolean installNoChainingSignals(Env* env);
 
 #if defined(DARWIN)
@@ -93,12 +102,19 @@ jboolean rvmInitSignals(Env* env) {
     if (sem_init(&dumpThreadStackTraceCallSemaphore, 0, 0) != 0) {
         return FALSE;
     }
+    if (sem_init(&threadStoppedSemaphore, 0, 0) != 0 || sem_init(&resumeThreadSemaphore, 0, 0) != 0) {
+        return FALSE;
+    }
+    if (rvmInitMutex(&threadSignalLock) != 0) {
+        return FALSE;
+    }
     if (!installNoChainingSignals(env)) {
         return FALSE;
     }
 #if defined(DARWIN)
     registerDarwinExceptionHandler();
 #endif
+    signalsInitialized = TRUE;
     return TRUE;
 }
 
@@ -183,6 +199,17 @@ static jboolean installNoChainingSignals(Env* env) {
     return TRUE;
 }
 
+jboolean rvmInstallProfilingSignal(Env* env) {
+    struct sigaction sa = create_sigaction(&signalHandler_profile);
+    // Don't make the syscalls of profiled threads fail with EINTR
+    sa.sa_flags |= SA_RESTART;
+    if (installSignalHandlerIfNeeded(PROFILING_SIGNAL, sa, NULL) != 0) {
+        rvmThrowInternalErrorErrno(env, errno);
+        return FALSE;
+    }
+    return TRUE;
+}
+
 jboolean rvmInstallThreadSignalMask(Env* env) {
     int err;
     if ((err = pthread_sigmask(0, NULL, &env->currentThread->signalMask)) != 0) {
@@ -227,14 +254,54 @@ void dumpThreadStackTrace(Env* env, Thread* thread, CallStack* callStack) {
     // NOTE: This function must not be called concurrently. It uses global 
     // variables to transfer data to/from a signal handler.
 
+    rvmLockMutex(&threadSignalLock);
     rvmAtomicStorePtr((void**) &dumpThreadStackTraceCallStack, callStack);
     if (pthread_kill(thread->pThread, DUMP_THREAD_STACK_TRACE_SIGNAL) != 0) {
         // The thread is probably not alive
+        rvmUnlockMutex(&threadSignalLock);
         return;
     }
 
     while (sem_wait(&dumpThreadStackTraceCallSemaphore) == EINTR) {
     }
+    rvmUnlockMutex(&threadSignalLock);
+}
+
+static void waitForSemaphore(sem_t* sem) {
+#if defined(DARWIN)
+    while (sem_wait(sem) == KERN_ABORTED) {
+    }
+#else
+    while (sem_wait(sem) != 0 && errno == EINTR) {
+    }
+#endif
+}
+
+/*
+ * Stops the specified thread in a signal handler, calls f(thread, data)
+ * and lets the thread continue. Since the stopped thread may hold any lock
+ * f must not lock anything or allocate memory. Returns FALSE if the thread
+ * couldn't be signalled. The caller must hold the threads list lock.
+ */
+jboolean runWithThreadStopped(Env* env, Thread* thread, void (*f)(Thread*, void*), void* data) {
+    if (!signalsInitialized) {
+        return FALSE;
+    }
+    rvmLockMutex(&threadSignalLock);
+    stopThreadRequested = TRUE;
+    if (pthread_kill(thread->pThread, DUMP_THREAD_STACK_TRACE_SIGNAL) != 0) {
+        stopThreadRequested = FALSE;
+        rvmUnlockMutex(&threadSignalLock);
+        return FALSE;
+    }
+    // Posting and waiting on the semaphores also makes sure the stopped
+    // thread's memory writes are visible to f and vice versa.
+    waitForSemaphore(&threadStoppedSemaphore);
+    f(thread, data);
+    stopThreadRequested = FALSE;
+    sem_post(&resumeThreadSemaphore);
+    rvmUnlockMutex(&threadSignalLock);
+    return TRUE;
 }
 
 static inline void* getFramePointer(ucontext_t* context) {
@@ -360,6 +427,14 @@ static void signalHandler_npe_so_chaining(int signum, siginfo_t* info, void* con
 }
 
 static void signalHandler_dump_thread(int signum, siginfo_t* info, void* context) {
+    if (stopThreadRequested) {
+        // Stopped by runWithThreadStopped()
+        int savedErrno = errno;
+        sem_post(&threadStoppedSemaphore);
+        waitForSemaphore(&resumeThreadSemaphore);
+        errno = savedErrno;
+        return;
+    }
     Env* env = rvmGetEnv();
     if (env) {
         Frame fakeFrame;
@@ -380,3 +455,19 @@ static void signalHandler_dump_thread(int signum, siginfo_t* info, void* context
     }
     sem_post(&dumpThreadStackTraceCallSemaphore);
 }
+
+static void signalHandler_profile(int signum, siginfo_t* info, void* context) {
+    int savedErrno = errno;
+    Env* env = rvmGetEnv();
+    if (env && env->currentThread) {
+        if (rvmIsNonNativeFrame(env)) {
+            profilerRecordSample(env, getPC((ucontext_t*) context), (Frame*) getFramePointer((ucontext_t*) context));
+        } else if (env->gatewayFrames) {
+            // Native code may not maintain frame pointers. Start at the frame
+            // which called into native code like signalHandler_dump_thread().
+            Frame* frame = (Frame*) env->gatewayFrames->frameAddress;
+            profilerRecordSample(env, frame->returnAddress, frame->prev);
+        }
+    }
+    errno = savedErrno;
+}
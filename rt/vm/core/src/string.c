@@ -17,199 +17,328 @@
 #include <string.h>
 #include <stddef.h>
 #include "private.h"
-#include "uthash.h"
 
 #define LOG_TAG "core.string"
 
-static uint32_t cacheEntryGCKind;
 static const jchar EMPTY_JCHARS = 0;
 
-// TODO: Restrict the number of bytes stored in the cache instead of the number of String objects.
-#define MAX_CACHE_SIZE 10000
-
-// GC descriptor specifying which words in a CacheEntry that should be scanned 
-// for heap pointers. The hh.hashv value in particular must not be scanned since
-// it often can be mistaken for a pointer.
-#define CACHE_ENTRY_GC_BITMAP (MAKE_GC_BITMAP(offsetof(CacheEntry, key)) \
-                              |MAKE_GC_BITMAP(offsetof(CacheEntry, string)) \
-                              |MAKE_GC_BITMAP(offsetof(CacheEntry, hh.next)))
-
-typedef struct CacheEntry {
-    const char* key; // The string in modified UTF-8
-    Object* string;  // The java.lang.String object.
-    UT_hash_handle hh;
-} CacheEntry;
-static CacheEntry* internedStrings = NULL;
-static Mutex internedStringsLock;
-
-static inline void obtainInternedStringsLock() {
-    rvmLockMutex(&internedStringsLock);
+/*
+ * The interned strings table is split into shards selected by the hash of
+ * the string's chars. Each shard is a chained hash table protected by its
+ * own lock. Entries and bucket arrays are allocated atomic and
+ * uncollectable so the GC never scans them. An entry references its String
+ * through a disappearing link which the GC clears once the String is no
+ * longer reachable from anywhere else. Cleared entries are unlinked and
+ * freed when a chain containing them is walked or when the shard grows.
+ *
+ * String literals are emitted by the compiler as String and char[] objects
+ * in the executable's data and are never GCed. They are the interned
+ * instances of their contents and are looked up in the table emitted by the
+ * linker, sorted by String.hashCode(), before the interned strings table.
+ * They never enter the interned strings table which only holds GCed Strings.
+ * Since the GC doesn't manage them, rvmRegisterReference() and
+ * registerCleanupHandler() in memory.c ignore them: references to a literal
+ * are never cleared.
+ */
+#define INTERNED_STRING_SHARDS 64 // Must be a power of 2
+#define INTERNED_STRING_SHARD_BITS 6
+#define INTERNED_STRING_SHARD_INITIAL_CAPACITY 64 // Must be a power of 2
+
+typedef struct InternedString {
+    struct InternedString* next;
+    Object* string; // Disappearing link. NULL once the String has been GCed.
+    uint32_t hash;
+} InternedString;
+
+typedef struct {
+    Mutex lock;
+    InternedString** buckets;
+    uint32_t capacity; // Always a power of 2
+    uint32_t count;
+} InternedStringShard;
+
+static InternedStringShard internedStrings[INTERNED_STRING_SHARDS];
+
+static Object** stringLiterals = NULL;
+static jint* stringLiteralHashes = NULL;
+static jint stringLiteralsCount = 0;
+
+/*
+ * The chars of a string being looked up. Exactly one of chars and utf8 is
+ * set. utf8 strings are decoded on the fly while hashing and comparing.
+ */
+typedef struct {
+    const jchar* chars;
+    const char* utf8;
+    jint length;
+    uint32_t hash;
+    jint stringHash; // Same as String.hashCode()
+} InternKey;
+
+#define LOAD_PTR(p) (*(void* volatile*) (p))
+
+static inline jchar nextUtf8Char(const unsigned char** utf8) {
+    const unsigned char* p = *utf8;
+    jchar ch = *p++;
+    if (ch & 0x80) {
+        if (ch & 0x20) {
+            ch = (jchar) (((0x0f & ch) << 12) + ((0x3f & p[0]) << 6) + (0x3f & p[1]));
+            p += 2;
+        } else {
+            ch = (jchar) (((0x1f & ch) << 6) + (0x3f & p[0]));
+            p += 1;
+        }
+    }
+    *utf8 = p;
+    return ch;
 }
 
-static inline void releaseInternedStringsLock() {
-    rvmUnlockMutex(&internedStringsLock);
+static inline uint32_t mixHash(uint32_t h) {
+    // String.hashCode() style hashes cluster in the low bits. Spread them
+    // since the high bits select the shard.
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
 }
 
-/**
- * Finds an interned string in the interned strings key. If found the string
- * will be "touched", i.e. marked as most recently used. The internedStringsLock
- * MUST be held when calling this function.
- */
-static Object* findInternedString(Env* env, const char* s) {
-    CacheEntry* cacheEntry;
-    HASH_FIND_STR(internedStrings, s, cacheEntry);
-    if (cacheEntry) {
-        // Touch the string
-        HASH_DELETE(hh, internedStrings, cacheEntry);
-        HASH_ADD_KEYPTR(hh, internedStrings, cacheEntry->key, strlen(cacheEntry->key), cacheEntry);
-        return cacheEntry->string;
+static void hashInternKey(InternKey* key) {
+    uint32_t h = 0;
+    jint i;
+    if (key->chars) {
+        for (i = 0; i < key->length; i++) {
+            h = 31 * h + key->chars[i];
+        }
+    } else {
+        const unsigned char* p = (const unsigned char*) key->utf8;
+        for (i = 0; i < key->length; i++) {
+            h = 31 * h + nextUtf8Char(&p);
+        }
     }
-    return NULL;
+    key->stringHash = (jint) h;
+    key->hash = mixHash(h);
 }
 
-/**
- * Adds a string to the cache of interned string. The string must not already be
- * interned.  The internedStringsLock MUST be held when calling this function.
- */
-static jboolean addInternedString(Env* env, const char* s,  Object* string) {
-    CacheEntry* cacheEntry = allocateMemoryOfKind(env, sizeof(CacheEntry), cacheEntryGCKind);
-    if (!cacheEntry) {
+static jboolean internKeyEquals(Env* env, InternKey* key, Object* string) {
+    if (rvmGetStringLength(env, string) != key->length) {
         return FALSE;
     }
-
-    cacheEntry->key = s;
-    cacheEntry->string = string;
-    HASH_ADD_KEYPTR(hh, internedStrings, cacheEntry->key, strlen(cacheEntry->key), cacheEntry);
-
-    // prune the cache to MAX_CACHE_SIZE
-    if (HASH_COUNT(internedStrings) >= MAX_CACHE_SIZE) {
-        CacheEntry* tmpEntry;
-        HASH_ITER(hh, internedStrings, cacheEntry, tmpEntry) {
-            // prune the first entry (loop is based on insertion order so this deletes the oldest item)
-            HASH_DELETE(hh, internedStrings, cacheEntry);
-            break;
+    jchar* chars = rvmGetStringChars(env, string);
+    if (key->chars) {
+        return memcmp(chars, key->chars, sizeof(jchar) * key->length) == 0;
+    }
+    const unsigned char* p = (const unsigned char*) key->utf8;
+    jint i;
+    for (i = 0; i < key->length; i++) {
+        if (chars[i] != nextUtf8Char(&p)) {
+            return FALSE;
         }
     }
-
     return TRUE;
 }
 
-// TODO: Return the same instance for strings of length == 0?
+static inline InternedStringShard* getInternedStringShard(uint32_t hash) {
+    return &internedStrings[hash >> (32 - INTERNED_STRING_SHARD_BITS)];
+}
 
-/* 
- * Determines the number of Java chars needed to store the 
- * specified modified UTF-8 string.
- * Copied from Harmony (vm_strings.cpp).
+/**
+ * Finds an interned string in the specified shard. Entries whose String has
+ * been GCed are removed as they are encountered. The shard's lock MUST be
+ * held when calling this function.
  */
-static jint getUnicodeLengthOfUtf8(const char* utf8) {
-    jint len = 0;
-    unsigned char ch;
-    unsigned char ch2;
-    unsigned char ch3;
-    while ((ch = *utf8++)) {
-        len++;
-        if (ch & 0x80) { // 2 or 3 byte encoding
-            if (! (ch & 0x40))
-                return -1;
-            ch2 = *utf8++;
-            if (ch & 0x20) { // 3 byte encoding
-                ch3 = *utf8++;
-                if ((ch  & 0xf0) != 0xe0  ||  // check first byte high bits
-                    (ch2 & 0xc0) != 0x80  ||  // check second byte high bits
-                    (ch3 & 0xc0) != 0x80)     // check third byte high bits
-                    return -1;
-            } else {    // 2 byte encoding
-                if ((ch2 & 0xc0) != 0x80)     // check second byte high bits
-                    return -1;
-            }
-        } 
+static Object* findInternedString(Env* env, InternedStringShard* shard, InternKey* key) {
+    InternedString** prev = &shard->buckets[key->hash & (shard->capacity - 1)];
+    InternedString* entry;
+    while ((entry = *prev)) {
+        Object* string = LOAD_PTR(&entry->string);
+        if (!string) {
+            // The GC unregisters a disappearing link when it clears it
+            *prev = entry->next;
+            shard->count--;
+            gcFree(entry);
+            continue;
+        }
+        if (entry->hash == key->hash && internKeyEquals(env, key, string)) {
+            return string;
+        }
+        prev = &entry->next;
     }
-    return len;
+    return NULL;
 }
 
-static jint getUtf8LengthOfUnicode(const jchar* unicode, jint unicodeLength) {
-    jint length = 0;
-    jint i;
-    for (i = 0; i < unicodeLength; i++) {
-        jchar ch = unicode[i];
-        if (ch == 0) {
-            length += 2;
-        } else if (ch < 0x80) {
-            length += 1;
-        } else if (ch < 0x800) {
-            length += 2;
-        } else {
-            length += 3;
+/**
+ * Doubles the number of buckets in a shard. Called without the shard's lock
+ * held since allocating may trigger a GC and run finalizers on the current
+ * thread.
+ */
+static void growInternedStringShard(InternedStringShard* shard, uint32_t capacity) {
+    uint32_t newCapacity = capacity << 1;
+    InternedString** buckets = gcAllocateAtomicUncollectable(sizeof(InternedString*) * newCapacity);
+    if (!buckets) {
+        return; // Keep using the current buckets
+    }
+    rvmLockMutex(&shard->lock);
+    if (shard->capacity != capacity) {
+        // Another thread grew the shard while we were allocating
+        rvmUnlockMutex(&shard->lock);
+        gcFree(buckets);
+        return;
+    }
+    uint32_t i;
+    for (i = 0; i < capacity; i++) {
+        InternedString* entry = shard->buckets[i];
+        while (entry) {
+            InternedString* next = entry->next;
+            if (!LOAD_PTR(&entry->string)) {
+                shard->count--;
+                gcFree(entry);
+            } else {
+                InternedString** bucket = &buckets[entry->hash & (newCapacity - 1)];
+                entry->next = *bucket;
+                *bucket = entry;
+            }
+            entry = next;
         }
     }
-    return length;
+    InternedString** old = shard->buckets;
+    shard->buckets = buckets;
+    shard->capacity = newCapacity;
+    rvmUnlockMutex(&shard->lock);
+    gcFree(old);
 }
 
-/* 
- * Converts a null terminated string of modified UTF-8 
- * characters into a string of UTF-16 Java chars.
- * Copied from Harmony (vm_strings.cpp).
+/**
+ * Finds the String literal equal to key using binary search. No lock needed
+ * since the table never changes after rvmInitStrings().
  */
-static void utf8ToUnicode(jchar* unicode, const char* utf8String) {
-    const unsigned char* utf8 = (const unsigned char*) utf8String;
-    jchar ch;
-    while ((ch = (jchar) *utf8++)) {
-        if (ch & 0x80) {
-//            assert(ch & 0x40);
-            if (ch & 0x20) {
-                jchar x = ch;
-                jchar y = (jchar) *utf8++;
-                jchar z = (jchar) *utf8++;
-                *unicode++ = (jchar) (((0x0f & x) << 12) + ((0x3f & y) << 6) + ((0x3f & z)));
-            } else {
-                jchar x = ch;
-                jchar y = (jchar) *utf8++;
-                *unicode++ = (jchar) (((0x1f & x) << 6) + (0x3f & y));
-            }
+static Object* findStringLiteral(Env* env, InternKey* key) {
+    jint lo = 0;
+    jint hi = stringLiteralsCount;
+    while (lo < hi) {
+        jint mid = lo + ((hi - lo) >> 1);
+        if (stringLiteralHashes[mid] < key->stringHash) {
+            lo = mid + 1;
         } else {
-            *unicode++ = ch;
+            hi = mid;
+        }
+    }
+    // lo is the first literal with a hash >= key's
+    for (; lo < stringLiteralsCount && stringLiteralHashes[lo] == key->stringHash; lo++) {
+        if (internKeyEquals(env, key, stringLiterals[lo])) {
+            return stringLiterals[lo];
         }
     }
+    return NULL;
 }
 
-static void unicodeToUtf8(char* utf8String, const jchar* unicode, jint unicodeLength) {
-    char *s = utf8String;
-    jint i;
-    for (i = 0; i < unicodeLength; i++) {
-        jint ch = unicode[i];
-        if (ch == 0) {
-            *s++ = (char)0xc0;
-            *s++ = (char)0x80;
-        } else if (ch < 0x80) {
-            *s++ = (char)ch;
-        } else if(ch < 0x800) {
-            unsigned b5_0 = ch & 0x3f;
-            unsigned b10_6 = (ch >> 6) & 0x1f;
-            *s++ = (char)(0xc0 | b10_6);
-            *s++ = (char)(0x80 | b5_0);
-        } else {
-            unsigned b5_0 = ch & 0x3f;
-            unsigned b11_6 = (ch >> 6) & 0x3f;
-            unsigned b15_12 = (ch >> 12) & 0xf;
-            *s++ = (char)(0xe0 | b15_12);
-            *s++ = (char)(0x80 | b11_6);
-            *s++ = (char)(0x80 | b5_0);
+static Object* newStringForInternKey(Env* env, InternKey* key);
+
+/**
+ * Returns the interned String equal to key. If there is none string is
+ * interned and returned. If string is NULL a new String is created from
+ * key. The shard's lock is never held while allocating.
+ */
+static Object* internString(Env* env, InternKey* key, Object* string) {
+    Object* found = findStringLiteral(env, key);
+    if (found) {
+        return found;
+    }
+
+    InternedStringShard* shard = getInternedStringShard(key->hash);
+    rvmLockMutex(&shard->lock);
+    found = findInternedString(env, shard, key);
+    rvmUnlockMutex(&shard->lock);
+    if (found) {
+        return found;
+    }
+
+    if (!string) {
+        string = newStringForInternKey(env, key);
+        if (!string) {
+            return NULL;
         }
     }
-    *s = 0;
+    InternedString* entry = gcAllocateAtomicUncollectable(sizeof(InternedString));
+    if (!entry) {
+        rvmThrowOutOfMemoryError(env);
+        return NULL;
+    }
+    entry->hash = key->hash;
+    entry->string = string;
+
+    rvmLockMutex(&shard->lock);
+    // Another thread may have interned an equal string while we were allocating
+    found = findInternedString(env, shard, key);
+    if (!found) {
+        InternedString** bucket = &shard->buckets[key->hash & (shard->capacity - 1)];
+        entry->next = *bucket;
+        *bucket = entry;
+        shard->count++;
+        rvmRegisterDisappearingLink(env, (void**) &entry->string, string);
+        found = string;
+        entry = NULL;
+    }
+    uint32_t capacity = shard->capacity;
+    jboolean grow = shard->count > capacity - (capacity >> 2);
+    rvmUnlockMutex(&shard->lock);
+
+    if (entry) {
+        gcFree(entry);
+    }
+    if (grow) {
+        growInternedStringShard(shard, capacity);
+    }
+    return found;
 }
 
+// TODO: Return the same instance for strings of length == 0?
+
 static inline Object* newString(Env* env, CharArray* value, jint offset, jint length) {
     return rvmRTNewString(env, value, offset, length);
 }
 
+static Object* newStringForInternKey(Env* env, InternKey* key) {
+    if (key->chars) {
+        return rvmNewString(env, key->chars, key->length);
+    }
+    CharArray* value = rvmNewCharArray(env, key->length);
+    if (!value) return NULL;
+    rvmUtf8ToUtf16(value->values, key->utf8);
+    return newString(env, value, 0, key->length);
+}
+
 jboolean rvmInitStrings(Env* env) {
-    if (rvmInitMutex(&internedStringsLock) != 0) {
-        return FALSE;
+    jint i;
+    for (i = 0; i < INTERNED_STRING_SHARDS; i++) {
+        InternedStringShard* shard = &internedStrings[i];
+        if (rvmInitMutex(&shard->lock) != 0) {
+            return FALSE;
+        }
+        shard->buckets = gcAllocateAtomicUncollectable(sizeof(InternedString*) * INTERNED_STRING_SHARD_INITIAL_CAPACITY);
+        if (!shard->buckets) {
+            return FALSE;
+        }
+        shard->capacity = INTERNED_STRING_SHARD_INITIAL_CAPACITY;
+        shard->count = 0;
     }
 
-    gcAddRoot(&internedStrings);
-    cacheEntryGCKind = gcNewDirectBitmapKind(CACHE_ENTRY_GC_BITMAP);
+    // Set the class pointers of the String literals compiled into the
+    // executable. This must be done before any Java code runs.
+    Options* options = env->vm->options;
+    if (options->stringLiterals) {
+        stringLiterals = options->stringLiterals;
+        stringLiteralHashes = options->stringLiteralHashes;
+        Object** p;
+        for (p = stringLiterals; *p; p++) {
+            Object* str = *p;
+            str->clazz = java_lang_String;
+            rvmRTGetStringValue(env, str)->object.clazz = array_C;
+        }
+        stringLiteralsCount = (jint) (p - stringLiterals);
+        TRACEF("Initialized %d string literals", stringLiteralsCount);
+    }
 
     return TRUE;
 }
@@ -224,20 +353,17 @@ Object* rvmNewStringAscii(Env* env, const char* s, jint length) {
     length = (length == -1) ? strlen(s) : length;
     CharArray* value = rvmNewCharArray(env, length);
     if (!value) return NULL;
-    jint i;
-    for (i = 0; i < length; i++) {
-        value->values[i] = (jchar) (s[i] & 0xff);
-    }
+    rvmLatin1ToUtf16(value->values, (const jbyte*) s, length);
     return newString(env, value, 0, length);
 }
 
 Object* rvmNewStringUTF(Env* env, const char* s, jint length) {
     if (length == 0) s = "";
     if (!s) return NULL;
-    length = (length == -1) ? getUnicodeLengthOfUtf8(s) : length;
+    length = (length == -1) ? rvmUtf8CountChars(s) : length;
     CharArray* value = rvmNewCharArray(env, length);
     if (!value) return NULL;
-    utf8ToUnicode(value->values, s);
+    rvmUtf8ToUtf16(value->values, s);
     return newString(env, value, 0, length);
 }
 
@@ -254,48 +380,33 @@ Object* rvmNewInternedStringUTF(Env* env, const char* s, jint length) {
     if (length == 0) s = "";
     if (!s) return NULL;
 
-    obtainInternedStringsLock();
-
-    // Check the cache first.
-    Object* string = findInternedString(env, s);
-    if (!string) {
-        length = (length == -1) ? getUnicodeLengthOfUtf8(s) : length;
-        CharArray* value = rvmNewCharArray(env, length);
-        if (value) {
-            utf8ToUnicode(value->values, s);
-            Object* str = newString(env, value, 0, length);
-            if (str && addInternedString(env, s, str)) {
-                string = str;
-            }
-        }
+    length = (length == -1) ? rvmUtf8CountChars(s) : length;
+    if (length < 0) {
+        // Invalid modified UTF-8. Let rvmNewCharArray() throw.
+        rvmNewCharArray(env, length);
+        return NULL;
     }
+    InternKey key = {NULL, s, length, 0};
+    hashInternKey(&key);
+    return internString(env, &key, NULL);
+}
 
-    releaseInternedStringsLock();
+Object* rvmNewInternedString(Env* env, const jchar* chars, jint length) {
+    if (length == 0) chars = &EMPTY_JCHARS;
+    if (!chars) return NULL;
 
-    return string;
+    InternKey key = {chars, NULL, length, 0};
+    hashInternKey(&key);
+    return internString(env, &key, NULL);
 }
 
 Object* rvmInternString(Env* env, Object* str) {
     if (!str) return NULL;
 
-    obtainInternedStringsLock();
-
-    Object* string = NULL;
-
-    char* s = rvmGetStringUTFChars(env, str);
-    if (s) {
-        // Check the cache first.
-        string = findInternedString(env, s);
-        if (!string) {
-            if (addInternedString(env, s, str)) {
-                string = str;
-            }
-        }
-    }
-
-    releaseInternedStringsLock();
-
-    return string;
+    // Look up the chars of str directly. No need to convert to modified UTF-8.
+    InternKey key = {rvmGetStringChars(env, str), NULL, rvmGetStringLength(env, str), 0};
+    hashInternKey(&key);
+    return internString(env, &key, str);
 }
 
 jint rvmGetStringLength(Env* env, Object* str) {
@@ -309,18 +420,18 @@ jchar* rvmGetStringChars(Env* env, Object* str) {
 jint rvmGetStringUTFLength(Env* env, Object* str) {
     jchar* chars = rvmGetStringChars(env, str);
     jint count = rvmGetStringLength(env, str);
-    return getUtf8LengthOfUnicode(chars, count);
+    return rvmUtf16CountModifiedUtf8Bytes(chars, count);
 }
 
 char* rvmGetStringUTFChars(Env* env, Object* str) {
     jchar* chars = rvmGetStringChars(env, str);
     jint count = rvmGetStringLength(env, str);
-    jint length = getUtf8LengthOfUnicode(chars, count);
+    jint length = rvmUtf16CountModifiedUtf8Bytes(chars, count);
 
     char* result = rvmAllocateMemoryAtomic(env, length + 1);
     if (!result) return NULL;
 
-    unicodeToUtf8(result, chars, count);
+    rvmUtf16ToModifiedUtf8(result, chars, count);
     return result;
 }
 
@@ -335,6 +446,83 @@ void rvmGetStringUTFRegion(Env *env, Object* str, jint start, jint len, char* bu
     // TODO: Check bounds
     jchar* chars = rvmGetStringChars(env, str);
     //jint count = rvmGetStringLength(env, str);
-    unicodeToUtf8(buf, chars + start, len);
+    rvmUtf16ToModifiedUtf8(buf, chars + start, len);
 }
 
+
+/*
+ * The functions below implement String.equals(), compareTo() and indexOf()
+ * for the compiler intrinsics in bc.c. They work directly on the chars of
+ * the strings and must behave exactly like the Java code in String.java.
+ */
+
+jboolean rvmStringEquals(Env* env, Object* s1, Object* s2) {
+    if (s1 == s2) return TRUE;
+    jint count = rvmGetStringLength(env, s1);
+    if (count != rvmGetStringLength(env, s2)) return FALSE;
+    return memcmp(rvmGetStringChars(env, s1), rvmGetStringChars(env, s2), sizeof(jchar) * count) == 0;
+}
+
+jint rvmStringCompareTo(Env* env, Object* s1, Object* s2) {
+    if (s1 == s2) return 0;
+    jchar* chars1 = rvmGetStringChars(env, s1);
+    jchar* chars2 = rvmGetStringChars(env, s2);
+    jint count1 = rvmGetStringLength(env, s1);
+    jint count2 = rvmGetStringLength(env, s2);
+    jint end = count1 < count2 ? count1 : count2;
+    jint i;
+    for (i = 0; i < end; i++) {
+        if (chars1[i] != chars2[i]) {
+            return chars1[i] - chars2[i];
+        }
+    }
+    return count1 - count2;
+}
+
+jint rvmStringIndexOfChar(Env* env, Object* str, jint c, jint start) {
+    jchar* chars = rvmGetStringChars(env, str);
+    jint count = rvmGetStringLength(env, str);
+    jint i;
+    if (start < 0) {
+        start = 0;
+    }
+    if (c >= 0 && c <= 0xffff) {
+        for (i = start; i < count; i++) {
+            if (chars[i] == c) {
+                return i;
+            }
+        }
+    } else if (c > 0xffff && c <= 0x10ffff) {
+        // Supplementary code point. Look for its surrogate pair.
+        jchar high = (jchar) (0xd7c0 + (c >> 10));
+        jchar low = (jchar) (0xdc00 + (c & 0x3ff));
+        for (i = start; i < count - 1; i++) {
+            if (chars[i] == high && chars[i + 1] == low) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+jint rvmStringIndexOf(Env* env, Object* str, Object* sub, jint start) {
+    jchar* chars = rvmGetStringChars(env, str);
+    jint count = rvmGetStringLength(env, str);
+    jchar* subChars = rvmGetStringChars(env, sub);
+    jint subCount = rvmGetStringLength(env, sub);
+    if (start < 0) {
+        start = 0;
+    }
+    if (subCount == 0) {
+        return start < count ? start : count;
+    }
+    jchar first = subChars[0];
+    jint last = count - subCount;
+    jint i;
+    for (i = start; i <= last; i++) {
+        if (chars[i] == first && !memcmp(chars + i + 1, subChars + 1, sizeof(jchar) * (subCount - 1))) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2012 RoboVM AB
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Micro-benchmark for the copy and byte swap functions in move.c. First
+ * checks every set of kernels available on this CPU against memmove() for
+ * overlapping and non-overlapping moves of many sizes and alignments.
+ * Then prints the throughput in MB per second of rvmMoveMemory() with each
+ * set of kernels next to libc memmove() and a plain element-by-element
+ * loop, which is what rvmMoveMemory16() used to do.
+ *
+ * Usage: bench_move [total MB per measurement]
+ */
+#include <bugvm.h>
+#include <string.h>
+#include <time.h>
+
+static const char* KERNELS[] = {"scalar", "sse2", "avx2", "neon"};
+static const size_t SIZES[] = {8, 24, 64, 256, 4096, 65536, 1024 * 1024, 8 * 1024 * 1024};
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void elementLoop(void* dest, const void* src, size_t n) {
+    uint16_t* d = (uint16_t*) dest;
+    const uint16_t* s = (const uint16_t*) src;
+    n >>= 1;
+    if (d < s) {
+        while (n--) {
+            *d++ = *s++;
+        }
+    } else {
+        d += n;
+        s += n;
+        while (n--) {
+            *--d = *--s;
+        }
+    }
+}
+
+static void libcMemmove(void* dest, const void* src, size_t n) {
+    memmove(dest, src, n);
+}
+
+static void fill(uint8_t* p, size_t n, uint32_t seed) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        p[i] = (uint8_t) (seed >> 16);
+    }
+}
+
+static jboolean checkMoves(uint8_t* a, uint8_t* b, size_t bufferSize) {
+    size_t n;
+    for (n = 0; n < 600; n = n < 80 ? n + 1 : n + 37) {
+        int srcOffset, destOffset;
+        for (srcOffset = 0; srcOffset < 48; srcOffset += 5) {
+            for (destOffset = 0; destOffset < 48; destOffset += 3) {
+                // Overlapping moves in both directions within one buffer
+                fill(a, bufferSize, (uint32_t) (n + srcOffset));
+                memcpy(b, a, bufferSize);
+                rvmMoveMemory(a + 64 + destOffset, a + 64 + srcOffset, n);
+                memmove(b + 64 + destOffset, b + 64 + srcOffset, n);
+                if (memcmp(a, b, bufferSize)) return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+static jboolean checkLargeMove(uint8_t* a, uint8_t* b, size_t bufferSize) {
+    // Large non-overlapping moves use non-temporal stores
+    fill(a, bufferSize, 1);
+    fill(b, bufferSize, 2);
+    rvmMoveMemory(b + 8, a + 24, bufferSize - 32);
+    return memcmp(b + 8, a + 24, bufferSize - 32) == 0;
+}
+
+static jboolean checkSwaps(uint8_t* a, uint8_t* b, size_t bufferSize) {
+    size_t count;
+    for (count = 0; count < 100; count++) {
+        int offset = (int) (count % 8);
+        fill(a, bufferSize, (uint32_t) count);
+        rvmSwapMemory16(b + offset, a + 1, count);
+        size_t i;
+        for (i = 0; i < count; i++) {
+            if (b[offset + i * 2] != a[1 + i * 2 + 1] || b[offset + i * 2 + 1] != a[1 + i * 2]) return FALSE;
+        }
+        rvmSwapMemory32(b + offset, a + 1, count);
+        for (i = 0; i < count * 4; i++) {
+            if (b[offset + i] != a[1 + (i & ~3) + 3 - (i & 3)]) return FALSE;
+        }
+        rvmSwapMemory64(b + offset, a + 1, count);
+        for (i = 0; i < count * 8; i++) {
+            if (b[offset + i] != a[1 + (i & ~7) + 7 - (i & 7)]) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+typedef void (*MoveFunc)(void*, const void*, size_t);
+
+static double measure(MoveFunc f, uint8_t* dest, const uint8_t* src, size_t n, double totalMB) {
+    size_t iterations = (size_t) (totalMB * 1024 * 1024 / n) + 1;
+    f(dest, src, n); // Warm up
+    double start = nowSeconds();
+    size_t i;
+    for (i = 0; i < iterations; i++) {
+        f(dest, src, n);
+    }
+    double elapsed = nowSeconds() - start;
+    return iterations * n / (1024.0 * 1024.0) / elapsed;
+}
+
+static void swap16(void* dest, const void* src, size_t n) {
+    rvmSwapMemory16(dest, src, n >> 1);
+}
+
+static void swap32(void* dest, const void* src, size_t n) {
+    rvmSwapMemory32(dest, src, n >> 2);
+}
+
+static void swap64(void* dest, const void* src, size_t n) {
+    rvmSwapMemory64(dest, src, n >> 3);
+}
+
+int main(int argc, char* argv[]) {
+    double totalMB = argc > 1 ? atof(argv[1]) : 1024;
+    size_t maxSize = SIZES[sizeof(SIZES) / sizeof(SIZES[0]) - 1];
+    size_t bufferSize = maxSize + 1024;
+    uint8_t* a = malloc(bufferSize);
+    uint8_t* b = malloc(bufferSize);
+    fill(a, bufferSize, 0);
+    fill(b, bufferSize, 0);
+
+    printf("Default kernels: %s\n", rvmMoveGetKernelsName());
+    int k;
+    for (k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); k++) {
+        if (!rvmMoveUseKernels(KERNELS[k])) continue;
+        if (!checkMoves(a, b, 4096) || !checkLargeMove(a, b, bufferSize) || !checkSwaps(a, b, 4096)) {
+            fprintf(stderr, "%s kernels produced wrong output\n", KERNELS[k]);
+            return 1;
+        }
+    }
+
+    printf("%-22s %9s %8s %10s\n", "op", "size", "kernels", "MB/s");
+    int s;
+    for (s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++) {
+        size_t n = SIZES[s];
+        printf("%-22s %9zu %8s %10.1f\n", "memmove", n, "libc", measure(libcMemmove, b, a, n, totalMB));
+        printf("%-22s %9zu %8s %10.1f\n", "memmove overlapping", n, "libc", measure(libcMemmove, a + 16, a, n, totalMB));
+        printf("%-22s %9zu %8s %10.1f\n", "element loop", n, "-", measure(elementLoop, b, a, n, totalMB));
+        for (k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); k++) {
+            if (!rvmMoveUseKernels(KERNELS[k])) continue;
+            printf("%-22s %9zu %8s %10.1f\n", "rvmMoveMemory", n, KERNELS[k], measure(rvmMoveMemory, b, a, n, totalMB));
+            printf("%-22s %9zu %8s %10.1f\n", "rvmMoveMemory overlap", n, KERNELS[k], measure(rvmMoveMemory, a + 16, a, n, totalMB));
+            printf("%-22s %9zu %8s %10.1f\n", "rvmSwapMemory16", n, KERNELS[k], measure(swap16, b, a, n, totalMB));
+            printf("%-22s %9zu %8s %10.1f\n", "rvmSwapMemory32", n, KERNELS[k], measure(swap32, b, a, n, totalMB));
+            printf("%-22s %9zu %8s %10.1f\n", "rvmSwapMemory64", n, KERNELS[k], measure(swap64, b, a, n, totalMB));
+        }
+    }
+    return 0;
+}
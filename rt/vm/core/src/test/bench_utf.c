@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2012 RoboVM AB
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Micro-benchmark for the transcoding functions in utf.c. Runs every
+ * conversion with each set of kernels available on this CPU and prints the
+ * throughput in MB of UTF-16 text per second. The output of each set of
+ * kernels is checked against the portable kernels.
+ *
+ * Usage: bench_utf [total MB per measurement]
+ */
+#include <bugvm.h>
+#include <string.h>
+#include <time.h>
+
+static const char* KERNELS[] = {"scalar", "sse2", "avx2", "neon"};
+static const size_t SIZES[] = {16, 256, 4096, 65536};
+
+typedef enum {ASCII, MOSTLY_ASCII, CJK} Payload;
+static const char* PAYLOAD_NAMES[] = {"ascii", "mostly-ascii", "cjk"};
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fillChars(jchar* chars, size_t n, Payload payload) {
+    static const char json[] = "{\"id\":12345,\"name\":\"value\",\"tags\":[\"a\",\"b\"]},";
+    size_t i;
+    for (i = 0; i < n; i++) {
+        jchar c = (jchar) json[i % (sizeof(json) - 1)];
+        if (payload == MOSTLY_ASCII && i % 97 == 50) {
+            c = 0x00e9; // e acute
+        } else if (payload == CJK) {
+            c = (jchar) (0x4e00 + i % 0x5000);
+        }
+        chars[i] = c;
+    }
+}
+
+typedef struct {
+    jchar* chars;
+    jchar* charsOut;
+    char* utf8;
+    char* modifiedUtf8;
+    jbyte* bytes;
+    size_t n;
+} Buffers;
+
+static volatile jint sink;
+
+static void runOnce(const char* op, Buffers* b) {
+    if (!strcmp(op, "utf16->utf8")) {
+        sink = rvmUtf16ToUtf8(b->utf8, b->chars, (jint) b->n);
+    } else if (!strcmp(op, "utf16->utf8 count")) {
+        sink = rvmUtf16CountUtf8Bytes(b->chars, (jint) b->n);
+    } else if (!strcmp(op, "utf16->mutf8")) {
+        rvmUtf16ToModifiedUtf8(b->modifiedUtf8, b->chars, (jint) b->n);
+    } else if (!strcmp(op, "mutf8 count")) {
+        sink = rvmUtf8CountChars(b->modifiedUtf8);
+    } else if (!strcmp(op, "mutf8->utf16")) {
+        rvmUtf8ToUtf16(b->charsOut, b->modifiedUtf8);
+    } else if (!strcmp(op, "ascii->utf16")) {
+        rvmAsciiToUtf16(b->charsOut, b->bytes, (jint) b->n);
+    } else if (!strcmp(op, "utf16->latin1")) {
+        rvmUtf16ToSingleByte(b->bytes, b->chars, (jint) b->n, 0xff);
+    }
+}
+
+static const char* OPS[] = {
+    "utf16->utf8", "utf16->utf8 count", "utf16->mutf8", "mutf8 count", "mutf8->utf16", "ascii->utf16", "utf16->latin1"
+};
+
+static jboolean check(Buffers* b, const char* kernels) {
+    // Compare against the portable kernels
+    size_t n = b->n;
+    char* utf8 = malloc(n * 3);
+    char* modifiedUtf8 = malloc(n * 3 + 1);
+    jchar* chars = malloc(n * sizeof(jchar));
+    rvmUtfUseKernels("scalar");
+    jint utf8Length = rvmUtf16ToUtf8(utf8, b->chars, (jint) n);
+    rvmUtf16ToModifiedUtf8(modifiedUtf8, b->chars, (jint) n);
+    rvmUtf8ToUtf16(chars, modifiedUtf8);
+    rvmUtfUseKernels(kernels);
+    jboolean ok = rvmUtf16ToUtf8(b->utf8, b->chars, (jint) n) == utf8Length
+            && !memcmp(b->utf8, utf8, utf8Length)
+            && rvmUtf16CountUtf8Bytes(b->chars, (jint) n) == utf8Length;
+    rvmUtf16ToModifiedUtf8(b->modifiedUtf8, b->chars, (jint) n);
+    ok = ok && !strcmp(b->modifiedUtf8, modifiedUtf8);
+    ok = ok && rvmUtf8CountChars(b->modifiedUtf8) == (jint) n;
+    rvmUtf8ToUtf16(b->charsOut, b->modifiedUtf8);
+    ok = ok && !memcmp(b->charsOut, chars, n * sizeof(jchar));
+    free(utf8);
+    free(modifiedUtf8);
+    free(chars);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    double totalMB = argc > 1 ? atof(argv[1]) : 256;
+    size_t maxSize = SIZES[sizeof(SIZES) / sizeof(SIZES[0]) - 1];
+    Buffers b;
+    b.chars = malloc(maxSize * sizeof(jchar));
+    b.charsOut = malloc(maxSize * sizeof(jchar));
+    b.utf8 = malloc(maxSize * 3);
+    b.modifiedUtf8 = malloc(maxSize * 3 + 1);
+    b.bytes = malloc(maxSize);
+
+    printf("Default kernels: %s\n", rvmUtfGetKernelsName());
+    printf("%-14s %-18s %7s %8s %10s\n", "payload", "op", "size", "kernels", "MB/s");
+    int p, s, k, o;
+    for (p = ASCII; p <= CJK; p++) {
+        for (s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++) {
+            b.n = SIZES[s];
+            fillChars(b.chars, b.n, p);
+            size_t i;
+            for (i = 0; i < b.n; i++) {
+                b.bytes[i] = (jbyte) b.chars[i];
+            }
+            for (k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); k++) {
+                if (!rvmUtfUseKernels(KERNELS[k])) continue;
+                if (!check(&b, KERNELS[k])) {
+                    fprintf(stderr, "%s kernels produced wrong output for %s payload of size %zu\n",
+                            KERNELS[k], PAYLOAD_NAMES[p], b.n);
+                    return 1;
+                }
+                for (o = 0; o < sizeof(OPS) / sizeof(OPS[0]); o++) {
+                    size_t iterations = (size_t) (totalMB * 1024 * 1024 / (b.n * sizeof(jchar))) + 1;
+                    rvmUtf16ToModifiedUtf8(b.modifiedUtf8, b.chars, (jint) b.n);
+                    runOnce(OPS[o], &b); // Warm up
+                    double start = nowSeconds();
+                    for (i = 0; i < iterations; i++) {
+                        runOnce(OPS[o], &b);
+                    }
+                    double elapsed = nowSeconds() - start;
+                    double mb = iterations * b.n * sizeof(jchar) / (1024.0 * 1024.0);
+                    printf("%-14s %-18s %7zu %8s %10.1f\n", PAYLOAD_NAMES[p], OPS[o], b.n, KERNELS[k], mb / elapsed);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -172,7 +172,11 @@ static jboolean isGuardPage(void* page) {
 /**
  * Determines the stack address of the current thread
  */
-static void* getStackAddress(void) {
+/*
+ * Returns the lowest usable address of the calling thread's stack and stores
+ * the highest address of the stack in *top.
+ */
+static void* getStackAddress(void** top) {
     void* result = NULL;
     pthread_t self = pthread_self();
 #if defined(DARWIN)
@@ -180,6 +184,7 @@ static void* getStackAddress(void) {
     // Decrement by page size until vm_region() reports a read protected page. The lowest
     // unprotected page is the start of the stack.
     result = pthread_get_stackaddr_np(self);
+    *top = result;
     long pageSize = sysconf(_SC_PAGE_SIZE);
     while (!isGuardPage(result - pageSize)) {
         result -= pageSize;
@@ -191,6 +196,7 @@ static void* getStackAddress(void) {
     pthread_getattr_np(self, &attr);
     pthread_attr_getstack(&attr, &result, &stackSize);
     pthread_attr_getguardsize(&attr, &guardSize);
+    *top = result + stackSize;
     // On Linux pthread_attr_getstack() returns the address of the memory area allocated for the stack
     // including the guard page (except for the main thread which returns the correct stack address and 
     // pthread_attr_getguardsize() returns 0 even if there is a guard page).
@@ -225,7 +231,16 @@ static void freeThreadId(jint threadId) {
 static jboolean initThread(Env* env, Thread* thread, Object* threadObj) {
     // NOTE: threadsLock must be held
     int err = 0;
+#if defined(DARWIN)
     pthread_cond_init(&thread->waitCond, NULL);
+#else
+    // Timed waits in monitor.c use CLOCK_MONOTONIC deadlines
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&thread->waitCond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+#endif
     if ((err = rvmInitMutex(&thread->waitMutex)) != 0) {
         rvmThrowInternalErrorErrno(env, err);
         return FALSE;
@@ -314,7 +329,7 @@ static jint attachThread(VM* vm, Env** envPtr, char* name, Object* group, jboole
 
     Thread* thread = allocThread(env);
     if (!thread) goto error;
-    thread->stackAddr = getStackAddress();
+    thread->stackAddr = getStackAddress(&thread->stackTop);
     thread->pThread = pthread_self();
     env->currentThread = thread;
     rvmChangeThreadStatus(env, thread, THREAD_RUNNING);
@@ -333,6 +348,7 @@ static jint attachThread(VM* vm, Env** envPtr, char* name, Object* group, jboole
     }
     DL_PREPEND(threads, thread);
     pthread_cond_broadcast(&threadsChangedCond);
+    profilerAttachThread(env);
     rvmUnlockThreadsList();
 
     Object* threadName = NULL;
@@ -414,6 +430,8 @@ static jint detachThread(Env* env, jboolean ignoreAttachCount, jboolean unregist
 
     rvmRTResumeJoiningThreads(env, threadObj);
 
+    profilerDetachThread(env);
+
     rvmLockThreadsList();
     thread->status = THREAD_ZOMBIE;
     DL_DELETE(threads, thread);
@@ -425,6 +443,10 @@ static jint detachThread(Env* env, jboolean ignoreAttachCount, jboolean unregist
     cleanupThreadMutex(env, thread);
     rvmUnlockThreadsList();
 
+    gcFreeTlab(env);
+    freeCallStackBuffer(env);
+    rvmFreeLocalRefFrames(env);
+
     if (unregisterGC) {
         // Unregister the thread with the GC
         gcUnregisterCurrentThread();
@@ -524,7 +546,7 @@ static void* startThreadEntryPoint(void* _args) {
         if (initThread(env, thread, threadObj)) {
             if (rvmInstallThreadSignalMask(env)) {
                 failure = FALSE;
-                thread->stackAddr = getStackAddress();
+                thread->stackAddr = getStackAddress(&thread->stackTop);
             }
         }
     }
@@ -0,0 +1,642 @@
+/*
+ * Copyright (C) 2012 RoboVM AB
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * UTF-16 transcoding. Most strings converted by the VM and the class
+ * library are mostly or entirely ASCII. The conversions below therefore
+ * hand runs of ASCII to a set of kernels which handle a whole block of
+ * bytes or chars per iteration and only fall back to decoding or encoding
+ * one char at a time for the rest.
+ *
+ * A kernel processes whole blocks from the start of its input and stops at
+ * the first block which contains a unit it can't handle, returning the
+ * number of units processed. The caller handles what's left one unit at a
+ * time. The kernels are selected on first use: AVX2 if the CPU supports
+ * it, SSE2 on x86 otherwise, NEON on ARM and portable C everywhere else.
+ *
+ * This file must not depend on the rest of the VM. It's also used by the
+ * class library natives and by the utf benchmark.
+ */
+#include <bugvm.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#   define UTF_SSE2
+#endif
+#if defined(UTF_SSE2) && defined(__x86_64__) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#   include <immintrin.h>
+#   define UTF_AVX2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   include <arm_neon.h>
+#   define UTF_NEON
+#endif
+
+// Max number of units handled one at a time before trying the kernels again
+#define SCALAR_RUN 16
+
+typedef struct {
+    const char* name;
+    // Number of leading ASCII bytes
+    size_t (*scanAscii)(const uint8_t* src, size_t n);
+    // Widens leading ASCII bytes
+    size_t (*widenAscii)(uint16_t* dst, const uint8_t* src, size_t n);
+    // Widens bytes regardless of their value
+    size_t (*widen)(uint16_t* dst, const uint8_t* src, size_t n);
+    // Number of leading chars with (c & mask) == 0 and, if stopOnZero, c != 0
+    size_t (*scanUtf16)(const uint16_t* src, size_t n, uint16_t mask, int stopOnZero);
+    // Narrows leading chars with (c & mask) == 0 and, if stopOnZero, c != 0
+    size_t (*narrowUtf16)(uint8_t* dst, const uint16_t* src, size_t n, uint16_t mask, int stopOnZero);
+} UtfKernels;
+
+/* Portable kernels */
+
+static size_t scanAsciiScalar(const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, src + i, 8);
+        if (w & 0x8080808080808080ULL) break;
+    }
+    return i;
+}
+
+static size_t widenAsciiScalar(uint16_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, src + i, 8);
+        if (w & 0x8080808080808080ULL) break;
+        size_t j;
+        for (j = 0; j < 8; j++) {
+            dst[i + j] = src[i + j];
+        }
+    }
+    return i;
+}
+
+static size_t widenScalar(uint16_t* dst, const uint8_t* src, size_t n) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        dst[i] = src[i];
+    }
+    return n;
+}
+
+static size_t scanUtf16Scalar(const uint16_t* src, size_t n, uint16_t mask, int stopOnZero) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        uint16_t c = src[i];
+        if ((c & mask) || (stopOnZero && !c)) break;
+    }
+    return i;
+}
+
+static size_t narrowUtf16Scalar(uint8_t* dst, const uint16_t* src, size_t n, uint16_t mask, int stopOnZero) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        uint16_t c = src[i];
+        if ((c & mask) || (stopOnZero && !c)) break;
+        dst[i] = (uint8_t) c;
+    }
+    return i;
+}
+
+static const UtfKernels scalarKernels = {
+    "scalar", scanAsciiScalar, widenAsciiScalar, widenScalar, scanUtf16Scalar, narrowUtf16Scalar
+};
+
+#if defined(UTF_SSE2)
+/* SSE2 kernels. 16 units per block. */
+
+static size_t scanAsciiSse2(const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+        if (_mm_movemask_epi8(v)) break;
+    }
+    return i;
+}
+
+static size_t widenAsciiSse2(uint16_t* dst, const uint8_t* src, size_t n) {
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+        if (_mm_movemask_epi8(v)) break;
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*) (dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+    return i;
+}
+
+static size_t widenSse2(uint16_t* dst, const uint8_t* src, size_t n) {
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*) (dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+    return i;
+}
+
+static inline int validUtf16BlockSse2(__m128i a, __m128i b, __m128i m, int stopOnZero) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i bad = _mm_or_si128(_mm_and_si128(a, m), _mm_and_si128(b, m));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(bad, zero)) != 0xffff) return 0;
+    if (stopOnZero && _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(a, zero), _mm_cmpeq_epi16(b, zero)))) return 0;
+    return 1;
+}
+
+static size_t scanUtf16Sse2(const uint16_t* src, size_t n, uint16_t mask, int stopOnZero) {
+    __m128i m = _mm_set1_epi16((short) mask);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (src + i + 8));
+        if (!validUtf16BlockSse2(a, b, m, stopOnZero)) break;
+    }
+    return i;
+}
+
+static size_t narrowUtf16Sse2(uint8_t* dst, const uint16_t* src, size_t n, uint16_t mask, int stopOnZero) {
+    __m128i m = _mm_set1_epi16((short) mask);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (src + i + 8));
+        if (!validUtf16BlockSse2(a, b, m, stopOnZero)) break;
+        // All chars are <= 0xff so the saturation never kicks in
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(a, b));
+    }
+    return i;
+}
+
+static const UtfKernels sse2Kernels = {
+    "sse2", scanAsciiSse2, widenAsciiSse2, widenSse2, scanUtf16Sse2, narrowUtf16Sse2
+};
+#endif
+
+#if defined(UTF_AVX2)
+/*
+ * AVX2 kernels. 32 units per block. Compiled for AVX2 regardless of the
+ * compiler flags and only used if the CPU supports it. Inputs shorter than
+ * a block are handed to the SSE2 kernels which are always available on
+ * x86_64.
+ */
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static size_t scanAsciiAvx2(const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src + i));
+        if (_mm256_movemask_epi8(v)) break;
+    }
+    // Handle what remains with 16 unit blocks. Clear the upper halves of
+    // the ymm registers first to avoid AVX-SSE transition penalties.
+    _mm256_zeroupper();
+    return i + scanAsciiSse2(src + i, n - i);
+}
+
+AVX2 static size_t widenAsciiAvx2(uint16_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src + i));
+        if (_mm256_movemask_epi8(v)) break;
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+        _mm256_storeu_si256((__m256i*) (dst + i + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+    }
+    // Handle what remains with 16 unit blocks. Clear the upper halves of
+    // the ymm registers first to avoid AVX-SSE transition penalties.
+    _mm256_zeroupper();
+    return i + widenAsciiSse2(dst + i, src + i, n - i);
+}
+
+AVX2 static size_t widenAvx2(uint16_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src + i));
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+        _mm256_storeu_si256((__m256i*) (dst + i + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+    }
+    // Handle what remains with 16 unit blocks. Clear the upper halves of
+    // the ymm registers first to avoid AVX-SSE transition penalties.
+    _mm256_zeroupper();
+    return i + widenSse2(dst + i, src + i, n - i);
+}
+
+AVX2 static inline int validUtf16BlockAvx2(__m256i a, __m256i b, __m256i m, int stopOnZero) {
+    __m256i bad = _mm256_or_si256(_mm256_and_si256(a, m), _mm256_and_si256(b, m));
+    if (!_mm256_testz_si256(bad, bad)) return 0;
+    if (stopOnZero) {
+        __m256i zero = _mm256_setzero_si256();
+        if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi16(a, zero), _mm256_cmpeq_epi16(b, zero)))) return 0;
+    }
+    return 1;
+}
+
+AVX2 static size_t scanUtf16Avx2(const uint16_t* src, size_t n, uint16_t mask, int stopOnZero) {
+    __m256i m = _mm256_set1_epi16((short) mask);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*) (src + i + 16));
+        if (!validUtf16BlockAvx2(a, b, m, stopOnZero)) break;
+    }
+    // Handle what remains with 16 unit blocks. Clear the upper halves of
+    // the ymm registers first to avoid AVX-SSE transition penalties.
+    _mm256_zeroupper();
+    return i + scanUtf16Sse2(src + i, n - i, mask, stopOnZero);
+}
+
+AVX2 static size_t narrowUtf16Avx2(uint8_t* dst, const uint16_t* src, size_t n, uint16_t mask, int stopOnZero) {
+    __m256i m = _mm256_set1_epi16((short) mask);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*) (src + i + 16));
+        if (!validUtf16BlockAvx2(a, b, m, stopOnZero)) break;
+        // packus works on 128-bit lanes. Put the 64-bit quarters back in order.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+        _mm256_storeu_si256((__m256i*) (dst + i), packed);
+    }
+    // Handle what remains with 16 unit blocks. Clear the upper halves of
+    // the ymm registers first to avoid AVX-SSE transition penalties.
+    _mm256_zeroupper();
+    return i + narrowUtf16Sse2(dst + i, src + i, n - i, mask, stopOnZero);
+}
+
+static const UtfKernels avx2Kernels = {
+    "avx2", scanAsciiAvx2, widenAsciiAvx2, widenAvx2, scanUtf16Avx2, narrowUtf16Avx2
+};
+#endif
+
+#if defined(UTF_NEON)
+/* NEON kernels. 16 units per block. */
+
+static inline int anyBitsSetNeon(uint8x16_t v) {
+    uint64x2_t w = vreinterpretq_u64_u8(v);
+    return (vgetq_lane_u64(w, 0) | vgetq_lane_u64(w, 1)) != 0;
+}
+
+static size_t scanAsciiNeon(const uint8_t* src, size_t n) {
+    uint8x16_t high = vdupq_n_u8(0x80);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        if (anyBitsSetNeon(vandq_u8(v, high))) break;
+    }
+    return i;
+}
+
+static size_t widenAsciiNeon(uint16_t* dst, const uint8_t* src, size_t n) {
+    uint8x16_t high = vdupq_n_u8(0x80);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        if (anyBitsSetNeon(vandq_u8(v, high))) break;
+        vst1q_u16(dst + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(dst + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+    return i;
+}
+
+static size_t widenNeon(uint16_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        vst1q_u16(dst + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(dst + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+    return i;
+}
+
+static inline int validUtf16BlockNeon(uint16x8_t a, uint16x8_t b, uint16x8_t m, int stopOnZero) {
+    uint16x8_t bad = vorrq_u16(vandq_u16(a, m), vandq_u16(b, m));
+    if (anyBitsSetNeon(vreinterpretq_u8_u16(bad))) return 0;
+    if (stopOnZero && anyBitsSetNeon(vreinterpretq_u8_u16(vceqq_u16(vminq_u16(a, b), vdupq_n_u16(0))))) return 0;
+    return 1;
+}
+
+static size_t scanUtf16Neon(const uint16_t* src, size_t n, uint16_t mask, int stopOnZero) {
+    uint16x8_t m = vdupq_n_u16(mask);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        if (!validUtf16BlockNeon(vld1q_u16(src + i), vld1q_u16(src + i + 8), m, stopOnZero)) break;
+    }
+    return i;
+}
+
+static size_t narrowUtf16Neon(uint8_t* dst, const uint16_t* src, size_t n, uint16_t mask, int stopOnZero) {
+    uint16x8_t m = vdupq_n_u16(mask);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint16x8_t a = vld1q_u16(src + i);
+        uint16x8_t b = vld1q_u16(src + i + 8);
+        if (!validUtf16BlockNeon(a, b, m, stopOnZero)) break;
+        vst1q_u8(dst + i, vcombine_u8(vmovn_u16(a), vmovn_u16(b)));
+    }
+    return i;
+}
+
+static const UtfKernels neonKernels = {
+    "neon", scanAsciiNeon, widenAsciiNeon, widenNeon, scanUtf16Neon, narrowUtf16Neon
+};
+#endif
+
+static const UtfKernels* kernels = NULL;
+
+static const UtfKernels* selectKernels(void) {
+#if defined(UTF_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2Kernels;
+    }
+#endif
+#if defined(UTF_SSE2)
+    return &sse2Kernels;
+#elif defined(UTF_NEON)
+    return &neonKernels;
+#else
+    return &scalarKernels;
+#endif
+}
+
+static inline const UtfKernels* getKernels(void) {
+    // Racy but harmless. All threads select the same kernels.
+    const UtfKernels* k = kernels;
+    if (!k) {
+        k = selectKernels();
+        kernels = k;
+    }
+    return k;
+}
+
+const char* rvmUtfGetKernelsName(void) {
+    return getKernels()->name;
+}
+
+jboolean rvmUtfUseKernels(const char* name) {
+    const UtfKernels* k = NULL;
+    if (!strcmp(name, "scalar")) {
+        k = &scalarKernels;
+    }
+#if defined(UTF_SSE2)
+    if (!strcmp(name, "sse2")) {
+        k = &sse2Kernels;
+    }
+#endif
+#if defined(UTF_AVX2)
+    __builtin_cpu_init();
+    if (!strcmp(name, "avx2") && __builtin_cpu_supports("avx2")) {
+        k = &avx2Kernels;
+    }
+#endif
+#if defined(UTF_NEON)
+    if (!strcmp(name, "neon")) {
+        k = &neonKernels;
+    }
+#endif
+    if (!k) {
+        return FALSE;
+    }
+    kernels = k;
+    return TRUE;
+}
+
+jint rvmUtf8CountChars(const char* utf8) {
+    const UtfKernels* k = getKernels();
+    const uint8_t* s = (const uint8_t*) utf8;
+    const uint8_t* end = s + strlen(utf8);
+    jint length = 0;
+    while (s < end) {
+        size_t n = k->scanAscii(s, end - s);
+        s += n;
+        length += n;
+        jint i;
+        for (i = 0; i < SCALAR_RUN && s < end; i++) {
+            uint8_t ch = *s;
+            if (!(ch & 0x80)) {
+                s++;
+            } else if (!(ch & 0x40)) {
+                return -1;
+            } else if (ch & 0x20) { // 3 byte encoding
+                if (end - s < 3 || (ch & 0xf0) != 0xe0 || (s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80) {
+                    return -1;
+                }
+                s += 3;
+            } else { // 2 byte encoding
+                if (end - s < 2 || (s[1] & 0xc0) != 0x80) {
+                    return -1;
+                }
+                s += 2;
+            }
+            length++;
+        }
+    }
+    return length;
+}
+
+void rvmUtf8ToUtf16(jchar* dst, const char* utf8) {
+    const UtfKernels* k = getKernels();
+    const uint8_t* s = (const uint8_t*) utf8;
+    const uint8_t* end = s + strlen(utf8);
+    while (s < end) {
+        size_t n = k->widenAscii(dst, s, end - s);
+        s += n;
+        dst += n;
+        jint i;
+        for (i = 0; i < SCALAR_RUN && s < end; i++) {
+            jchar ch = *s++;
+            if (ch & 0x80) {
+                if (ch & 0x20) {
+                    jchar y = s[0];
+                    jchar z = s[1];
+                    ch = (jchar) (((0x0f & ch) << 12) + ((0x3f & y) << 6) + (0x3f & z));
+                    s += 2;
+                } else {
+                    jchar y = s[0];
+                    ch = (jchar) (((0x1f & ch) << 6) + (0x3f & y));
+                    s += 1;
+                }
+            }
+            *dst++ = ch;
+        }
+    }
+}
+
+jint rvmUtf16CountModifiedUtf8Bytes(const jchar* src, jint length) {
+    const UtfKernels* k = getKernels();
+    jint count = 0;
+    jint i = 0;
+    while (i < length) {
+        size_t n = k->scanUtf16(src + i, length - i, 0xff80, 1);
+        i += n;
+        count += n;
+        jint end = i + SCALAR_RUN < length ? i + SCALAR_RUN : length;
+        for (; i < end; i++) {
+            jchar ch = src[i];
+            if (ch == 0) {
+                count += 2;
+            } else if (ch < 0x80) {
+                count += 1;
+            } else if (ch < 0x800) {
+                count += 2;
+            } else {
+                count += 3;
+            }
+        }
+    }
+    return count;
+}
+
+void rvmUtf16ToModifiedUtf8(char* dst, const jchar* src, jint length) {
+    const UtfKernels* k = getKernels();
+    uint8_t* d = (uint8_t*) dst;
+    jint i = 0;
+    while (i < length) {
+        size_t n = k->narrowUtf16(d, src + i, length - i, 0xff80, 1);
+        i += n;
+        d += n;
+        jint end = i + SCALAR_RUN < length ? i + SCALAR_RUN : length;
+        for (; i < end; i++) {
+            jchar ch = src[i];
+            if (ch == 0) {
+                *d++ = 0xc0;
+                *d++ = 0x80;
+            } else if (ch < 0x80) {
+                *d++ = (uint8_t) ch;
+            } else if (ch < 0x800) {
+                *d++ = (uint8_t) (0xc0 | (ch >> 6));
+                *d++ = (uint8_t) (0x80 | (ch & 0x3f));
+            } else {
+                *d++ = (uint8_t) (0xe0 | (ch >> 12));
+                *d++ = (uint8_t) (0x80 | ((ch >> 6) & 0x3f));
+                *d++ = (uint8_t) (0x80 | (ch & 0x3f));
+            }
+        }
+    }
+    *d = 0;
+}
+
+#define IS_SURROGATE(c) (((c) & 0xf800) == 0xd800)
+#define IS_SURROGATE_LEAD(c) (((c) & 0xfc00) == 0xd800)
+#define IS_SURROGATE_TRAIL(c) (((c) & 0xfc00) == 0xdc00)
+
+jint rvmUtf16CountUtf8Bytes(const jchar* src, jint length) {
+    const UtfKernels* k = getKernels();
+    jint count = 0;
+    jint i = 0;
+    while (i < length) {
+        size_t n = k->scanUtf16(src + i, length - i, 0xff80, 0);
+        i += n;
+        count += n;
+        jint end = i + SCALAR_RUN < length ? i + SCALAR_RUN : length;
+        for (; i < end; i++) {
+            jchar ch = src[i];
+            if (ch < 0x80) {
+                count += 1;
+            } else if (ch < 0x800) {
+                count += 2;
+            } else if (IS_SURROGATE(ch)) {
+                if (IS_SURROGATE_LEAD(ch) && i + 1 < length && IS_SURROGATE_TRAIL(src[i + 1])) {
+                    count += 4;
+                    i++;
+                } else {
+                    count += 1; // '?'
+                }
+            } else {
+                count += 3;
+            }
+        }
+    }
+    return count;
+}
+
+jint rvmUtf16ToUtf8(char* dst, const jchar* src, jint length) {
+    const UtfKernels* k = getKernels();
+    uint8_t* d = (uint8_t*) dst;
+    jint i = 0;
+    while (i < length) {
+        size_t n = k->narrowUtf16(d, src + i, length - i, 0xff80, 0);
+        i += n;
+        d += n;
+        jint end = i + SCALAR_RUN < length ? i + SCALAR_RUN : length;
+        for (; i < end; i++) {
+            jint ch = src[i];
+            if (ch < 0x80) {
+                *d++ = (uint8_t) ch;
+            } else if (ch < 0x800) {
+                *d++ = (uint8_t) (0xc0 | (ch >> 6));
+                *d++ = (uint8_t) (0x80 | (ch & 0x3f));
+            } else if (IS_SURROGATE(ch)) {
+                if (IS_SURROGATE_LEAD(ch) && i + 1 < length && IS_SURROGATE_TRAIL(src[i + 1])) {
+                    ch = 0x10000 + ((ch - 0xd800) << 10) + (src[++i] - 0xdc00);
+                    *d++ = (uint8_t) (0xf0 | (ch >> 18));
+                    *d++ = (uint8_t) (0x80 | ((ch >> 12) & 0x3f));
+                    *d++ = (uint8_t) (0x80 | ((ch >> 6) & 0x3f));
+                    *d++ = (uint8_t) (0x80 | (ch & 0x3f));
+                } else {
+                    *d++ = '?';
+                }
+            } else {
+                *d++ = (uint8_t) (0xe0 | (ch >> 12));
+                *d++ = (uint8_t) (0x80 | ((ch >> 6) & 0x3f));
+                *d++ = (uint8_t) (0x80 | (ch & 0x3f));
+            }
+        }
+    }
+    return (jint) (d - (uint8_t*) dst);
+}
+
+void rvmAsciiToUtf16(jchar* dst, const jbyte* src, jint length) {
+    const UtfKernels* k = getKernels();
+    const uint8_t* s = (const uint8_t*) src;
+    jint i = 0;
+    while (i < length) {
+        i += k->widenAscii(dst + i, s + i, length - i);
+        jint end = i + SCALAR_RUN < length ? i + SCALAR_RUN : length;
+        for (; i < end; i++) {
+            dst[i] = s[i] <= 0x7f ? s[i] : 0xfffd;
+        }
+    }
+}
+
+void rvmLatin1ToUtf16(jchar* dst, const jbyte* src, jint length) {
+    const UtfKernels* k = getKernels();
+    const uint8_t* s = (const uint8_t*) src;
+    jint i = k->widen(dst, s, length);
+    for (; i < length; i++) {
+        dst[i] = s[i];
+    }
+}
+
+void rvmUtf16ToSingleByte(jbyte* dst, const jchar* src, jint length, jchar maxValidChar) {
+    const UtfKernels* k = getKernels();
+    uint8_t* d = (uint8_t*) dst;
+    uint16_t mask = (uint16_t) ~maxValidChar;
+    jint i = 0;
+    while (i < length) {
+        i += k->narrowUtf16(d + i, src + i, length - i, mask, 0);
+        jint end = i + SCALAR_RUN < length ? i + SCALAR_RUN : length;
+        for (; i < end; i++) {
+            jchar ch = src[i];
+            d[i] = (uint8_t) (ch > maxValidChar ? '?' : ch);
+        }
+    }
+}
@@ -447,3 +447,21 @@ ObjectArray* Java_com_bugvm_rt_VM_listClasses0(Env* env, Class* c, Class* instan
 void Java_com_bugvm_rt_VM_generateHeapDump(Env* env, Class* c) {
     rvmGenerateHeapDump(env);
 }
+
+jboolean Java_com_bugvm_rt_VM_dumpContentionProfile(Env* env, Class* c, Object* path) {
+    const char* s = NULL;
+    if (path) {
+        s = rvmGetStringUTFChars(env, path);
+        if (!s) return FALSE;
+    }
+    return rvmDumpContentionProfile(env, s);
+}
+
+jboolean Java_com_bugvm_rt_VM_dumpAllocationProfile(Env* env, Class* c, Object* path) {
+    const char* s = NULL;
+    if (path) {
+        s = rvmGetStringUTFChars(env, path);
+        if (!s) return FALSE;
+    }
+    return rvmDumpAllocationProfile(env, s);
+}
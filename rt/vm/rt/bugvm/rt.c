@@ -38,7 +38,6 @@ typedef struct {
 #endif
   jlong stackSize;
   /*volatile*/ jlong threadPtr; // Points to the Thread
-  jint parkState;
   jint priority;
   jboolean daemon;
   jboolean started;
@@ -76,6 +75,10 @@ jint rvmRTGetStringLength(Env* env, Object* str) {
     return rvmGetIntInstanceFieldValue(env, str, field_java_lang_String_count(env));
 }
 
+CharArray* rvmRTGetStringValue(Env* env, Object* str) {
+    return (CharArray*) rvmGetObjectInstanceFieldValue(env, str, field_java_lang_String_value(env));
+}
+
 jchar* rvmRTGetStringChars(Env* env, Object* str) {
     CharArray* value = (CharArray*) rvmGetObjectInstanceFieldValue(env, str, field_java_lang_String_value(env));
     jint offset = rvmGetIntInstanceFieldValue(env, str, field_java_lang_String_offset(env));
@@ -179,6 +179,14 @@ void Java_sun_misc_Unsafe_putOrderedObject(Env* env, Object* unsafe, Object* obj
     *address = newValue;
 }
 
+void Java_sun_misc_Unsafe_park(Env* env, Object* unsafe, jboolean absolute, jlong time) {
+    rvmThreadPark(env, absolute, time);
+}
+
+void Java_sun_misc_Unsafe_unpark0(Env* env, Class* c, Object* thread) {
+    rvmThreadUnpark(env, thread);
+}
+
 Object* Java_sun_misc_Unsafe_allocateInstance(Env* env, Object* unsafe, Class* c) {
   return rvmAllocateObject(env, c);
 }